@@ -9,9 +9,17 @@
 #include "mcp_server.h"
 #include "assets.h"
 #include "settings.h"
+#include "boot_profiler.h"
+#include "metrics.h"
+#include "task_profiler.h"
+#include "heap_accounting.h"
+#include "trace_recorder.h"
 
 #include <cstring>
+#include <algorithm>
+#include <esp_pthread.h>
 #include <esp_log.h>
+#include <esp_heap_caps.h>
 #include <cJSON.h>
 #include <driver/gpio.h>
 #include <arpa/inet.h>
@@ -19,6 +27,20 @@
 
 #define TAG "Application"
 
+// assets_init is the first to open the "assets" Settings namespace on boot, which reads its
+// NVS entries, and logs through ESP_LOG. The esp_timer task makes the deeper NVS commits of
+// Settings on its default 3.5 KB stack, so 4 KB covers these; the extra 2 KB is a margin for
+// the checksum and file table checks. The stack is only held until the task exits
+#define ASSETS_INIT_STACK_SIZE          (4096 + 2048)
+// The background assets tasks warn when less than this much of their stack was left unused
+#define ASSETS_TASK_STACK_WARNING       1024
+
+static const char* const SCHEDULE_PRIORITY_NAMES[] = {
+    "realtime",
+    "ui",
+    "background",
+};
+
 
 Application::Application() {
     event_group_ = xEventGroupCreate();
@@ -44,6 +66,8 @@ Application::Application() {
         .skip_unhandled_events = true
     };
     esp_timer_create(&clock_timer_args, &clock_timer_handle_);
+
+    InitializeMetrics();
 }
 
 Application::~Application() {
@@ -59,27 +83,56 @@ bool Application::SetDeviceState(DeviceState state) {
 }
 
 void Application::Initialize() {
+    // Verifying the assets partition only reads flash, so it runs while the board,
+    // display and audio service come up instead of in front of them
+    xTaskCreate([](void* arg) {
+        Assets::GetInstance();
+        auto unused = uxTaskGetStackHighWaterMark(NULL);
+        if (unused < ASSETS_TASK_STACK_WARNING) {
+            ESP_LOGW(TAG, "assets_init left only %u bytes of stack unused", (unsigned)unused);
+        }
+        vTaskDelete(NULL);
+    }, "assets_init", ASSETS_INIT_STACK_SIZE, nullptr, 1, nullptr);
+
+    // Board construction includes the display driver and the LVGL UI build
+    auto& profiler = BootProfiler::GetInstance();
+    profiler.Begin("board");
     auto& board = Board::GetInstance();
     SetDeviceState(kDeviceStateStarting);
 
     // Setup the display
     auto display = board.GetDisplay();
+    profiler.End("board");
 
     // Print board name/version info
     display->SetChatMessage("system", SystemInfo::GetUserAgent().c_str());
 
     // Setup the audio service
     auto codec = board.GetAudioCodec();
-    audio_service_.Initialize(codec);
-    audio_service_.Start();
+    {
+        BootPhase phase("audio_service");
+        audio_service_.Initialize(codec);
+        audio_service_.Start();
+    }
+
+    // Uplink audio is sent from a dedicated task so that slow network writes
+    // never delay the control events handled in the main loop
+    xTaskCreate([](void* arg) {
+        Application* app = static_cast<Application*>(arg);
+        app->AudioSendTask();
+        vTaskDelete(NULL);
+    }, "audio_send", 4096 * 2, this, AUDIO_SEND_TASK_PRIORITY, &audio_send_task_handle_);
 
     AudioServiceCallbacks callbacks;
     callbacks.on_send_queue_available = [this]() {
-        xEventGroupSetBits(event_group_, MAIN_EVENT_SEND_AUDIO);
+        xTaskNotifyGive(audio_send_task_handle_);
     };
     callbacks.on_wake_word_detected = [this](const std::string& wake_word) {
         xEventGroupSetBits(event_group_, MAIN_EVENT_WAKE_WORD_DETECTED);
     };
+    callbacks.on_wake_word_candidate = [this]() {
+        xEventGroupSetBits(event_group_, MAIN_EVENT_WAKE_WORD_CANDIDATE);
+    };
     callbacks.on_vad_change = [this](bool speaking) {
         xEventGroupSetBits(event_group_, MAIN_EVENT_VAD_CHANGE);
     };
@@ -94,9 +147,13 @@ void Application::Initialize() {
     esp_timer_start_periodic(clock_timer_handle_, 1000000);
 
     // Add MCP common tools (only once during initialization)
-    auto& mcp_server = McpServer::GetInstance();
-    mcp_server.AddCommonTools();
-    mcp_server.AddUserOnlyTools();
+    // The user only tools depend on the assets partition, so this waits for its verification
+    {
+        BootPhase phase("mcp_tools");
+        auto& mcp_server = McpServer::GetInstance();
+        mcp_server.AddCommonTools();
+        mcp_server.AddUserOnlyTools();
+    }
 
     // Set network event callback for UI updates and network state handling
     board.SetNetworkEventCallback([this](NetworkEvent event, const std::string& data) {
@@ -157,7 +214,10 @@ void Application::Initialize() {
     });
 
     // Start network asynchronously
-    board.StartNetwork();
+    {
+        BootPhase phase("network_start");
+        board.StartNetwork();
+    }
 
     // Update the status bar immediately to show the network state
     display->UpdateStatusBar(true);
@@ -166,8 +226,8 @@ void Application::Initialize() {
 void Application::Run() {
     const EventBits_t ALL_EVENTS = 
         MAIN_EVENT_SCHEDULE |
-        MAIN_EVENT_SEND_AUDIO |
         MAIN_EVENT_WAKE_WORD_DETECTED |
+        MAIN_EVENT_WAKE_WORD_CANDIDATE |
         MAIN_EVENT_VAD_CHANGE |
         MAIN_EVENT_CLOCK_TICK |
         MAIN_EVENT_ERROR |
@@ -181,6 +241,7 @@ void Application::Run() {
 
     while (true) {
         auto bits = xEventGroupWaitBits(event_group_, ALL_EVENTS, pdTRUE, pdFALSE, portMAX_DELAY);
+        TRACE_SCOPE("main.loop");
 
         if (bits & MAIN_EVENT_ERROR) {
             SetDeviceState(kDeviceStateIdle);
@@ -215,12 +276,8 @@ void Application::Run() {
             HandleStopListeningEvent();
         }
 
-        if (bits & MAIN_EVENT_SEND_AUDIO) {
-            while (auto packet = audio_service_.PopPacketFromSendQueue()) {
-                if (protocol_ && !protocol_->SendAudio(std::move(packet))) {
-                    break;
-                }
-            }
+        if (bits & MAIN_EVENT_WAKE_WORD_CANDIDATE) {
+            HandleWakeWordCandidateEvent();
         }
 
         if (bits & MAIN_EVENT_WAKE_WORD_DETECTED) {
@@ -235,12 +292,7 @@ void Application::Run() {
         }
 
         if (bits & MAIN_EVENT_SCHEDULE) {
-            std::unique_lock<std::mutex> lock(mutex_);
-            auto tasks = std::move(main_tasks_);
-            lock.unlock();
-            for (auto& task : tasks) {
-                task();
-            }
+            RunScheduledTasks();
         }
 
         if (bits & MAIN_EVENT_CLOCK_TICK) {
@@ -251,11 +303,196 @@ void Application::Run() {
             // Print debug info every 10 seconds
             if (clock_ticks_ % 10 == 0) {
                 SystemInfo::PrintHeapStats();
+                PrintScheduleStatistics();
+            }
+#if CONFIG_TASK_PROFILER_INTERVAL_MS > 0
+            if (clock_ticks_ % 60 == 0) {
+                TaskProfiler::GetInstance().Print();
+            }
+#endif
+#if CONFIG_METRICS_PUSH_INTERVAL_SECONDS > 0
+            if (clock_ticks_ % CONFIG_METRICS_PUSH_INTERVAL_SECONDS == 0) {
+                PushMetrics();
+            }
+#endif
+        }
+    }
+}
+
+void Application::RunScheduledTasks() {
+    int64_t deadline = esp_timer_get_time() + MAIN_LOOP_BUDGET_US;
+    MainTaskQueue::Task task;
+    int64_t enqueue_time;
+
+    for (int priority = 0; priority < kSchedulePriorityCount; priority++) {
+        auto& stats = schedule_stats_[priority];
+        while (main_tasks_[priority].Pop(task, enqueue_time)) {
+            int64_t start_time = esp_timer_get_time();
+            TRACE_BEGIN(task.Name());
+            task();
+            TRACE_END(task.Name());
+            int64_t end_time = esp_timer_get_time();
+
+            int64_t wait_us = start_time - enqueue_time;
+            int64_t run_us = end_time - start_time;
+            metrics_.task_wait_us[priority]->Record(wait_us);
+            stats.tasks++;
+            stats.total_wait_us += wait_us;
+            stats.max_wait_us = std::max(stats.max_wait_us, wait_us);
+            stats.max_run_us = std::max(stats.max_run_us, run_us);
+            if (run_us > MAIN_TASK_STALL_US) {
+                stats.stalls++;
+                ESP_LOGW(TAG, "Main task stalled the loop for %d ms (%s): %s",
+                    int(run_us / 1000), SCHEDULE_PRIORITY_NAMES[priority], task.Name());
+            }
+            task.Reset();
+
+            // Out of budget: handle pending events first, then come back for the rest
+            if (end_time >= deadline) {
+                xEventGroupSetBits(event_group_, MAIN_EVENT_SCHEDULE);
+                return;
+            }
+        }
+    }
+}
+
+void Application::PrintScheduleStatistics() {
+    for (int priority = 0; priority < kSchedulePriorityCount; priority++) {
+        auto& stats = schedule_stats_[priority];
+        auto queue_stats = main_tasks_[priority].GetStatistics();
+        if (stats.tasks == 0 && queue_stats.overflowed == 0) {
+            continue;
+        }
+        ESP_LOGI(TAG, "Main tasks (%s): %lu run, wait avg %lld us max %lld us, run max %lld us, %lu stalls, "
+            "%lu heap allocated, %lu overflowed, high watermark %lu/%d",
+            SCHEDULE_PRIORITY_NAMES[priority], stats.tasks, stats.total_wait_us / std::max<uint32_t>(stats.tasks, 1),
+            stats.max_wait_us, stats.max_run_us, stats.stalls,
+            queue_stats.heap_allocated, queue_stats.overflowed, queue_stats.high_watermark, MAIN_TASK_QUEUE_SIZE);
+        stats = ScheduleStatistics();
+    }
+}
+
+void Application::InitializeMetrics() {
+    // Metric names must be string literals, in SchedulePriority order
+    static const char* const task_wait_names[kSchedulePriorityCount] = {
+        "main.task_wait_us.realtime",
+        "main.task_wait_us.ui",
+        "main.task_wait_us.background",
+    };
+
+    auto& metrics = Metrics::GetInstance();
+    for (int priority = 0; priority < kSchedulePriorityCount; priority++) {
+        metrics_.task_wait_us[priority] = metrics.GetHistogram(task_wait_names[priority],
+            {1000, 5000, 20000, 50000, 100000, 500000});
+    }
+    metrics_.audio_send_us = metrics.GetHistogram("audio.send_us", {1000, 5000, 20000, 50000, 100000, 500000});
+    metrics_.audio_send_failures = metrics.GetCounter("audio.send_failures");
+    metrics_.open_channel_ms = metrics.GetHistogram("protocol.open_channel_ms", {100, 200, 500, 1000, 2000, 5000});
+    metrics_.open_channel_failures = metrics.GetCounter("protocol.open_channel_failures");
+
+    auto free_heap = metrics.GetGauge("heap.free_internal");
+    auto min_free_heap = metrics.GetGauge("heap.min_free_internal");
+    auto largest_block = metrics.GetGauge("heap.largest_internal_block");
+    auto fragmentation = metrics.GetGauge("heap.internal_fragmentation");
+    auto free_psram = metrics.GetGauge("heap.free_spiram");
+    auto largest_psram_block = metrics.GetGauge("heap.largest_spiram_block");
+    auto psram_fragmentation = metrics.GetGauge("heap.spiram_fragmentation");
+    metrics.AddCollector([=]() {
+        multi_heap_info_t info;
+        heap_caps_get_info(&info, MALLOC_CAP_INTERNAL);
+        free_heap->Set(info.total_free_bytes);
+        min_free_heap->Set(info.minimum_free_bytes);
+        largest_block->Set(info.largest_free_block);
+        fragmentation->Set(SystemInfo::GetFragmentation(info));
+        heap_caps_get_info(&info, MALLOC_CAP_SPIRAM);
+        free_psram->Set(info.total_free_bytes);
+        largest_psram_block->Set(info.largest_free_block);
+        psram_fragmentation->Set(SystemInfo::GetFragmentation(info));
+    });
+    HeapAccounting::RegisterMetrics();
+
+#if CONFIG_TASK_PROFILER_INTERVAL_MS > 0
+    TaskProfiler::GetInstance().Start(CONFIG_TASK_PROFILER_INTERVAL_MS);
+#endif
+}
+
+void Application::PushMetrics() {
+    if (!protocol_ || !protocol_->IsAudioChannelOpened()) {
+        return;
+    }
+    protocol_->SendMetrics(Metrics::GetInstance().ToJson());
+}
+
+bool Application::OpenAudioChannel() {
+    int64_t start_time = esp_timer_get_time();
+    bool opened = protocol_->OpenAudioChannel();
+    if (opened) {
+        metrics_.open_channel_ms->Record((esp_timer_get_time() - start_time) / 1000);
+    } else {
+        metrics_.open_channel_failures->Add();
+    }
+    return opened;
+}
+
+void Application::AudioSendTask() {
+    audio_send_stats_.last_report_time = esp_timer_get_time();
+
+    while (true) {
+        // Notifications coalesce, so one wake-up drains every packet queued since the last pass
+        ulTaskNotifyTake(pdTRUE, pdMS_TO_TICKS(AUDIO_SEND_STATS_INTERVAL_US / 1000));
+
+        uint32_t batch = 0;
+        while (auto packet = audio_service_.PopPacketFromSendQueue()) {
+            std::lock_guard<std::mutex> lock(protocol_mutex_);
+            if (!protocol_) {
+                continue;
             }
+
+            size_t size = packet->payload.size();
+            int64_t start_time = esp_timer_get_time();
+            bool success = protocol_->SendAudio(std::move(packet));
+            int64_t send_us = esp_timer_get_time() - start_time;
+            metrics_.audio_send_us->Record(send_us);
+
+            audio_send_stats_.total_send_us += send_us;
+            audio_send_stats_.max_send_us = std::max(audio_send_stats_.max_send_us, send_us);
+            if (!success) {
+                // Leave the rest of the queue in place; the codec task stops encoding
+                // once the send queue is full, which throttles the microphone path
+                audio_send_stats_.failures++;
+                metrics_.audio_send_failures->Add();
+                break;
+            }
+            audio_send_stats_.packets++;
+            audio_send_stats_.bytes += size;
+            batch++;
+            OnUplinkAudioSent();
+        }
+
+        if (batch > 0) {
+            audio_send_stats_.batches++;
+            audio_send_stats_.max_batch = std::max(audio_send_stats_.max_batch, batch);
         }
+        ReportAudioSendStatistics();
     }
 }
 
+void Application::ReportAudioSendStatistics() {
+    auto& stats = audio_send_stats_;
+    int64_t now = esp_timer_get_time();
+    if (now - stats.last_report_time < AUDIO_SEND_STATS_INTERVAL_US) {
+        return;
+    }
+    if (stats.packets > 0 || stats.failures > 0) {
+        ESP_LOGI(TAG, "Audio send: %lu packets, %lu bytes, %lu failures, avg %lld us, max %lld us, max batch %lu",
+            stats.packets, stats.bytes, stats.failures,
+            stats.total_send_us / std::max<uint32_t>(stats.packets + stats.failures, 1),
+            stats.max_send_us, stats.max_batch);
+    }
+    stats = AudioSendStatistics();
+    stats.last_report_time = now;
+}
+
 void Application::HandleNetworkConnectedEvent() {
     ESP_LOGI(TAG, "Network connected");
     auto state = GetDeviceState();
@@ -299,6 +536,7 @@ void Application::HandleActivationDoneEvent() {
 
     SystemInfo::PrintHeapStats();
     SetDeviceState(kDeviceStateIdle);
+    BootProfiler::GetInstance().Report();
 
     has_server_time_ = ota_->HasServerTime();
 
@@ -320,23 +558,47 @@ void Application::ActivationTask() {
     // Create OTA object for activation process
     ota_ = std::make_unique<Ota>();
 
-    // Check for new assets version
-    CheckAssetsVersion();
+    // Check for new assets version, then apply them in the background: loading
+    // fonts, emoji and srmodels only reads flash and overlaps with the version check.
+    // Apply() changes the themes under the display lock, opens no Settings, and leaves
+    // the srmodels to WaitForAssetsApplied() so the audio service is only touched here
+    if (CheckAssetsVersion()) {
+        auto cfg = esp_pthread_get_default_config();
+        cfg.thread_name = "assets_apply";
+        cfg.stack_size = 4096 * 2;
+        esp_pthread_set_cfg(&cfg);
+        assets_apply_thread_ = std::thread([]() {
+            Assets::GetInstance().Apply();
+            auto unused = uxTaskGetStackHighWaterMark(NULL);
+            if (unused < ASSETS_TASK_STACK_WARNING) {
+                ESP_LOGW(TAG, "assets_apply left only %u bytes of stack unused", (unsigned)unused);
+            }
+        });
+        cfg = esp_pthread_get_default_config();
+        esp_pthread_set_cfg(&cfg);
+    }
 
     // Check for new firmware version
-    CheckNewVersion();
+    {
+        BootPhase phase("check_version");
+        CheckNewVersion();
+    }
+    WaitForAssetsApplied();
 
     // Initialize the protocol
-    InitializeProtocol();
+    {
+        BootPhase phase("protocol");
+        InitializeProtocol();
+    }
 
     // Signal completion to main loop
     xEventGroupSetBits(event_group_, MAIN_EVENT_ACTIVATION_DONE);
 }
 
-void Application::CheckAssetsVersion() {
+bool Application::CheckAssetsVersion() {
     // Only allow CheckAssetsVersion to be called once
     if (assets_version_checked_) {
-        return;
+        return false;
     }
     assets_version_checked_ = true;
 
@@ -346,7 +608,7 @@ void Application::CheckAssetsVersion() {
 
     if (!assets.partition_valid()) {
         ESP_LOGW(TAG, "Assets partition is disabled for board %s", BOARD_NAME);
-        return;
+        return false;
     }
     
     Settings settings("assets", true);
@@ -381,12 +643,27 @@ void Application::CheckAssetsVersion() {
             Alert(Lang::Strings::ERROR, Lang::Strings::DOWNLOAD_ASSETS_FAILED, "circle_xmark", Lang::Sounds::OGG_EXCLAMATION);
             vTaskDelay(pdMS_TO_TICKS(2000));
             SetDeviceState(kDeviceStateActivating);
-            return;
+            return false;
         }
     }
 
-    // Apply assets
-    assets.Apply();
+    // The assets are ready to be applied
+    return true;
+}
+
+void Application::WaitForAssetsApplied() {
+    if (!assets_apply_thread_.joinable()) {
+        return;
+    }
+    assets_apply_thread_.join();
+
+    auto models_list = Assets::GetInstance().models_list();
+    if (models_list != nullptr) {
+        audio_service_.SetModelsList(models_list);
+    }
+
+    // Cleared only now so that an activation code shown meanwhile stays until activation is done
+    auto display = Board::GetInstance().GetDisplay();
     display->SetChatMessage("system", "");
     display->SetEmotion("microchip_ai");
 }
@@ -429,7 +706,9 @@ void Application::CheckNewVersion() {
         retry_delay = 10; // Reset retry delay
 
         if (ota_->HasNewVersion()) {
-            if (UpgradeFirmware(ota_->GetFirmwareUrl(), ota_->GetFirmwareVersion())) {
+            // Do not start writing flash while the assets are still being loaded
+            WaitForAssetsApplied();
+            if (UpgradeFirmware(ota_->GetFirmwareUrl(), ota_->GetFirmwareVersion(), ota_->GetFirmwarePatchUrl())) {
                 return; // This line will never be reached after reboot
             }
             // If upgrade failed, continue to normal operation
@@ -473,13 +752,18 @@ void Application::InitializeProtocol() {
 
     display->SetStatus(Lang::Strings::LOADING_PROTOCOL);
 
+    std::unique_ptr<Protocol> protocol;
     if (ota_->HasMqttConfig()) {
-        protocol_ = std::make_unique<MqttProtocol>();
+        protocol = std::make_unique<MqttProtocol>();
     } else if (ota_->HasWebsocketConfig()) {
-        protocol_ = std::make_unique<WebsocketProtocol>();
+        protocol = std::make_unique<WebsocketProtocol>();
     } else {
         ESP_LOGW(TAG, "No protocol specified in the OTA config, using MQTT");
-        protocol_ = std::make_unique<MqttProtocol>();
+        protocol = std::make_unique<MqttProtocol>();
+    }
+    {
+        std::lock_guard<std::mutex> lock(protocol_mutex_);
+        protocol_ = std::move(protocol);
     }
 
     protocol_->OnConnected([this]() {
@@ -511,7 +795,7 @@ void Application::InitializeProtocol() {
             auto display = Board::GetInstance().GetDisplay();
             display->SetChatMessage("system", "");
             SetDeviceState(kDeviceStateIdle);
-        });
+        }, kSchedulePriorityRealtime);
     });
     
     protocol_->OnIncomingJson([this, display](const cJSON* root) {
@@ -523,7 +807,7 @@ void Application::InitializeProtocol() {
                 Schedule([this]() {
                     aborted_ = false;
                     SetDeviceState(kDeviceStateSpeaking);
-                });
+                }, kSchedulePriorityRealtime);
             } else if (strcmp(state->valuestring, "stop") == 0) {
                 Schedule([this]() {
                     if (GetDeviceState() == kDeviceStateSpeaking) {
@@ -533,7 +817,7 @@ void Application::InitializeProtocol() {
                             SetDeviceState(kDeviceStateListening);
                         }
                     }
-                });
+                }, kSchedulePriorityRealtime);
             } else if (strcmp(state->valuestring, "sentence_start") == 0) {
                 auto text = cJSON_GetObjectItem(root, "text");
                 if (cJSON_IsString(text)) {
@@ -560,7 +844,7 @@ void Application::InitializeProtocol() {
             }
         } else if (strcmp(type->valuestring, "mcp") == 0) {
             auto payload = cJSON_GetObjectItem(root, "payload");
-            if (cJSON_IsObject(payload)) {
+            if (cJSON_IsObject(payload) || cJSON_IsArray(payload)) {
                 McpServer::GetInstance().ParseMessage(payload);
             }
         } else if (strcmp(type->valuestring, "system") == 0) {
@@ -691,7 +975,7 @@ void Application::HandleToggleChatEvent() {
     if (state == kDeviceStateIdle) {
         if (!protocol_->IsAudioChannelOpened()) {
             SetDeviceState(kDeviceStateConnecting);
-            if (!protocol_->OpenAudioChannel()) {
+            if (!OpenAudioChannel()) {
                 return;
             }
         }
@@ -724,7 +1008,7 @@ void Application::HandleStartListeningEvent() {
     if (state == kDeviceStateIdle) {
         if (!protocol_->IsAudioChannelOpened()) {
             SetDeviceState(kDeviceStateConnecting);
-            if (!protocol_->OpenAudioChannel()) {
+            if (!OpenAudioChannel()) {
                 return;
             }
         }
@@ -759,11 +1043,13 @@ void Application::HandleWakeWordDetectedEvent() {
     auto state = GetDeviceState();
     
     if (state == kDeviceStateIdle) {
+        state_machine_.timing().OnWakeWordDetected();
         audio_service_.EncodeWakeWord();
 
         if (!protocol_->IsAudioChannelOpened()) {
             SetDeviceState(kDeviceStateConnecting);
-            if (!protocol_->OpenAudioChannel()) {
+            if (!OpenAudioChannel()) {
+                state_machine_.timing().OnWakeWordCancelled();
                 audio_service_.EnableWakeWordDetection(true);
                 return;
             }
@@ -774,7 +1060,9 @@ void Application::HandleWakeWordDetectedEvent() {
 #if CONFIG_SEND_WAKE_WORD_DATA
         // Encode and send the wake word data to the server
         while (auto packet = audio_service_.PopWakeWordPacket()) {
-            protocol_->SendAudio(std::move(packet));
+            if (protocol_->SendAudio(std::move(packet))) {
+                OnUplinkAudioSent();
+            }
         }
         // Set the chat state to wake word detected
         protocol_->SendWakeWordDetected(wake_word);
@@ -792,6 +1080,20 @@ void Application::HandleWakeWordDetectedEvent() {
     }
 }
 
+void Application::HandleWakeWordCandidateEvent() {
+    // Warm up the connection while the wake word engine is still deciding. The AFE engine only
+    // reports speech onset, so this is rate limited and the session hello waits for the wake word
+    if (!protocol_ || GetDeviceState() != kDeviceStateIdle) {
+        return;
+    }
+    auto now = esp_timer_get_time();
+    if (last_pre_connect_time_ != 0 && now - last_pre_connect_time_ < PRE_CONNECT_MIN_INTERVAL_US) {
+        return;
+    }
+    last_pre_connect_time_ = now;
+    protocol_->PreConnect();
+}
+
 void Application::HandleStateChangedEvent() {
     DeviceState new_state = state_machine_.GetState();
     clock_ticks_ = 0;
@@ -844,14 +1146,7 @@ void Application::HandleStateChangedEvent() {
             // Do nothing
             break;
     }
-}
-
-void Application::Schedule(std::function<void()> callback) {
-    {
-        std::lock_guard<std::mutex> lock(mutex_);
-        main_tasks_.push_back(std::move(callback));
-    }
-    xEventGroupSetBits(event_group_, MAIN_EVENT_SCHEDULE);
+    state_machine_.timing().OnStateSettled();
 }
 
 void Application::AbortSpeaking(AbortReason reason) {
@@ -867,20 +1162,31 @@ void Application::SetListeningMode(ListeningMode mode) {
     SetDeviceState(kDeviceStateListening);
 }
 
+void Application::OnUplinkAudioSent() {
+    // Report the time from wake word detection to the first uplink audio packet
+    int elapsed_ms = state_machine_.timing().OnUplinkAudioSent();
+    if (elapsed_ms >= 0) {
+        ESP_LOGI(TAG, "Wake word to first uplink packet: %d ms", elapsed_ms);
+    }
+}
+
 void Application::Reboot() {
     ESP_LOGI(TAG, "Rebooting...");
     // Disconnect the audio channel
     if (protocol_ && protocol_->IsAudioChannelOpened()) {
         protocol_->CloseAudioChannel();
     }
-    protocol_.reset();
+    {
+        std::lock_guard<std::mutex> lock(protocol_mutex_);
+        protocol_.reset();
+    }
     audio_service_.Stop();
 
     vTaskDelay(pdMS_TO_TICKS(1000));
     esp_restart();
 }
 
-bool Application::UpgradeFirmware(const std::string& url, const std::string& version) {
+bool Application::UpgradeFirmware(const std::string& url, const std::string& version, const std::string& patch_url) {
     auto& board = Board::GetInstance();
     auto display = board.GetDisplay();
 
@@ -906,13 +1212,14 @@ bool Application::UpgradeFirmware(const std::string& url, const std::string& ver
     audio_service_.Stop();
     vTaskDelay(pdMS_TO_TICKS(1000));
 
-    bool upgrade_success = Ota::Upgrade(upgrade_url, [display](int progress, size_t speed) {
+    auto progress_callback = [display](int progress, size_t speed) {
         std::thread([display, progress, speed]() {
             char buffer[32];
             snprintf(buffer, sizeof(buffer), "%d%% %uKB/s", progress, speed / 1024);
             display->SetChatMessage("system", buffer);
         }).detach();
-    });
+    };
+    bool upgrade_success = Ota::Upgrade(upgrade_url, patch_url, progress_callback);
 
     if (!upgrade_success) {
         // Upgrade failed, restart audio service and continue running
@@ -940,11 +1247,13 @@ void Application::WakeWordInvoke(const std::string& wake_word) {
     auto state = GetDeviceState();
     
     if (state == kDeviceStateIdle) {
+        state_machine_.timing().OnWakeWordDetected();
         audio_service_.EncodeWakeWord();
 
         if (!protocol_->IsAudioChannelOpened()) {
             SetDeviceState(kDeviceStateConnecting);
-            if (!protocol_->OpenAudioChannel()) {
+            if (!OpenAudioChannel()) {
+                state_machine_.timing().OnWakeWordCancelled();
                 audio_service_.EnableWakeWordDetection(true);
                 return;
             }
@@ -954,7 +1263,9 @@ void Application::WakeWordInvoke(const std::string& wake_word) {
 #if CONFIG_USE_AFE_WAKE_WORD || CONFIG_USE_CUSTOM_WAKE_WORD
         // Encode and send the wake word data to the server
         while (auto packet = audio_service_.PopWakeWordPacket()) {
-            protocol_->SendAudio(std::move(packet));
+            if (protocol_->SendAudio(std::move(packet))) {
+                OnUplinkAudioSent();
+            }
         }
         // Set the chat state to wake word detected
         protocol_->SendWakeWordDetected(wake_word);
@@ -967,13 +1278,13 @@ void Application::WakeWordInvoke(const std::string& wake_word) {
     } else if (state == kDeviceStateSpeaking) {
         Schedule([this]() {
             AbortSpeaking(kAbortReasonNone);
-        });
+        }, kSchedulePriorityRealtime);
     } else if (state == kDeviceStateListening) {   
         Schedule([this]() {
             if (protocol_) {
                 protocol_->CloseAudioChannel();
             }
-        });
+        }, kSchedulePriorityRealtime);
     }
 }
 
@@ -1003,6 +1314,14 @@ void Application::SendMcpMessage(const std::string& payload) {
     });
 }
 
+void Application::SendMcpMessage(TextProducer payload) {
+    Schedule([this, payload = std::move(payload)]() {
+        if (protocol_) {
+            protocol_->SendMcpMessage(payload);
+        }
+    });
+}
+
 void Application::SetAecMode(AecMode mode) {
     aec_mode_ = mode;
     Schedule([this]() {
@@ -1041,7 +1360,8 @@ void Application::ResetProtocol() {
             protocol_->CloseAudioChannel();
         }
         // Reset protocol
+        std::lock_guard<std::mutex> lock(protocol_mutex_);
         protocol_.reset();
-    });
+    }, kSchedulePriorityBackground);
 }
 
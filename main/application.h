@@ -8,18 +8,20 @@
 
 #include <string>
 #include <mutex>
-#include <deque>
 #include <memory>
+#include <atomic>
+#include <thread>
 
 #include "protocol.h"
 #include "ota.h"
 #include "audio_service.h"
 #include "device_state.h"
 #include "device_state_machine.h"
+#include "task_queue.h"
+#include "metrics.h"
 
 // Main event bits
 #define MAIN_EVENT_SCHEDULE             (1 << 0)
-#define MAIN_EVENT_SEND_AUDIO           (1 << 1)
 #define MAIN_EVENT_WAKE_WORD_DETECTED   (1 << 2)
 #define MAIN_EVENT_VAD_CHANGE           (1 << 3)
 #define MAIN_EVENT_ERROR                (1 << 4)
@@ -31,7 +33,56 @@
 #define MAIN_EVENT_START_LISTENING      (1 << 10)
 #define MAIN_EVENT_STOP_LISTENING       (1 << 11)
 #define MAIN_EVENT_STATE_CHANGED        (1 << 12)
+#define MAIN_EVENT_WAKE_WORD_CANDIDATE  (1 << 13)
+// Scheduled main tasks: captures up to MAIN_TASK_INLINE_SIZE bytes are stored without allocation
+#define MAIN_TASK_QUEUE_SIZE            32
+#define MAIN_TASK_INLINE_SIZE           40
+// Scheduled tasks stop running after this much time per loop iteration and resume in the next one
+#define MAIN_LOOP_BUDGET_US             (20 * 1000)
+// A single scheduled task running longer than this is reported as a stall
+#define MAIN_TASK_STALL_US              (50 * 1000)
+// Speech onset is only a hint of a wake word, so ambient talk pre-connects at most this often
+#define PRE_CONNECT_MIN_INTERVAL_US     (60 * 1000 * 1000LL)
 
+enum SchedulePriority {
+    kSchedulePriorityRealtime,      // Audio channel and device state changes
+    kSchedulePriorityUi,            // Display and other user facing updates
+    kSchedulePriorityBackground,    // Tool calls, upgrades, reconnects
+    kSchedulePriorityCount,
+};
+
+struct ScheduleStatistics {
+    uint32_t tasks = 0;
+    uint32_t stalls = 0;
+    int64_t total_wait_us = 0;
+    int64_t max_wait_us = 0;
+    int64_t max_run_us = 0;
+};
+
+// Audio send task
+#define AUDIO_SEND_TASK_PRIORITY        5
+#define AUDIO_SEND_STATS_INTERVAL_US    (10 * 1000 * 1000)
+
+struct AudioSendStatistics {
+    uint32_t packets = 0;
+    uint32_t failures = 0;
+    uint32_t bytes = 0;
+    uint32_t batches = 0;
+    uint32_t max_batch = 0;
+    int64_t total_send_us = 0;
+    int64_t max_send_us = 0;
+    int64_t last_report_time = 0;
+};
+
+// Exported through Metrics
+struct ApplicationMetrics {
+    // One per SchedulePriority, so a slow background lane never hides in the realtime numbers
+    MetricHistogram* task_wait_us[kSchedulePriorityCount];
+    MetricHistogram* audio_send_us;
+    MetricCounter* audio_send_failures;
+    MetricHistogram* open_channel_ms;
+    MetricCounter* open_channel_failures;
+};
 
 enum AecMode {
     kAecOff,
@@ -74,8 +125,14 @@ public:
 
     /**
      * Schedule a callback to be executed in the main task
+     * Lock-free; small callables are queued without heap allocation.
+     * Higher priority tasks run first and are not held up by a backlog of lower ones.
      */
-    void Schedule(std::function<void()> callback);
+    template <typename F>
+    void Schedule(F&& callback, SchedulePriority priority = kSchedulePriorityUi) {
+        main_tasks_[priority].Push(std::forward<F>(callback), esp_timer_get_time());
+        xEventGroupSetBits(event_group_, MAIN_EVENT_SCHEDULE);
+    }
 
     /**
      * Alert with status, message, emotion and optional sound
@@ -105,9 +162,10 @@ public:
 
     void Reboot();
     void WakeWordInvoke(const std::string& wake_word);
-    bool UpgradeFirmware(const std::string& url, const std::string& version = "");
+    bool UpgradeFirmware(const std::string& url, const std::string& version = "", const std::string& patch_url = "");
     bool CanEnterSleepMode();
     void SendMcpMessage(const std::string& payload);
+    void SendMcpMessage(TextProducer payload);
     void SetAecMode(AecMode mode);
     AecMode GetAecMode() const { return aec_mode_; }
     void PlaySound(const std::string_view& sound);
@@ -124,8 +182,11 @@ private:
     Application();
     ~Application();
 
-    std::mutex mutex_;
-    std::deque<std::function<void()>> main_tasks_;
+    using MainTaskQueue = TaskQueue<MAIN_TASK_QUEUE_SIZE, MAIN_TASK_INLINE_SIZE>;
+    MainTaskQueue main_tasks_[kSchedulePriorityCount];
+    ScheduleStatistics schedule_stats_[kSchedulePriorityCount];
+    // Guards protocol_ replacement against the audio send task
+    std::mutex protocol_mutex_;
     std::unique_ptr<Protocol> protocol_;
     EventGroupHandle_t event_group_ = nullptr;
     esp_timer_handle_t clock_timer_handle_ = nullptr;
@@ -140,7 +201,12 @@ private:
     bool aborted_ = false;
     bool assets_version_checked_ = false;
     int clock_ticks_ = 0;
+    int64_t last_pre_connect_time_ = 0;
     TaskHandle_t activation_task_handle_ = nullptr;
+    std::thread assets_apply_thread_;
+    TaskHandle_t audio_send_task_handle_ = nullptr;
+    AudioSendStatistics audio_send_stats_;
+    ApplicationMetrics metrics_;
 
 
     // Event handlers
@@ -152,16 +218,28 @@ private:
     void HandleNetworkDisconnectedEvent();
     void HandleActivationDoneEvent();
     void HandleWakeWordDetectedEvent();
+    void HandleWakeWordCandidateEvent();
 
     // Activation task (runs in background)
     void ActivationTask();
 
+    // Audio send task, owns the send queue and writes packets to the protocol
+    void AudioSendTask();
+    void ReportAudioSendStatistics();
+
     // Helper methods
-    void CheckAssetsVersion();
+    void RunScheduledTasks();
+    void PrintScheduleStatistics();
+    void InitializeMetrics();
+    void PushMetrics();
+    bool OpenAudioChannel();
+    bool CheckAssetsVersion();
+    void WaitForAssetsApplied();
     void CheckNewVersion();
     void InitializeProtocol();
     void ShowActivationCode(const std::string& code, const std::string& message);
     void SetListeningMode(ListeningMode mode);
+    void OnUplinkAudioSent();
     
     // State change handler called by state machine
     void OnStateChanged(DeviceState old_state, DeviceState new_state);
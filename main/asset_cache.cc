@@ -0,0 +1,142 @@
+#include "asset_cache.h"
+#include "memory_policy.h"
+
+#include <cstring>
+#include <esp_log.h>
+#include <esp_timer.h>
+#include <esp_heap_caps.h>
+
+#define TAG "AssetCache"
+
+AssetBuffer::AssetBuffer(size_t size) : size(size) {
+    data = static_cast<uint8_t*>(MemoryPolicy::Allocate(BufferClass::kAssetCache, size));
+}
+
+AssetBuffer::~AssetBuffer() {
+    if (data != nullptr) {
+        heap_caps_free(data);
+    }
+}
+
+static bool ReadLength(const uint8_t*& ip, const uint8_t* ip_end, size_t& length) {
+    uint8_t byte;
+    do {
+        if (ip >= ip_end) {
+            return false;
+        }
+        byte = *ip++;
+        length += byte;
+    } while (byte == 255);
+    return true;
+}
+
+// Decodes one LZ4 block, the output must fill dst exactly
+static bool Lz4Decompress(const uint8_t* src, size_t src_size, uint8_t* dst, size_t dst_size) {
+    const uint8_t* ip = src;
+    const uint8_t* ip_end = src + src_size;
+    uint8_t* op = dst;
+    uint8_t* op_end = dst + dst_size;
+
+    while (ip < ip_end) {
+        uint8_t token = *ip++;
+        size_t literal_length = token >> 4;
+        if (literal_length == 15 && !ReadLength(ip, ip_end, literal_length)) {
+            return false;
+        }
+        if (literal_length > static_cast<size_t>(ip_end - ip) || literal_length > static_cast<size_t>(op_end - op)) {
+            return false;
+        }
+        memcpy(op, ip, literal_length);
+        ip += literal_length;
+        op += literal_length;
+
+        // The last sequence has literals only
+        if (ip == ip_end) {
+            break;
+        }
+        if (ip_end - ip < 2) {
+            return false;
+        }
+        size_t offset = ip[0] | (ip[1] << 8);
+        ip += 2;
+        if (offset == 0 || offset > static_cast<size_t>(op - dst)) {
+            return false;
+        }
+        size_t match_length = token & 15;
+        if (match_length == 15 && !ReadLength(ip, ip_end, match_length)) {
+            return false;
+        }
+        match_length += 4;
+        if (match_length > static_cast<size_t>(op_end - op)) {
+            return false;
+        }
+
+        const uint8_t* match = op - offset;
+        if (offset >= match_length) {
+            memcpy(op, match, match_length);
+            op += match_length;
+        } else {
+            // Overlapping match repeats the last offset bytes
+            while (match_length--) {
+                *op++ = *match++;
+            }
+        }
+    }
+    return op == op_end;
+}
+
+std::shared_ptr<AssetBuffer> AssetCache::Get(uint32_t key, const uint8_t* compressed, size_t compressed_size, size_t size, bool pin) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    for (auto it = entries_.begin(); it != entries_.end(); ++it) {
+        if (it->key == key) {
+            hits_++;
+            if (pin && !it->pinned) {
+                it->pinned = true;
+                cached_size_ -= it->buffer->size;
+                pinned_size_ += it->buffer->size;
+            }
+            entries_.splice(entries_.begin(), entries_, it);
+            return it->buffer;
+        }
+    }
+
+    misses_++;
+    auto buffer = std::make_shared<AssetBuffer>(size);
+    if (buffer->data == nullptr) {
+        ESP_LOGE(TAG, "Failed to allocate %u bytes for asset 0x%lx", size, key);
+        return nullptr;
+    }
+    int64_t start_time = esp_timer_get_time();
+    if (!Lz4Decompress(compressed, compressed_size, buffer->data, size)) {
+        ESP_LOGE(TAG, "Failed to decompress asset 0x%lx", key);
+        return nullptr;
+    }
+    int decompress_ms = (esp_timer_get_time() - start_time) / 1000;
+
+    entries_.push_front({key, buffer, pin});
+    if (pin) {
+        pinned_size_ += size;
+    } else {
+        cached_size_ += size;
+    }
+    // Drop the least recently used unpinned files, but keep the new entry even if it alone exceeds the capacity
+    auto it = entries_.end();
+    while (cached_size_ > capacity_ && --it != entries_.begin()) {
+        if (!it->pinned) {
+            cached_size_ -= it->buffer->size;
+            it = entries_.erase(it);
+        }
+    }
+
+    ESP_LOGI(TAG, "Decompressed asset 0x%lx, %u -> %u bytes in %d ms, hit rate %lu%% (%lu/%lu), cached %u/%u KB, pinned %u KB",
+        key, compressed_size, size, decompress_ms, hits_ * 100 / (hits_ + misses_), hits_, hits_ + misses_,
+        cached_size_ / 1024, capacity_ / 1024, pinned_size_ / 1024);
+    return buffer;
+}
+
+void AssetCache::Clear() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    entries_.clear();
+    cached_size_ = 0;
+    pinned_size_ = 0;
+}
@@ -0,0 +1,55 @@
+#ifndef ASSET_CACHE_H
+#define ASSET_CACHE_H
+
+#include <cstdint>
+#include <cstddef>
+#include <list>
+#include <memory>
+#include <mutex>
+
+// Decompressed file content, in PSRAM when the board has it
+struct AssetBuffer {
+    uint8_t* data = nullptr;
+    size_t size = 0;
+
+    explicit AssetBuffer(size_t size);
+    ~AssetBuffer();
+    AssetBuffer(const AssetBuffer&) = delete;
+    AssetBuffer& operator=(const AssetBuffer&) = delete;
+};
+
+/**
+ * AssetCache - Size-limited LRU cache of decompressed asset files
+ *
+ * Files packed with "compress_assets" are stored as one LZ4 block each and
+ * decompressed here on first use. When the cached size exceeds the capacity
+ * the least recently used files are dropped. A buffer that is still held by
+ * its user stays valid after eviction and is freed with the last reference.
+ * Pinned files are never dropped before Clear() and do not count against the
+ * capacity, the log reports them next to the cached size.
+ */
+class AssetCache {
+public:
+    explicit AssetCache(size_t capacity) : capacity_(capacity) {}
+
+    // key identifies the file, usually its offset in the assets partition
+    std::shared_ptr<AssetBuffer> Get(uint32_t key, const uint8_t* compressed, size_t compressed_size, size_t size, bool pin = false);
+    void Clear();
+
+private:
+    struct Entry {
+        uint32_t key;
+        std::shared_ptr<AssetBuffer> buffer;
+        bool pinned;
+    };
+
+    std::mutex mutex_;
+    std::list<Entry> entries_;
+    size_t capacity_;
+    size_t cached_size_ = 0;
+    size_t pinned_size_ = 0;
+    uint32_t hits_ = 0;
+    uint32_t misses_ = 0;
+};
+
+#endif // ASSET_CACHE_H
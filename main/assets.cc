@@ -1,32 +1,94 @@
 #include "assets.h"
 #include "board.h"
 #include "display.h"
-#include "application.h"
 #include "lvgl_theme.h"
 #include "emote_display.h"
+#include "boot_profiler.h"
+#include "settings.h"
+#include "downloader.h"
+#include "assets_delta.h"
+#include "assets_table.h"
 #ifdef HAVE_LVGL
 #include "display/lcd_display.h"
 #endif
 
 #include <esp_log.h>
+#include <cstring>
+#include <algorithm>
 #include <spi_flash_mmap.h>
 #include <esp_timer.h>
 #include <cbin_font.h>
 
 
 #define TAG "Assets"
+// Downloader resume key of full assets downloads
+#define ASSETS_RESUME_KEY "assets"
+
+// index.bin, written by scripts/spiffs_assets/asset_manifest.py
+#define ASSET_MANIFEST_FORMAT_VERSION       1
+#define ASSET_MANIFEST_NONE                 0xFFFFFFFF
+#define ASSET_MANIFEST_COLOR_PRESENT        0x1000000
+
+#define ASSET_MANIFEST_FLAG_HAS_HIDE_SUBTITLE       0x01
+#define ASSET_MANIFEST_FLAG_HIDE_SUBTITLE           0x02
+#define ASSET_MANIFEST_FLAG_HAS_EMOJI_COLLECTION    0x04
+
+#define ASSET_MANIFEST_EMOJI_EAF            0x01
+#define ASSET_MANIFEST_EMOJI_LOOP           0x02
+#define ASSET_MANIFEST_EMOJI_LACK           0x04
+
+enum AssetManifestRecordType : uint8_t {
+    kAssetManifestSrmodels = 1,
+    kAssetManifestTextFont = 2,
+    kAssetManifestEmoji = 3,
+    kAssetManifestIcon = 4,
+    kAssetManifestLayout = 5,
+    kAssetManifestSkinLight = 6,
+    kAssetManifestSkinDark = 7,
+};
+
+struct asset_manifest_header {
+    char magic[4];                /*!< "XZAM" */
+    uint16_t format_version;      /*!< Layout of this file */
+    uint16_t index_version;       /*!< "version" of the index.json it was built from */
+    uint32_t record_count;
+    uint32_t strings_offset;      /*!< String table, from the start of the manifest */
+    uint32_t flags;
+};
 
-struct mmap_assets_table {
-    char asset_name[32];          /*!< Name of the asset */
-    uint32_t asset_size;          /*!< Size of the asset */
-    uint32_t asset_offset;        /*!< Offset of the asset */
-    uint16_t asset_width;         /*!< Width of the asset */
-    uint16_t asset_height;        /*!< Height of the asset */
+struct asset_manifest_record {
+    uint8_t type;                 /*!< AssetManifestRecordType */
+    uint8_t flags;                /*!< Emoji eaf flags */
+    uint16_t fps;                 /*!< Emoji eaf frame rate */
+    uint32_t name;                /*!< Offset in the string table */
+    uint32_t file_offset;         /*!< Offset of the file in the data region */
+    uint32_t file_size;
+    int16_t x;                    /*!< Layout position and size */
+    int16_t y;
+    int16_t width;
+    int16_t height;
+    uint32_t value;               /*!< Layout: align string, skin: text color */
+    uint32_t value2;              /*!< Skin: background color */
 };
 
+static_assert(sizeof(asset_manifest_header) == 20, "asset_manifest_header must match the packer");
+static_assert(sizeof(asset_manifest_record) == 32, "asset_manifest_record must match the packer");
+
+static bool IsValidManifest(const void* data, size_t size) {
+    auto header = static_cast<const asset_manifest_header*>(data);
+    if ((reinterpret_cast<uintptr_t>(data) & 3) != 0 || size < sizeof(asset_manifest_header) ||
+        memcmp(header->magic, "XZAM", 4) != 0 || header->format_version != ASSET_MANIFEST_FORMAT_VERSION) {
+        return false;
+    }
+    return header->record_count <= (size - sizeof(asset_manifest_header)) / sizeof(asset_manifest_record) &&
+        header->strings_offset >= sizeof(asset_manifest_header) + header->record_count * sizeof(asset_manifest_record) &&
+        header->strings_offset <= size;
+}
 
-Assets::Assets() {
+
+Assets::Assets() : cache_(CONFIG_ASSETS_CACHE_SIZE_KB * 1024) {
     // Initialize the partition
+    BootPhase phase("assets_verify");
     InitializePartition();
 }
 
@@ -36,18 +98,37 @@ Assets::~Assets() {
     }
 }
 
-uint32_t Assets::CalculateChecksum(const char* data, uint32_t length) {
-    uint32_t checksum = 0;
-    for (uint32_t i = 0; i < length; i++) {
-        checksum += data[i];
+uint32_t Assets::GetVerifiedMarker(uint32_t stored_files, uint32_t stored_chksum, uint32_t stored_len) {
+    // Identifies what was verified: the partition, its header and the generation that is
+    // bumped whenever a download starts overwriting the partition
+    Settings settings("assets");
+    uint32_t values[] = {
+        partition_->address, partition_->size, stored_files, stored_chksum, stored_len,
+        static_cast<uint32_t>(settings.GetInt("generation")),
+    };
+    uint32_t hash = 2166136261u;  // FNV-1a
+    for (auto value : values) {
+        for (int i = 0; i < 4; i++) {
+            hash = (hash ^ ((value >> (i * 8)) & 0xFF)) * 16777619u;
+        }
     }
-    return checksum & 0xFFFF;
+    return hash;
+}
+
+void Assets::InvalidateVerifiedMarker() {
+    Settings settings("assets", true);
+    settings.SetInt("generation", settings.GetInt("generation") + 1);
+    settings.EraseKey("verified");
 }
 
 bool Assets::InitializePartition() {
     partition_valid_ = false;
     checksum_valid_ = false;
-    assets_.clear();
+    table_ = nullptr;
+    table_size_ = 0;
+    data_root_ = nullptr;
+    data_size_ = 0;
+    cache_.Clear();
 
     partition_ = esp_partition_find_first(ESP_PARTITION_TYPE_ANY, ESP_PARTITION_SUBTYPE_ANY, "assets");
     if (partition_ == nullptr) {
@@ -80,33 +161,267 @@ bool Assets::InitializePartition() {
         ESP_LOGD(TAG, "The stored_len (0x%lx) is greater than the partition size (0x%lx) - 12", stored_len, partition_->size);
         return false;
     }
+    if (stored_files > stored_len / sizeof(mmap_assets_table)) {
+        ESP_LOGE(TAG, "The file table (%lu files) does not fit in the stored data", stored_files);
+        return false;
+    }
 
-    auto start_time = esp_timer_get_time();
-    uint32_t calculated_checksum = CalculateChecksum(mmap_root_ + 12, stored_len);
-    auto end_time = esp_timer_get_time();
-    ESP_LOGI(TAG, "The checksum calculation time is %d ms", int((end_time - start_time) / 1000));
+    // Skip the full scan if this exact partition content has been verified before
+    uint32_t marker = GetVerifiedMarker(stored_files, stored_chksum, stored_len);
+    if (static_cast<uint32_t>(Settings("assets").GetInt("verified")) == marker) {
+        ESP_LOGI(TAG, "The assets partition is unchanged since last verification");
+    } else {
+        auto start_time = esp_timer_get_time();
+        uint32_t calculated_checksum = CalculateAssetsChecksum(mmap_root_ + 12, stored_len);
+        auto end_time = esp_timer_get_time();
+        ESP_LOGI(TAG, "The checksum calculation time is %d ms", int((end_time - start_time) / 1000));
+
+        if (calculated_checksum != stored_chksum) {
+            ESP_LOGE(TAG, "The calculated checksum (0x%lx) does not match the stored checksum (0x%lx)", calculated_checksum, stored_chksum);
+            return false;
+        }
 
-    if (calculated_checksum != stored_chksum) {
-        ESP_LOGE(TAG, "The calculated checksum (0x%lx) does not match the stored checksum (0x%lx)", calculated_checksum, stored_chksum);
-        return false;
+        Settings settings("assets", true);
+        settings.SetInt("verified", static_cast<int32_t>(marker));
     }
 
     checksum_valid_ = true;
 
-    for (uint32_t i = 0; i < stored_files; i++) {
-        auto item = (const mmap_assets_table*)(mmap_root_ + 12 + i * sizeof(mmap_assets_table));
-        auto asset = Asset{
-            .size = static_cast<size_t>(item->asset_size),
-            .offset = static_cast<size_t>(12 + sizeof(mmap_assets_table) * stored_files + item->asset_offset)
-        };
-        assets_[item->asset_name] = asset;
+    // The packer sorts the file table by name so it can be binary searched where it is
+    // mapped; tables from older packers are searched linearly
+    table_ = (const mmap_assets_table*)(mmap_root_ + 12);
+    table_size_ = stored_files;
+    data_root_ = mmap_root_ + 12 + sizeof(mmap_assets_table) * stored_files;
+    data_size_ = stored_len - sizeof(mmap_assets_table) * stored_files;
+    table_sorted_ = IsAssetsTableSorted(table_, table_size_);
+    if (!table_sorted_) {
+        ESP_LOGW(TAG, "The assets file table is not sorted, lookups will be linear");
     }
     return checksum_valid_;
 }
 
+const mmap_assets_table* Assets::FindAsset(const std::string& name) const {
+    return FindAssetsTableEntry(table_, table_size_, table_sorted_, name.c_str());
+}
+
+void Assets::LoadSrmodels(void* data) {
+    if (models_list_ != nullptr) {
+        esp_srmodel_deinit(models_list_);
+        models_list_ = nullptr;
+    }
+    {
+        BootPhase phase("srmodel_load");
+        models_list_ = srmodel_load(static_cast<uint8_t*>(data));
+    }
+    if (models_list_ == nullptr) {
+        ESP_LOGE(TAG, "Failed to load srmodels.bin");
+    }
+}
+
+#ifdef HAVE_LVGL
+void Assets::RefreshDisplay(bool has_hide_subtitle, bool hide_subtitle) {
+    auto display = Board::GetInstance().GetDisplay();
+    ESP_LOGI(TAG, "Refreshing display theme...");
+
+    auto current_theme = display->GetTheme();
+    if (current_theme != nullptr) {
+        display->SetTheme(current_theme);
+    }
+
+    if (has_hide_subtitle) {
+        auto lcd_display = dynamic_cast<LcdDisplay*>(display);
+        if (lcd_display != nullptr) {
+            lcd_display->SetHideSubtitle(hide_subtitle);
+            ESP_LOGI(TAG, "Set hide_subtitle to %s", hide_subtitle ? "true" : "false");
+        }
+    }
+}
+#endif
+
+bool Assets::ApplyManifest(const void* data, size_t size) {
+    auto header = static_cast<const asset_manifest_header*>(data);
+    if (header->index_version > 1) {
+        ESP_LOGE(TAG, "The assets version %d is not supported, please upgrade the firmware", header->index_version);
+        return false;
+    }
+
+    auto records = reinterpret_cast<const asset_manifest_record*>(header + 1);
+    auto strings = static_cast<const char*>(data) + header->strings_offset;
+    size_t strings_size = size - header->strings_offset;
+    [[maybe_unused]] auto get_string = [strings, strings_size](uint32_t offset) {
+        return offset < strings_size ? strings + offset : "";
+    };
+
+    // srmodels do not touch the display, load them before taking the display lock
+    for (uint32_t i = 0; i < header->record_count; i++) {
+        if (records[i].type != kAssetManifestSrmodels) {
+            continue;
+        }
+        void* ptr = nullptr;
+        size_t file_size = 0;
+        if (GetFileData(records[i].file_offset, records[i].file_size, ptr, file_size)) {
+            LoadSrmodels(ptr);
+        } else {
+            ESP_LOGE(TAG, "The srmodels file is not found");
+        }
+    }
+
+#ifdef HAVE_LVGL
+    // Apply() runs beside the version check, whose display updates read the themes
+    DisplayLockGuard lock(Board::GetInstance().GetDisplay());
+    auto& theme_manager = LvglThemeManager::GetInstance();
+    auto light_theme = theme_manager.GetTheme("light");
+    auto dark_theme = theme_manager.GetTheme("dark");
+    std::shared_ptr<EmojiCollection> custom_emoji_collection;
+    if (header->flags & ASSET_MANIFEST_FLAG_HAS_EMOJI_COLLECTION) {
+        custom_emoji_collection = std::make_shared<EmojiCollection>();
+    }
+#elif defined(CONFIG_USE_EMOTE_MESSAGE_STYLE)
+    auto display = Board::GetInstance().GetDisplay();
+    auto emote_display = dynamic_cast<emote::EmoteDisplay*>(display);
+#endif
+
+    for (uint32_t i = 0; i < header->record_count; i++) {
+        auto& record = records[i];
+        if (record.type == kAssetManifestSrmodels) {
+            continue;
+        }
+        void* ptr = nullptr;
+        size_t file_size = 0;
+#ifdef HAVE_LVGL
+        // Emoji images are created from the record, compressed ones are only loaded when shown
+        bool has_file = record.type != kAssetManifestEmoji &&
+            GetFileData(record.file_offset, record.file_size, ptr, file_size);
+#else
+        bool has_file = GetFileData(record.file_offset, record.file_size, ptr, file_size);
+#endif
+
+        switch (record.type) {
+#if defined(HAVE_LVGL) || defined(CONFIG_USE_EMOTE_MESSAGE_STYLE)
+        case kAssetManifestTextFont: {
+            if (!has_file) {
+                ESP_LOGE(TAG, "The font file is not found");
+                break;
+            }
+            auto text_font = std::make_shared<LvglCBinFont>(ptr);
+            if (text_font->font() == nullptr) {
+                ESP_LOGE(TAG, "Failed to load fonts.bin");
+                return false;
+            }
+#ifdef HAVE_LVGL
+            if (light_theme != nullptr) {
+                light_theme->set_text_font(text_font);
+            }
+            if (dark_theme != nullptr) {
+                dark_theme->set_text_font(text_font);
+            }
+#else
+            if (emote_display) {
+                emote_display->AddTextFont(text_font);
+            }
+#endif
+            break;
+        }
+#endif
+#ifdef HAVE_LVGL
+        case kAssetManifestEmoji:
+            // Emoji with eaf animation parameters are only for the emote display
+            if (record.flags & ASSET_MANIFEST_EMOJI_EAF) {
+                break;
+            }
+            if (custom_emoji_collection != nullptr) {
+                auto image = CreateImage(record.file_offset, record.file_size);
+                if (image == nullptr) {
+                    ESP_LOGE(TAG, "Emoji %s image file is not found", get_string(record.name));
+                    break;
+                }
+                custom_emoji_collection->AddEmoji(get_string(record.name), image);
+            }
+            break;
+        case kAssetManifestSkinLight:
+        case kAssetManifestSkinDark: {
+            auto theme = record.type == kAssetManifestSkinLight ? light_theme : dark_theme;
+            if (theme == nullptr) {
+                break;
+            }
+            if (record.value & ASSET_MANIFEST_COLOR_PRESENT) {
+                theme->set_text_color(lv_color_hex(record.value & 0xFFFFFF));
+            }
+            if (record.value2 & ASSET_MANIFEST_COLOR_PRESENT) {
+                theme->set_background_color(lv_color_hex(record.value2 & 0xFFFFFF));
+                theme->set_chat_background_color(lv_color_hex(record.value2 & 0xFFFFFF));
+            }
+            if (record.file_offset != ASSET_MANIFEST_NONE) {
+                if (!has_file) {
+                    ESP_LOGE(TAG, "The background image file is not found");
+                    return false;
+                }
+                theme->set_background_image(std::make_shared<LvglCBinImage>(ptr));
+            }
+            break;
+        }
+#elif defined(CONFIG_USE_EMOTE_MESSAGE_STYLE)
+        case kAssetManifestEmoji:
+            // Only emoji with eaf animation parameters are used by the emote display
+            if (!(record.flags & ASSET_MANIFEST_EMOJI_EAF)) {
+                break;
+            }
+            if (!has_file) {
+                ESP_LOGE(TAG, "Emoji \"%10s\" image file is not found", get_string(record.name));
+            } else if (emote_display) {
+                emote_display->AddEmojiData(get_string(record.name), ptr, file_size, static_cast<uint8_t>(record.fps),
+                                            (record.flags & ASSET_MANIFEST_EMOJI_LOOP) != 0,
+                                            (record.flags & ASSET_MANIFEST_EMOJI_LACK) != 0);
+            }
+            break;
+        case kAssetManifestIcon:
+            if (!emote_display) {
+                break;
+            }
+            if (has_file) {
+                emote_display->AddIconData(get_string(record.name), ptr, file_size);
+            } else {
+                ESP_LOGE(TAG, "Icon \"%10s\" image file is not found", get_string(record.name));
+            }
+            break;
+        case kAssetManifestLayout:
+            if (emote_display) {
+                emote_display->AddLayoutData(get_string(record.name), get_string(record.value),
+                                             record.x, record.y, record.width, record.height);
+            }
+            break;
+#endif
+        default:
+            break;
+        }
+    }
+
+#ifdef HAVE_LVGL
+    if (custom_emoji_collection != nullptr) {
+        if (light_theme != nullptr) {
+            light_theme->set_emoji_collection(custom_emoji_collection);
+        }
+        if (dark_theme != nullptr) {
+            dark_theme->set_emoji_collection(custom_emoji_collection);
+        }
+    }
+    RefreshDisplay((header->flags & ASSET_MANIFEST_FLAG_HAS_HIDE_SUBTITLE) != 0,
+                   (header->flags & ASSET_MANIFEST_FLAG_HIDE_SUBTITLE) != 0);
+#endif
+    return true;
+}
+
 bool Assets::Apply() {
+    BootPhase phase("assets_apply");
     void* ptr = nullptr;
     size_t size = 0;
+
+    // Newer bundles carry index.bin, the content of index.json with file offsets resolved
+    // at pack time, which is used in place instead of building a cJSON tree
+    if (GetAssetData("index.bin", ptr, size) && IsValidManifest(ptr, size)) {
+        return ApplyManifest(ptr, size);
+    }
+
     if (!GetAssetData("index.json", ptr, size)) {
         ESP_LOGE(TAG, "The index.json file is not found");
         return false;
@@ -130,23 +445,14 @@ bool Assets::Apply() {
     if (cJSON_IsString(srmodels)) {
         std::string srmodels_file = srmodels->valuestring;
         if (GetAssetData(srmodels_file, ptr, size)) {
-            if (models_list_ != nullptr) {
-                esp_srmodel_deinit(models_list_);
-                models_list_ = nullptr;
-            }
-            models_list_ = srmodel_load(static_cast<uint8_t*>(ptr));
-            if (models_list_ != nullptr) {
-                auto& app = Application::GetInstance();
-                app.GetAudioService().SetModelsList(models_list_);
-            } else {
-                ESP_LOGE(TAG, "Failed to load srmodels.bin");
-            }
+            LoadSrmodels(ptr);
         } else {
             ESP_LOGE(TAG, "The srmodels file %s is not found", srmodels_file.c_str());
         }
     }
 
 #ifdef HAVE_LVGL
+    DisplayLockGuard lock(Board::GetInstance().GetDisplay());
     auto& theme_manager = LvglThemeManager::GetInstance();
     auto light_theme = theme_manager.GetTheme("light");
     auto dark_theme = theme_manager.GetTheme("dark");
@@ -182,11 +488,13 @@ bool Assets::Apply() {
                 cJSON* file = cJSON_GetObjectItem(emoji, "file");
                 cJSON* eaf = cJSON_GetObjectItem(emoji, "eaf");
                 if (cJSON_IsString(name) && cJSON_IsString(file) && (NULL== eaf)) {
-                    if (!GetAssetData(file->valuestring, ptr, size)) {
+                    auto asset = FindAsset(file->valuestring);
+                    auto image = asset != nullptr ? CreateImage(asset->asset_offset, asset->asset_size) : nullptr;
+                    if (image == nullptr) {
                         ESP_LOGE(TAG, "Emoji %s image file %s is not found", name->valuestring, file->valuestring);
                         continue;
                     }
-                    custom_emoji_collection->AddEmoji(name->valuestring, new LvglRawImage(ptr, size));
+                    custom_emoji_collection->AddEmoji(name->valuestring, image);
                 }
             }
         }
@@ -244,24 +552,9 @@ bool Assets::Apply() {
         }
     }
 
-    auto display = Board::GetInstance().GetDisplay();
-    ESP_LOGI(TAG, "Refreshing display theme...");
-
-    auto current_theme = display->GetTheme();
-    if (current_theme != nullptr) {
-        display->SetTheme(current_theme);
-    }
-
     // Parse hide_subtitle configuration
     cJSON* hide_subtitle = cJSON_GetObjectItem(root, "hide_subtitle");
-    if (cJSON_IsBool(hide_subtitle)) {
-        bool hide = cJSON_IsTrue(hide_subtitle);
-        auto lcd_display = dynamic_cast<LcdDisplay*>(display);
-        if (lcd_display != nullptr) {
-            lcd_display->SetHideSubtitle(hide);
-            ESP_LOGI(TAG, "Set hide_subtitle to %s", hide ? "true" : "false");
-        }
-    }
+    RefreshDisplay(cJSON_IsBool(hide_subtitle), cJSON_IsTrue(hide_subtitle));
 
 #elif defined(CONFIG_USE_EMOTE_MESSAGE_STYLE)
     auto &board = Board::GetInstance();
@@ -384,7 +677,21 @@ bool Assets::Apply() {
 
 bool Assets::Download(std::string url, std::function<void(int progress, size_t speed)> progress_callback) {
     ESP_LOGI(TAG, "Downloading new version of assets from %s", url.c_str());
-    
+
+    // 当前分区有效时先尝试增量更新，已有的文件直接从分区内复制
+    AssetsDelta delta(partition_, url);
+    bool use_delta = false;
+    if (checksum_valid_ && table_ != nullptr) {
+        std::vector<AssetsDelta::OldFile> old_files;
+        uint32_t data_offset = data_root_ - mmap_root_;
+        for (uint32_t i = 0; i < table_size_; i++) {
+            if (table_[i].asset_offset < data_size_ && table_[i].asset_size + 2ull <= data_size_ - table_[i].asset_offset) {
+                old_files.push_back({data_offset + table_[i].asset_offset, table_[i].asset_size + 2});
+            }
+        }
+        use_delta = delta.Prepare(mmap_root_, old_files);
+    }
+
     // 取消当前资源分区的内存映射
     if (mmap_handle_ != 0) {
         esp_partition_munmap(mmap_handle_);
@@ -392,119 +699,39 @@ bool Assets::Download(std::string url, std::function<void(int progress, size_t s
         mmap_root_ = nullptr;
     }
     checksum_valid_ = false;
-    assets_.clear();
-
-    // 下载新的资源文件
-    auto network = Board::GetInstance().GetNetwork();
-    auto http = network->CreateHttp(0);
-    
-    if (!http->Open("GET", url)) {
-        ESP_LOGE(TAG, "Failed to open HTTP connection");
-        return false;
-    }
-
-    if (http->GetStatusCode() != 200) {
-        ESP_LOGE(TAG, "Failed to get assets, status code: %d", http->GetStatusCode());
-        return false;
-    }
-
-    size_t content_length = http->GetBodyLength();
-    if (content_length == 0) {
-        ESP_LOGE(TAG, "Failed to get content length");
-        return false;
+    table_ = nullptr;
+    table_size_ = 0;
+    data_root_ = nullptr;
+    data_size_ = 0;
+    cache_.Clear();
+
+    // 分区内容即将改变，作废之前的校验记录
+    InvalidateVerifiedMarker();
+
+    // 增量更新会原地改写扇区，之前中断的整包下载进度不再可信，回退时必须从头下载
+    if (use_delta) {
+        Downloader::ClearResume(ASSETS_RESUME_KEY);
     }
-
-    if (content_length > partition_->size) {
-        ESP_LOGE(TAG, "Assets file size (%u) is larger than partition size (%lu)", content_length, partition_->size);
-        return false;
+    bool ok = use_delta && delta.Apply(progress_callback);
+    if (use_delta && !ok) {
+        ESP_LOGW(TAG, "Delta update failed, downloading the whole assets");
     }
 
-    // 定义扇区大小为4KB（ESP32的标准扇区大小）
-    const size_t SECTOR_SIZE = esp_partition_get_main_flash_sector_size();
-    
-    // 计算需要擦除的扇区数量
-    size_t sectors_to_erase = (content_length + SECTOR_SIZE - 1) / SECTOR_SIZE; // 向上取整
-    size_t total_erase_size = sectors_to_erase * SECTOR_SIZE;
-    
-    ESP_LOGI(TAG, "Sector size: %u, content length: %u, sectors to erase: %u, total erase size: %u", 
-             SECTOR_SIZE, content_length, sectors_to_erase, total_erase_size);
-    
-    // 写入新的资源文件到分区，一边erase一边写入
-    char buffer[512];
-    size_t total_written = 0;
-    size_t recent_written = 0;
-    size_t current_sector = 0;
-    auto last_calc_time = esp_timer_get_time();
-    
-    while (true) {
-        int ret = http->Read(buffer, sizeof(buffer));
-        if (ret < 0) {
-            ESP_LOGE(TAG, "Failed to read HTTP data: %s", esp_err_to_name(ret));
-            return false;
-        }
-
-        if (ret == 0) {
-            break;
-        }
-
-        // 检查是否需要擦除新的扇区
-        size_t write_end_offset = total_written + ret;
-        size_t needed_sectors = (write_end_offset + SECTOR_SIZE - 1) / SECTOR_SIZE;
-        
-        // 擦除需要的新扇区
-        while (current_sector < needed_sectors) {
-            size_t sector_start = current_sector * SECTOR_SIZE;
-            size_t sector_end = (current_sector + 1) * SECTOR_SIZE;
-            
-            // 确保擦除范围不超过分区大小
-            if (sector_end > partition_->size) {
-                ESP_LOGE(TAG, "Sector end (%u) exceeds partition size (%lu)", sector_end, partition_->size);
-                return false;
-            }
-            
-            ESP_LOGD(TAG, "Erasing sector %u (offset: %u, size: %u)", current_sector, sector_start, SECTOR_SIZE);
-            esp_err_t err = esp_partition_erase_range(partition_, sector_start, SECTOR_SIZE);
-            if (err != ESP_OK) {
-                ESP_LOGE(TAG, "Failed to erase sector %u at offset %u: %s", current_sector, sector_start, esp_err_to_name(err));
-                return false;
-            }
-            
-            current_sector++;
-        }
-
-        // 写入数据到分区
-        esp_err_t err = esp_partition_write(partition_, total_written, buffer, ret);
-        if (err != ESP_OK) {
-            ESP_LOGE(TAG, "Failed to write to assets partition at offset %u: %s", total_written, esp_err_to_name(err));
+    if (!ok) {
+        // 网络读取与 Flash 写入并行进行，中断后同一 URL 可以从断点继续下载
+        PartitionWriter writer(partition_);
+        Downloader downloader(url, ASSETS_RESUME_KEY);
+        downloader.set_max_size(partition_->size);
+        ok = downloader.Run([&writer](size_t offset, const uint8_t* data, size_t size) {
+            return writer.Write(offset, data, size);
+        }, progress_callback);
+        if (!ok) {
+            ESP_LOGE(TAG, "Failed to download assets");
             return false;
         }
-
-        total_written += ret;
-        recent_written += ret;
-
-        // 计算进度和速度
-        if (esp_timer_get_time() - last_calc_time >= 1000000 || total_written == content_length || ret == 0) {
-            size_t progress = total_written * 100 / content_length;
-            size_t speed = recent_written; // 每秒的字节数
-            ESP_LOGI(TAG, "Progress: %u%% (%u/%u), Speed: %u B/s, Sectors erased: %u", 
-                     progress, total_written, content_length, speed, current_sector);
-            if (progress_callback) {
-                progress_callback(progress, speed);
-            }
-            last_calc_time = esp_timer_get_time();
-            recent_written = 0; // 重置最近写入的字节数
-        }
-    }
-    
-    http->Close();
-
-    if (total_written != content_length) {
-        ESP_LOGE(TAG, "Downloaded size (%u) does not match expected size (%u)", total_written, content_length);
-        return false;
     }
 
-    ESP_LOGI(TAG, "Assets download completed, total written: %u bytes, total sectors erased: %u", 
-             total_written, current_sector);
+    ESP_LOGI(TAG, "Assets download completed");
 
     // 重新初始化资源分区
     if (!InitializePartition()) {
@@ -516,17 +743,81 @@ bool Assets::Download(std::string url, std::function<void(int progress, size_t s
 }
 
 bool Assets::GetAssetData(const std::string& name, void*& ptr, size_t& size) {
-    auto asset = assets_.find(name);
-    if (asset == assets_.end()) {
+    auto asset = FindAsset(name);
+    if (asset == nullptr) {
         return false;
     }
-    auto data = (const char*)(mmap_root_ + asset->second.offset);
+    if (!GetFileData(asset->asset_offset, asset->asset_size, ptr, size)) {
+        ESP_LOGE(TAG, "The asset %s is not valid", name.c_str());
+        return false;
+    }
+    return true;
+}
+
+bool Assets::IsFileInRange(uint32_t offset, uint32_t size) const {
+    return offset != ASSET_MANIFEST_NONE && offset <= data_size_ && data_size_ - offset >= size + 2ull;
+}
+
+bool Assets::GetFileData(uint32_t offset, uint32_t size, void*& ptr, size_t& data_size) {
+    if (!IsFileInRange(offset, size)) {
+        return false;
+    }
+    auto data = data_root_ + offset;
+    if (data[0] == 'Z' && data[1] == 'L') {
+        // 压缩文件解压后常驻内存，指针在资源更新前一直有效
+        auto buffer = LoadCompressedFile(offset, size, true);
+        if (buffer == nullptr) {
+            return false;
+        }
+        ptr = buffer->data;
+        data_size = buffer->size;
+        return true;
+    }
     if (data[0] != 'Z' || data[1] != 'Z') {
-        ESP_LOGE(TAG, "The asset %s is not valid with magic %02x%02x", name.c_str(), data[0], data[1]);
+        ESP_LOGE(TAG, "The file at offset 0x%lx is not valid with magic %02x%02x", offset, data[0], data[1]);
         return false;
     }
 
     ptr = static_cast<void*>(const_cast<char*>(data + 2));
-    size = asset->second.size;
+    data_size = size;
     return true;
 }
+
+std::shared_ptr<AssetBuffer> Assets::LoadCompressedFile(uint32_t offset, uint32_t size, bool pin) {
+    // "ZL", 原始大小 (uint32)，然后是一个 LZ4 数据块
+    if (!IsFileInRange(offset, size) || size < 4) {
+        return nullptr;
+    }
+    // 延迟加载的图片可能在资源更新后才解压，此时该偏移处已是别的内容
+    if (data_root_[offset] != 'Z' || data_root_[offset + 1] != 'L') {
+        ESP_LOGE(TAG, "The file at offset 0x%lx is not compressed", offset);
+        return nullptr;
+    }
+    auto data = reinterpret_cast<const uint8_t*>(data_root_ + offset + 2);
+    uint32_t original_size;
+    memcpy(&original_size, data, sizeof(original_size));
+    return cache_.Get(offset, data + 4, size - 4, original_size, pin);
+}
+
+#ifdef HAVE_LVGL
+LvglImage* Assets::CreateImage(uint32_t offset, uint32_t size) {
+    if (IsFileInRange(offset, size) && data_root_[offset] == 'Z' && data_root_[offset + 1] == 'L') {
+        // 压缩的图片在显示时才解压，不再显示后可被缓存淘汰
+        return new LvglLazyImage([this, offset, size](size_t& data_size) -> std::shared_ptr<const void> {
+            auto buffer = LoadCompressedFile(offset, size);
+            if (buffer == nullptr) {
+                return nullptr;
+            }
+            data_size = buffer->size;
+            return std::shared_ptr<const void>(buffer, buffer->data);
+        });
+    }
+
+    void* ptr = nullptr;
+    size_t data_size = 0;
+    if (!GetFileData(offset, size, ptr, data_size)) {
+        return nullptr;
+    }
+    return new LvglRawImage(ptr, data_size);
+}
+#endif
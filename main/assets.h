@@ -1,19 +1,20 @@
 #ifndef ASSETS_H
 #define ASSETS_H
 
-#include <map>
 #include <string>
 #include <functional>
+#include <memory>
+#include <vector>
 
 #include <cJSON.h>
 #include <esp_partition.h>
 #include <model_path.h>
 
+#include "asset_cache.h"
 
-struct Asset {
-    size_t size;
-    size_t offset;
-};
+
+struct mmap_assets_table;
+class LvglImage;
 
 class Assets {
 public:
@@ -30,6 +31,8 @@ public:
     inline bool partition_valid() const { return partition_valid_; }
     inline bool checksum_valid() const { return checksum_valid_; }
     inline std::string default_assets_url() const { return default_assets_url_; }
+    // Loaded by Apply(), handed to the audio service by the caller once Apply() has returned
+    inline srmodel_list_t* models_list() const { return models_list_; }
 
 private:
     Assets();
@@ -37,7 +40,18 @@ private:
     Assets& operator=(const Assets&) = delete;
 
     bool InitializePartition();
-    uint32_t CalculateChecksum(const char* data, uint32_t length);
+    uint32_t GetVerifiedMarker(uint32_t stored_files, uint32_t stored_chksum, uint32_t stored_len);
+    void InvalidateVerifiedMarker();
+    const mmap_assets_table* FindAsset(const std::string& name) const;
+    bool IsFileInRange(uint32_t offset, uint32_t size) const;
+    bool GetFileData(uint32_t offset, uint32_t size, void*& ptr, size_t& data_size);
+    std::shared_ptr<AssetBuffer> LoadCompressedFile(uint32_t offset, uint32_t size, bool pin = false);
+#ifdef HAVE_LVGL
+    LvglImage* CreateImage(uint32_t offset, uint32_t size);
+#endif
+    bool ApplyManifest(const void* data, size_t size);
+    void LoadSrmodels(void* data);
+    void RefreshDisplay(bool has_hide_subtitle, bool hide_subtitle);
 
     const esp_partition_t* partition_ = nullptr;
     esp_partition_mmap_handle_t mmap_handle_ = 0;
@@ -46,7 +60,15 @@ private:
     bool checksum_valid_ = false;
     std::string default_assets_url_;
     srmodel_list_t* models_list_ = nullptr;
-    std::map<std::string, Asset> assets_;
+    // File table inside the mapped partition, looked up in place
+    const mmap_assets_table* table_ = nullptr;
+    uint32_t table_size_ = 0;
+    bool table_sorted_ = false;
+    // File data follows the table, file offsets are relative to it
+    const char* data_root_ = nullptr;
+    size_t data_size_ = 0;
+    // Decompressed files, those handed out as plain pointers stay pinned in memory
+    AssetCache cache_;
 };
 
 #endif
@@ -0,0 +1,321 @@
+#include "assets_delta.h"
+#include "board.h"
+#include "downloader.h"
+
+#include <algorithm>
+#include <cstring>
+#include <esp_log.h>
+#include <esp_timer.h>
+#include <mbedtls/sha256.h>
+
+#define TAG "AssetsDelta"
+
+struct assets_delta_header {
+    char magic[4];                /*!< "XZAD" */
+    uint16_t format_version;
+    uint16_t block_size;          /*!< Flash sector size the packer assumed */
+    uint32_t image_size;
+    uint32_t entry_count;
+    uint8_t image_sha256[32];
+};
+
+struct assets_delta_entry {
+    uint32_t offset;              /*!< Position of the file in the new image, at its 0x5A5A prefix */
+    uint32_t size;                /*!< Size including the prefix */
+    uint8_t sha256[32];
+};
+
+static_assert(sizeof(assets_delta_header) == 48, "assets_delta_header must match the packer");
+static_assert(sizeof(assets_delta_entry) == 40, "assets_delta_entry must match the packer");
+
+AssetsDelta::AssetsDelta(const esp_partition_t* partition, const std::string& url)
+    : partition_(partition), url_(url) {
+}
+
+bool AssetsDelta::FetchManifest(std::string& manifest) {
+    auto network = Board::GetInstance().GetNetwork();
+    auto http = network->CreateHttp(0);
+    if (!http->Open("GET", url_ + ASSETS_DELTA_SUFFIX)) {
+        ESP_LOGW(TAG, "Failed to open HTTP connection");
+        return false;
+    }
+    if (http->GetStatusCode() != 200) {
+        ESP_LOGI(TAG, "No delta manifest, status code: %d", http->GetStatusCode());
+        return false;
+    }
+
+    size_t length = http->GetBodyLength();
+    if (length < sizeof(assets_delta_header) || length > ASSETS_DELTA_MAX_MANIFEST_SIZE) {
+        ESP_LOGW(TAG, "Invalid delta manifest size: %u", length);
+        return false;
+    }
+    manifest.resize(length);
+    size_t received = 0;
+    while (received < length) {
+        int ret = http->Read(manifest.data() + received, length - received);
+        if (ret <= 0) {
+            ESP_LOGW(TAG, "Failed to read delta manifest");
+            return false;
+        }
+        received += ret;
+    }
+    http->Close();
+    return true;
+}
+
+bool AssetsDelta::Prepare(const char* old_image, const std::vector<OldFile>& old_files) {
+    std::string manifest;
+    if (!FetchManifest(manifest)) {
+        return false;
+    }
+    manifest_size_ = manifest.size();
+
+    assets_delta_header header;
+    memcpy(&header, manifest.data(), sizeof(header));
+    if (memcmp(header.magic, "XZAD", 4) != 0 || header.format_version != ASSETS_DELTA_FORMAT_VERSION ||
+        header.block_size != ASSETS_DELTA_BLOCK_SIZE || header.image_size == 0 || header.image_size > partition_->size ||
+        manifest.size() != sizeof(header) + header.entry_count * sizeof(assets_delta_entry)) {
+        ESP_LOGW(TAG, "Unsupported delta manifest");
+        return false;
+    }
+    image_size_ = header.image_size;
+    memcpy(image_sha256_, header.image_sha256, sizeof(image_sha256_));
+
+    // Only old files with the size of a new file are hashed, each at most once
+    std::vector<bool> hashed(old_files.size(), false);
+    std::vector<uint8_t> old_hashes(old_files.size() * 32);
+    uint32_t previous_end = 0;
+    size_t reused_size = 0;
+    auto start_time = esp_timer_get_time();
+    for (uint32_t i = 0; i < header.entry_count; i++) {
+        assets_delta_entry entry;
+        memcpy(&entry, manifest.data() + sizeof(header) + i * sizeof(entry), sizeof(entry));
+        if (entry.offset < previous_end || entry.offset > image_size_ || entry.size > image_size_ - entry.offset) {
+            ESP_LOGW(TAG, "Invalid delta manifest entry %lu", i);
+            matches_.clear();
+            return false;
+        }
+        previous_end = entry.offset + entry.size;
+
+        for (size_t j = 0; j < old_files.size(); j++) {
+            if (old_files[j].size != entry.size) {
+                continue;
+            }
+            uint8_t* old_hash = &old_hashes[j * 32];
+            if (!hashed[j]) {
+                mbedtls_sha256((const unsigned char*)old_image + old_files[j].offset, old_files[j].size, old_hash, 0);
+                hashed[j] = true;
+            }
+            if (memcmp(old_hash, entry.sha256, 32) == 0) {
+                matches_.push_back(Match{entry.offset, entry.size, old_files[j].offset});
+                reused_size += entry.size;
+                break;
+            }
+        }
+    }
+
+    ESP_LOGI(TAG, "%u of %lu files (%u of %lu bytes) are reused, matched in %d ms", matches_.size(), header.entry_count,
+             reused_size, image_size_, int((esp_timer_get_time() - start_time) / 1000));
+    return !matches_.empty();
+}
+
+template <typename F>
+void AssetsDelta::ForEachPiece(uint32_t sector, F&& callback) const {
+    uint32_t begin = sector * ASSETS_DELTA_BLOCK_SIZE;
+    uint32_t end = std::min<uint32_t>(begin + ASSETS_DELTA_BLOCK_SIZE, image_size_);
+    auto it = std::upper_bound(matches_.begin(), matches_.end(), begin, [](uint32_t value, const Match& match) {
+        return value < match.offset + match.size;
+    });
+    for (; it != matches_.end() && it->offset < end; ++it) {
+        uint32_t piece_begin = std::max(begin, it->offset);
+        uint32_t piece_end = std::min(end, it->offset + it->size);
+        callback(piece_begin, it->old_offset + (piece_begin - it->offset), piece_end - piece_begin);
+    }
+}
+
+template <typename F>
+void AssetsDelta::ForEachSource(uint32_t sector, F&& callback) const {
+    ForEachPiece(sector, [&callback](uint32_t, uint32_t old_offset, uint32_t size) {
+        uint32_t last = (old_offset + size - 1) / ASSETS_DELTA_BLOCK_SIZE;
+        for (uint32_t source = old_offset / ASSETS_DELTA_BLOCK_SIZE; source <= last; source++) {
+            callback(source);
+        }
+    });
+}
+
+void AssetsDelta::PlanSectors() {
+    // A sector is copied when reused files cover all of it, anything else in it
+    // (the header, the file table, changed files) makes it fetched
+    uint32_t sector_count = (image_size_ + ASSETS_DELTA_BLOCK_SIZE - 1) / ASSETS_DELTA_BLOCK_SIZE;
+    states_.assign(sector_count, kSectorFetch);
+    readers_.assign(partition_->size / ASSETS_DELTA_BLOCK_SIZE, 0);
+    for (uint32_t sector = 0; sector < sector_count; sector++) {
+        uint32_t cursor = sector * ASSETS_DELTA_BLOCK_SIZE;
+        uint32_t end = std::min<uint32_t>(cursor + ASSETS_DELTA_BLOCK_SIZE, image_size_);
+        ForEachPiece(sector, [&cursor](uint32_t offset, uint32_t, uint32_t size) {
+            if (offset == cursor) {
+                cursor += size;
+            }
+        });
+        if (cursor != end) {
+            continue;
+        }
+        states_[sector] = kSectorCopy;
+        ForEachSource(sector, [this, sector](uint32_t source) {
+            if (source != sector) {
+                readers_[source]++;
+            }
+        });
+    }
+}
+
+bool AssetsDelta::CopySector(uint32_t sector, uint8_t* buffer, uint8_t* current, bool& unchanged) {
+    uint32_t begin = sector * ASSETS_DELTA_BLOCK_SIZE;
+    uint32_t size = std::min<uint32_t>(ASSETS_DELTA_BLOCK_SIZE, image_size_ - begin);
+    esp_err_t err = ESP_OK;
+    ForEachPiece(sector, [&](uint32_t offset, uint32_t old_offset, uint32_t piece_size) {
+        if (err == ESP_OK) {
+            err = esp_partition_read(partition_, old_offset, buffer + (offset - begin), piece_size);
+        }
+    });
+    if (err != ESP_OK) {
+        ESP_LOGE(TAG, "Failed to read sector %lu sources: %s", sector, esp_err_to_name(err));
+        return false;
+    }
+
+    // Files in front of the first change usually did not move, leave their sectors alone
+    unchanged = esp_partition_read(partition_, begin, current, size) == ESP_OK && memcmp(buffer, current, size) == 0;
+    if (unchanged) {
+        return true;
+    }
+    return PartitionWriter(partition_).Write(begin, buffer, size);
+}
+
+bool AssetsDelta::FetchSectors(std::function<void(int progress, size_t speed)> progress_callback, size_t& fetched) {
+    size_t total = 0;
+    for (uint32_t sector = 0; sector < states_.size(); sector++) {
+        if (states_[sector] == kSectorFetch) {
+            total += std::min<uint32_t>(ASSETS_DELTA_BLOCK_SIZE, image_size_ - sector * ASSETS_DELTA_BLOCK_SIZE);
+        }
+    }
+
+    // One Range request for each run of consecutive fetched sectors
+    fetched = 0;
+    uint32_t sector = 0;
+    while (sector < states_.size()) {
+        if (states_[sector] != kSectorFetch) {
+            sector++;
+            continue;
+        }
+        uint32_t end = sector;
+        while (end < states_.size() && states_[end] == kSectorFetch) {
+            end++;
+        }
+        uint32_t begin_offset = sector * ASSETS_DELTA_BLOCK_SIZE;
+        uint32_t end_offset = std::min<uint32_t>(end * ASSETS_DELTA_BLOCK_SIZE, image_size_);
+        size_t run_size = end_offset - begin_offset;
+
+        PartitionWriter writer(partition_);
+        Downloader downloader(url_);
+        downloader.set_range(begin_offset, end_offset);
+        bool ok = downloader.Run([&writer](size_t offset, const uint8_t* data, size_t size) {
+            return writer.Write(offset, data, size);
+        }, [&](int progress, size_t speed) {
+            if (progress_callback) {
+                progress_callback((fetched + run_size * progress / 100) * 100 / total, speed);
+            }
+        });
+        if (!ok) {
+            return false;
+        }
+        fetched += run_size;
+        sector = end;
+    }
+    return true;
+}
+
+bool AssetsDelta::VerifyImage(uint8_t* buffer) {
+    uint8_t digest[32];
+    mbedtls_sha256_context ctx;
+    mbedtls_sha256_init(&ctx);
+    mbedtls_sha256_starts(&ctx, 0);
+    esp_err_t err = ESP_OK;
+    for (uint32_t offset = 0; offset < image_size_ && err == ESP_OK; offset += ASSETS_DELTA_BLOCK_SIZE) {
+        uint32_t size = std::min<uint32_t>(ASSETS_DELTA_BLOCK_SIZE, image_size_ - offset);
+        err = esp_partition_read(partition_, offset, buffer, size);
+        mbedtls_sha256_update(&ctx, buffer, size);
+    }
+    mbedtls_sha256_finish(&ctx, digest);
+    mbedtls_sha256_free(&ctx);
+
+    if (err != ESP_OK || memcmp(digest, image_sha256_, sizeof(digest)) != 0) {
+        ESP_LOGE(TAG, "The updated partition does not match the delta manifest");
+        return false;
+    }
+    return true;
+}
+
+bool AssetsDelta::Apply(std::function<void(int progress, size_t speed)> progress_callback) {
+    auto start_time = esp_timer_get_time();
+    PlanSectors();
+
+    // Copy a sector only once no other copy needs to read its old content, when every
+    // remaining copy waits on another one, fetch one of them instead to break the cycle
+    std::vector<uint32_t> ready;
+    size_t remaining = 0;
+    for (uint32_t sector = 0; sector < states_.size(); sector++) {
+        if (states_[sector] == kSectorCopy) {
+            remaining++;
+            if (readers_[sector] == 0) {
+                ready.push_back(sector);
+            }
+        }
+    }
+
+    std::vector<uint8_t> buffer(ASSETS_DELTA_BLOCK_SIZE);
+    std::vector<uint8_t> current(ASSETS_DELTA_BLOCK_SIZE);
+    size_t copied = 0, unchanged_count = 0, cycles = 0;
+    uint32_t next = 0;
+    while (remaining > 0) {
+        uint32_t sector;
+        if (!ready.empty()) {
+            sector = ready.back();
+            ready.pop_back();
+            bool unchanged;
+            if (!CopySector(sector, buffer.data(), current.data(), unchanged)) {
+                return false;
+            }
+            states_[sector] = kSectorDone;
+            unchanged ? unchanged_count++ : copied++;
+        } else {
+            while (states_[next] != kSectorCopy) {
+                next++;
+            }
+            sector = next;
+            states_[sector] = kSectorFetch;
+            cycles++;
+        }
+        remaining--;
+
+        ForEachSource(sector, [this, sector, &ready](uint32_t source) {
+            if (source != sector && --readers_[source] == 0 && source < states_.size() && states_[source] == kSectorCopy) {
+                ready.push_back(source);
+            }
+        });
+    }
+    auto copy_ms = int((esp_timer_get_time() - start_time) / 1000);
+    ESP_LOGI(TAG, "%u sectors copied, %u unchanged in %d ms, %u cycles broken", copied, unchanged_count, copy_ms, cycles);
+
+    size_t fetched = 0;
+    if (!FetchSectors(progress_callback, fetched)) {
+        return false;
+    }
+    if (!VerifyImage(buffer.data())) {
+        return false;
+    }
+
+    size_t transferred = fetched + manifest_size_;
+    ESP_LOGI(TAG, "Delta update applied in %d ms, downloaded %u of %lu bytes (%u%%)",
+             int((esp_timer_get_time() - start_time) / 1000), transferred, image_size_, transferred * 100 / image_size_);
+    return true;
+}
@@ -0,0 +1,75 @@
+#ifndef ASSETS_DELTA_H
+#define ASSETS_DELTA_H
+
+#include <cstdint>
+#include <functional>
+#include <string>
+#include <vector>
+
+#include <esp_partition.h>
+
+// Written by scripts/spiffs_assets/asset_delta.py next to the image as <image>.delta
+#define ASSETS_DELTA_SUFFIX             ".delta"
+#define ASSETS_DELTA_FORMAT_VERSION     1
+#define ASSETS_DELTA_BLOCK_SIZE         4096
+#define ASSETS_DELTA_MAX_MANIFEST_SIZE  (64 * 1024)
+
+/**
+ * AssetsDelta - Rewrites the assets partition in place with only the changed sectors downloaded
+ *
+ * The delta manifest lists every file of the new image by position and SHA-256.
+ * Files that already exist anywhere in the current partition are copied from
+ * there, sector by sector in an order that never overwrites data a later copy
+ * still needs. The sectors left over are fetched from the new image with Range
+ * requests, and the result is checked against the image hash in the manifest.
+ */
+class AssetsDelta {
+public:
+    // A packed file in the current partition, including its 0x5A5A prefix
+    struct OldFile {
+        uint32_t offset;
+        uint32_t size;
+    };
+
+    AssetsDelta(const esp_partition_t* partition, const std::string& url);
+
+    // Fetches the manifest and matches its files against the mapped current partition,
+    // false when there is no usable manifest or nothing to reuse
+    bool Prepare(const char* old_image, const std::vector<OldFile>& old_files);
+    // Must be called after the partition is unmapped, the partition is invalid if it fails
+    bool Apply(std::function<void(int progress, size_t speed)> progress_callback);
+
+private:
+    enum SectorState : uint8_t {
+        kSectorFetch,
+        kSectorCopy,
+        kSectorDone,
+    };
+
+    // A file of the new image that is copied from the current partition
+    struct Match {
+        uint32_t offset;
+        uint32_t size;
+        uint32_t old_offset;
+    };
+
+    const esp_partition_t* partition_;
+    std::string url_;
+    uint32_t image_size_ = 0;
+    uint8_t image_sha256_[32];
+    size_t manifest_size_ = 0;
+    std::vector<Match> matches_;
+    std::vector<uint8_t> states_;
+    // Number of copies that still have to read each old sector
+    std::vector<uint16_t> readers_;
+
+    bool FetchManifest(std::string& manifest);
+    void PlanSectors();
+    template <typename F> void ForEachPiece(uint32_t sector, F&& callback) const;
+    template <typename F> void ForEachSource(uint32_t sector, F&& callback) const;
+    bool CopySector(uint32_t sector, uint8_t* buffer, uint8_t* current, bool& unchanged);
+    bool FetchSectors(std::function<void(int progress, size_t speed)> progress_callback, size_t& fetched);
+    bool VerifyImage(uint8_t* buffer);
+};
+
+#endif // ASSETS_DELTA_H
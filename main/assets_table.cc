@@ -0,0 +1,72 @@
+#include "assets_table.h"
+
+#include <cstring>
+
+uint32_t CalculateAssetsChecksum(const char* data, uint32_t length) {
+    // Added a word at a time: the even and odd bytes of each word are masked into two 16-bit
+    // lanes, which are folded into the result every 128 words before they can overflow
+    // (128 * 2 * 255 < 65536)
+    auto bytes = reinterpret_cast<const uint8_t*>(data);
+    uint32_t checksum = 0;
+    while (length > 0 && (reinterpret_cast<uintptr_t>(bytes) & 3) != 0) {
+        checksum += *bytes++;
+        length--;
+    }
+
+    auto words = reinterpret_cast<const uint32_t*>(bytes);
+    uint32_t word_count = length / 4;
+    while (word_count > 0) {
+        uint32_t block = word_count < 128 ? word_count : 128;
+        uint32_t lanes = 0;
+        for (uint32_t i = 0; i < block; i++) {
+            uint32_t word = words[i];
+            lanes += (word & 0x00FF00FF) + ((word >> 8) & 0x00FF00FF);
+        }
+        checksum += (lanes & 0xFFFF) + (lanes >> 16);
+        words += block;
+        word_count -= block;
+    }
+
+    bytes = reinterpret_cast<const uint8_t*>(words);
+    for (uint32_t i = 0; i < (length & 3); i++) {
+        checksum += bytes[i];
+    }
+    return checksum & 0xFFFF;
+}
+
+bool IsAssetsTableSorted(const mmap_assets_table* table, uint32_t count) {
+    for (uint32_t i = 1; i < count; i++) {
+        if (strncmp(table[i - 1].asset_name, table[i].asset_name, sizeof(table[i].asset_name)) > 0) {
+            return false;
+        }
+    }
+    return true;
+}
+
+const mmap_assets_table* FindAssetsTableEntry(const mmap_assets_table* table, uint32_t count, bool sorted,
+        const char* name) {
+    const size_t name_len = sizeof(mmap_assets_table::asset_name);
+    if (!sorted) {
+        for (uint32_t i = 0; i < count; i++) {
+            if (strncmp(table[i].asset_name, name, name_len) == 0) {
+                return &table[i];
+            }
+        }
+        return nullptr;
+    }
+
+    uint32_t low = 0;
+    uint32_t high = count;
+    while (low < high) {
+        uint32_t mid = low + (high - low) / 2;
+        int cmp = strncmp(table[mid].asset_name, name, name_len);
+        if (cmp == 0) {
+            return &table[mid];
+        } else if (cmp < 0) {
+            low = mid + 1;
+        } else {
+            high = mid;
+        }
+    }
+    return nullptr;
+}
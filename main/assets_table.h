@@ -0,0 +1,27 @@
+#ifndef ASSETS_TABLE_H
+#define ASSETS_TABLE_H
+
+#include <cstdint>
+
+// File table record of the assets partition, as written by the packers
+struct mmap_assets_table {
+    char asset_name[32];          /*!< Name of the asset */
+    uint32_t asset_size;          /*!< Size of the asset */
+    uint32_t asset_offset;        /*!< Offset of the asset */
+    uint16_t asset_width;         /*!< Width of the asset */
+    uint16_t asset_height;        /*!< Height of the asset */
+};
+
+// These depend on nothing else, so scripts/assets_bench can build them on a host
+
+// Sum of all bytes modulo 65536, the checksum the packers store in the partition header
+uint32_t CalculateAssetsChecksum(const char* data, uint32_t length);
+
+// Whether the records are in strncmp order of their names, as the current packers write them
+bool IsAssetsTableSorted(const mmap_assets_table* table, uint32_t count);
+
+// Binary search of a sorted table, linear scan otherwise. Returns nullptr if name is not found
+const mmap_assets_table* FindAssetsTableEntry(const mmap_assets_table* table, uint32_t count, bool sorted,
+    const char* name);
+
+#endif // ASSETS_TABLE_H
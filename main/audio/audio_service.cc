@@ -1,4 +1,5 @@
 #include "audio_service.h"
+#include "trace_recorder.h"
 #include <esp_log.h>
 #include <cstring>
 
@@ -20,6 +21,40 @@
 
 AudioService::AudioService() {
     event_group_ = xEventGroupCreate();
+
+    auto& metrics = Metrics::GetInstance();
+    metrics_.input_frames = metrics.GetCounter("audio.input_frames");
+    metrics_.decoded_frames = metrics.GetCounter("audio.decoded_frames");
+    metrics_.encoded_frames = metrics.GetCounter("audio.encoded_frames");
+    metrics_.played_frames = metrics.GetCounter("audio.played_frames");
+    metrics_.decode_time_us = metrics.GetHistogram("audio.decode_us", {1000, 2000, 4000, 8000, 16000, 32000});
+    metrics_.encode_time_us = metrics.GetHistogram("audio.encode_us", {2000, 4000, 8000, 16000, 32000, 64000});
+
+    auto decode_queue = metrics.GetGauge("audio.decode_queue");
+    auto send_queue = metrics.GetGauge("audio.send_queue");
+    auto encode_queue = metrics.GetGauge("audio.encode_queue");
+    auto playback_queue = metrics.GetGauge("audio.playback_queue");
+    auto queued_bytes = metrics.GetGauge("audio.queued_bytes");
+    metrics.AddCollector([this, decode_queue, send_queue, encode_queue, playback_queue, queued_bytes]() {
+        std::lock_guard<std::mutex> lock(audio_queue_mutex_);
+        decode_queue->Set(audio_decode_queue_.size());
+        send_queue->Set(audio_send_queue_.size());
+        encode_queue->Set(audio_encode_queue_.size());
+        playback_queue->Set(audio_playback_queue_.size());
+        // Heap held by the queued packets and PCM frames
+        size_t bytes = 0;
+        for (auto* queue : {&audio_decode_queue_, &audio_send_queue_, &audio_testing_queue_}) {
+            for (auto& packet : *queue) {
+                bytes += packet->payload.capacity();
+            }
+        }
+        for (auto* queue : {&audio_encode_queue_, &audio_playback_queue_}) {
+            for (auto& task : *queue) {
+                bytes += task->pcm.capacity() * sizeof(int16_t);
+            }
+        }
+        queued_bytes->Set(bytes);
+    });
 }
 
 AudioService::~AudioService() {
@@ -133,6 +168,7 @@ void AudioService::Stop() {
 }
 
 bool AudioService::ReadAudioData(std::vector<int16_t>& data, int sample_rate, int samples) {
+    TRACE_SCOPE("audio.read");
     if (!codec_->input_enabled()) {
         esp_timer_stop(audio_power_timer_);
         esp_timer_start_periodic(audio_power_timer_, AUDIO_POWER_CHECK_INTERVAL_MS * 1000);
@@ -174,7 +210,7 @@ bool AudioService::ReadAudioData(std::vector<int16_t>& data, int sample_rate, in
 
     /* Update the last input time */
     last_input_time_ = std::chrono::steady_clock::now();
-    debug_statistics_.input_count++;
+    metrics_.input_frames->Add();
 
 #if CONFIG_USE_AUDIO_DEBUGGER
     // 音频调试：发送原始音频数据
@@ -266,6 +302,7 @@ void AudioService::AudioOutputTask() {
 
         auto task = std::move(audio_playback_queue_.front());
         audio_playback_queue_.pop_front();
+        TRACE_COUNTER("audio.playback_queue", audio_playback_queue_.size());
         audio_queue_cv_.notify_all();
         lock.unlock();
 
@@ -274,11 +311,13 @@ void AudioService::AudioOutputTask() {
             esp_timer_start_periodic(audio_power_timer_, AUDIO_POWER_CHECK_INTERVAL_MS * 1000);
             codec_->EnableOutput(true);
         }
+        TRACE_BEGIN("audio.play");
         codec_->OutputData(task->pcm);
+        TRACE_END("audio.play");
 
         /* Update the last output time */
         last_output_time_ = std::chrono::steady_clock::now();
-        debug_statistics_.playback_count++;
+        metrics_.played_frames->Add();
 
 #if CONFIG_USE_SERVER_AEC
         /* Record the timestamp for server AEC */
@@ -316,7 +355,12 @@ void AudioService::OpusCodecTask() {
             task->timestamp = packet->timestamp;
 
             SetDecodeSampleRate(packet->sample_rate, packet->frame_duration);
-            if (opus_decoder_->Decode(std::move(packet->payload), task->pcm)) {
+            int64_t decode_start = esp_timer_get_time();
+            TRACE_BEGIN("audio.decode");
+            bool decoded = opus_decoder_->Decode(std::move(packet->payload), task->pcm);
+            TRACE_END("audio.decode");
+            metrics_.decode_time_us->Record(esp_timer_get_time() - decode_start);
+            if (decoded) {
                 // Resample if the sample rate is different
                 if (opus_decoder_->sample_rate() != codec_->output_sample_rate()) {
                     int target_size = output_resampler_.GetOutputSamples(task->pcm.size());
@@ -332,7 +376,7 @@ void AudioService::OpusCodecTask() {
                 ESP_LOGE(TAG, "Failed to decode audio");
                 lock.lock();
             }
-            debug_statistics_.decode_count++;
+            metrics_.decoded_frames->Add();
         }
         
         /* Encode the audio to send queue */
@@ -346,7 +390,12 @@ void AudioService::OpusCodecTask() {
             packet->frame_duration = OPUS_FRAME_DURATION_MS;
             packet->sample_rate = 16000;
             packet->timestamp = task->timestamp;
-            if (!opus_encoder_->Encode(std::move(task->pcm), packet->payload)) {
+            int64_t encode_start = esp_timer_get_time();
+            TRACE_BEGIN("audio.encode");
+            bool encoded = opus_encoder_->Encode(std::move(task->pcm), packet->payload);
+            TRACE_END("audio.encode");
+            metrics_.encode_time_us->Record(esp_timer_get_time() - encode_start);
+            if (!encoded) {
                 ESP_LOGE(TAG, "Failed to encode audio");
                 continue;
             }
@@ -363,7 +412,7 @@ void AudioService::OpusCodecTask() {
                 std::lock_guard<std::mutex> lock(audio_queue_mutex_);
                 audio_testing_queue_.push_back(std::move(packet));
             }
-            debug_statistics_.encode_count++;
+            metrics_.encoded_frames->Add();
             lock.lock();
         }
     }
@@ -419,6 +468,7 @@ bool AudioService::PushPacketToDecodeQueue(std::unique_ptr<AudioStreamPacket> pa
         }
     }
     audio_decode_queue_.push_back(std::move(packet));
+    TRACE_COUNTER("audio.decode_queue", audio_decode_queue_.size());
     audio_queue_cv_.notify_all();
     return true;
 }
@@ -430,6 +480,7 @@ std::unique_ptr<AudioStreamPacket> AudioService::PopPacketFromSendQueue() {
     }
     auto packet = std::move(audio_send_queue_.front());
     audio_send_queue_.pop_front();
+    TRACE_COUNTER("audio.send_queue", audio_send_queue_.size());
     audio_queue_cv_.notify_all();
     return packet;
 }
@@ -674,6 +725,11 @@ void AudioService::SetModelsList(srmodel_list_t* models_list) {
                 callbacks_.on_wake_word_detected(wake_word);
             }
         });
+        wake_word_->OnWakeWordCandidate([this]() {
+            if (callbacks_.on_wake_word_candidate) {
+                callbacks_.on_wake_word_candidate();
+            }
+        });
     }
 }
 
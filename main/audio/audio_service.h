@@ -22,6 +22,7 @@
 #include "processors/audio_debugger.h"
 #include "wake_word.h"
 #include "protocol.h"
+#include "metrics.h"
 
 
 /*
@@ -55,6 +56,7 @@
 struct AudioServiceCallbacks {
     std::function<void(void)> on_send_queue_available;
     std::function<void(const std::string&)> on_wake_word_detected;
+    std::function<void(void)> on_wake_word_candidate;
     std::function<void(bool)> on_vad_change;
     std::function<void(void)> on_audio_testing_queue_full;
 };
@@ -72,11 +74,14 @@ struct AudioTask {
     uint32_t timestamp;
 };
 
-struct DebugStatistics {
-    uint32_t input_count = 0;
-    uint32_t decode_count = 0;
-    uint32_t encode_count = 0;
-    uint32_t playback_count = 0;
+// Exported through Metrics
+struct AudioMetrics {
+    MetricCounter* input_frames;
+    MetricCounter* decoded_frames;
+    MetricCounter* encoded_frames;
+    MetricCounter* played_frames;
+    MetricHistogram* decode_time_us;
+    MetricHistogram* encode_time_us;
 };
 
 class AudioService {
@@ -121,7 +126,7 @@ private:
     OpusResampler input_resampler_;
     OpusResampler reference_resampler_;
     OpusResampler output_resampler_;
-    DebugStatistics debug_statistics_;
+    AudioMetrics metrics_;
     srmodel_list_t* models_list_ = nullptr;
 
     EventGroupHandle_t event_group_;
@@ -7,6 +7,11 @@
 
 #include <model_path.h>
 #include "audio_codec.h"
+#include "memory_policy.h"
+
+// Audio kept around a wake word for voiceprint, placed by the memory policy
+using WakeWordPcm = BufferVector<int16_t, BufferClass::kWakeWordHistory>;
+using WakeWordOpus = BufferVector<uint8_t, BufferClass::kWakeWordHistory>;
 
 class WakeWord {
 public:
@@ -15,6 +20,8 @@ public:
     virtual bool Initialize(AudioCodec* codec, srmodel_list_t* models_list) = 0;
     virtual void Feed(const std::vector<int16_t>& data) = 0;
     virtual void OnWakeWordDetected(std::function<void(const std::string& wake_word)> callback) = 0;
+    // Called when the engine hears speech that may turn into a wake word, used as a hint to pre-connect
+    virtual void OnWakeWordCandidate(std::function<void()> callback) {}
     virtual void Start() = 0;
     virtual void Stop() = 0;
     virtual size_t GetFeedSize() = 0;
@@ -94,6 +94,10 @@ void AfeWakeWord::OnWakeWordDetected(std::function<void(const std::string& wake_
     wake_word_detected_callback_ = callback;
 }
 
+void AfeWakeWord::OnWakeWordCandidate(std::function<void()> callback) {
+    wake_word_candidate_callback_ = callback;
+}
+
 void AfeWakeWord::Start() {
     xEventGroupSetBits(event_group_, DETECTION_RUNNING_EVENT);
 }
@@ -136,6 +140,16 @@ void AfeWakeWord::AudioDetectionTask() {
         // Store the wake word data for voice recognition, like who is speaking
         StoreWakeWordData(res->data, res->data_size / sizeof(int16_t));
 
+        // Report the start of speech as a wake word candidate, so the network can be warmed up
+        if (res->vad_state == VAD_SPEECH && !speech_detected_) {
+            speech_detected_ = true;
+            if (wake_word_candidate_callback_) {
+                wake_word_candidate_callback_();
+            }
+        } else if (res->vad_state == VAD_SILENCE) {
+            speech_detected_ = false;
+        }
+
         if (res->wakeup_state == WAKENET_DETECTED) {
             Stop();
             last_detected_wake_word_ = wake_words_[res->wakenet_model_index - 1];
@@ -149,7 +163,7 @@ void AfeWakeWord::AudioDetectionTask() {
 
 void AfeWakeWord::StoreWakeWordData(const int16_t* data, size_t samples) {
     // store audio data to wake_word_pcm_
-    wake_word_pcm_.emplace_back(std::vector<int16_t>(data, data + samples));
+    wake_word_pcm_.emplace_back(data, data + samples);
     // keep about 2 seconds of data, detect duration is 30ms (sample_rate == 16000, chunksize == 512)
     while (wake_word_pcm_.size() > 2000 / 30) {
         wake_word_pcm_.pop_front();
@@ -160,11 +174,11 @@ void AfeWakeWord::EncodeWakeWordData() {
     const size_t stack_size = 4096 * 7;
     wake_word_opus_.clear();
     if (wake_word_encode_task_stack_ == nullptr) {
-        wake_word_encode_task_stack_ = (StackType_t*)heap_caps_malloc(stack_size, MALLOC_CAP_SPIRAM);
+        wake_word_encode_task_stack_ = (StackType_t*)MemoryPolicy::Allocate(BufferClass::kTaskStack, stack_size);
         assert(wake_word_encode_task_stack_ != nullptr);
     }
     if (wake_word_encode_task_buffer_ == nullptr) {
-        wake_word_encode_task_buffer_ = (StaticTask_t*)heap_caps_malloc(sizeof(StaticTask_t), MALLOC_CAP_INTERNAL);
+        wake_word_encode_task_buffer_ = (StaticTask_t*)MemoryPolicy::Allocate(BufferClass::kTaskControlBlock, sizeof(StaticTask_t));
         assert(wake_word_encode_task_buffer_ != nullptr);
     }
 
@@ -177,9 +191,9 @@ void AfeWakeWord::EncodeWakeWordData() {
 
             int packets = 0;
             for (auto& pcm: this_->wake_word_pcm_) {
-                encoder->Encode(std::move(pcm), [this_](std::vector<uint8_t>&& opus) {
+                encoder->Encode(std::vector<int16_t>(pcm.begin(), pcm.end()), [this_](std::vector<uint8_t>&& opus) {
                     std::lock_guard<std::mutex> lock(this_->wake_word_mutex_);
-                    this_->wake_word_opus_.emplace_back(std::move(opus));
+                    this_->wake_word_opus_.emplace_back(opus.begin(), opus.end());
                     this_->wake_word_cv_.notify_all();
                 });
                 packets++;
@@ -190,7 +204,7 @@ void AfeWakeWord::EncodeWakeWordData() {
             ESP_LOGI(TAG, "Encode wake word opus %d packets in %ld ms", packets, (long)((end_time - start_time) / 1000));
 
             std::lock_guard<std::mutex> lock(this_->wake_word_mutex_);
-            this_->wake_word_opus_.push_back(std::vector<uint8_t>());
+            this_->wake_word_opus_.emplace_back();
             this_->wake_word_cv_.notify_all();
         }
         vTaskDelete(NULL);
@@ -202,7 +216,8 @@ bool AfeWakeWord::GetWakeWordOpus(std::vector<uint8_t>& opus) {
     wake_word_cv_.wait(lock, [this]() {
         return !wake_word_opus_.empty();
     });
-    opus.swap(wake_word_opus_.front());
+    auto& front = wake_word_opus_.front();
+    opus.assign(front.begin(), front.end());
     wake_word_opus_.pop_front();
     return !opus.empty();
 }
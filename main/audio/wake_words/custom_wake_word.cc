@@ -195,7 +195,7 @@ size_t CustomWakeWord::GetFeedSize() {
 
 void CustomWakeWord::StoreWakeWordData(const std::vector<int16_t>& data) {
     // store audio data to wake_word_pcm_
-    wake_word_pcm_.push_back(data);
+    wake_word_pcm_.emplace_back(data.begin(), data.end());
     // keep about 2 seconds of data, detect duration is 30ms (sample_rate == 16000, chunksize == 512)
     while (wake_word_pcm_.size() > 2000 / 30) {
         wake_word_pcm_.pop_front();
@@ -206,11 +206,11 @@ void CustomWakeWord::EncodeWakeWordData() {
     const size_t stack_size = 4096 * 7;
     wake_word_opus_.clear();
     if (wake_word_encode_task_stack_ == nullptr) {
-        wake_word_encode_task_stack_ = (StackType_t*)heap_caps_malloc(stack_size, MALLOC_CAP_SPIRAM);
+        wake_word_encode_task_stack_ = (StackType_t*)MemoryPolicy::Allocate(BufferClass::kTaskStack, stack_size);
         assert(wake_word_encode_task_stack_ != nullptr);
     }
     if (wake_word_encode_task_buffer_ == nullptr) {
-        wake_word_encode_task_buffer_ = (StaticTask_t*)heap_caps_malloc(sizeof(StaticTask_t), MALLOC_CAP_INTERNAL);
+        wake_word_encode_task_buffer_ = (StaticTask_t*)MemoryPolicy::Allocate(BufferClass::kTaskControlBlock, sizeof(StaticTask_t));
         assert(wake_word_encode_task_buffer_ != nullptr);
     }
 
@@ -223,9 +223,9 @@ void CustomWakeWord::EncodeWakeWordData() {
 
             int packets = 0;
             for (auto& pcm: this_->wake_word_pcm_) {
-                encoder->Encode(std::move(pcm), [this_](std::vector<uint8_t>&& opus) {
+                encoder->Encode(std::vector<int16_t>(pcm.begin(), pcm.end()), [this_](std::vector<uint8_t>&& opus) {
                     std::lock_guard<std::mutex> lock(this_->wake_word_mutex_);
-                    this_->wake_word_opus_.emplace_back(std::move(opus));
+                    this_->wake_word_opus_.emplace_back(opus.begin(), opus.end());
                     this_->wake_word_cv_.notify_all();
                 });
                 packets++;
@@ -236,7 +236,7 @@ void CustomWakeWord::EncodeWakeWordData() {
             ESP_LOGI(TAG, "Encode wake word opus %d packets in %ld ms", packets, (long)((end_time - start_time) / 1000));
 
             std::lock_guard<std::mutex> lock(this_->wake_word_mutex_);
-            this_->wake_word_opus_.push_back(std::vector<uint8_t>());
+            this_->wake_word_opus_.emplace_back();
             this_->wake_word_cv_.notify_all();
         }
         vTaskDelete(NULL);
@@ -248,7 +248,8 @@ bool CustomWakeWord::GetWakeWordOpus(std::vector<uint8_t>& opus) {
     wake_word_cv_.wait(lock, [this]() {
         return !wake_word_opus_.empty();
     });
-    opus.swap(wake_word_opus_.front());
+    auto& front = wake_word_opus_.front();
+    opus.assign(front.begin(), front.end());
     wake_word_opus_.pop_front();
     return !opus.empty();
 }
@@ -57,8 +57,8 @@ private:
     TaskHandle_t wake_word_encode_task_ = nullptr;
     StaticTask_t* wake_word_encode_task_buffer_ = nullptr;
     StackType_t* wake_word_encode_task_stack_ = nullptr;
-    std::deque<std::vector<int16_t>> wake_word_pcm_;
-    std::deque<std::vector<uint8_t>> wake_word_opus_;
+    BufferDeque<WakeWordPcm, BufferClass::kWakeWordHistory> wake_word_pcm_;
+    BufferDeque<WakeWordOpus, BufferClass::kWakeWordHistory> wake_word_opus_;
     std::mutex wake_word_mutex_;
     std::condition_variable wake_word_cv_;
 
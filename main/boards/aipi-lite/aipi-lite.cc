@@ -59,7 +59,7 @@ class AIPILite : public WifiBoard {
             esp_lcd_panel_disp_on_off(panel_, false);  // 关闭显示
             rtc_gpio_set_level(POWER_CONTROL_PIN, 0);
             rtc_gpio_hold_dis(POWER_CONTROL_PIN);
-            esp_deep_sleep_start();
+            Board::GetInstance().EnterDeepSleep();
         });
         power_save_timer_->SetEnabled(true);
     }
@@ -166,7 +166,7 @@ class AIPILite : public WifiBoard {
                 esp_lcd_panel_disp_on_off(panel_, false);  // 关闭显示
                 rtc_gpio_set_level(POWER_CONTROL_PIN, 0);
                 rtc_gpio_hold_dis(POWER_CONTROL_PIN);
-                esp_deep_sleep_start();
+                Board::GetInstance().EnterDeepSleep();
             }
         });
     }
@@ -9,6 +9,7 @@
 #include <esp_ota_ops.h>
 #include <esp_chip_info.h>
 #include <esp_random.h>
+#include <esp_sleep.h>
 
 #define TAG "Board"
 
@@ -22,6 +23,12 @@ Board::Board() {
     ESP_LOGI(TAG, "UUID=%s SKU=%s", uuid_.c_str(), BOARD_NAME);
 }
 
+void Board::EnterDeepSleep() {
+    // Writes are committed with a delay, they would be lost otherwise
+    Settings::Flush();
+    Board::GetInstance().EnterDeepSleep();
+}
+
 std::string Board::GenerateUuid() {
     // UUID v4 需要 16 字节的随机数据
     uint8_t uuid[16];
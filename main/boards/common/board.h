@@ -82,6 +82,10 @@ public:
     virtual void SetPowerSaveLevel(PowerSaveLevel level) = 0;
     virtual std::string GetBoardJson() = 0;
     virtual std::string GetDeviceStatusJson() = 0;
+
+    // Deep sleep skips the shutdown handlers, so boards enter it through here instead of
+    // calling esp_deep_sleep_start() directly
+    void EnterDeepSleep();
 };
 
 #define DECLARE_BOARD(BOARD_CLASS_NAME) \
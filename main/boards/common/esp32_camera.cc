@@ -21,6 +21,7 @@
 #include "jpg/jpeg_to_image.h"
 #include "lvgl_display.h"
 #include "mcp_server.h"
+#include "memory_policy.h"
 #include "system_info.h"
 
 #ifdef CONFIG_XIAOZHI_ENABLE_CAMERA_DEBUG_MODE
@@ -408,7 +409,7 @@ bool Esp32Camera::Capture() {
                 frame_.format = 0;
             }
             frame_.len = buf.bytesused;
-            frame_.data = (uint8_t*)heap_caps_malloc(frame_.len, MALLOC_CAP_SPIRAM | MALLOC_CAP_8BIT);
+            frame_.data = (uint8_t*)MemoryPolicy::Allocate(BufferClass::kCameraFrame, frame_.len);
             if (!frame_.data) {
                 ESP_LOGE(TAG, "alloc frame copy failed: need allocate %lu bytes", buf.bytesused);
                 if (ioctl(video_fd_, VIDIOC_QBUF, &buf) != 0) {
@@ -491,8 +492,7 @@ bool Esp32Camera::Capture() {
 
 #ifdef CONFIG_XIAOZHI_ENABLE_ROTATE_CAMERA_IMAGE
 #ifndef CONFIG_SOC_PPA_SUPPORTED
-            uint8_t* rotate_dst =
-                (uint8_t*)heap_caps_aligned_alloc(64, frame_.len, MALLOC_CAP_SPIRAM | MALLOC_CAP_8BIT);
+            uint8_t* rotate_dst = (uint8_t*)MemoryPolicy::Allocate(BufferClass::kCameraFrame, frame_.len, 64);
             if (rotate_dst == nullptr) {
                 ESP_LOGE(TAG, "Failed to allocate memory for rotate image");
                 if (ioctl(video_fd_, VIDIOC_QBUF, &buf) != 0) {
@@ -584,8 +584,7 @@ bool Esp32Camera::Capture() {
                     break;
                 case V4L2_PIX_FMT_YUYV: {
                     ESP_LOGW(TAG, "YUYV format is not supported for PPA rotation, using software conversion to RGB888");
-                    rotate_src = (uint8_t*)heap_caps_malloc(frame_.width * frame_.height * 3,
-                                                            MALLOC_CAP_SPIRAM | MALLOC_CAP_8BIT);
+                    rotate_src = (uint8_t*)MemoryPolicy::Allocate(BufferClass::kCameraFrame, frame_.width * frame_.height * 3);
                     if (rotate_src == nullptr) {
                         ESP_LOGE(TAG, "Failed to allocate memory for rotate image");
                         if (ioctl(video_fd_, VIDIOC_QBUF, &buf) != 0) {
@@ -747,7 +746,7 @@ bool Esp32Camera::Capture() {
             case V4L2_PIX_FMT_YUV420:
             case V4L2_PIX_FMT_RGB24: {
                 color_format = LV_COLOR_FORMAT_RGB565;
-                data = (uint8_t*)heap_caps_malloc(w * h * 2, MALLOC_CAP_SPIRAM | MALLOC_CAP_8BIT);
+                data = (uint8_t*)MemoryPolicy::Allocate(BufferClass::kCameraFrame, w * h * 2);
                 if (data == nullptr) {
                     ESP_LOGE(TAG, "Failed to allocate memory for preview image");
                     return false;
@@ -791,7 +790,7 @@ bool Esp32Camera::Capture() {
             }
 
             case V4L2_PIX_FMT_RGB565:
-                data = (uint8_t*)heap_caps_malloc(w * h * 2, MALLOC_CAP_SPIRAM | MALLOC_CAP_8BIT);
+                data = (uint8_t*)MemoryPolicy::Allocate(BufferClass::kCameraFrame, w * h * 2);
                 if (data == nullptr) {
                     ESP_LOGE(TAG, "Failed to allocate memory for preview image");
                     return false;
@@ -918,7 +917,7 @@ std::string Esp32Camera::Explain(const std::string& question) {
                 auto jpeg_queue = static_cast<QueueHandle_t>(arg);
                 JpegChunk chunk = {.data = nullptr, .len = len};
                 if (index == 0 && data != nullptr && len > 0) {
-                    chunk.data = (uint8_t*)heap_caps_aligned_alloc(16, len, MALLOC_CAP_SPIRAM | MALLOC_CAP_8BIT);
+                    chunk.data = (uint8_t*)MemoryPolicy::Allocate(BufferClass::kJpeg, len, 16);
                     if (chunk.data == nullptr) {
                         ESP_LOGE(TAG, "Failed to allocate %zu bytes for JPEG chunk", len);
                         chunk.len = 0;
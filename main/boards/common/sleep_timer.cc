@@ -118,7 +118,7 @@ void SleepTimer::CheckTimer() {
             on_enter_deep_sleep_mode_();
         }
 
-        esp_deep_sleep_start();
+        Board::GetInstance().EnterDeepSleep();
     }
 }
 
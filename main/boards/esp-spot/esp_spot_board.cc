@@ -316,12 +316,12 @@ private:
             return;
         }
         sleep_timer_ = new SleepTimer(-1, kDeepSleepTimeoutSeconds);
-        sleep_timer_->OnEnterDeepSleepMode([this]() { EnterDeepSleep(); });
+        sleep_timer_->OnEnterDeepSleepMode([this]() { EnterImuWakeupDeepSleep(); });
         sleep_timer_->SetEnabled(true);
         ESP_LOGI(TAG, "Deep sleep timer enabled, timeout=%ds", kDeepSleepTimeoutSeconds);
     }
 
-    void EnterDeepSleep() {
+    void EnterImuWakeupDeepSleep() {
         if (!imu_ready_) {
             ESP_LOGW(TAG, "Skip deep sleep because IMU is not ready");
             return;
@@ -340,7 +340,7 @@ private:
         const uint64_t wakeup_mask = (1ULL << KEY_BUTTON_GPIO) | (1ULL << IMU_INT_GPIO);
         ESP_ERROR_CHECK(esp_sleep_enable_ext1_wakeup(wakeup_mask, ESP_EXT1_WAKEUP_ANY_HIGH));
         ESP_LOGI(TAG, "Entering deep sleep, waiting for key or wrist gesture");
-        esp_deep_sleep_start();
+        EnterDeepSleep();
     }
 #endif  // IMU_INT_GPIO
 
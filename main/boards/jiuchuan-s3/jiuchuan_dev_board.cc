@@ -105,7 +105,7 @@ private:
                 ESP_ERROR_CHECK(esp_sleep_enable_ext0_wakeup(PWR_BUTTON_GPIO, 0));
                 ESP_ERROR_CHECK(rtc_gpio_pullup_en(PWR_BUTTON_GPIO));  // 内部上拉
                 ESP_ERROR_CHECK(rtc_gpio_pulldown_dis(PWR_BUTTON_GPIO));
-                esp_deep_sleep_start();
+                Board::GetInstance().EnterDeepSleep();
             }
         }
         #endif
@@ -128,7 +128,7 @@ private:
             ESP_ERROR_CHECK(rtc_gpio_pulldown_dis(PWR_BUTTON_GPIO));
 
             esp_lcd_panel_disp_on_off(panel, false); //关闭显示
-            esp_deep_sleep_start();
+            Board::GetInstance().EnterDeepSleep();
             #else
             rtc_gpio_set_level(PWR_EN_GPIO, 0);
             rtc_gpio_hold_dis(PWR_EN_GPIO);
@@ -19,6 +19,7 @@
 #include "config.h"
 
 #include "board.h"
+#include "memory_policy.h"
 
 #define TAG "CustomLcdDisplay"
 
@@ -109,7 +110,7 @@ CustomLcdDisplay::CustomLcdDisplay(esp_lcd_panel_io_handle_t panel_io, esp_lcd_p
     port_cfg.timer_period_ms = 50;
     lvgl_port_init(&port_cfg);
     trans_done_sem = xSemaphoreCreateBinary();
-    trans_buf_1 = (uint16_t *)heap_caps_malloc(LVGL_DMA_BUFF_LEN, MALLOC_CAP_DMA);
+    trans_buf_1 = (uint16_t *)MemoryPolicy::Allocate(BufferClass::kDmaTransfer, LVGL_DMA_BUFF_LEN);
 
     uint32_t buffer_size = 0;
     lv_color_t *buf1 = NULL;
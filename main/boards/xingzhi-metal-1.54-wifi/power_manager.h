@@ -306,7 +306,7 @@ public:
                 ESP_LOGI("PowerManager","触发开关机控制");
             }
             ESP_LOGI("PowerManager","关机失败，进入深睡眠");
-            esp_deep_sleep_start();
+            Board::GetInstance().EnterDeepSleep();
         } else {
             ESP_LOGI("PowerManager","检测到插入usb，无法关机"); 
         }
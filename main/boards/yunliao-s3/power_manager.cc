@@ -6,6 +6,7 @@
 #include <esp_sleep.h>
 #include "esp_log.h"
 #include "settings.h"
+#include "board.h"
 
 #define TAG "PowerManager"
 
@@ -199,5 +200,5 @@ void PowerManager::Sleep() {
     ESP_ERROR_CHECK(esp_sleep_enable_ext0_wakeup(BOOT_BUTTON_PIN, 0));
     ESP_ERROR_CHECK(rtc_gpio_pulldown_dis(BOOT_BUTTON_PIN));
     ESP_ERROR_CHECK(rtc_gpio_pullup_en(BOOT_BUTTON_PIN));
-    esp_deep_sleep_start();
+    Board::GetInstance().EnterDeepSleep();
 } 
\ No newline at end of file
@@ -0,0 +1,64 @@
+#include "boot_profiler.h"
+
+#include <algorithm>
+#include <cstring>
+#include <esp_log.h>
+#include <esp_timer.h>
+#include <freertos/FreeRTOS.h>
+#include <freertos/task.h>
+
+#define TAG "BootProfiler"
+
+void BootProfiler::Begin(const char* phase) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (reported_ || phase_count_ >= BOOT_PROFILER_MAX_PHASES) {
+        return;
+    }
+    phases_[phase_count_++] = Phase{
+        .name = phase,
+        .task = pcTaskGetName(nullptr),
+        .start_us = esp_timer_get_time(),
+        .end_us = 0,
+    };
+}
+
+void BootProfiler::End(const char* phase) {
+    auto now = esp_timer_get_time();
+    std::lock_guard<std::mutex> lock(mutex_);
+    // Search backwards, a phase name may be reused and the latest one is still open
+    for (int i = phase_count_ - 1; i >= 0; i--) {
+        if (phases_[i].end_us == 0 && strcmp(phases_[i].name, phase) == 0) {
+            phases_[i].end_us = now;
+            return;
+        }
+    }
+}
+
+void BootProfiler::Report() {
+    auto now = esp_timer_get_time();
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (reported_) {
+        return;
+    }
+    reported_ = true;
+
+    std::sort(phases_, phases_ + phase_count_, [](const Phase& a, const Phase& b) {
+        return a.start_us < b.start_us;
+    });
+
+    // Time covered by at least one phase, overlapping phases are counted once
+    int64_t busy_us = 0;
+    int64_t covered_until = 0;
+    ESP_LOGI(TAG, "%-24s %-12s %8s %8s", "phase", "task", "start", "ms");
+    for (int i = 0; i < phase_count_; i++) {
+        auto& phase = phases_[i];
+        int64_t end_us = phase.end_us != 0 ? phase.end_us : now;
+        ESP_LOGI(TAG, "%-24s %-12s %8d %8d%s", phase.name, phase.task, int(phase.start_us / 1000),
+            int((end_us - phase.start_us) / 1000), phase.end_us != 0 ? "" : " (unfinished)");
+        if (end_us > covered_until) {
+            busy_us += end_us - std::max(phase.start_us, covered_until);
+            covered_until = end_us;
+        }
+    }
+    ESP_LOGI(TAG, "Ready in %d ms, %d ms inside profiled phases", int(now / 1000), int(busy_us / 1000));
+}
@@ -0,0 +1,62 @@
+#ifndef BOOT_PROFILER_H
+#define BOOT_PROFILER_H
+
+#include <cstdint>
+#include <mutex>
+
+#define BOOT_PROFILER_MAX_PHASES 32
+
+/**
+ * BootProfiler - Records where time goes between app_main and the device being ready
+ *
+ * Phases may run on different tasks and overlap, so each one keeps its own start
+ * and end time (microseconds since boot) together with the task that ran it.
+ * Report() prints them once, ordered by start time, when the device becomes ready.
+ */
+class BootProfiler {
+public:
+    static BootProfiler& GetInstance() {
+        static BootProfiler instance;
+        return instance;
+    }
+
+    void Begin(const char* phase);
+    void End(const char* phase);
+    void Report();
+
+private:
+    BootProfiler() = default;
+    BootProfiler(const BootProfiler&) = delete;
+    BootProfiler& operator=(const BootProfiler&) = delete;
+
+    struct Phase {
+        const char* name;
+        const char* task;
+        int64_t start_us;
+        int64_t end_us;
+    };
+
+    std::mutex mutex_;
+    Phase phases_[BOOT_PROFILER_MAX_PHASES];
+    int phase_count_ = 0;
+    bool reported_ = false;
+};
+
+// Times the enclosing scope as a boot phase, the name must be a string literal
+class BootPhase {
+public:
+    explicit BootPhase(const char* name) : name_(name) {
+        BootProfiler::GetInstance().Begin(name_);
+    }
+    ~BootPhase() {
+        BootProfiler::GetInstance().End(name_);
+    }
+
+    BootPhase(const BootPhase&) = delete;
+    BootPhase& operator=(const BootPhase&) = delete;
+
+private:
+    const char* name_;
+};
+
+#endif // BOOT_PROFILER_H
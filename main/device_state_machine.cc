@@ -1,7 +1,9 @@
 #include "device_state_machine.h"
+#include "trace_recorder.h"
 
 #include <algorithm>
 #include <esp_log.h>
+#include <esp_timer.h>
 
 static const char* TAG = "StateMachine";
 
@@ -21,7 +23,7 @@ static const char* const STATE_STRINGS[] = {
     "invalid_state"
 };
 
-DeviceStateMachine::DeviceStateMachine() {
+DeviceStateMachine::DeviceStateMachine() : timing_(esp_timer_get_time) {
 }
 
 const char* DeviceStateMachine::GetStateName(DeviceState state) {
@@ -117,11 +119,15 @@ bool DeviceStateMachine::TransitionTo(DeviceState new_state) {
     if (!IsValidTransition(old_state, new_state)) {
         ESP_LOGW(TAG, "Invalid state transition: %s -> %s",
                  GetStateName(old_state), GetStateName(new_state));
+        timing_.OnInvalidTransition();
         return false;
     }
 
     // Perform transition
+    TRACE_SCOPE("state.transition");
     current_state_.store(new_state);
+    timing_.OnTransition(old_state, new_state);
+    TRACE_INSTANT(GetStateName(new_state), old_state);
     ESP_LOGI(TAG, "State: %s -> %s",
              GetStateName(old_state), GetStateName(new_state));
 
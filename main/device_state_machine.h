@@ -7,6 +7,7 @@
 #include <vector>
 
 #include "device_state.h"
+#include "device_state_timing.h"
 
 /**
  * DeviceStateMachine - Manages device state transitions with validation
@@ -63,11 +64,17 @@ public:
      */
     static const char* GetStateName(DeviceState state);
 
+    /**
+     * Dwell times, transition counts and responsiveness of key transitions, see DeviceStateTiming
+     */
+    DeviceStateTiming& timing() { return timing_; }
+
 private:
     std::atomic<DeviceState> current_state_{kDeviceStateUnknown};
     std::vector<std::pair<int, StateCallback>> listeners_;
     int next_listener_id_{0};
     std::mutex mutex_;
+    DeviceStateTiming timing_;
 
     /**
      * Check if transition from source to target is valid
@@ -0,0 +1,116 @@
+#include "device_state_timing.h"
+
+#include <algorithm>
+
+// Metric names must outlive the registry, in the order of DeviceState
+static const char* const DWELL_METRICS[DEVICE_STATE_COUNT] = {
+    "state.unknown.dwell_ms",
+    "state.starting.dwell_ms",
+    "state.wifi_configuring.dwell_ms",
+    "state.idle.dwell_ms",
+    "state.connecting.dwell_ms",
+    "state.listening.dwell_ms",
+    "state.speaking.dwell_ms",
+    "state.upgrading.dwell_ms",
+    "state.activating.dwell_ms",
+    "state.audio_testing.dwell_ms",
+    "state.fatal_error.dwell_ms",
+};
+
+static const char* const ENTERED_METRICS[DEVICE_STATE_COUNT] = {
+    "state.unknown.entered",
+    "state.starting.entered",
+    "state.wifi_configuring.entered",
+    "state.idle.entered",
+    "state.connecting.entered",
+    "state.listening.entered",
+    "state.speaking.entered",
+    "state.upgrading.entered",
+    "state.activating.entered",
+    "state.audio_testing.entered",
+    "state.fatal_error.entered",
+};
+
+DeviceStateTiming::DeviceStateTiming(Clock clock) : clock_(std::move(clock)) {
+    state_entered_time_ = clock_();
+
+    auto& metrics = Metrics::GetInstance();
+    for (int state = 0; state < DEVICE_STATE_COUNT; state++) {
+        dwell_ms_[state] = metrics.GetHistogram(DWELL_METRICS[state], {100, 500, 1000, 5000, 10000, 30000, 60000, 300000});
+        entered_[state] = metrics.GetCounter(ENTERED_METRICS[state]);
+    }
+    transitions_ = metrics.GetCounter("state.transitions");
+    invalid_transitions_ = metrics.GetCounter("state.invalid_transitions");
+    idle_to_listening_ms_ = metrics.GetHistogram("state.idle_to_listening_ms", {200, 500, 1000, 2000, 5000});
+    speaking_to_listening_ms_ = metrics.GetHistogram("state.speaking_to_listening_ms", {50, 100, 200, 500, 1000});
+    wake_to_uplink_ms_ = metrics.GetHistogram("app.wake_to_uplink_ms", {200, 500, 1000, 2000, 5000});
+}
+
+int32_t DeviceStateTiming::ElapsedMs(int64_t from_us, int64_t to_us) {
+    return static_cast<int32_t>(std::min<int64_t>((to_us - from_us) / 1000, INT32_MAX));
+}
+
+void DeviceStateTiming::OnTransition(DeviceState from, DeviceState to) {
+    int64_t now = clock_();
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (from >= 0 && from < DEVICE_STATE_COUNT) {
+        dwell_ms_[from]->Record(ElapsedMs(state_entered_time_, now));
+    }
+    if (to >= 0 && to < DEVICE_STATE_COUNT) {
+        entered_[to]->Add();
+    }
+    transitions_->Add();
+    state_entered_time_ = now;
+
+    settle_histogram_ = nullptr;
+    if (from == kDeviceStateIdle && to == kDeviceStateConnecting) {
+        connect_start_time_ = now;
+    } else if (to == kDeviceStateListening) {
+        if (from == kDeviceStateConnecting && connect_start_time_ != 0) {
+            settle_histogram_ = idle_to_listening_ms_;
+            settle_start_time_ = connect_start_time_;
+        } else if (from == kDeviceStateSpeaking) {
+            settle_histogram_ = speaking_to_listening_ms_;
+            settle_start_time_ = now;
+        }
+        connect_start_time_ = 0;
+    } else if (to != kDeviceStateConnecting) {
+        connect_start_time_ = 0;
+    }
+
+    // Back to idle before any audio went up, the wake word led nowhere
+    if (to == kDeviceStateIdle) {
+        wake_word_time_ = 0;
+    }
+}
+
+void DeviceStateTiming::OnInvalidTransition() {
+    invalid_transitions_->Add();
+}
+
+void DeviceStateTiming::OnStateSettled() {
+    int64_t now = clock_();
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (settle_histogram_ != nullptr) {
+        settle_histogram_->Record(ElapsedMs(settle_start_time_, now));
+        settle_histogram_ = nullptr;
+    }
+}
+
+void DeviceStateTiming::OnWakeWordDetected() {
+    wake_word_time_ = clock_();
+}
+
+void DeviceStateTiming::OnWakeWordCancelled() {
+    wake_word_time_ = 0;
+}
+
+int DeviceStateTiming::OnUplinkAudioSent() {
+    int64_t detected_time = wake_word_time_.exchange(0);
+    if (detected_time == 0) {
+        return -1;
+    }
+    int32_t elapsed_ms = ElapsedMs(detected_time, clock_());
+    wake_to_uplink_ms_->Record(elapsed_ms);
+    return elapsed_ms;
+}
@@ -0,0 +1,71 @@
+#ifndef DEVICE_STATE_TIMING_H
+#define DEVICE_STATE_TIMING_H
+
+#include <atomic>
+#include <cstdint>
+#include <functional>
+#include <mutex>
+
+#include "device_state.h"
+#include "metrics.h"
+
+#define DEVICE_STATE_COUNT (kDeviceStateFatalError + 1)
+
+/**
+ * DeviceStateTiming - Responsiveness metrics of the device state machine
+ *
+ * Fed by DeviceStateMachine on every transition, it publishes:
+ *   state.<state>.dwell_ms          histogram of the time spent in each state
+ *   state.<state>.entered           counter of the entries into each state
+ *   state.transitions               counter of all transitions, and state.invalid_transitions
+ *   state.idle_to_listening_ms      idle -> connecting until listening is settled
+ *   state.speaking_to_listening_ms  speaking -> listening until listening is settled
+ *   app.wake_to_uplink_ms           wake word until the first uplink audio packet
+ *
+ * A state is settled once the application has finished reacting to it, such as
+ * the microphone being open when listening. Time comes from the clock passed to
+ * the constructor, so the logic runs on a host with a virtual clock.
+ */
+class DeviceStateTiming {
+public:
+    // Returns microseconds, esp_timer_get_time() on the device
+    using Clock = std::function<int64_t()>;
+
+    explicit DeviceStateTiming(Clock clock);
+
+    DeviceStateTiming(const DeviceStateTiming&) = delete;
+    DeviceStateTiming& operator=(const DeviceStateTiming&) = delete;
+
+    void OnTransition(DeviceState from, DeviceState to);
+    void OnInvalidTransition();
+    void OnStateSettled();
+
+    void OnWakeWordDetected();
+    void OnWakeWordCancelled();
+    // Returns the time since the wake word in ms for the first packet after it, -1 otherwise
+    int OnUplinkAudioSent();
+
+private:
+    static int32_t ElapsedMs(int64_t from_us, int64_t to_us);
+
+    Clock clock_;
+    std::mutex mutex_;
+    int64_t state_entered_time_;
+    // Set when idle is left for connecting, cleared when the attempt ends
+    int64_t connect_start_time_ = 0;
+    // The journey completed when the current state is settled
+    MetricHistogram* settle_histogram_ = nullptr;
+    int64_t settle_start_time_ = 0;
+    // Checked on every uplink packet, so kept outside of the mutex
+    std::atomic<int64_t> wake_word_time_{0};
+
+    MetricHistogram* dwell_ms_[DEVICE_STATE_COUNT];
+    MetricCounter* entered_[DEVICE_STATE_COUNT];
+    MetricCounter* transitions_;
+    MetricCounter* invalid_transitions_;
+    MetricHistogram* idle_to_listening_ms_;
+    MetricHistogram* speaking_to_listening_ms_;
+    MetricHistogram* wake_to_uplink_ms_;
+};
+
+#endif // DEVICE_STATE_TIMING_H
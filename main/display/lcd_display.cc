@@ -2,6 +2,7 @@
 #include "gif/lvgl_gif.h"
 #include "settings.h"
 #include "lvgl_theme.h"
+#include "trace_recorder.h"
 #include "assets/lang_config.h"
 
 #include <vector>
@@ -348,10 +349,17 @@ LcdDisplay::~LcdDisplay() {
 }
 
 bool LcdDisplay::Lock(int timeout_ms) {
-    return lvgl_port_lock(timeout_ms);
+    TRACE_BEGIN("display.lock_wait");
+    bool locked = lvgl_port_lock(timeout_ms);
+    TRACE_END("display.lock_wait");
+    if (locked) {
+        TRACE_BEGIN("display.locked");
+    }
+    return locked;
 }
 
 void LcdDisplay::Unlock() {
+    TRACE_END("display.locked");
     lvgl_port_unlock();
 }
 
@@ -500,6 +508,7 @@ void LcdDisplay::SetupUI() {
 #define  MAX_MESSAGES 20
 #endif
 void LcdDisplay::SetChatMessage(const char* role, const char* content) {
+    TRACE_SCOPE("display.set_chat_message");
     DisplayLockGuard lock(this);
     if (content_ == nullptr) {
         return;
@@ -962,6 +971,7 @@ void LcdDisplay::SetPreviewImage(std::unique_ptr<LvglImage> image) {
 }
 
 void LcdDisplay::SetChatMessage(const char* role, const char* content) {
+    TRACE_SCOPE("display.set_chat_message");
     DisplayLockGuard lock(this);
     if (chat_message_label_ == nullptr) {
         return;
@@ -970,7 +980,17 @@ void LcdDisplay::SetChatMessage(const char* role, const char* content) {
 }
 #endif
 
+void LcdDisplay::SetShownEmoji(std::shared_ptr<EmojiCollection> collection, const LvglImage* image) {
+    // Data of the previous emoji may be dropped now that it is no longer referenced by LVGL
+    if (shown_emoji_ != nullptr && shown_emoji_ != image) {
+        shown_emoji_->Release();
+    }
+    shown_emoji_ = image;
+    shown_emoji_collection_ = collection;
+}
+
 void LcdDisplay::SetEmotion(const char* emotion) {
+    TRACE_SCOPE("display.set_emotion");
     // Stop any running GIF animation
     if (gif_controller_) {
         DisplayLockGuard lock(this);
@@ -984,18 +1004,23 @@ void LcdDisplay::SetEmotion(const char* emotion) {
 
     auto emoji_collection = static_cast<LvglTheme*>(current_theme_)->emoji_collection();
     auto image = emoji_collection != nullptr ? emoji_collection->GetEmojiImage(emotion) : nullptr;
+
+    DisplayLockGuard lock(this);
+    // Compressed emoji are loaded here, fall back to the icon if that fails
+    if (image != nullptr && image->image_dsc() == nullptr) {
+        image = nullptr;
+    }
     if (image == nullptr) {
         const char* utf8 = font_awesome_get_utf8(emotion);
         if (utf8 != nullptr && emoji_label_ != nullptr) {
-            DisplayLockGuard lock(this);
             lv_label_set_text(emoji_label_, utf8);
             lv_obj_add_flag(emoji_image_, LV_OBJ_FLAG_HIDDEN);
             lv_obj_remove_flag(emoji_label_, LV_OBJ_FLAG_HIDDEN);
+            SetShownEmoji(nullptr, nullptr);
         }
         return;
     }
 
-    DisplayLockGuard lock(this);
     if (image->IsGif()) {
         // Create new GIF controller
         gif_controller_ = std::make_unique<LvglGif>(image->image_dsc());
@@ -1022,6 +1047,7 @@ void LcdDisplay::SetEmotion(const char* emotion) {
         lv_obj_add_flag(emoji_label_, LV_OBJ_FLAG_HIDDEN);
         lv_obj_remove_flag(emoji_image_, LV_OBJ_FLAG_HIDDEN);
     }
+    SetShownEmoji(emoji_collection, image);
 
 #if CONFIG_USE_WECHAT_MESSAGE_STYLE
     // In WeChat message style, if emotion is neutral, don't display it
@@ -1040,6 +1066,7 @@ void LcdDisplay::SetEmotion(const char* emotion) {
 }
 
 void LcdDisplay::SetTheme(Theme* theme) {
+    TRACE_SCOPE("display.set_theme");
     DisplayLockGuard lock(this);
     
     auto lvgl_theme = static_cast<LvglTheme*>(theme);
@@ -13,6 +13,8 @@
 
 #define PREVIEW_IMAGE_DURATION_MS 5000
 
+class EmojiCollection;
+
 
 class LcdDisplay : public LvglDisplay {
 protected:
@@ -30,6 +32,9 @@ protected:
     lv_obj_t* emoji_label_ = nullptr;
     lv_obj_t* emoji_image_ = nullptr;
     std::unique_ptr<LvglGif> gif_controller_ = nullptr;
+    // The emoji image being shown, and the collection owning it
+    const LvglImage* shown_emoji_ = nullptr;
+    std::shared_ptr<EmojiCollection> shown_emoji_collection_;
     lv_obj_t* emoji_box_ = nullptr;
     lv_obj_t* chat_message_label_ = nullptr;
     esp_timer_handle_t preview_timer_ = nullptr;
@@ -38,6 +43,7 @@ protected:
 
     void InitializeLcdThemes();
     void SetupUI();
+    void SetShownEmoji(std::shared_ptr<EmojiCollection> collection, const LvglImage* image);
     virtual bool Lock(int timeout_ms = 0) override;
     virtual void Unlock() override;
 
@@ -215,7 +215,7 @@ void LvglDisplay::SetPowerSaveMode(bool on) {
     }
 }
 
-bool LvglDisplay::SnapshotToJpeg(std::string& jpeg_data, int quality) {
+bool LvglDisplay::SnapshotToJpeg(JpegData& jpeg_data, int quality) {
 #if CONFIG_LV_USE_SNAPSHOT
     DisplayLockGuard lock(this);
 
@@ -239,7 +239,7 @@ bool LvglDisplay::SnapshotToJpeg(std::string& jpeg_data, int quality) {
     // Use callback-based JPEG encoder to further save memory
     bool ret = image_to_jpeg_cb((uint8_t*)draw_buffer->data, draw_buffer->data_size, draw_buffer->header.w, draw_buffer->header.h, V4L2_PIX_FMT_RGB565, quality,
         [](void *arg, size_t index, const void *data, size_t len) -> size_t {
-        std::string* output = static_cast<std::string*>(arg);
+        auto output = static_cast<JpegData*>(arg);
         if (data && len > 0) {
             output->append(static_cast<const char*>(data), len);
         }
@@ -3,6 +3,7 @@
 
 #include "display.h"
 #include "lvgl_image.h"
+#include "memory_policy.h"
 
 #include <lvgl.h>
 #include <esp_timer.h>
@@ -12,6 +13,9 @@
 #include <string>
 #include <chrono>
 
+// Encoded JPEG image, placed by the memory policy
+using JpegData = BufferString<BufferClass::kJpeg>;
+
 class LvglDisplay : public Display {
 public:
     LvglDisplay();
@@ -23,7 +27,7 @@ public:
     virtual void SetPreviewImage(std::unique_ptr<LvglImage> image);
     virtual void UpdateStatusBar(bool update_all = false);
     virtual void SetPowerSaveMode(bool on);
-    virtual bool SnapshotToJpeg(std::string& jpeg_data, int quality = 80);
+    virtual bool SnapshotToJpeg(JpegData& jpeg_data, int quality = 80);
 
 protected:
     esp_pm_lock_handle_t pm_lock_ = nullptr;
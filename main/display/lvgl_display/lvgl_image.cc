@@ -61,4 +61,41 @@ LvglAllocatedImage::~LvglAllocatedImage() {
         heap_caps_free((void*)image_dsc_.data);
         image_dsc_.data = nullptr;
     }
-}
\ No newline at end of file
+}
+
+bool LvglLazyImage::Load() const {
+    if (data_ != nullptr) {
+        return true;
+    }
+    size_t size = 0;
+    data_ = loader_(size);
+    if (data_ == nullptr) {
+        return false;
+    }
+    bzero(&image_dsc_, sizeof(image_dsc_));
+    image_dsc_.data_size = size;
+    image_dsc_.data = static_cast<const uint8_t*>(data_.get());
+    image_dsc_.header.magic = LV_IMAGE_HEADER_MAGIC;
+    image_dsc_.header.cf = LV_COLOR_FORMAT_RAW_ALPHA;
+    return true;
+}
+
+const lv_img_dsc_t* LvglLazyImage::image_dsc() const {
+    return Load() ? &image_dsc_ : nullptr;
+}
+
+bool LvglLazyImage::IsGif() const {
+    if (!Load() || image_dsc_.data_size < 3) {
+        return false;
+    }
+    auto ptr = image_dsc_.data;
+    return ptr[0] == 'G' && ptr[1] == 'I' && ptr[2] == 'F';
+}
+
+void LvglLazyImage::Release() const {
+    if (data_ != nullptr) {
+        // Drop what LVGL decoded from the data along with it
+        lv_image_cache_drop(&image_dsc_);
+        data_.reset();
+    }
+}
@@ -2,12 +2,17 @@
 
 #include <lvgl.h>
 
+#include <functional>
+#include <memory>
+
 
 // Wrap around lv_img_dsc_t
 class LvglImage {
 public:
     virtual const lv_img_dsc_t* image_dsc() const = 0;
     virtual bool IsGif() const { return false; }
+    // Called when the image is no longer shown, data loaded on demand may be dropped
+    virtual void Release() const {}
     virtual ~LvglImage() = default;
 };
 
@@ -50,4 +55,23 @@ public:
 
 private:
     lv_img_dsc_t image_dsc_;
-};
\ No newline at end of file
+};
+
+// Image whose data is loaded when it is shown, such as a compressed asset
+class LvglLazyImage : public LvglImage {
+public:
+    // Returns the image data and sets its size, or nullptr when it cannot be loaded
+    using Loader = std::function<std::shared_ptr<const void>(size_t& size)>;
+
+    LvglLazyImage(Loader loader) : loader_(loader) {}
+    virtual const lv_img_dsc_t* image_dsc() const override;
+    virtual bool IsGif() const override;
+    virtual void Release() const override;
+
+private:
+    Loader loader_;
+    mutable std::shared_ptr<const void> data_;
+    mutable lv_img_dsc_t image_dsc_;
+
+    bool Load() const;
+};
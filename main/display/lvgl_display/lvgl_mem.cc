@@ -0,0 +1,57 @@
+#include <lvgl.h>
+
+// LVGL memory core for LV_USE_CUSTOM_MALLOC, accounts every LVGL allocation to
+// the display tag. With the default C library allocator this file is empty.
+#if LV_USE_STDLIB_MALLOC == LV_STDLIB_CUSTOM
+
+#include <esp_heap_caps.h>
+#include "heap_accounting.h"
+
+void lv_mem_init(void) {
+}
+
+void lv_mem_deinit(void) {
+}
+
+lv_mem_pool_t lv_mem_add_pool(void* mem, size_t bytes) {
+    LV_UNUSED(mem);
+    LV_UNUSED(bytes);
+    return nullptr;
+}
+
+void lv_mem_remove_pool(lv_mem_pool_t pool) {
+    LV_UNUSED(pool);
+}
+
+void* lv_malloc_core(size_t size) {
+    return HeapAccounting::Allocate(size, kHeapTagDisplay);
+}
+
+void* lv_realloc_core(void* p, size_t new_size) {
+    return HeapAccounting::Reallocate(p, new_size, kHeapTagDisplay);
+}
+
+void lv_free_core(void* p) {
+    HeapAccounting::Free(p);
+}
+
+void lv_mem_monitor_core(lv_mem_monitor_t* mon_p) {
+    auto usage = HeapAccounting::GetUsage(kHeapTagDisplay);
+    multi_heap_info_t info;
+    heap_caps_get_info(&info, MALLOC_CAP_DEFAULT);
+    mon_p->total_size = info.total_free_bytes + info.total_allocated_bytes;
+    mon_p->free_cnt = info.free_blocks;
+    mon_p->free_size = info.total_free_bytes;
+    mon_p->free_biggest_size = info.largest_free_block;
+    mon_p->used_cnt = usage.blocks;
+    mon_p->max_used = usage.peak_bytes;
+    mon_p->used_pct = mon_p->total_size > 0 ? usage.bytes * 100 / mon_p->total_size : 0;
+    mon_p->frag_pct = info.total_free_bytes > 0 ?
+        100 - info.largest_free_block * 100 / info.total_free_bytes : 0;
+}
+
+lv_result_t lv_mem_test_core(void) {
+    return LV_RESULT_OK;
+}
+
+#endif
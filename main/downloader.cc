@@ -0,0 +1,330 @@
+#include "downloader.h"
+#include "board.h"
+#include "settings.h"
+
+#include <algorithm>
+#include <cstring>
+#include <esp_log.h>
+#include <esp_timer.h>
+#include <esp_heap_caps.h>
+#include <freertos/task.h>
+
+#define TAG "Downloader"
+
+Downloader::Downloader(const std::string& url, const std::string& resume_key)
+    : url_(url), resume_key_(resume_key) {
+}
+
+Downloader::~Downloader() {
+    if (free_queue_ != nullptr) {
+        vQueueDelete(free_queue_);
+    }
+    if (full_queue_ != nullptr) {
+        vQueueDelete(full_queue_);
+    }
+    if (writer_done_ != nullptr) {
+        vSemaphoreDelete(writer_done_);
+    }
+    for (auto buffer : buffers_) {
+        heap_caps_free(buffer);
+    }
+}
+
+size_t Downloader::LoadResumeOffset() {
+    if (resume_key_.empty()) {
+        return 0;
+    }
+    Settings settings("download");
+    if (settings.GetString(resume_key_ + "_url") != url_) {
+        return 0;
+    }
+    // Without a validator a changed file can not be told apart, so it is not resumed
+    validator_ = settings.GetString(resume_key_ + "_tag");
+    total_size_ = settings.GetInt(resume_key_ + "_size");
+    size_t offset = settings.GetInt(resume_key_ + "_off");
+    if (validator_.empty() || total_size_ == 0 || offset >= total_size_) {
+        return 0;
+    }
+    return offset;
+}
+
+void Downloader::SaveResumeOffset(size_t offset) {
+    Settings settings("download", true);
+    settings.SetString(resume_key_ + "_url", url_);
+    settings.SetString(resume_key_ + "_tag", validator_);
+    settings.SetInt(resume_key_ + "_size", total_size_);
+    settings.SetInt(resume_key_ + "_off", offset);
+}
+
+void Downloader::ClearResume(const std::string& resume_key) {
+    Settings settings("download", true);
+    settings.EraseKey(resume_key + "_url");
+    settings.EraseKey(resume_key + "_tag");
+    settings.EraseKey(resume_key + "_size");
+    settings.EraseKey(resume_key + "_off");
+}
+
+std::unique_ptr<Http> Downloader::Open(size_t offset, int& status) {
+    auto network = Board::GetInstance().GetNetwork();
+    auto http = network->CreateHttp(0);
+    if (range_end_ > 0) {
+        http->SetHeader("Range", "bytes=" + std::to_string(offset) + "-" + std::to_string(range_end_ - 1));
+    } else if (offset > 0) {
+        http->SetHeader("Range", "bytes=" + std::to_string(offset) + "-");
+        // The server answers 200 with the whole file when it no longer matches
+        if (!validator_.empty()) {
+            http->SetHeader("If-Range", validator_);
+        }
+    }
+    if (!http->Open("GET", url_)) {
+        ESP_LOGE(TAG, "Failed to open HTTP connection");
+        return nullptr;
+    }
+    status = http->GetStatusCode();
+    return http;
+}
+
+// If-Range only accepts a strong ETag, fall back to Last-Modified otherwise
+std::string Downloader::GetValidator(const Http& http) {
+    std::string etag = http.GetResponseHeader("ETag");
+    if (!etag.empty() && etag.compare(0, 2, "W/") != 0) {
+        return etag;
+    }
+    return http.GetResponseHeader("Last-Modified");
+}
+
+void Downloader::WriterTask() {
+    Block block;
+    while (xQueueReceive(full_queue_, &block, portMAX_DELAY) == pdTRUE) {
+        if (block.size == 0) {
+            break;
+        }
+        // After a failure keep draining so the reader never blocks on a full queue
+        if (!write_failed_) {
+            auto start_time = esp_timer_get_time();
+            if (!write_(block.offset, block.data, block.size)) {
+                ESP_LOGE(TAG, "Failed to write %u bytes at offset %u", block.size, block.offset);
+                write_failed_ = true;
+            } else {
+                write_us_ += esp_timer_get_time() - start_time;
+                written_ = block.offset + block.size;
+                if (!resume_key_.empty() && written_ - checkpoint_ >= DOWNLOAD_CHECKPOINT_SIZE) {
+                    checkpoint_ = written_ / DOWNLOAD_SECTOR_SIZE * DOWNLOAD_SECTOR_SIZE;
+                    SaveResumeOffset(checkpoint_);
+                }
+            }
+        }
+        xQueueSend(free_queue_, &block, portMAX_DELAY);
+    }
+    xSemaphoreGive(writer_done_);
+}
+
+bool Downloader::Run(WriteCallback write, ProgressCallback progress) {
+    size_t offset;
+    if (range_end_ > 0) {
+        offset = range_begin_;
+        total_size_ = range_end_;
+    } else {
+        offset = LoadResumeOffset();
+    }
+    int status = 0;
+    auto http = Open(offset, status);
+    if (http == nullptr) {
+        return false;
+    }
+
+    // A resume that does not line up with the server falls back to the whole file,
+    // an explicit range does not
+    size_t content_length = http->GetBodyLength();
+    if (range_end_ == 0 && offset > 0) {
+        if (status == 206 && content_length != total_size_ - offset) {
+            ESP_LOGW(TAG, "Partial content length %u does not match, starting over", content_length);
+            http->Close();
+            offset = 0;
+            http = Open(offset, status);
+            if (http == nullptr) {
+                return false;
+            }
+            content_length = http->GetBodyLength();
+        } else if (status == 200) {
+            ESP_LOGW(TAG, "File changed or range not supported, starting over");
+            offset = 0;
+        }
+    }
+    if (range_end_ == 0 && offset == 0 && status == 200) {
+        total_size_ = content_length;
+        validator_ = GetValidator(*http);
+    } else if (status == 206 && content_length == total_size_ - offset) {
+        if (range_end_ == 0) {
+            ESP_LOGI(TAG, "Resuming download at %u/%u", offset, total_size_);
+        }
+    } else {
+        ESP_LOGE(TAG, "Failed to download %s, status code: %d", url_.c_str(), status);
+        return false;
+    }
+
+    if (total_size_ == 0) {
+        ESP_LOGE(TAG, "Failed to get content length");
+        return false;
+    }
+    if (total_size_ > max_size_) {
+        ESP_LOGE(TAG, "File size (%u) is larger than the limit (%u)", total_size_, max_size_);
+        return false;
+    }
+
+    write_ = write;
+    written_ = offset;
+    checkpoint_ = offset;
+    write_failed_ = false;
+    write_us_ = 0;
+    if (!resume_key_.empty() && offset == 0) {
+        SaveResumeOffset(0);
+    }
+
+    free_queue_ = xQueueCreate(2, sizeof(Block));
+    full_queue_ = xQueueCreate(2, sizeof(Block));
+    writer_done_ = xSemaphoreCreateBinary();
+    for (auto& buffer : buffers_) {
+        buffer = (uint8_t*)heap_caps_malloc(DOWNLOAD_BUFFER_SIZE, MALLOC_CAP_8BIT);
+        if (buffer == nullptr) {
+            ESP_LOGE(TAG, "Failed to allocate download buffer");
+            return false;
+        }
+        Block block = { buffer, 0, 0 };
+        xQueueSend(free_queue_, &block, 0);
+    }
+
+    xTaskCreate([](void* arg) {
+        auto downloader = (Downloader*)arg;
+        downloader->WriterTask();
+        vTaskDelete(NULL);
+    }, "download_writer", DOWNLOAD_WRITER_STACK_SIZE, this, uxTaskPriorityGet(NULL), nullptr);
+
+    bool read_ok = true;
+    int retries = 0;
+    size_t received = offset;
+    size_t recent_read = 0;
+    int64_t flash_wait_us = 0;
+    auto start_time = esp_timer_get_time();
+    auto last_calc_time = start_time;
+    while (received < total_size_ && !write_failed_) {
+        Block block;
+        auto wait_start = esp_timer_get_time();
+        xQueueReceive(free_queue_, &block, portMAX_DELAY);
+        flash_wait_us += esp_timer_get_time() - wait_start;
+
+        block.offset = received;
+        block.size = 0;
+        size_t block_size = std::min<size_t>(DOWNLOAD_BUFFER_SIZE, total_size_ - received);
+        bool interrupted = false;
+        while (block.size < block_size) {
+            int ret = http->Read((char*)block.data + block.size, block_size - block.size);
+            if (ret <= 0) {
+                if (ret < 0) {
+                    ESP_LOGW(TAG, "Failed to read HTTP data: %s", esp_err_to_name(ret));
+                } else {
+                    ESP_LOGW(TAG, "Connection closed at %u/%u", received + block.size, total_size_);
+                }
+                // Keep block offsets 16-byte aligned for encrypted partitions
+                block.size &= ~size_t(15);
+                interrupted = true;
+                break;
+            }
+            block.size += ret;
+        }
+
+        received += block.size;
+        recent_read += block.size;
+        if (block.size > 0) {
+            xQueueSend(full_queue_, &block, portMAX_DELAY);
+        } else {
+            xQueueSend(free_queue_, &block, portMAX_DELAY);
+        }
+
+        if (esp_timer_get_time() - last_calc_time >= 1000000 || received == total_size_) {
+            size_t percent = (uint64_t)(received - range_begin_) * 100 / (total_size_ - range_begin_);
+            ESP_LOGI(TAG, "Progress: %u%% (%u/%u), Speed: %uB/s", percent, received, total_size_, recent_read);
+            if (progress) {
+                progress(percent, recent_read);
+            }
+            last_calc_time = esp_timer_get_time();
+            recent_read = 0;
+        }
+
+        if (interrupted) {
+            http.reset();
+            while (http == nullptr && retries < DOWNLOAD_MAX_RETRIES) {
+                retries++;
+                ESP_LOGW(TAG, "Reconnecting at %u/%u (%d/%d)", received, total_size_, retries, DOWNLOAD_MAX_RETRIES);
+                vTaskDelay(pdMS_TO_TICKS(1000 * retries));
+                http = Open(received, status);
+                if (http != nullptr && (status != 206 || http->GetBodyLength() != total_size_ - received)) {
+                    ESP_LOGW(TAG, "Range request failed, status code: %d", status);
+                    http.reset();
+                }
+            }
+            if (http == nullptr) {
+                read_ok = false;
+                break;
+            }
+        }
+    }
+    if (http != nullptr) {
+        http->Close();
+    }
+
+    Block end = { nullptr, 0, 0 };
+    xQueueSend(full_queue_, &end, portMAX_DELAY);
+    xSemaphoreTake(writer_done_, portMAX_DELAY);
+
+    int64_t elapsed_ms = (esp_timer_get_time() - start_time) / 1000;
+    ESP_LOGI(TAG, "Downloaded %u bytes in %d ms (%u B/s), flash write %d ms, reader waited %d ms for flash",
+             received - offset, int(elapsed_ms), elapsed_ms > 0 ? size_t((received - offset) * 1000ull / elapsed_ms) : 0,
+             int(write_us_ / 1000), int(flash_wait_us / 1000));
+
+    if (!read_ok || write_failed_ || written_ != total_size_) {
+        ESP_LOGE(TAG, "Download failed at %u/%u", written_, total_size_);
+        return false;
+    }
+    if (!resume_key_.empty()) {
+        ClearResume(resume_key_);
+    }
+    return true;
+}
+
+bool PartitionWriter::Write(size_t offset, const uint8_t* data, size_t size) {
+    if (offset + size > partition_->size) {
+        ESP_LOGE(TAG, "Write at offset %u size %u exceeds partition %s", offset, size, partition_->label);
+        return false;
+    }
+
+    if (!started_) {
+        erased_until_ = offset / DOWNLOAD_SECTOR_SIZE * DOWNLOAD_SECTOR_SIZE;
+        started_ = true;
+    }
+    size_t erase_end = std::min<size_t>((offset + size + DOWNLOAD_SECTOR_SIZE - 1) / DOWNLOAD_SECTOR_SIZE * DOWNLOAD_SECTOR_SIZE,
+                                        partition_->size);
+    if (erase_end > erased_until_) {
+        esp_err_t err = esp_partition_erase_range(partition_, erased_until_, erase_end - erased_until_);
+        if (err != ESP_OK) {
+            ESP_LOGE(TAG, "Failed to erase %s at offset %u: %s", partition_->label, erased_until_, esp_err_to_name(err));
+            return false;
+        }
+        erased_until_ = erase_end;
+    }
+
+    // Encrypted writes must be 16-byte aligned, pad the tail of the file with erased bytes
+    size_t tail = partition_->encrypted ? size % 16 : 0;
+    esp_err_t err = esp_partition_write(partition_, offset, data, size - tail);
+    if (err == ESP_OK && tail > 0) {
+        uint8_t padded[16];
+        memset(padded, 0xFF, sizeof(padded));
+        memcpy(padded, data + size - tail, tail);
+        err = esp_partition_write(partition_, offset + size - tail, padded, sizeof(padded));
+    }
+    if (err != ESP_OK) {
+        ESP_LOGE(TAG, "Failed to write %s at offset %u: %s", partition_->label, offset, esp_err_to_name(err));
+        return false;
+    }
+    return true;
+}
@@ -0,0 +1,109 @@
+#ifndef DOWNLOADER_H
+#define DOWNLOADER_H
+
+#include <atomic>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <string>
+
+#include <freertos/FreeRTOS.h>
+#include <freertos/queue.h>
+#include <freertos/semphr.h>
+#include <esp_partition.h>
+#include <http.h>
+
+// Two buffers of this size are in flight, one filled from the network while the other is written to flash
+#define DOWNLOAD_BUFFER_SIZE        (16 * 1024)
+// Progress is persisted for resuming every this many bytes, on flash sector boundaries
+#define DOWNLOAD_CHECKPOINT_SIZE    (128 * 1024)
+#define DOWNLOAD_SECTOR_SIZE        4096
+// Reconnects with a Range request within one Run() before giving up
+#define DOWNLOAD_MAX_RETRIES        3
+#define DOWNLOAD_WRITER_STACK_SIZE  4096
+
+/**
+ * Downloader - Streams an HTTP file into a sink with network and flash overlapped
+ *
+ * The calling task reads the network into one buffer while a writer task hands
+ * the other one to the sink. When a resume key is given, the written size is
+ * persisted in NVS together with the URL and the ETag or Last-Modified of the
+ * file, and a later Run() for the same URL continues with an HTTP Range request,
+ * also after a reboot. The request carries If-Range, so a file that changed on
+ * the server is downloaded again from the start instead of being spliced.
+ */
+class Downloader {
+public:
+    // Called on the writer task with consecutive data, offset is the position in the file
+    using WriteCallback = std::function<bool(size_t offset, const uint8_t* data, size_t size)>;
+    using ProgressCallback = std::function<void(int progress, size_t speed)>;
+
+    // resume_key names the persisted progress (at most 10 characters), empty disables resuming
+    Downloader(const std::string& url, const std::string& resume_key = "");
+    ~Downloader();
+
+    // Fail before writing anything when the file is larger than this
+    void set_max_size(size_t max_size) { max_size_ = max_size; }
+    // Only download bytes [begin, end) of the file, resuming does not apply
+    void set_range(size_t begin, size_t end) { range_begin_ = begin; range_end_ = end; }
+
+    bool Run(WriteCallback write, ProgressCallback progress);
+
+    // Forgets the persisted progress, for when the destination was written by someone else
+    static void ClearResume(const std::string& resume_key);
+
+    // Size of the file, known once Run() has started
+    size_t total_size() const { return total_size_; }
+
+private:
+    struct Block {
+        uint8_t* data;
+        size_t offset;
+        size_t size;        // 0 marks the end of the stream
+    };
+
+    std::string url_;
+    std::string resume_key_;
+    size_t max_size_ = SIZE_MAX;
+    size_t total_size_ = 0;
+    size_t range_begin_ = 0;
+    size_t range_end_ = 0;
+    // ETag or Last-Modified of the file being downloaded, sent as If-Range when resuming
+    std::string validator_;
+
+    WriteCallback write_;
+    uint8_t* buffers_[2] = { nullptr, nullptr };
+    QueueHandle_t free_queue_ = nullptr;
+    QueueHandle_t full_queue_ = nullptr;
+    SemaphoreHandle_t writer_done_ = nullptr;
+    std::atomic<bool> write_failed_ = false;
+    size_t written_ = 0;
+    size_t checkpoint_ = 0;
+    int64_t write_us_ = 0;
+
+    std::unique_ptr<Http> Open(size_t offset, int& status);
+    static std::string GetValidator(const Http& http);
+    size_t LoadResumeOffset();
+    void SaveResumeOffset(size_t offset);
+    void WriterTask();
+};
+
+/**
+ * PartitionWriter - Sequential partition writes that erase sectors just ahead of the data
+ *
+ * The first write may start at any sector boundary, so a resumed download only
+ * erases what it is about to rewrite.
+ */
+class PartitionWriter {
+public:
+    explicit PartitionWriter(const esp_partition_t* partition) : partition_(partition) {}
+
+    bool Write(size_t offset, const uint8_t* data, size_t size);
+
+private:
+    const esp_partition_t* partition_;
+    size_t erased_until_ = 0;
+    bool started_ = false;
+};
+
+#endif // DOWNLOADER_H
@@ -0,0 +1,188 @@
+#include "heap_accounting.h"
+#include "metrics.h"
+
+#include <atomic>
+#include <cassert>
+#include <cstdlib>
+#include <mutex>
+#include <unordered_map>
+#include <cJSON.h>
+
+// Precedes every accounted block, keeps the 8-byte alignment of malloc
+struct HeapBlockHeader {
+    uint32_t size;
+    uint8_t tag;
+    uint8_t reserved;
+    uint16_t magic;
+};
+
+static_assert(sizeof(HeapBlockHeader) == 8, "HeapBlockHeader must keep the alignment of malloc");
+
+#define HEAP_BLOCK_MAGIC 0x4854
+
+struct HeapTagCounters {
+    std::atomic<size_t> bytes{0};
+    std::atomic<size_t> blocks{0};
+    std::atomic<size_t> peak_bytes{0};
+};
+
+static HeapTagCounters tag_counters[kHeapTagCount];
+
+// cJSON blocks allocated inside a HeapTagScope, the blocks themselves stay plain malloc() blocks
+struct JsonBlock {
+    uint32_t size;
+    HeapTag tag;
+};
+
+static std::mutex json_blocks_mutex;
+static std::unordered_map<void*, JsonBlock> json_blocks;
+// Lets frees skip the table while nothing is recorded in it
+static std::atomic<size_t> json_block_count{0};
+
+static const char* const tag_names[kHeapTagCount] = {
+    "none",
+    "json",
+    "mcp",
+    "display",
+};
+
+thread_local HeapTag HeapAccounting::scope_tag_ = kHeapTagNone;
+
+static void Account(HeapTag tag, size_t size) {
+    auto& counters = tag_counters[tag];
+    size_t bytes = counters.bytes.fetch_add(size, std::memory_order_relaxed) + size;
+    counters.blocks.fetch_add(1, std::memory_order_relaxed);
+    size_t peak = counters.peak_bytes.load(std::memory_order_relaxed);
+    while (bytes > peak && !counters.peak_bytes.compare_exchange_weak(peak, bytes, std::memory_order_relaxed)) {
+    }
+}
+
+static void Unaccount(HeapTag tag, size_t size) {
+    auto& counters = tag_counters[tag];
+    counters.bytes.fetch_sub(size, std::memory_order_relaxed);
+    counters.blocks.fetch_sub(1, std::memory_order_relaxed);
+}
+
+void* HeapAccounting::Allocate(size_t size, HeapTag default_tag) {
+    auto header = static_cast<HeapBlockHeader*>(malloc(sizeof(HeapBlockHeader) + size));
+    if (header == nullptr) {
+        return nullptr;
+    }
+    HeapTag tag = scope_tag_ != kHeapTagNone ? scope_tag_ : default_tag;
+    header->size = size;
+    header->tag = tag;
+    header->reserved = 0;
+    header->magic = HEAP_BLOCK_MAGIC;
+    Account(tag, size);
+    return header + 1;
+}
+
+void* HeapAccounting::Reallocate(void* ptr, size_t size, HeapTag default_tag) {
+    if (ptr == nullptr) {
+        return Allocate(size, default_tag);
+    }
+    if (size == 0) {
+        Free(ptr);
+        return nullptr;
+    }
+    auto header = static_cast<HeapBlockHeader*>(ptr) - 1;
+    assert(header->magic == HEAP_BLOCK_MAGIC);
+    // The block keeps its tag, only its size changes
+    HeapTag tag = static_cast<HeapTag>(header->tag);
+    size_t old_size = header->size;
+    auto new_header = static_cast<HeapBlockHeader*>(realloc(header, sizeof(HeapBlockHeader) + size));
+    if (new_header == nullptr) {
+        return nullptr;
+    }
+    Unaccount(tag, old_size);
+    Account(tag, size);
+    new_header->size = size;
+    return new_header + 1;
+}
+
+void HeapAccounting::Free(void* ptr) {
+    if (ptr == nullptr) {
+        return;
+    }
+    auto header = static_cast<HeapBlockHeader*>(ptr) - 1;
+    assert(header->magic == HEAP_BLOCK_MAGIC);
+    header->magic = 0;
+    Unaccount(static_cast<HeapTag>(header->tag), header->size);
+    free(header);
+}
+
+HeapTagUsage HeapAccounting::GetUsage(HeapTag tag) {
+    auto& counters = tag_counters[tag];
+    return {
+        counters.bytes.load(std::memory_order_relaxed),
+        counters.blocks.load(std::memory_order_relaxed),
+        counters.peak_bytes.load(std::memory_order_relaxed),
+    };
+}
+
+const char* HeapAccounting::GetTagName(HeapTag tag) {
+    return tag < kHeapTagCount ? tag_names[tag] : "unknown";
+}
+
+void* HeapAccounting::AllocateJson(size_t size) {
+    void* ptr = malloc(size);
+    HeapTag tag = scope_tag_;
+    if (ptr == nullptr || tag == kHeapTagNone) {
+        return ptr;
+    }
+    std::lock_guard<std::mutex> lock(json_blocks_mutex);
+    auto [it, inserted] = json_blocks.emplace(ptr, JsonBlock{static_cast<uint32_t>(size), tag});
+    if (inserted) {
+        json_block_count.fetch_add(1, std::memory_order_relaxed);
+    } else {
+        // The recorded block was released with free() and its address reused
+        Unaccount(it->second.tag, it->second.size);
+        it->second = JsonBlock{static_cast<uint32_t>(size), tag};
+    }
+    Account(tag, size);
+    return ptr;
+}
+
+void HeapAccounting::FreeJson(void* ptr) {
+    if (ptr != nullptr && json_block_count.load(std::memory_order_relaxed) > 0) {
+        std::lock_guard<std::mutex> lock(json_blocks_mutex);
+        auto it = json_blocks.find(ptr);
+        if (it != json_blocks.end()) {
+            Unaccount(it->second.tag, it->second.size);
+            json_blocks.erase(it);
+            json_block_count.fetch_sub(1, std::memory_order_relaxed);
+        }
+    }
+    free(ptr);
+}
+
+void HeapAccounting::InstallJsonHooks() {
+    cJSON_Hooks hooks = {
+        .malloc_fn = AllocateJson,
+        .free_fn = FreeJson,
+    };
+    cJSON_InitHooks(&hooks);
+}
+
+void HeapAccounting::RegisterMetrics() {
+    // Metric names must outlive the registry
+    static const char* const metric_names[kHeapTagCount][3] = {
+        {"heap.none.bytes", "heap.none.blocks", "heap.none.peak"},
+        {"heap.json.bytes", "heap.json.blocks", "heap.json.peak"},
+        {"heap.mcp.bytes", "heap.mcp.blocks", "heap.mcp.peak"},
+        {"heap.display.bytes", "heap.display.blocks", "heap.display.peak"},
+    };
+
+    auto& metrics = Metrics::GetInstance();
+    for (int tag = kHeapTagNone + 1; tag < kHeapTagCount; tag++) {
+        auto bytes = metrics.GetGauge(metric_names[tag][0]);
+        auto blocks = metrics.GetGauge(metric_names[tag][1]);
+        auto peak = metrics.GetGauge(metric_names[tag][2]);
+        metrics.AddCollector([tag, bytes, blocks, peak]() {
+            auto usage = GetUsage(static_cast<HeapTag>(tag));
+            bytes->Set(usage.bytes);
+            blocks->Set(usage.blocks);
+            peak->Set(usage.peak_bytes);
+        });
+    }
+}
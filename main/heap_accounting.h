@@ -0,0 +1,75 @@
+#ifndef HEAP_ACCOUNTING_H
+#define HEAP_ACCOUNTING_H
+
+#include <cstddef>
+#include <cstdint>
+
+enum HeapTag : uint8_t {
+    kHeapTagNone,           // Use the default tag of the allocation site
+    kHeapTagJson,           // cJSON trees of the protocol messages
+    kHeapTagMcp,            // Allocations made while handling MCP messages
+    kHeapTagDisplay,        // LVGL objects, when LVGL uses the custom allocator
+    kHeapTagCount
+};
+
+struct HeapTagUsage {
+    size_t bytes;
+    size_t blocks;
+    size_t peak_bytes;
+};
+
+/**
+ * HeapAccounting - Attributes heap usage to subsystems
+ *
+ * Allocations made through Allocate() carry a small header recording their
+ * size and tag, so the bytes and blocks in use and the peak of each tag are
+ * kept exactly as memory is freed. LVGL uses it when it is configured with the
+ * custom allocator. A HeapTagScope attributes the allocations of the current
+ * task to another tag while it is alive.
+ *
+ * cJSON is shared with the managed components, which may free its output with
+ * free(), so its blocks never get a header. Only the cJSON blocks allocated
+ * inside a HeapTagScope are accounted, recorded by address in a table, for
+ * example everything parsed or built while handling MCP messages.
+ *
+ * Only malloc() is used underneath, so this can be built and tested on a host.
+ */
+class HeapAccounting {
+public:
+    static void* Allocate(size_t size, HeapTag default_tag);
+    static void* Reallocate(void* ptr, size_t size, HeapTag default_tag);
+    static void Free(void* ptr);
+
+    static HeapTagUsage GetUsage(HeapTag tag);
+    static const char* GetTagName(HeapTag tag);
+
+    // Accounts the cJSON blocks allocated inside a HeapTagScope
+    static void InstallJsonHooks();
+    // Publishes heap.<tag>.bytes, heap.<tag>.blocks and heap.<tag>.peak
+    static void RegisterMetrics();
+
+private:
+    friend class HeapTagScope;
+    static thread_local HeapTag scope_tag_;
+
+    static void* AllocateJson(size_t size);
+    static void FreeJson(void* ptr);
+};
+
+// Attributes the allocations of the current task to a tag while in scope
+class HeapTagScope {
+public:
+    explicit HeapTagScope(HeapTag tag) : previous_(HeapAccounting::scope_tag_) {
+        HeapAccounting::scope_tag_ = tag;
+    }
+    ~HeapTagScope() {
+        HeapAccounting::scope_tag_ = previous_;
+    }
+    HeapTagScope(const HeapTagScope&) = delete;
+    HeapTagScope& operator=(const HeapTagScope&) = delete;
+
+private:
+    HeapTag previous_;
+};
+
+#endif // HEAP_ACCOUNTING_H
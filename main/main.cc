@@ -9,19 +9,31 @@
 
 #include "application.h"
 #include "system_info.h"
+#include "boot_profiler.h"
+#include "heap_accounting.h"
+#include "trace_recorder.h"
 
 #define TAG "main"
 
 extern "C" void app_main(void)
 {
+    // Before anything allocates through cJSON
+    HeapAccounting::InstallJsonHooks();
+#if CONFIG_TRACE_RECORDER
+    TraceRecorder::GetInstance().Start();
+#endif
+
     // Initialize NVS flash for WiFi configuration
-    esp_err_t ret = nvs_flash_init();
-    if (ret == ESP_ERR_NVS_NO_FREE_PAGES || ret == ESP_ERR_NVS_NEW_VERSION_FOUND) {
-        ESP_LOGW(TAG, "Erasing NVS flash to fix corruption");
-        ESP_ERROR_CHECK(nvs_flash_erase());
-        ret = nvs_flash_init();
+    {
+        BootPhase phase("nvs_init");
+        esp_err_t ret = nvs_flash_init();
+        if (ret == ESP_ERR_NVS_NO_FREE_PAGES || ret == ESP_ERR_NVS_NEW_VERSION_FOUND) {
+            ESP_LOGW(TAG, "Erasing NVS flash to fix corruption");
+            ESP_ERROR_CHECK(nvs_flash_erase());
+            ret = nvs_flash_init();
+        }
+        ESP_ERROR_CHECK(ret);
     }
-    ESP_ERROR_CHECK(ret);
 
     // Initialize and run the application
     auto& app = Application::GetInstance();
@@ -9,17 +9,55 @@
 #include <algorithm>
 #include <cstring>
 #include <esp_pthread.h>
+#include <esp_timer.h>
+#include <mbedtls/sha256.h>
 
 #include "application.h"
 #include "display.h"
 #include "oled_display.h"
 #include "board.h"
 #include "settings.h"
+#include "metrics.h"
+#include "heap_accounting.h"
+#include "memory_policy.h"
+#include "trace_recorder.h"
 #include "lvgl_theme.h"
 #include "lvgl_display.h"
 
 #define TAG "MCP"
 
+// The async tool call being executed by the current worker task
+static thread_local McpToolCall* current_tool_call = nullptr;
+
+// Batch of the request being answered on the current task, null for a request sent on its own
+static thread_local McpBatch* current_batch = nullptr;
+
+// Collects the replies sent on the current task into a batch while in scope
+class BatchScope {
+public:
+    explicit BatchScope(McpBatch* batch) : previous_(current_batch) {
+        current_batch = batch;
+    }
+    ~BatchScope() {
+        current_batch = previous_;
+    }
+
+private:
+    McpBatch* previous_;
+};
+
+static std::shared_ptr<McpBatch> GetCurrentBatch() {
+    return current_batch != nullptr ? current_batch->shared_from_this() : nullptr;
+}
+
+// JSON-RPC 2.0 Invalid Request error, the id is null unless the request carried a usable one
+static std::string InvalidRequestError(const cJSON* id) {
+    std::string payload = "{\"jsonrpc\":\"2.0\",\"id\":";
+    payload += cJSON_IsNumber(id) ? std::to_string(id->valueint) : "null";
+    payload += ",\"error\":{\"code\":-32600,\"message\":\"Invalid Request\"}}";
+    return payload;
+}
+
 McpServer::McpServer() {
 }
 
@@ -99,7 +137,7 @@ void McpServer::AddCommonTools() {
 
     auto camera = board.GetCamera();
     if (camera) {
-        AddTool("self.camera.take_photo",
+        AddAsyncTool("self.camera.take_photo",
             "Take a photo and explain it. Use this tool after the user asks you to see something.\n"
             "Args:\n"
             "  `question`: The question that you want to ask about the photo.\n"
@@ -112,12 +150,16 @@ void McpServer::AddCommonTools() {
                 // Lower the priority to do the camera capture
                 TaskPriorityReset priority_reset(1);
 
+                McpServer::ReportProgress(0, 2, "Capturing");
                 if (!camera->Capture()) {
                     throw std::runtime_error("Failed to capture photo");
                 }
+                if (!McpServer::ReportProgress(1, 2, "Explaining")) {
+                    throw std::runtime_error("Cancelled");
+                }
                 auto question = properties["question"].value<std::string>();
                 return camera->Explain(question);
-            });
+            }, true);
     }
 #endif
 
@@ -135,6 +177,44 @@ void McpServer::AddUserOnlyTools() {
             return board.GetSystemInfoJson();
         });
 
+    AddUserOnlyTool("self.get_metrics",
+        "Get the device metrics: event counters, gauges such as free heap and queue depths, and latency histograms",
+        PropertyList(),
+        [](const PropertyList& properties) -> ReturnValue {
+            return Metrics::GetInstance().ToJson();
+        });
+
+#if CONFIG_TRACE_RECORDER
+    AddUserOnlyTool("self.trace.dump",
+        "Dump the recorded trace events, base64 encoded in the result or to the serial console. "
+        "Convert them with scripts/trace_to_chrome.py",
+        PropertyList({
+            Property("serial", kPropertyTypeBoolean, false)
+        }),
+        [](const PropertyList& properties) -> ReturnValue {
+            auto& recorder = TraceRecorder::GetInstance();
+            if (properties["serial"].value<bool>()) {
+                recorder.DumpToSerial();
+                return true;
+            }
+
+            auto data = recorder.Dump();
+            std::string encoded((data.size() + 2) / 3 * 4 + 1, 0);
+            size_t olen = 0;
+            if (mbedtls_base64_encode((unsigned char*)encoded.data(), encoded.size(), &olen,
+                    (const unsigned char*)data.data(), data.size()) != 0) {
+                throw std::runtime_error("Failed to encode trace");
+            }
+            encoded.resize(olen);
+
+            cJSON* json = cJSON_CreateObject();
+            cJSON_AddStringToObject(json, "format", "xztrace");
+            cJSON_AddNumberToObject(json, "size", data.size());
+            cJSON_AddStringToObject(json, "data", encoded.c_str());
+            return json;
+        });
+#endif
+
     AddUserOnlyTool("self.reboot", "Reboot the system",
         PropertyList(),
         [this](const PropertyList& properties) -> ReturnValue {
@@ -144,7 +224,7 @@ void McpServer::AddUserOnlyTools() {
                 vTaskDelay(pdMS_TO_TICKS(1000));
 
                 app.Reboot();
-            });
+            }, kSchedulePriorityBackground);
             return true;
         });
 
@@ -163,7 +243,7 @@ void McpServer::AddUserOnlyTools() {
                 if (!success) {
                     ESP_LOGE(TAG, "Firmware upgrade failed");
                 }
-            });
+            }, kSchedulePriorityBackground);
             
             return true;
         });
@@ -196,7 +276,7 @@ void McpServer::AddUserOnlyTools() {
                 auto url = properties["url"].value<std::string>();
                 auto quality = properties["quality"].value<int>();
 
-                std::string jpeg_data;
+                JpegData jpeg_data;
                 if (!display->SnapshotToJpeg(jpeg_data, quality)) {
                     throw std::runtime_error("Failed to snapshot screen");
                 }
@@ -258,7 +338,7 @@ void McpServer::AddUserOnlyTools() {
                 }
 
                 size_t content_length = http->GetBodyLength();
-                char* data = (char*)heap_caps_malloc(content_length, MALLOC_CAP_8BIT);
+                char* data = (char*)MemoryPolicy::Allocate(BufferClass::kDownload, content_length);
                 if (data == nullptr) {
                     throw std::runtime_error("Failed to allocate memory for image: " + url);
                 }
@@ -302,13 +382,17 @@ void McpServer::AddUserOnlyTools() {
 
 void McpServer::AddTool(McpTool* tool) {
     // Prevent adding duplicate tools
-    if (std::find_if(tools_.begin(), tools_.end(), [tool](const McpTool* t) { return t->name() == tool->name(); }) != tools_.end()) {
+    if (tool_index_.find(tool->name()) != tool_index_.end()) {
         ESP_LOGW(TAG, "Tool %s already added", tool->name().c_str());
         return;
     }
 
     ESP_LOGI(TAG, "Add tool: %s%s", tool->name().c_str(), tool->user_only() ? " [user]" : "");
     tools_.push_back(tool);
+    tool_index_.emplace(tool->name(), tool);
+
+    std::lock_guard<std::mutex> lock(manifest_mutex_);
+    manifest_valid_ = false;
 }
 
 void McpServer::AddTool(const std::string& name, const std::string& description, const PropertyList& properties, std::function<ReturnValue(const PropertyList&)> callback) {
@@ -321,7 +405,15 @@ void McpServer::AddUserOnlyTool(const std::string& name, const std::string& desc
     AddTool(tool);
 }
 
+void McpServer::AddAsyncTool(const std::string& name, const std::string& description, const PropertyList& properties, std::function<ReturnValue(const PropertyList&)> callback, bool exclusive) {
+    auto tool = new McpTool(name, description, properties, callback);
+    tool->set_async(true);
+    tool->set_exclusive(exclusive);
+    AddTool(tool);
+}
+
 void McpServer::ParseMessage(const std::string& message) {
+    HeapTagScope heap_tag(kHeapTagMcp);
     cJSON* json = cJSON_Parse(message.c_str());
     if (json == nullptr) {
         ESP_LOGE(TAG, "Failed to parse MCP message: %s", message.c_str());
@@ -350,7 +442,84 @@ void McpServer::ParseCapabilities(const cJSON* capabilities) {
     }
 }
 
+void McpServer::ParseBatch(const cJSON* json) {
+    if (cJSON_GetArraySize(json) == 0) {
+        Application::GetInstance().SendMcpMessage(InvalidRequestError(nullptr));
+        return;
+    }
+
+    // The batch holds one extra pending count while its messages are dispatched,
+    // so that a fast reply can not complete it early
+    auto batch = std::make_shared<McpBatch>();
+    batch->pending = 1;
+    int requests = 0;
+    int invalid = 0;
+    cJSON* item;
+    cJSON_ArrayForEach(item, json) {
+        auto version = cJSON_IsObject(item) ? cJSON_GetObjectItem(item, "jsonrpc") : nullptr;
+        auto method = cJSON_IsObject(item) ? cJSON_GetObjectItem(item, "method") : nullptr;
+        auto id = cJSON_IsObject(item) ? cJSON_GetObjectItem(item, "id") : nullptr;
+        auto params = cJSON_IsObject(item) ? cJSON_GetObjectItem(item, "params") : nullptr;
+        if (!cJSON_IsString(version) || strcmp(version->valuestring, "2.0") != 0 || !cJSON_IsString(method) ||
+            (id != nullptr && !cJSON_IsNumber(id)) || (params != nullptr && !cJSON_IsObject(params))) {
+            std::lock_guard<std::mutex> lock(batch_mutex_);
+            batch->responses.push_back(InvalidRequestError(id));
+            invalid++;
+            continue;
+        }
+        // Notifications get no response
+        if (id == nullptr || strncmp(method->valuestring, "notifications", 13) == 0) {
+            ParseMessage(item);
+            continue;
+        }
+        {
+            std::lock_guard<std::mutex> lock(batch_mutex_);
+            batch->pending++;
+        }
+        requests++;
+        BatchScope scope(batch.get());
+        ParseMessage(item);
+    }
+    ESP_LOGI(TAG, "Batch of %d messages, %d requests, %d invalid", cJSON_GetArraySize(json), requests, invalid);
+    CompleteBatchRequest(batch.get(), std::string());
+}
+
+void McpServer::CompleteBatchRequest(McpBatch* batch, std::string&& response) {
+    std::string message;
+    {
+        std::lock_guard<std::mutex> lock(batch_mutex_);
+        if (!response.empty()) {
+            batch->responses.push_back(std::move(response));
+        }
+        if (--batch->pending > 0 || batch->responses.empty()) {
+            return;
+        }
+
+        message = "[";
+        for (auto& r : batch->responses) {
+            message += r;
+            message += ",";
+        }
+        message.back() = ']';
+    }
+    Application::GetInstance().SendMcpMessage(message);
+}
+
+void McpServer::SendReply(std::string&& payload) {
+    if (current_batch != nullptr) {
+        CompleteBatchRequest(current_batch, std::move(payload));
+    } else {
+        Application::GetInstance().SendMcpMessage(payload);
+    }
+}
+
 void McpServer::ParseMessage(const cJSON* json) {
+    HeapTagScope heap_tag(kHeapTagMcp);
+    if (cJSON_IsArray(json)) {
+        ParseBatch(json);
+        return;
+    }
+
     // Check JSONRPC version
     auto version = cJSON_GetObjectItem(json, "jsonrpc");
     if (version == nullptr || !cJSON_IsString(version) || strcmp(version->valuestring, "2.0") != 0) {
@@ -367,6 +536,13 @@ void McpServer::ParseMessage(const cJSON* json) {
     
     auto method_str = std::string(method->valuestring);
     if (method_str.find("notifications") == 0) {
+        if (method_str == "notifications/cancelled") {
+            auto params = cJSON_GetObjectItem(json, "params");
+            auto request_id = cJSON_GetObjectItem(params, "requestId");
+            if (cJSON_IsNumber(request_id)) {
+                CancelToolCall(request_id->valueint);
+            }
+        }
         return;
     }
     
@@ -391,8 +567,17 @@ void McpServer::ParseMessage(const cJSON* json) {
                 ParseCapabilities(capabilities);
             }
         }
+        std::string manifest_hash;
+        {
+            std::lock_guard<std::mutex> lock(manifest_mutex_);
+            BuildToolsManifest();
+            manifest_hash = manifest_hash_;
+        }
+        // The manifest hash lets the client skip tools/list when it already has this tool set cached
         auto app_desc = esp_app_get_description();
-        std::string message = "{\"protocolVersion\":\"2024-11-05\",\"capabilities\":{\"tools\":{}},\"serverInfo\":{\"name\":\"" BOARD_NAME "\",\"version\":\"";
+        std::string message = "{\"protocolVersion\":\"2024-11-05\",\"capabilities\":{\"tools\":{\"manifestHash\":\"";
+        message += manifest_hash;
+        message += "\"}},\"serverInfo\":{\"name\":\"" BOARD_NAME "\",\"version\":\"";
         message += app_desc->version;
         message += "\"}}";
         ReplyResult(id_int, message);
@@ -428,7 +613,7 @@ void McpServer::ParseMessage(const cJSON* json) {
             ReplyError(id_int, "Invalid arguments");
             return;
         }
-        DoToolCall(id_int, std::string(tool_name->valuestring), tool_arguments);
+        DoToolCall(id_int, std::string(tool_name->valuestring), tool_arguments, cJSON_GetObjectItem(params, "_meta"));
     } else {
         ESP_LOGE(TAG, "Method not implemented: %s", method_str.c_str());
         ReplyError(id_int, "Method not implemented: " + method_str);
@@ -440,7 +625,31 @@ void McpServer::ReplyResult(int id, const std::string& result) {
     payload += std::to_string(id) + ",\"result\":";
     payload += result;
     payload += "}";
-    Application::GetInstance().SendMcpMessage(payload);
+    SendReply(std::move(payload));
+}
+
+void McpServer::ReplyToolResult(int id, ReturnValue value) {
+    // Batch responses are sent as one message, so images can only be streamed on their own
+    if (std::holds_alternative<ImageContent*>(value) && current_batch == nullptr) {
+        ReplyImageResult(id, std::get<ImageContent*>(value));
+    } else {
+        ReplyResult(id, McpTool::FormatResult(value));
+    }
+}
+
+void McpServer::ReplyImageResult(int id, ImageContent* image) {
+    // The base64 data is encoded straight into the outgoing message, one chunk at a time,
+    // instead of being copied through cJSON and several intermediate strings
+    std::shared_ptr<ImageContent> content(image);
+    std::string head = "{\"jsonrpc\":\"2.0\",\"id\":";
+    head += std::to_string(id);
+    head += ",\"result\":{\"content\":[{\"type\":\"image\",\"mimeType\":\"";
+    head += content->mime_type();
+    head += "\",\"data\":\"";
+    Application::GetInstance().SendMcpMessage([head = std::move(head), content](const TextWriter& write) {
+        static const char tail[] = "\"}],\"isError\":false}}";
+        return write(head.data(), head.size()) && content->Encode(write) && write(tail, sizeof(tail) - 1);
+    });
 }
 
 void McpServer::ReplyError(int id, const std::string& message) {
@@ -449,115 +658,330 @@ void McpServer::ReplyError(int id, const std::string& message) {
     payload += ",\"error\":{\"message\":\"";
     payload += message;
     payload += "\"}}";
-    Application::GetInstance().SendMcpMessage(payload);
+    SendReply(std::move(payload));
 }
 
 void McpServer::GetToolsList(int id, const std::string& cursor, bool list_user_only_tools) {
-    const int max_payload_size = 8000;
-    std::string json = "{\"tools\":[";
-    
-    bool found_cursor = cursor.empty();
-    auto it = tools_.begin();
-    std::string next_cursor = "";
-    
-    while (it != tools_.end()) {
-        // 如果我们还没有找到起始位置，继续搜索
-        if (!found_cursor) {
-            if ((*it)->name() == cursor) {
-                found_cursor = true;
-            } else {
-                ++it;
-                continue;
+    std::string page;
+    {
+        std::lock_guard<std::mutex> lock(manifest_mutex_);
+        BuildToolsManifest();
+        const auto& tools = manifest_.tools;
+        const auto& starts = manifest_.page_starts[list_user_only_tools ? 1 : 0];
+        size_t index = 0;
+        if (!cursor.empty()) {
+            index = 1;
+            while (index < starts.size() && tools[starts[index]].tool->name() != cursor) {
+                index++;
             }
         }
 
-        if (!list_user_only_tools && (*it)->user_only()) {
-            ++it;
-            continue;
-        }
-        
-        // 添加tool前检查大小
-        std::string tool_json = (*it)->to_json() + ",";
-        if (json.length() + tool_json.length() + 30 > max_payload_size) {
-            // 如果添加这个tool会超出大小限制，设置next_cursor并退出循环
-            next_cursor = (*it)->name();
-            break;
+        if (index < starts.size()) {
+            size_t end = index + 1 < starts.size() ? starts[index + 1] : tools.size();
+            page = "{\"tools\":[";
+            for (size_t i = starts[index]; i < end; i++) {
+                if (!list_user_only_tools && tools[i].user_only) {
+                    continue;
+                }
+                page += tools[i].json;
+                page += ",";
+            }
+            if (page.back() == ',') {
+                page.pop_back();
+            }
+            page += "]";
+            if (end < tools.size()) {
+                page += ",\"nextCursor\":\"" + tools[end].tool->name() + "\"";
+            }
+            page += "}";
         }
-        
-        json += tool_json;
-        ++it;
     }
-    
-    if (json.back() == ',') {
-        json.pop_back();
+
+    if (page.empty()) {
+        ESP_LOGE(TAG, "tools/list: Invalid cursor: %s", cursor.c_str());
+        ReplyError(id, "Invalid cursor: " + cursor);
+        return;
     }
-    
-    if (json.back() == '[' && !tools_.empty()) {
-        // 如果没有添加任何tool，返回错误
-        ESP_LOGE(TAG, "tools/list: Failed to add tool %s because of payload size limit", next_cursor.c_str());
-        ReplyError(id, "Failed to add tool " + next_cursor + " because of payload size limit");
+    ReplyResult(id, page);
+}
+
+void McpServer::BuildToolsManifest() {
+    // Must be called with manifest_mutex_ held
+    if (manifest_valid_) {
         return;
     }
 
-    if (next_cursor.empty()) {
-        json += "]}";
-    } else {
-        json += "],\"nextCursor\":\"" + next_cursor + "\"}";
+    int64_t start_time = esp_timer_get_time();
+    manifest_.tools.clear();
+    size_t total_size = 0;
+    for (auto tool : tools_) {
+        std::string tool_json = tool->to_json();
+        if (tool_json.length() + 30 > MCP_TOOLS_PAGE_SIZE) {
+            ESP_LOGE(TAG, "tools/list: Tool %s exceeds the payload size limit", tool->name().c_str());
+            continue;
+        }
+        total_size += tool_json.size();
+        manifest_.tools.push_back({tool, tool->user_only(), std::move(tool_json)});
     }
-    
-    ReplyResult(id, json);
+    manifest_.tools.shrink_to_fit();
+    PaginateToolsManifest(false);
+    PaginateToolsManifest(true);
+
+    // Covers both listings: every tool and whether it is user-only
+    unsigned char digest[32];
+    mbedtls_sha256_context ctx;
+    mbedtls_sha256_init(&ctx);
+    mbedtls_sha256_starts(&ctx, 0);
+    for (const auto& entry : manifest_.tools) {
+        unsigned char user_only = entry.user_only ? 1 : 0;
+        mbedtls_sha256_update(&ctx, &user_only, 1);
+        mbedtls_sha256_update(&ctx, (const unsigned char*)entry.json.data(), entry.json.size());
+    }
+    mbedtls_sha256_finish(&ctx, digest);
+    mbedtls_sha256_free(&ctx);
+
+    char hex[17];
+    for (int i = 0; i < 8; i++) {
+        snprintf(hex + i * 2, 3, "%02x", digest[i]);
+    }
+    manifest_hash_ = hex;
+    manifest_valid_ = true;
+
+    ESP_LOGI(TAG, "Tools manifest %s built in %d ms: %u tools, %u + %u pages, %u bytes", manifest_hash_.c_str(),
+        int((esp_timer_get_time() - start_time) / 1000), manifest_.tools.size(),
+        manifest_.page_starts[0].size(), manifest_.page_starts[1].size(), total_size);
 }
 
-void McpServer::DoToolCall(int id, const std::string& tool_name, const cJSON* tool_arguments) {
-    auto tool_iter = std::find_if(tools_.begin(), tools_.end(), 
-                                 [&tool_name](const McpTool* tool) { 
-                                     return tool->name() == tool_name; 
-                                 });
-    
-    if (tool_iter == tools_.end()) {
+void McpServer::PaginateToolsManifest(bool list_user_only_tools) {
+    // Same page sizes as the assembled JSON in GetToolsList(), which adds at most 30 bytes around the tools
+    auto& starts = manifest_.page_starts[list_user_only_tools ? 1 : 0];
+    const size_t head_length = sizeof("{\"tools\":[") - 1;
+    starts.clear();
+    starts.push_back(0);
+    size_t length = head_length;
+    for (size_t i = 0; i < manifest_.tools.size(); i++) {
+        const auto& entry = manifest_.tools[i];
+        if (!list_user_only_tools && entry.user_only) {
+            continue;
+        }
+        // Start a new page with this tool if it does not fit in the current one
+        if (length > head_length && length + entry.json.length() + 30 > MCP_TOOLS_PAGE_SIZE) {
+            starts.push_back(i);
+            length = head_length;
+        }
+        length += entry.json.length() + 1;
+    }
+}
+
+void McpServer::DoToolCall(int id, const std::string& tool_name, const cJSON* tool_arguments, const cJSON* meta) {
+    auto tool_it = tool_index_.find(tool_name);
+    if (tool_it == tool_index_.end()) {
         ESP_LOGE(TAG, "tools/call: Unknown tool: %s", tool_name.c_str());
         ReplyError(id, "Unknown tool: " + tool_name);
         return;
     }
+    McpTool* tool = tool_it->second;
 
-    PropertyList arguments = (*tool_iter)->properties();
-    try {
-        for (auto& argument : arguments) {
-            bool found = false;
-            if (cJSON_IsObject(tool_arguments)) {
-                auto value = cJSON_GetObjectItem(tool_arguments, argument.name().c_str());
-                if (argument.type() == kPropertyTypeBoolean && cJSON_IsBool(value)) {
-                    argument.set_value<bool>(value->valueint == 1);
-                    found = true;
-                } else if (argument.type() == kPropertyTypeInteger && cJSON_IsNumber(value)) {
-                    argument.set_value<int>(value->valueint);
-                    found = true;
-                } else if (argument.type() == kPropertyTypeString && cJSON_IsString(value)) {
-                    argument.set_value<std::string>(value->valuestring);
-                    found = true;
-                }
-            }
+    PropertyList arguments;
+    if (!BindArguments(id, tool, tool_arguments, arguments)) {
+        return;
+    }
 
-            if (!argument.has_default_value() && !found) {
-                ESP_LOGE(TAG, "tools/call: Missing valid argument: %s", argument.name().c_str());
-                ReplyError(id, "Missing valid argument: " + argument.name());
-                return;
-            }
+    if (tool->async()) {
+        auto call = std::make_shared<McpToolCall>();
+        call->id = id;
+        call->tool = tool;
+        call->arguments = std::move(arguments);
+        call->batch = GetCurrentBatch();
+        auto progress_token = cJSON_GetObjectItem(meta, "progressToken");
+        if (cJSON_IsString(progress_token) || cJSON_IsNumber(progress_token)) {
+            char* token_str = cJSON_PrintUnformatted(progress_token);
+            call->progress_token = token_str;
+            cJSON_free(token_str);
         }
-    } catch (const std::exception& e) {
-        ESP_LOGE(TAG, "tools/call: %s", e.what());
-        ReplyError(id, e.what());
+        StartAsyncToolCall(std::move(call));
         return;
     }
 
     // Use main thread to call the tool
     auto& app = Application::GetInstance();
-    app.Schedule([this, id, tool_iter, arguments = std::move(arguments)]() {
+    app.Schedule([this, id, tool, batch = GetCurrentBatch(), arguments = std::move(arguments)]() {
+        BatchScope scope(batch.get());
         try {
-            ReplyResult(id, (*tool_iter)->Call(arguments));
+            ReplyToolResult(id, tool->Invoke(arguments));
         } catch (const std::exception& e) {
             ESP_LOGE(TAG, "tools/call: %s", e.what());
             ReplyError(id, e.what());
         }
-    });
+    }, kSchedulePriorityBackground);
+}
+
+bool McpServer::BindArguments(int id, const McpTool* tool, const cJSON* tool_arguments, PropertyList& arguments) {
+    // Only the values sent by the client are stored, defaults are read from the tool's schema.
+    // Tools are never removed, so the schema outlives any call.
+    const PropertyList& schema = tool->properties();
+    arguments = PropertyList(&schema);
+    try {
+        for (const auto& property : schema) {
+            auto value = cJSON_IsObject(tool_arguments) ? cJSON_GetObjectItem(tool_arguments, property.name().c_str()) : nullptr;
+            if (property.type() == kPropertyTypeBoolean && cJSON_IsBool(value)) {
+                arguments.AddProperty(property.Bind<bool>(value->valueint == 1));
+            } else if (property.type() == kPropertyTypeInteger && cJSON_IsNumber(value)) {
+                arguments.AddProperty(property.Bind<int>(value->valueint));
+            } else if (property.type() == kPropertyTypeString && cJSON_IsString(value)) {
+                arguments.AddProperty(property.Bind<std::string>(value->valuestring));
+            } else if (!property.has_default_value()) {
+                ESP_LOGE(TAG, "tools/call: Missing valid argument: %s", property.name().c_str());
+                ReplyError(id, "Missing valid argument: " + property.name());
+                return false;
+            }
+        }
+    } catch (const std::exception& e) {
+        ESP_LOGE(TAG, "tools/call: %s", e.what());
+        ReplyError(id, e.what());
+        return false;
+    }
+    return true;
+}
+
+void McpServer::StartAsyncToolCall(std::shared_ptr<McpToolCall> call) {
+    std::lock_guard<std::mutex> lock(calls_mutex_);
+    active_calls_[call->id] = call;
+    bool runnable = IsRunnable(*call);
+    pending_calls_.push_back(std::move(call));
+
+    // Workers are created on demand, up to the concurrency limit. A call held back by
+    // its exclusive tool is picked up by the worker running that tool once it is done.
+    if (runnable && idle_workers_ == 0 && worker_count_ < MCP_TOOL_WORKER_COUNT) {
+        TaskHandle_t handle = nullptr;
+        xTaskCreate([](void* arg) {
+            static_cast<McpServer*>(arg)->ToolWorkerTask();
+        }, "mcp_worker", MCP_TOOL_WORKER_STACK_SIZE, this, 2, &handle);
+        if (handle != nullptr) {
+            worker_count_++;
+        }
+    }
+    calls_cv_.notify_all();
+}
+
+// Must be called with calls_mutex_ held
+bool McpServer::IsRunnable(const McpToolCall& call) const {
+    return !call.tool->exclusive() || busy_tools_.find(call.tool) == busy_tools_.end();
+}
+
+void McpServer::CancelToolCall(int id) {
+    std::lock_guard<std::mutex> lock(calls_mutex_);
+    auto it = active_calls_.find(id);
+    if (it == active_calls_.end()) {
+        return;
+    }
+    auto call = it->second;
+    ESP_LOGI(TAG, "tools/call: Cancel request %d (%s)", id, call->tool->name().c_str());
+    call->cancelled = true;
+    // A call that has not started yet is dropped here; a running one stops replying
+    pending_calls_.erase(std::remove(pending_calls_.begin(), pending_calls_.end(), call), pending_calls_.end());
+    active_calls_.erase(it);
+    // A cancelled request gets no response, but must not hold back the rest of its batch
+    if (call->batch != nullptr) {
+        CompleteBatchRequest(call->batch.get(), std::string());
+    }
+}
+
+void McpServer::ToolWorkerTask() {
+    HeapTagScope heap_tag(kHeapTagMcp);
+    while (true) {
+        std::shared_ptr<McpToolCall> call;
+        {
+            std::unique_lock<std::mutex> lock(calls_mutex_);
+            // Oldest call whose tool is free to run
+            auto next = pending_calls_.end();
+            idle_workers_++;
+            calls_cv_.wait(lock, [this, &next]() {
+                next = std::find_if(pending_calls_.begin(), pending_calls_.end(),
+                    [this](const auto& pending) { return IsRunnable(*pending); });
+                return next != pending_calls_.end();
+            });
+            idle_workers_--;
+            call = std::move(*next);
+            pending_calls_.erase(next);
+            if (call->tool->exclusive()) {
+                busy_tools_.insert(call->tool);
+            }
+        }
+
+        current_tool_call = call.get();
+        ReturnValue result = false;
+        std::string error;
+        try {
+            result = call->tool->Invoke(call->arguments);
+        } catch (const std::exception& e) {
+            error = e.what();
+        }
+        current_tool_call = nullptr;
+
+        {
+            std::lock_guard<std::mutex> lock(calls_mutex_);
+            auto it = active_calls_.find(call->id);
+            if (it != active_calls_.end() && it->second == call) {
+                active_calls_.erase(it);
+            }
+            if (call->tool->exclusive()) {
+                busy_tools_.erase(call->tool);
+                // Calls of the tool queued meanwhile can run now
+                calls_cv_.notify_all();
+            }
+        }
+
+        // Per the MCP spec, cancelled requests get no response
+        BatchScope scope(call->batch.get());
+        if (call->cancelled) {
+            ESP_LOGI(TAG, "tools/call: Request %d cancelled", call->id);
+            if (std::holds_alternative<ImageContent*>(result)) {
+                delete std::get<ImageContent*>(result);
+            } else if (std::holds_alternative<cJSON*>(result)) {
+                cJSON_Delete(std::get<cJSON*>(result));
+            }
+        } else if (!error.empty()) {
+            ESP_LOGE(TAG, "tools/call: %s", error.c_str());
+            ReplyError(call->id, error);
+        } else {
+            ReplyToolResult(call->id, result);
+        }
+    }
+}
+
+bool McpServer::ReportProgress(int progress, int total, const std::string& message) {
+    auto call = current_tool_call;
+    if (call == nullptr) {
+        return true;
+    }
+    if (call->cancelled) {
+        return false;
+    }
+    if (call->progress_token.empty()) {
+        return true;
+    }
+
+    cJSON* params = cJSON_CreateObject();
+    cJSON_AddItemToObject(params, "progressToken", cJSON_Parse(call->progress_token.c_str()));
+    cJSON_AddNumberToObject(params, "progress", progress);
+    if (total > 0) {
+        cJSON_AddNumberToObject(params, "total", total);
+    }
+    if (!message.empty()) {
+        cJSON_AddStringToObject(params, "message", message.c_str());
+    }
+    char* params_str = cJSON_PrintUnformatted(params);
+    std::string payload = "{\"jsonrpc\":\"2.0\",\"method\":\"notifications/progress\",\"params\":";
+    payload += params_str;
+    payload += "}";
+    cJSON_free(params_str);
+    cJSON_Delete(params);
+    Application::GetInstance().SendMcpMessage(payload);
+    return true;
+}
+
+bool McpServer::IsCancelled() {
+    auto call = current_tool_call;
+    return call != nullptr && call->cancelled;
 }
@@ -4,40 +4,66 @@
 #include <string>
 #include <vector>
 #include <map>
+#include <unordered_map>
+#include <unordered_set>
+#include <string_view>
 #include <functional>
 #include <variant>
 #include <optional>
 #include <stdexcept>
+#include <algorithm>
 #include <thread>
+#include <mutex>
+#include <deque>
+#include <memory>
+#include <atomic>
+#include <condition_variable>
 #include <mbedtls/base64.h>
 
 #include <cJSON.h>
 
+// Raw bytes per base64 chunk, encodes to 4096 characters
+#define IMAGE_CONTENT_CHUNK_SIZE 3072
+
 class ImageContent {
 private:
-    std::string encoded_data_;
+    std::string data_;
     std::string mime_type_;
 
-    static std::string Base64Encode(const std::string& data) {
-        size_t dlen = 0, olen = 0;
-        mbedtls_base64_encode((unsigned char*)nullptr, 0, &dlen, (const unsigned char*)data.data(), data.size());
-        std::string result(dlen, 0);
-        mbedtls_base64_encode((unsigned char*)result.data(), result.size(), &olen, (const unsigned char*)data.data(), data.size());
-        return result;
-    }
-
 public:
-    ImageContent(const std::string& mime_type, const std::string& data) {
-        mime_type_ = mime_type;
-        // base64 encode data
-        encoded_data_ = Base64Encode(data);
+    // The image is kept raw and base64 encoded chunk by chunk while the result is sent
+    ImageContent(const std::string& mime_type, std::string data)
+        : data_(std::move(data)), mime_type_(mime_type) {}
+
+    inline const std::string& mime_type() const { return mime_type_; }
+
+    bool Encode(const std::function<bool(const char* data, size_t len)>& write) const {
+        std::string chunk(IMAGE_CONTENT_CHUNK_SIZE / 3 * 4 + 1, 0);
+        for (size_t offset = 0; offset < data_.size(); offset += IMAGE_CONTENT_CHUNK_SIZE) {
+            size_t len = std::min(data_.size() - offset, (size_t)IMAGE_CONTENT_CHUNK_SIZE);
+            size_t olen = 0;
+            if (mbedtls_base64_encode((unsigned char*)chunk.data(), chunk.size(), &olen,
+                    (const unsigned char*)data_.data() + offset, len) != 0) {
+                return false;
+            }
+            if (!write(chunk.data(), olen)) {
+                return false;
+            }
+        }
+        return true;
     }
 
     std::string to_json() const {
+        std::string encoded;
+        encoded.reserve((data_.size() + 2) / 3 * 4);
+        Encode([&encoded](const char* data, size_t len) {
+            encoded.append(data, len);
+            return true;
+        });
         cJSON *json = cJSON_CreateObject();
         cJSON_AddStringToObject(json, "type", "image");
         cJSON_AddStringToObject(json, "mimeType", mime_type_.c_str());
-        cJSON_AddStringToObject(json, "data", encoded_data_.c_str());
+        cJSON_AddStringToObject(json, "data", encoded.c_str());
         char* json_str = cJSON_PrintUnformatted(json);
         std::string result(json_str);
         cJSON_free(json_str);
@@ -55,9 +81,18 @@ enum PropertyType {
     kPropertyTypeString
 };
 
+// Property names are interned so that a bound argument shares its name with the
+// schema; the pool only grows while tools are being registered.
+inline const std::string* InternPropertyName(const std::string& name) {
+    static std::mutex mutex;
+    static std::unordered_set<std::string> names;
+    std::lock_guard<std::mutex> lock(mutex);
+    return &*names.insert(name).first;
+}
+
 class Property {
 private:
-    std::string name_;
+    const std::string* name_;
     PropertyType type_;
     std::variant<bool, int, std::string> value_;
     bool has_default_value_;
@@ -67,24 +102,24 @@ private:
 public:
     // Required field constructor
     Property(const std::string& name, PropertyType type)
-        : name_(name), type_(type), has_default_value_(false) {}
+        : name_(InternPropertyName(name)), type_(type), has_default_value_(false) {}
 
     // Optional field constructor with default value
     template<typename T>
     Property(const std::string& name, PropertyType type, const T& default_value)
-        : name_(name), type_(type), has_default_value_(true) {
+        : name_(InternPropertyName(name)), type_(type), has_default_value_(true) {
         value_ = default_value;
     }
 
     Property(const std::string& name, PropertyType type, int min_value, int max_value)
-        : name_(name), type_(type), has_default_value_(false), min_value_(min_value), max_value_(max_value) {
+        : name_(InternPropertyName(name)), type_(type), has_default_value_(false), min_value_(min_value), max_value_(max_value) {
         if (type != kPropertyTypeInteger) {
             throw std::invalid_argument("Range limits only apply to integer properties");
         }
     }
 
     Property(const std::string& name, PropertyType type, int default_value, int min_value, int max_value)
-        : name_(name), type_(type), has_default_value_(true), min_value_(min_value), max_value_(max_value) {
+        : name_(InternPropertyName(name)), type_(type), has_default_value_(true), min_value_(min_value), max_value_(max_value) {
         if (type != kPropertyTypeInteger) {
             throw std::invalid_argument("Range limits only apply to integer properties");
         }
@@ -94,7 +129,15 @@ public:
         value_ = default_value;
     }
 
-    inline const std::string& name() const { return name_; }
+    // Argument bound to this schema entry, with the name and limits of the schema and only its own value
+    template<typename T>
+    Property Bind(const T& value) const {
+        Property argument(name_, type_, min_value_, max_value_);
+        argument.set_value<T>(value);
+        return argument;
+    }
+
+    inline const std::string& name() const { return *name_; }
     inline PropertyType type() const { return type_; }
     inline bool has_default_value() const { return has_default_value_; }
     inline bool has_range() const { return min_value_.has_value() && max_value_.has_value(); }
@@ -120,7 +163,12 @@ public:
         value_ = value;
     }
 
-    std::string to_json() const {
+private:
+    Property(const std::string* name, PropertyType type, std::optional<int> min_value, std::optional<int> max_value)
+        : name_(name), type_(type), has_default_value_(true), min_value_(min_value), max_value_(max_value) {}
+
+public:
+    cJSON* to_cjson() const {
         cJSON *json = cJSON_CreateObject();
         
         if (type_ == kPropertyTypeBoolean) {
@@ -145,12 +193,15 @@ public:
                 cJSON_AddStringToObject(json, "default", value<std::string>().c_str());
             }
         }
-        
+        return json;
+    }
+
+    std::string to_json() const {
+        cJSON *json = to_cjson();
         char *json_str = cJSON_PrintUnformatted(json);
         std::string result(json_str);
         cJSON_free(json_str);
         cJSON_Delete(json);
-        
         return result;
     }
 };
@@ -158,12 +209,17 @@ public:
 class PropertyList {
 private:
     std::vector<Property> properties_;
+    // Tool schema that supplies the properties not in properties_, for the arguments of a call
+    const PropertyList* schema_ = nullptr;
 
 public:
     PropertyList() = default;
     PropertyList(const std::vector<Property>& properties) : properties_(properties) {}
-    void AddProperty(const Property& property) {
-        properties_.push_back(property);
+    // Arguments of a call: holds the values sent by the client and refers to the schema,
+    // which must outlive it, for the defaults of the rest
+    explicit PropertyList(const PropertyList* schema) : schema_(schema) {}
+    void AddProperty(Property property) {
+        properties_.push_back(std::move(property));
     }
 
     const Property& operator[](const std::string& name) const {
@@ -172,11 +228,16 @@ public:
                 return property;
             }
         }
+        if (schema_ != nullptr) {
+            return (*schema_)[name];
+        }
         throw std::runtime_error("Property not found: " + name);
     }
 
     auto begin() { return properties_.begin(); }
     auto end() { return properties_.end(); }
+    auto begin() const { return properties_.begin(); }
+    auto end() const { return properties_.end(); }
 
     std::vector<std::string> GetRequired() const {
         std::vector<std::string> required;
@@ -188,14 +249,16 @@ public:
         return required;
     }
 
-    std::string to_json() const {
+    cJSON* to_cjson() const {
         cJSON *json = cJSON_CreateObject();
-        
         for (const auto& property : properties_) {
-            cJSON *prop_json = cJSON_Parse(property.to_json().c_str());
-            cJSON_AddItemToObject(json, property.name().c_str(), prop_json);
+            cJSON_AddItemToObject(json, property.name().c_str(), property.to_cjson());
         }
-        
+        return json;
+    }
+
+    std::string to_json() const {
+        cJSON *json = to_cjson();
         char *json_str = cJSON_PrintUnformatted(json);
         std::string result(json_str);
         cJSON_free(json_str);
@@ -212,6 +275,8 @@ private:
     PropertyList properties_;
     std::function<ReturnValue(const PropertyList&)> callback_;
     bool user_only_ = false;
+    bool async_ = false;
+    bool exclusive_ = false;
 
 public:
     McpTool(const std::string& name, 
@@ -224,10 +289,16 @@ public:
         callback_(callback) {}
 
     void set_user_only(bool user_only) { user_only_ = user_only; }
+    // Async tools run on the MCP worker pool instead of the main task
+    void set_async(bool async) { async_ = async; }
+    // At most one call of an exclusive async tool runs at a time, for tools driving hardware that is not thread-safe
+    void set_exclusive(bool exclusive) { exclusive_ = exclusive; }
     inline const std::string& name() const { return name_; }
     inline const std::string& description() const { return description_; }
     inline const PropertyList& properties() const { return properties_; }
     inline bool user_only() const { return user_only_; }
+    inline bool async() const { return async_; }
+    inline bool exclusive() const { return exclusive_; }
 
     std::string to_json() const {
         std::vector<std::string> required = properties_.GetRequired();
@@ -239,8 +310,7 @@ public:
         cJSON *input_schema = cJSON_CreateObject();
         cJSON_AddStringToObject(input_schema, "type", "object");
         
-        cJSON *properties = cJSON_Parse(properties_.to_json().c_str());
-        cJSON_AddItemToObject(input_schema, "properties", properties);
+        cJSON_AddItemToObject(input_schema, "properties", properties_.to_cjson());
         
         if (!required.empty()) {
             cJSON *required_array = cJSON_CreateArray();
@@ -269,18 +339,23 @@ public:
         return result;
     }
 
+    ReturnValue Invoke(const PropertyList& properties) {
+        return callback_(properties);
+    }
+
     std::string Call(const PropertyList& properties) {
-        ReturnValue return_value = callback_(properties);
+        return FormatResult(Invoke(properties));
+    }
+
+    // Build the tools/call result and release the value
+    static std::string FormatResult(ReturnValue return_value) {
         // 返回结果
         cJSON* result = cJSON_CreateObject();
         cJSON* content = cJSON_CreateArray();
 
         if (std::holds_alternative<ImageContent*>(return_value)) {
             auto image_content = std::get<ImageContent*>(return_value);
-            cJSON* image = cJSON_CreateObject();
-            cJSON_AddStringToObject(image, "type", "image");
-            cJSON_AddStringToObject(image, "image", image_content->to_json().c_str());
-            cJSON_AddItemToArray(content, image);
+            cJSON_AddItemToArray(content, cJSON_Parse(image_content->to_json().c_str()));
             delete image_content;
         } else {
             cJSON* text = cJSON_CreateObject();
@@ -311,6 +386,42 @@ public:
     }
 };
 
+// JSON-RPC batch waiting for the responses of its requests
+struct McpBatch : public std::enable_shared_from_this<McpBatch> {
+    int pending = 0;
+    std::vector<std::string> responses;
+};
+
+// Tool call running on the MCP worker pool
+struct McpToolCall {
+    int id;
+    McpTool* tool;
+    PropertyList arguments;
+    std::string progress_token;     // Serialized JSON value, empty if the client did not ask for progress
+    std::shared_ptr<McpBatch> batch;    // Batch the request came in, null if it was sent on its own
+    std::atomic<bool> cancelled = false;
+};
+
+// tools/list results: every tool is serialized once and reused until the tool set changes,
+// the pages of both listings are assembled from these on demand
+struct McpToolsManifest {
+    struct Entry {
+        const McpTool* tool;
+        bool user_only;
+        std::string json;
+    };
+    std::vector<Entry> tools;
+    // Index of the first tool of each page, indexed by list_user_only_tools.
+    // The name of that tool is the cursor of the page, empty for the first one.
+    std::vector<size_t> page_starts[2];
+};
+
+#define MCP_TOOLS_PAGE_SIZE         8000
+// Workers are created when async calls would otherwise wait and then stay alive for good,
+// so the pool costs up to MCP_TOOL_WORKER_COUNT * MCP_TOOL_WORKER_STACK_SIZE (16 KB) of internal RAM
+#define MCP_TOOL_WORKER_COUNT       2
+#define MCP_TOOL_WORKER_STACK_SIZE  (4096 * 2)
+
 class McpServer {
 public:
     static McpServer& GetInstance() {
@@ -323,7 +434,16 @@ public:
     void AddTool(McpTool* tool);
     void AddTool(const std::string& name, const std::string& description, const PropertyList& properties, std::function<ReturnValue(const PropertyList&)> callback);
     void AddUserOnlyTool(const std::string& name, const std::string& description, const PropertyList& properties, std::function<ReturnValue(const PropertyList&)> callback);
+    void AddAsyncTool(const std::string& name, const std::string& description, const PropertyList& properties, std::function<ReturnValue(const PropertyList&)> callback, bool exclusive = false);
     void ParseMessage(const cJSON* json);
+
+    /**
+     * For use inside an async tool callback
+     * ReportProgress sends notifications/progress if the client supplied a progress token,
+     * and returns false once the call has been cancelled so that the tool can stop early.
+     */
+    static bool ReportProgress(int progress, int total, const std::string& message = "");
+    static bool IsCancelled();
     void ParseMessage(const std::string& message);
 
 private:
@@ -331,14 +451,46 @@ private:
     ~McpServer();
 
     void ParseCapabilities(const cJSON* capabilities);
+    void ParseBatch(const cJSON* json);
+    void CompleteBatchRequest(McpBatch* batch, std::string&& response);
+    void SendReply(std::string&& payload);
 
     void ReplyResult(int id, const std::string& result);
+    void ReplyToolResult(int id, ReturnValue value);
+    void ReplyImageResult(int id, ImageContent* image);
     void ReplyError(int id, const std::string& message);
 
     void GetToolsList(int id, const std::string& cursor, bool list_user_only_tools);
-    void DoToolCall(int id, const std::string& tool_name, const cJSON* tool_arguments);
+    void BuildToolsManifest();
+    void PaginateToolsManifest(bool list_user_only_tools);
+    void DoToolCall(int id, const std::string& tool_name, const cJSON* tool_arguments, const cJSON* meta);
+    bool BindArguments(int id, const McpTool* tool, const cJSON* tool_arguments, PropertyList& arguments);
+    void StartAsyncToolCall(std::shared_ptr<McpToolCall> call);
+    bool IsRunnable(const McpToolCall& call) const;
+    void CancelToolCall(int id);
+    void ToolWorkerTask();
 
     std::vector<McpTool*> tools_;
+    // Keys point into the tool's own name, tools are never removed
+    std::unordered_map<std::string_view, McpTool*> tool_index_;
+
+    // Guards the pending count and responses of every unfinished batch
+    std::mutex batch_mutex_;
+
+    std::mutex manifest_mutex_;
+    bool manifest_valid_ = false;
+    McpToolsManifest manifest_;
+    std::string manifest_hash_;
+
+    // Async tool calls, queued or running, keyed by request id
+    std::mutex calls_mutex_;
+    std::condition_variable calls_cv_;
+    std::deque<std::shared_ptr<McpToolCall>> pending_calls_;
+    std::map<int, std::shared_ptr<McpToolCall>> active_calls_;
+    // Exclusive tools with a call running
+    std::unordered_set<const McpTool*> busy_tools_;
+    int worker_count_ = 0;
+    int idle_workers_ = 0;
 };
 
 #endif // MCP_SERVER_H
@@ -0,0 +1,60 @@
+#include "memory_policy.h"
+#include "metrics.h"
+
+#include <esp_heap_caps.h>
+
+uint32_t MemoryPolicy::GetCaps(MemoryRegion region) {
+    switch (region) {
+        case MemoryRegion::kInternalDma:
+            return MALLOC_CAP_INTERNAL | MALLOC_CAP_DMA | MALLOC_CAP_8BIT;
+        case MemoryRegion::kInternalFast:
+            return MALLOC_CAP_INTERNAL | MALLOC_CAP_8BIT;
+        case MemoryRegion::kPsramBulk:
+            return MALLOC_CAP_SPIRAM | MALLOC_CAP_8BIT;
+    }
+    return MALLOC_CAP_DEFAULT;
+}
+
+const char* MemoryPolicy::GetRegionName(MemoryRegion region) {
+    switch (region) {
+        case MemoryRegion::kInternalDma:
+            return "internal_dma";
+        case MemoryRegion::kInternalFast:
+            return "internal_fast";
+        case MemoryRegion::kPsramBulk:
+            return "psram_bulk";
+    }
+    return "unknown";
+}
+
+static void* AllocateWithCaps(size_t size, size_t alignment, uint32_t caps) {
+    if (alignment == 0) {
+        return heap_caps_malloc(size, caps);
+    }
+    return heap_caps_aligned_alloc(alignment, size, caps);
+}
+
+void* MemoryPolicy::Allocate(MemoryRegion region, size_t size, size_t alignment) {
+    if (region != MemoryRegion::kPsramBulk) {
+        return AllocateWithCaps(size, alignment, GetCaps(region));
+    }
+
+    static const bool has_psram = heap_caps_get_total_size(MALLOC_CAP_SPIRAM) > 0;
+    if (has_psram) {
+        void* ptr = AllocateWithCaps(size, alignment, GetCaps(region));
+        if (ptr != nullptr) {
+            return ptr;
+        }
+    }
+    void* ptr = AllocateWithCaps(size, alignment, MALLOC_CAP_INTERNAL | MALLOC_CAP_8BIT);
+    // Only a full PSRAM counts, chips without it are expected to use internal RAM
+    if (ptr != nullptr && has_psram) {
+        static auto fallbacks = Metrics::GetInstance().GetCounter("memory.fallbacks");
+        fallbacks->Add();
+    }
+    return ptr;
+}
+
+void MemoryPolicy::Free(void* ptr) {
+    heap_caps_free(ptr);
+}
@@ -0,0 +1,123 @@
+#ifndef MEMORY_POLICY_H
+#define MEMORY_POLICY_H
+
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <new>
+#include <string>
+#include <vector>
+
+enum class MemoryRegion : uint8_t {
+    kInternalDma,       // Internal RAM reachable by DMA, for buffers handed to peripherals
+    kInternalFast,      // Internal RAM, for small buffers on real-time paths and kernel objects
+    kPsramBulk,         // PSRAM for large buffers touched at low rates, internal RAM without PSRAM
+};
+
+enum class BufferClass : uint8_t {
+    kDmaTransfer,       // Buffers handed to SPI or LCD DMA, such as the board display transfer buffers
+    kTaskControlBlock,  // StaticTask_t and other FreeRTOS objects
+    kTaskStack,         // Stacks of tasks that never touch flash or disable the cache
+    kWakeWordHistory,   // PCM and Opus kept around a wake word for voiceprint
+    kAssetCache,        // Decompressed assets
+    kCameraFrame,       // Captured, converted and rotated camera frames
+    kJpeg,              // Encoded JPEG images
+    kDownload,          // Files downloaded by MCP tools, such as preview images
+    kTrace,             // The trace recorder ring and its dumps
+};
+
+// The placement policy, every buffer class lives in one region
+constexpr MemoryRegion GetBufferRegion(BufferClass buffer_class) {
+    switch (buffer_class) {
+        case BufferClass::kDmaTransfer:
+            return MemoryRegion::kInternalDma;
+        case BufferClass::kTaskControlBlock:
+            return MemoryRegion::kInternalFast;
+        case BufferClass::kTaskStack:
+        case BufferClass::kWakeWordHistory:
+        case BufferClass::kAssetCache:
+        case BufferClass::kCameraFrame:
+        case BufferClass::kJpeg:
+        case BufferClass::kDownload:
+        case BufferClass::kTrace:
+            return MemoryRegion::kPsramBulk;
+    }
+    return MemoryRegion::kInternalFast;
+}
+
+/**
+ * MemoryPolicy - Places buffers by what they are used for
+ *
+ * Internal RAM is scarce and also needed by DMA, WiFi and the kernel, so large
+ * buffers should not land there by chance. Allocations go to the region of
+ * their buffer class. PSRAM falls back to internal RAM on chips without it or
+ * when it is full, the latter counted in the memory.fallbacks metric; the
+ * internal regions never fall back, their users need the guarantee. Memory
+ * from Allocate() may also be released with heap_caps_free().
+ */
+class MemoryPolicy {
+public:
+    static uint32_t GetCaps(MemoryRegion region);
+    static const char* GetRegionName(MemoryRegion region);
+
+    // Returns nullptr on failure, alignment 0 means the default of malloc
+    static void* Allocate(MemoryRegion region, size_t size, size_t alignment = 0);
+    static void* Allocate(BufferClass buffer_class, size_t size, size_t alignment = 0) {
+        return Allocate(GetBufferRegion(buffer_class), size, alignment);
+    }
+    static void Free(void* ptr);
+};
+
+// STL allocator placing the elements of a container in a memory region
+template <typename T, MemoryRegion Region>
+class RegionAllocator {
+public:
+    using value_type = T;
+
+    template <typename U>
+    struct rebind {
+        using other = RegionAllocator<U, Region>;
+    };
+
+    RegionAllocator() noexcept = default;
+    template <typename U>
+    RegionAllocator(const RegionAllocator<U, Region>&) noexcept {}
+
+    T* allocate(size_t n) {
+        if (n > SIZE_MAX / sizeof(T)) {
+            throw std::bad_alloc();
+        }
+        auto ptr = MemoryPolicy::Allocate(Region, n * sizeof(T), alignof(T) > 4 ? alignof(T) : 0);
+        if (ptr == nullptr) {
+            throw std::bad_alloc();
+        }
+        return static_cast<T*>(ptr);
+    }
+
+    void deallocate(T* ptr, size_t) noexcept {
+        MemoryPolicy::Free(ptr);
+    }
+
+    template <typename U>
+    bool operator==(const RegionAllocator<U, Region>&) const noexcept { return true; }
+    template <typename U>
+    bool operator!=(const RegionAllocator<U, Region>&) const noexcept { return false; }
+};
+
+template <typename T>
+using InternalFastAllocator = RegionAllocator<T, MemoryRegion::kInternalFast>;
+template <typename T>
+using PsramAllocator = RegionAllocator<T, MemoryRegion::kPsramBulk>;
+
+// Allocator for a buffer class, follows the placement policy
+template <typename T, BufferClass Class>
+using BufferAllocator = RegionAllocator<T, GetBufferRegion(Class)>;
+
+template <typename T, BufferClass Class>
+using BufferVector = std::vector<T, BufferAllocator<T, Class>>;
+template <typename T, BufferClass Class>
+using BufferDeque = std::deque<T, BufferAllocator<T, Class>>;
+template <BufferClass Class>
+using BufferString = std::basic_string<char, std::char_traits<char>, BufferAllocator<char, Class>>;
+
+#endif // MEMORY_POLICY_H
@@ -0,0 +1,115 @@
+#include "metrics.h"
+
+#include <cstring>
+#include <esp_log.h>
+#include <esp_timer.h>
+
+#define TAG "Metrics"
+
+MetricHistogram::MetricHistogram(const char* name, std::initializer_list<int32_t> bounds) : name_(name) {
+    if (bounds.size() > METRIC_HISTOGRAM_MAX_BUCKETS) {
+        ESP_LOGW(TAG, "Histogram %s has more than %d buckets", name, METRIC_HISTOGRAM_MAX_BUCKETS);
+    }
+    for (auto bound : bounds) {
+        if (bound_count_ == METRIC_HISTOGRAM_MAX_BUCKETS) {
+            break;
+        }
+        bounds_[bound_count_++] = bound;
+    }
+}
+
+void MetricHistogram::Record(int32_t value) {
+    // Bounds are few and ascending, a linear scan is the fastest
+    size_t bucket = 0;
+    while (bucket < bound_count_ && value > bounds_[bucket]) {
+        bucket++;
+    }
+    buckets_[bucket].fetch_add(1, std::memory_order_relaxed);
+    count_.fetch_add(1, std::memory_order_relaxed);
+    sum_.fetch_add(static_cast<uint32_t>(value), std::memory_order_relaxed);
+
+    int32_t max = max_.load(std::memory_order_relaxed);
+    while (value > max && !max_.compare_exchange_weak(max, value, std::memory_order_relaxed)) {
+    }
+}
+
+template <typename T>
+static T* FindMetric(std::deque<T>& metrics, const char* name) {
+    for (auto& metric : metrics) {
+        if (strcmp(metric.name(), name) == 0) {
+            return &metric;
+        }
+    }
+    return nullptr;
+}
+
+MetricCounter* Metrics::GetCounter(const char* name) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (auto metric = FindMetric(counters_, name)) {
+        return metric;
+    }
+    return &counters_.emplace_back(name);
+}
+
+MetricGauge* Metrics::GetGauge(const char* name) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (auto metric = FindMetric(gauges_, name)) {
+        return metric;
+    }
+    return &gauges_.emplace_back(name);
+}
+
+MetricHistogram* Metrics::GetHistogram(const char* name, std::initializer_list<int32_t> bounds) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (auto metric = FindMetric(histograms_, name)) {
+        return metric;
+    }
+    return &histograms_.emplace_back(name, bounds);
+}
+
+void Metrics::AddCollector(std::function<void()> collector) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    collectors_.push_back(collector);
+}
+
+std::string Metrics::ToJson() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    for (auto& collector : collectors_) {
+        collector();
+    }
+
+    // {"uptime":s,"counters":{name:n},"gauges":{name:n},"histograms":{name:{"le":[..],"counts":[..],"count":n,"sum":n,"max":n}}}
+    std::string json = "{\"uptime\":" + std::to_string(esp_timer_get_time() / 1000000);
+    json += ",\"counters\":{";
+    for (auto& counter : counters_) {
+        json += (&counter == &counters_.front() ? "\"" : ",\"");
+        json += counter.name();
+        json += "\":" + std::to_string(counter.value());
+    }
+    json += "},\"gauges\":{";
+    for (auto& gauge : gauges_) {
+        json += (&gauge == &gauges_.front() ? "\"" : ",\"");
+        json += gauge.name();
+        json += "\":" + std::to_string(gauge.value());
+    }
+    json += "},\"histograms\":{";
+    for (auto& histogram : histograms_) {
+        json += (&histogram == &histograms_.front() ? "\"" : ",\"");
+        json += histogram.name();
+        json += "\":{\"le\":[";
+        for (size_t i = 0; i < histogram.bound_count_; i++) {
+            json += (i == 0 ? "" : ",") + std::to_string(histogram.bounds_[i]);
+        }
+        json += "],\"counts\":[";
+        for (size_t i = 0; i <= histogram.bound_count_; i++) {
+            json += (i == 0 ? "" : ",") + std::to_string(histogram.buckets_[i].load(std::memory_order_relaxed));
+        }
+        uint32_t count = histogram.count_.load(std::memory_order_relaxed);
+        json += "],\"count\":" + std::to_string(count);
+        json += ",\"sum\":" + std::to_string(histogram.sum_.load(std::memory_order_relaxed));
+        json += ",\"max\":" + std::to_string(count > 0 ? histogram.max_.load(std::memory_order_relaxed) : 0);
+        json += "}";
+    }
+    json += "}}";
+    return json;
+}
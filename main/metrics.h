@@ -0,0 +1,103 @@
+#ifndef METRICS_H
+#define METRICS_H
+
+#include <atomic>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <initializer_list>
+#include <mutex>
+#include <string>
+#include <vector>
+
+// Monotonic count of events
+class MetricCounter {
+public:
+    explicit MetricCounter(const char* name) : name_(name) {}
+
+    void Add(uint32_t n = 1) { value_.fetch_add(n, std::memory_order_relaxed); }
+    uint32_t value() const { return value_.load(std::memory_order_relaxed); }
+    const char* name() const { return name_; }
+
+private:
+    const char* name_;
+    std::atomic<uint32_t> value_{0};
+};
+
+// Current value of something, such as a queue depth or free memory
+class MetricGauge {
+public:
+    explicit MetricGauge(const char* name) : name_(name) {}
+
+    void Set(int32_t value) { value_.store(value, std::memory_order_relaxed); }
+    void Add(int32_t n) { value_.fetch_add(n, std::memory_order_relaxed); }
+    int32_t value() const { return value_.load(std::memory_order_relaxed); }
+    const char* name() const { return name_; }
+
+private:
+    const char* name_;
+    std::atomic<int32_t> value_{0};
+};
+
+#define METRIC_HISTOGRAM_MAX_BUCKETS 12
+
+// Distribution of values over fixed buckets, each counting the values up to its bound
+class MetricHistogram {
+public:
+    MetricHistogram(const char* name, std::initializer_list<int32_t> bounds);
+
+    void Record(int32_t value);
+    const char* name() const { return name_; }
+
+private:
+    friend class Metrics;
+
+    const char* name_;
+    int32_t bounds_[METRIC_HISTOGRAM_MAX_BUCKETS];
+    size_t bound_count_ = 0;
+    // One more bucket for the values above the last bound
+    std::atomic<uint32_t> buckets_[METRIC_HISTOGRAM_MAX_BUCKETS + 1] = {};
+    std::atomic<uint32_t> count_{0};
+    std::atomic<int32_t> max_{INT32_MIN};
+    // Wraps around on long uptimes, consumers should use differences
+    std::atomic<uint32_t> sum_{0};
+};
+
+/**
+ * Metrics - Registry of named counters, gauges and histograms
+ *
+ * Metrics are registered once, usually when their owner is created, and live
+ * for the whole run. Updates are relaxed atomics and can be made from any
+ * task without locking. Collectors refresh gauges that are sampled rather
+ * than updated, and run right before each snapshot.
+ */
+class Metrics {
+public:
+    static Metrics& GetInstance() {
+        static Metrics instance;
+        return instance;
+    }
+
+    // Return the metric with this name, creating it on first use. name must be a string literal
+    MetricCounter* GetCounter(const char* name);
+    MetricGauge* GetGauge(const char* name);
+    MetricHistogram* GetHistogram(const char* name, std::initializer_list<int32_t> bounds);
+    void AddCollector(std::function<void()> collector);
+
+    // Compact JSON of all metrics
+    std::string ToJson();
+
+private:
+    Metrics() = default;
+    Metrics(const Metrics&) = delete;
+    Metrics& operator=(const Metrics&) = delete;
+
+    std::mutex mutex_;
+    // Deques keep the addresses of the metrics handed out
+    std::deque<MetricCounter> counters_;
+    std::deque<MetricGauge> gauges_;
+    std::deque<MetricHistogram> histograms_;
+    std::vector<std::function<void()>> collectors_;
+};
+
+#endif // METRICS_H
@@ -1,6 +1,8 @@
 #include "ota.h"
 #include "system_info.h"
 #include "settings.h"
+#include "downloader.h"
+#include "ota_patch.h"
 #include "assets/lang_config.h"
 
 #include <cJSON.h>
@@ -8,6 +10,7 @@
 #include <esp_partition.h>
 #include <esp_ota_ops.h>
 #include <esp_app_format.h>
+#include <esp_image_format.h>
 #include <esp_efuse.h>
 #include <esp_efuse_table.h>
 #ifdef SOC_HMAC_SUPPORTED
@@ -106,7 +109,7 @@ esp_err_t Ota::CheckVersion() {
     data = http->ReadAll();
     http->Close();
 
-    // Response: { "firmware": { "version": "1.0.0", "url": "http://" } }
+    // Response: { "firmware": { "version": "1.0.0", "url": "http://", "patch_url": "http://" } }
     // Parse the JSON response and check if the version is newer
     // If it is, set has_new_version_ to true and store the new version and URL
     
@@ -218,6 +221,9 @@ esp_err_t Ota::CheckVersion() {
         if (cJSON_IsString(url)) {
             firmware_url_ = url->valuestring;
         }
+        // Optional patch against the running firmware, identified by the elf_sha256 we report
+        cJSON *patch_url = cJSON_GetObjectItem(firmware, "patch_url");
+        firmware_patch_url_ = cJSON_IsString(patch_url) ? patch_url->valuestring : "";
 
         if (cJSON_IsString(version) && cJSON_IsString(url)) {
             // Check if the version is newer, for example, 0.1.0 is newer than 0.0.1
@@ -261,114 +267,139 @@ void Ota::MarkCurrentVersionValid() {
     }
 }
 
-bool Ota::Upgrade(const std::string& firmware_url, std::function<void(int progress, size_t speed)> callback) {
-    ESP_LOGI(TAG, "Upgrading firmware from %s", firmware_url.c_str());
-    esp_ota_handle_t update_handle = 0;
-    auto update_partition = esp_ota_get_next_update_partition(NULL);
-    if (update_partition == NULL) {
-        ESP_LOGE(TAG, "Failed to get update partition");
+// Checks the start of a new image and logs its version
+static bool CheckImageHeader(const uint8_t* data, size_t size) {
+    constexpr size_t header_size = sizeof(esp_image_header_t) + sizeof(esp_image_segment_header_t) + sizeof(esp_app_desc_t);
+    if (size < header_size || data[0] != ESP_IMAGE_HEADER_MAGIC) {
+        ESP_LOGE(TAG, "Invalid firmware image header");
         return false;
     }
+    esp_app_desc_t new_app_info;
+    memcpy(&new_app_info, data + sizeof(esp_image_header_t) + sizeof(esp_image_segment_header_t), sizeof(esp_app_desc_t));
+    auto current_version = esp_app_get_description()->version;
+    ESP_LOGI(TAG, "Current version: %s, New version: %s", current_version, new_app_info.version);
+    return true;
+}
 
-    ESP_LOGI(TAG, "Writing to partition %s at offset 0x%lx", update_partition->label, update_partition->address);
-    bool image_header_checked = false;
-    std::string image_header;
-
-    auto network = Board::GetInstance().GetNetwork();
-    auto http = network->CreateHttp(0);
-    if (!http->Open("GET", firmware_url)) {
-        ESP_LOGE(TAG, "Failed to open HTTP connection");
-        return false;
+// The partition is written without esp_ota_begin(), so its rollback check is repeated here: a new
+// image must not replace the previous one while the running image has not been confirmed yet
+static const esp_partition_t* GetUpdatePartition() {
+#ifdef CONFIG_BOOTLOADER_APP_ROLLBACK_ENABLE
+    esp_ota_img_states_t state;
+    if (esp_ota_get_state_partition(esp_ota_get_running_partition(), &state) == ESP_OK &&
+            state == ESP_OTA_IMG_PENDING_VERIFY) {
+        ESP_LOGE(TAG, "Running firmware is not marked valid yet: %s", esp_err_to_name(ESP_ERR_OTA_ROLLBACK_INVALID_STATE));
+        return nullptr;
     }
+#endif
+    auto partition = esp_ota_get_next_update_partition(NULL);
+    if (partition == NULL) {
+        ESP_LOGE(TAG, "Failed to get update partition");
+    }
+    return partition;
+}
 
-    if (http->GetStatusCode() != 200) {
-        ESP_LOGE(TAG, "Failed to get firmware, status code: %d", http->GetStatusCode());
+// esp_ota_set_boot_partition() verifies the whole image before switching to it
+static bool SetBootPartition(const esp_partition_t* partition) {
+    esp_err_t err = esp_ota_set_boot_partition(partition);
+    if (err != ESP_OK) {
+        if (err == ESP_ERR_OTA_VALIDATE_FAILED) {
+            ESP_LOGE(TAG, "Image validation failed, image is corrupted");
+        } else {
+            ESP_LOGE(TAG, "Failed to set boot partition: %s", esp_err_to_name(err));
+        }
         return false;
     }
+    ESP_LOGI(TAG, "Firmware upgrade successful");
+    return true;
+}
 
-    size_t content_length = http->GetBodyLength();
-    if (content_length == 0) {
-        ESP_LOGE(TAG, "Failed to get content length");
+bool Ota::Upgrade(const std::string& firmware_url, std::function<void(int progress, size_t speed)> callback) {
+    ESP_LOGI(TAG, "Upgrading firmware from %s", firmware_url.c_str());
+    auto update_partition = GetUpdatePartition();
+    if (update_partition == NULL) {
         return false;
     }
 
-    char buffer[512];
-    size_t total_read = 0, recent_read = 0;
-    auto last_calc_time = esp_timer_get_time();
-    while (true) {
-        int ret = http->Read(buffer, sizeof(buffer));
-        if (ret < 0) {
-            ESP_LOGE(TAG, "Failed to read HTTP data: %s", esp_err_to_name(ret));
-            return false;
-        }
-
-        // Calculate speed and progress every second
-        recent_read += ret;
-        total_read += ret;
-        if (esp_timer_get_time() - last_calc_time >= 1000000 || ret == 0) {
-            size_t progress = total_read * 100 / content_length;
-            ESP_LOGI(TAG, "Progress: %u%% (%u/%u), Speed: %uB/s", progress, total_read, content_length, recent_read);
-            if (callback) {
-                callback(progress, recent_read);
-            }
-            last_calc_time = esp_timer_get_time();
-            recent_read = 0;
-        }
-
-        if (ret == 0) {
-            break;
-        }
-
-        if (!image_header_checked) {
-            image_header.append(buffer, ret);
-            if (image_header.size() >= sizeof(esp_image_header_t) + sizeof(esp_image_segment_header_t) + sizeof(esp_app_desc_t)) {
-                esp_app_desc_t new_app_info;
-                memcpy(&new_app_info, image_header.data() + sizeof(esp_image_header_t) + sizeof(esp_image_segment_header_t), sizeof(esp_app_desc_t));
-                
-                auto current_version = esp_app_get_description()->version;
-                ESP_LOGI(TAG, "Current version: %s, New version: %s", current_version, new_app_info.version);
-
-                if (esp_ota_begin(update_partition, OTA_WITH_SEQUENTIAL_WRITES, &update_handle)) {
-                    esp_ota_abort(update_handle);
-                    ESP_LOGE(TAG, "Failed to begin OTA");
-                    return false;
-                }
+    ESP_LOGI(TAG, "Writing to partition %s at offset 0x%lx", update_partition->label, update_partition->address);
 
-                image_header_checked = true;
-                std::string().swap(image_header);
-            }
-        }
-        auto err = esp_ota_write(update_handle, buffer, ret);
-        if (err != ESP_OK) {
-            ESP_LOGE(TAG, "Failed to write OTA data: %s", esp_err_to_name(err));
-            esp_ota_abort(update_handle);
+    // The image is written straight to the partition so an interrupted download can resume
+    PartitionWriter writer(update_partition);
+    Downloader downloader(firmware_url, "ota");
+    downloader.set_max_size(update_partition->size);
+    bool ok = downloader.Run([&writer](size_t offset, const uint8_t* data, size_t size) {
+        if (offset == 0 && !CheckImageHeader(data, size)) {
             return false;
         }
+        return writer.Write(offset, data, size);
+    }, callback);
+    if (!ok) {
+        return false;
     }
-    http->Close();
+    return SetBootPartition(update_partition);
+}
 
-    esp_err_t err = esp_ota_end(update_handle);
-    if (err != ESP_OK) {
-        if (err == ESP_ERR_OTA_VALIDATE_FAILED) {
-            ESP_LOGE(TAG, "Image validation failed, image is corrupted");
-        } else {
-            ESP_LOGE(TAG, "Failed to end OTA: %s", esp_err_to_name(err));
-        }
+bool Ota::UpgradeWithPatch(const std::string& patch_url, std::function<void(int progress, size_t speed)> callback) {
+    ESP_LOGI(TAG, "Upgrading firmware with patch from %s", patch_url.c_str());
+    auto running_partition = esp_ota_get_running_partition();
+    auto update_partition = GetUpdatePartition();
+    if (update_partition == NULL) {
         return false;
     }
 
-    err = esp_ota_set_boot_partition(update_partition);
+    // A resumable full download into the same partition cannot continue after this
+    Downloader::ClearResume("ota");
+
+    // The patch was made against the running image file, which ends well before the partition
+    esp_partition_pos_t running_pos = { .offset = running_partition->address, .size = running_partition->size };
+    esp_image_metadata_t running_image = {};
+    esp_err_t err = esp_image_get_metadata(&running_pos, &running_image);
     if (err != ESP_OK) {
-        ESP_LOGE(TAG, "Failed to set boot partition: %s", esp_err_to_name(err));
+        ESP_LOGE(TAG, "Failed to get the running image length: %s", esp_err_to_name(err));
         return false;
     }
 
-    ESP_LOGI(TAG, "Firmware upgrade successful");
-    return true;
+    // The new image is rebuilt from the running image and the patch as it streams in
+    PartitionWriter writer(update_partition);
+    OtaPatch patch(esp_app_get_description()->app_elf_sha256, running_image.image_len,
+        [running_partition](size_t offset, uint8_t* data, size_t size) {
+            esp_err_t err = esp_partition_read(running_partition, offset, data, size);
+            if (err != ESP_OK) {
+                ESP_LOGE(TAG, "Failed to read running partition: %s", esp_err_to_name(err));
+                return false;
+            }
+            return true;
+        },
+        [&writer](size_t offset, const uint8_t* data, size_t size) {
+            if (offset == 0 && !CheckImageHeader(data, size)) {
+                return false;
+            }
+            return writer.Write(offset, data, size);
+        });
+
+    Downloader downloader(patch_url);
+    bool ok = downloader.Run([&patch](size_t, const uint8_t* data, size_t size) {
+        return patch.Feed(data, size);
+    }, callback);
+    if (!ok || !patch.Finish()) {
+        return false;
+    }
+    ESP_LOGI(TAG, "Rebuilt a %u byte image from a %u byte patch", patch.target_size(), downloader.total_size());
+    return SetBootPartition(update_partition);
+}
+
+bool Ota::Upgrade(const std::string& firmware_url, const std::string& patch_url, std::function<void(int progress, size_t speed)> callback) {
+    if (!patch_url.empty()) {
+        if (UpgradeWithPatch(patch_url, callback)) {
+            return true;
+        }
+        ESP_LOGW(TAG, "Patch upgrade failed, downloading the full firmware");
+    }
+    return Upgrade(firmware_url, callback);
 }
 
 bool Ota::StartUpgrade(std::function<void(int progress, size_t speed)> callback) {
-    return Upgrade(firmware_url_, callback);
+    return Upgrade(firmware_url_, firmware_patch_url_, callback);
 }
 
 
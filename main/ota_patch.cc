@@ -0,0 +1,165 @@
+#include "ota_patch.h"
+
+#include <algorithm>
+#include <cstring>
+#include <esp_log.h>
+
+#define TAG "OtaPatch"
+
+struct ota_patch_header {
+    char magic[4];                /*!< "XZOP" */
+    uint16_t format_version;
+    uint16_t reserved;
+    uint8_t source_elf_sha256[32];
+    uint32_t target_size;
+    uint8_t target_sha256[32];
+};
+
+struct ota_patch_operation {
+    uint32_t length;              /*!< OTA_PATCH_INSERT_FLAG set: literal bytes follow */
+    uint32_t source_offset;       /*!< Copy from this offset of the running image */
+};
+
+static_assert(sizeof(ota_patch_header) == 76, "ota_patch_header must match the patch generator");
+static_assert(sizeof(ota_patch_operation) == 8, "ota_patch_operation must match the patch generator");
+
+OtaPatch::OtaPatch(const uint8_t* source_elf_sha256, size_t source_size, ReadCallback read, WriteCallback write)
+    : source_size_(source_size), read_(read), write_(write) {
+    memcpy(source_elf_sha256_, source_elf_sha256, sizeof(source_elf_sha256_));
+    mbedtls_sha256_init(&sha256_);
+    mbedtls_sha256_starts(&sha256_, 0);
+    copy_buffer_.resize(OTA_PATCH_CHUNK_SIZE);
+    output_.reserve(OTA_PATCH_CHUNK_SIZE);
+}
+
+OtaPatch::~OtaPatch() {
+    mbedtls_sha256_free(&sha256_);
+}
+
+bool OtaPatch::ParseHeader() {
+    ota_patch_header header;
+    memcpy(&header, pending_, sizeof(header));
+    if (memcmp(header.magic, "XZOP", 4) != 0 || header.format_version != OTA_PATCH_FORMAT_VERSION) {
+        ESP_LOGE(TAG, "Invalid patch header");
+        return false;
+    }
+    if (memcmp(header.source_elf_sha256, source_elf_sha256_, sizeof(source_elf_sha256_)) != 0) {
+        ESP_LOGE(TAG, "The patch was not made for the running firmware");
+        return false;
+    }
+    target_size_ = header.target_size;
+    memcpy(target_sha256_, header.target_sha256, sizeof(target_sha256_));
+    ESP_LOGI(TAG, "Patching to a new image of %u bytes", target_size_);
+    return true;
+}
+
+bool OtaPatch::Flush() {
+    if (output_.empty()) {
+        return true;
+    }
+    bool ok = write_(produced_ - output_.size(), output_.data(), output_.size());
+    output_.clear();
+    return ok;
+}
+
+bool OtaPatch::Emit(const uint8_t* data, size_t size) {
+    if (size > target_size_ - produced_) {
+        ESP_LOGE(TAG, "The patch produces more than %u bytes", target_size_);
+        return false;
+    }
+    mbedtls_sha256_update(&sha256_, data, size);
+    while (size > 0) {
+        size_t n = std::min(size, OTA_PATCH_CHUNK_SIZE - output_.size());
+        output_.insert(output_.end(), data, data + n);
+        produced_ += n;
+        data += n;
+        size -= n;
+        if (output_.size() == OTA_PATCH_CHUNK_SIZE && !Flush()) {
+            return false;
+        }
+    }
+    return true;
+}
+
+bool OtaPatch::Copy(size_t offset, size_t size) {
+    if (offset > source_size_ || size > source_size_ - offset) {
+        ESP_LOGE(TAG, "Copy of %u bytes at %u is outside the running image", size, offset);
+        return false;
+    }
+    while (size > 0) {
+        size_t n = std::min<size_t>(size, copy_buffer_.size());
+        if (!read_(offset, copy_buffer_.data(), n) || !Emit(copy_buffer_.data(), n)) {
+            return false;
+        }
+        offset += n;
+        size -= n;
+    }
+    return true;
+}
+
+bool OtaPatch::Feed(const uint8_t* data, size_t size) {
+    while (size > 0) {
+        if (state_ == kStateInsert) {
+            size_t n = std::min(size, insert_remaining_);
+            if (!Emit(data, n)) {
+                return false;
+            }
+            data += n;
+            size -= n;
+            insert_remaining_ -= n;
+            if (insert_remaining_ == 0) {
+                state_ = kStateOperation;
+            }
+            continue;
+        }
+
+        // Headers may be split across pieces, collect them first
+        size_t needed = state_ == kStateHeader ? sizeof(ota_patch_header) : sizeof(ota_patch_operation);
+        size_t n = std::min(size, needed - pending_size_);
+        memcpy(pending_ + pending_size_, data, n);
+        pending_size_ += n;
+        data += n;
+        size -= n;
+        if (pending_size_ < needed) {
+            break;
+        }
+        pending_size_ = 0;
+
+        if (state_ == kStateHeader) {
+            if (!ParseHeader()) {
+                return false;
+            }
+            state_ = kStateOperation;
+            continue;
+        }
+
+        ota_patch_operation operation;
+        memcpy(&operation, pending_, sizeof(operation));
+        size_t length = operation.length & ~OTA_PATCH_INSERT_FLAG;
+        if (operation.length & OTA_PATCH_INSERT_FLAG) {
+            insert_remaining_ = length;
+            state_ = length > 0 ? kStateInsert : kStateOperation;
+        } else if (!Copy(operation.source_offset, length)) {
+            return false;
+        }
+    }
+    return true;
+}
+
+bool OtaPatch::Finish() {
+    if (state_ == kStateHeader || state_ == kStateInsert || pending_size_ != 0 || produced_ != target_size_) {
+        ESP_LOGE(TAG, "The patch ended early, %u of %u bytes produced", produced_, target_size_);
+        return false;
+    }
+    if (!Flush()) {
+        return false;
+    }
+
+    uint8_t digest[32];
+    mbedtls_sha256_finish(&sha256_, digest);
+    if (memcmp(digest, target_sha256_, sizeof(digest)) != 0) {
+        ESP_LOGE(TAG, "The patched image does not match the patch header");
+        return false;
+    }
+    return true;
+}
@@ -0,0 +1,72 @@
+#ifndef OTA_PATCH_H
+#define OTA_PATCH_H
+
+#include <cstdint>
+#include <functional>
+#include <vector>
+
+#include <mbedtls/sha256.h>
+
+// Written by scripts/ota_patch.py
+#define OTA_PATCH_FORMAT_VERSION    1
+#define OTA_PATCH_INSERT_FLAG       0x80000000
+#define OTA_PATCH_CHUNK_SIZE        4096
+
+/**
+ * OtaPatch - Rebuilds a new application image from the running one and a streamed patch
+ *
+ * The patch is a list of operations, each either copying a range of the running
+ * image or inserting literal bytes, which produce the new image from start to
+ * end. Patch data can be fed in pieces of any size as it arrives. Memory use is
+ * two chunks, whatever the size of the image or of a single operation.
+ */
+class OtaPatch {
+public:
+    // Reads the running image, fills size bytes at offset
+    using ReadCallback = std::function<bool(size_t offset, uint8_t* data, size_t size)>;
+    // Writes consecutive data of the new image
+    using WriteCallback = std::function<bool(size_t offset, const uint8_t* data, size_t size)>;
+
+    // source_elf_sha256 identifies the running image the patch must have been made against,
+    // source_size is the length of that image file, not of the partition holding it
+    OtaPatch(const uint8_t* source_elf_sha256, size_t source_size, ReadCallback read, WriteCallback write);
+    ~OtaPatch();
+
+    bool Feed(const uint8_t* data, size_t size);
+    // Flushes the rest of the image and checks it against the hash in the patch header
+    bool Finish();
+
+    size_t target_size() const { return target_size_; }
+
+private:
+    enum State {
+        kStateHeader,
+        kStateOperation,
+        kStateInsert,
+    };
+
+    uint8_t source_elf_sha256_[32];
+    size_t source_size_;
+    ReadCallback read_;
+    WriteCallback write_;
+
+    State state_ = kStateHeader;
+    // Header or operation being assembled from the stream
+    uint8_t pending_[76];
+    size_t pending_size_ = 0;
+    size_t insert_remaining_ = 0;
+
+    size_t target_size_ = 0;
+    uint8_t target_sha256_[32];
+    size_t produced_ = 0;
+    mbedtls_sha256_context sha256_;
+    std::vector<uint8_t> copy_buffer_;
+    std::vector<uint8_t> output_;
+
+    bool ParseHeader();
+    bool Copy(size_t offset, size_t size);
+    bool Emit(const uint8_t* data, size_t size);
+    bool Flush();
+};
+
+#endif // OTA_PATCH_H
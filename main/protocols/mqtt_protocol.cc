@@ -2,6 +2,8 @@
 #include "board.h"
 #include "application.h"
 #include "settings.h"
+#include "trace_recorder.h"
+#include "heap_accounting.h"
 
 #include <esp_log.h>
 #include <cstring>
@@ -25,7 +27,7 @@ MqttProtocol::MqttProtocol() {
                     if (*alive) {
                         protocol->StartMqttClient(false);
                     }
-                });
+                }, kSchedulePriorityBackground);
             }
         },
         .arg = this,
@@ -98,6 +100,8 @@ bool MqttProtocol::StartMqttClient(bool report_error) {
     });
 
     mqtt_->OnMessage([this](const std::string& topic, const std::string& payload) {
+        TRACE_SCOPE("mqtt.recv_json");
+        HeapTagScope heap_tag(kHeapTagJson);
         cJSON* root = cJSON_Parse(payload.c_str());
         if (root == nullptr) {
             ESP_LOGE(TAG, "Failed to parse json message %s", payload.c_str());
@@ -121,7 +125,7 @@ bool MqttProtocol::StartMqttClient(bool report_error) {
                     if (*alive) {
                         CloseAudioChannel();
                     }
-                });
+                }, kSchedulePriorityRealtime);
             }
         } else if (on_incoming_json_ != nullptr) {
             on_incoming_json_(root);
@@ -163,6 +167,7 @@ bool MqttProtocol::SendText(const std::string& text) {
 }
 
 bool MqttProtocol::SendAudio(std::unique_ptr<AudioStreamPacket> packet) {
+    TRACE_SCOPE("udp.send_audio");
     std::lock_guard<std::mutex> lock(channel_mutex_);
     if (udp_ == nullptr) {
         return false;
@@ -206,6 +211,7 @@ void MqttProtocol::CloseAudioChannel() {
 }
 
 bool MqttProtocol::OpenAudioChannel() {
+    TRACE_SCOPE("mqtt.open_channel");
     if (mqtt_ == nullptr || !mqtt_->IsConnected()) {
         ESP_LOGI(TAG, "MQTT is not connected, try to connect now");
         if (!StartMqttClient(true)) {
@@ -234,6 +240,7 @@ bool MqttProtocol::OpenAudioChannel() {
     auto network = Board::GetInstance().GetNetwork();
     udp_ = network->CreateUdp(2);
     udp_->OnMessage([this](const std::string& data) {
+        TRACE_INSTANT("udp.recv_audio", data.size());
         /*
          * UDP Encrypted OPUS Packet Format:
          * |type 1u|flags 1u|payload_len 2u|ssrc 4u|timestamp 4u|sequence 4u|
@@ -78,6 +78,29 @@ void Protocol::SendMcpMessage(const std::string& payload) {
     SendText(message);
 }
 
+void Protocol::SendMetrics(const std::string& metrics) {
+    std::string message = "{\"session_id\":\"" + session_id_ + "\",\"type\":\"metrics\",\"payload\":" + metrics + "}";
+    SendText(message);
+}
+
+void Protocol::SendMcpMessage(const TextProducer& payload) {
+    std::string head = "{\"session_id\":\"" + session_id_ + "\",\"type\":\"mcp\",\"payload\":";
+    SendTextStream([&head, &payload](const TextWriter& write) {
+        return write(head.data(), head.size()) && payload(write) && write("}", 1);
+    });
+}
+
+bool Protocol::SendTextStream(const TextProducer& producer) {
+    std::string text;
+    if (!producer([&text](const char* data, size_t len) {
+        text.append(data, len);
+        return true;
+    })) {
+        return false;
+    }
+    return SendText(text);
+}
+
 bool Protocol::IsTimeout() const {
     const int kTimeoutSeconds = 120;
     auto now = std::chrono::steady_clock::now();
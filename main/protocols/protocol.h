@@ -5,6 +5,7 @@
 #include <string>
 #include <functional>
 #include <chrono>
+#include <memory>
 #include <vector>
 
 struct AudioStreamPacket {
@@ -30,6 +31,11 @@ struct BinaryProtocol3 {
     uint8_t payload[];
 } __attribute__((packed));
 
+// Receives one piece of a streamed text message, returns false to abort
+using TextWriter = std::function<bool(const char* data, size_t len)>;
+// Produces a text message piece by piece, so that large messages never exist in memory as a whole
+using TextProducer = std::function<bool(const TextWriter& write)>;
+
 enum AbortReason {
     kAbortReasonNone,
     kAbortReasonWakeWordDetected
@@ -67,12 +73,16 @@ public:
     virtual bool OpenAudioChannel() = 0;
     virtual void CloseAudioChannel() = 0;
     virtual bool IsAudioChannelOpened() const = 0;
+    // Optionally warm up the connection ahead of OpenAudioChannel(), must not block the caller
+    virtual void PreConnect() {}
     virtual bool SendAudio(std::unique_ptr<AudioStreamPacket> packet) = 0;
     virtual void SendWakeWordDetected(const std::string& wake_word);
     virtual void SendStartListening(ListeningMode mode);
     virtual void SendStopListening();
     virtual void SendAbortSpeaking(AbortReason reason);
     virtual void SendMcpMessage(const std::string& message);
+    void SendMcpMessage(const TextProducer& payload);
+    virtual void SendMetrics(const std::string& metrics);
 
 protected:
     std::function<void(const cJSON* root)> on_incoming_json_;
@@ -90,6 +100,8 @@ protected:
     std::chrono::time_point<std::chrono::steady_clock> last_incoming_time_;
 
     virtual bool SendText(const std::string& text) = 0;
+    // Transports that can fragment a message override this; the default assembles it first
+    virtual bool SendTextStream(const TextProducer& producer);
     virtual void SetError(const std::string& message);
     virtual bool IsTimeout() const;
 };
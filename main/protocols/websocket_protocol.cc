@@ -3,20 +3,73 @@
 #include "system_info.h"
 #include "application.h"
 #include "settings.h"
+#include "trace_recorder.h"
+#include "heap_accounting.h"
 
 #include <cstring>
+#include <algorithm>
 #include <cJSON.h>
 #include <esp_log.h>
+#include <esp_pthread.h>
 #include <arpa/inet.h>
 #include "assets/lang_config.h"
 
 #define TAG "WS"
 
+// ws_preconnect warns when less than this much of its stack was left unused by the TLS handshake
+#define PRE_CONNECT_STACK_WARNING 1024
+
 WebsocketProtocol::WebsocketProtocol() {
     event_group_handle_ = xEventGroupCreate();
+
+    Settings settings("websocket", false);
+    keep_warm_seconds_ = settings.GetInt("keep_warm", CONFIG_WEBSOCKET_KEEP_WARM_SECONDS);
+
+    esp_timer_create_args_t keep_warm_timer_args = {
+        .callback = [](void* arg) {
+            WebsocketProtocol* protocol = (WebsocketProtocol*)arg;
+            auto alive = protocol->alive_;  // Capture alive flag
+            Application::GetInstance().Schedule([protocol, alive]() {
+                if (!*alive) {
+                    return;
+                }
+                std::unique_lock<std::mutex> lock(protocol->connect_mutex_, std::try_to_lock);
+                if (!lock.owns_lock()) {
+                    // A connect or pre-connect is in progress, check again after another window
+                    protocol->StartKeepWarmTimer();
+                } else if (!protocol->audio_channel_opened_ && protocol->websocket_ != nullptr) {
+                    ESP_LOGI(TAG, "Keep-warm window expired, closing websocket");
+                    protocol->ResetWebSocket();
+                    protocol->session_ready_ = false;
+                }
+            }, kSchedulePriorityBackground);
+        },
+        .arg = this,
+        .dispatch_method = ESP_TIMER_TASK,
+        .name = "ws_keep_warm",
+        .skip_unhandled_events = true,
+    };
+    esp_timer_create(&keep_warm_timer_args, &keep_warm_timer_);
 }
 
 WebsocketProtocol::~WebsocketProtocol() {
+    // Mark as dead first to prevent any pending scheduled tasks from executing
+    *alive_ = false;
+
+    if (keep_warm_timer_ != nullptr) {
+        esp_timer_stop(keep_warm_timer_);
+        esp_timer_delete(keep_warm_timer_);
+    }
+
+    // A pending pre-connect sees alive_ cleared and skips connecting, one in progress is waited for
+    if (pre_connect_thread_.joinable()) {
+        pre_connect_thread_.join();
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(connect_mutex_);
+        ResetWebSocket();
+    }
     vEventGroupDelete(event_group_handle_);
 }
 
@@ -26,6 +79,8 @@ bool WebsocketProtocol::Start() {
 }
 
 bool WebsocketProtocol::SendAudio(std::unique_ptr<AudioStreamPacket> packet) {
+    TRACE_SCOPE("ws.send_audio");
+    std::lock_guard<std::mutex> lock(send_mutex_);
     if (websocket_ == nullptr || !websocket_->IsConnected()) {
         return false;
     }
@@ -58,6 +113,7 @@ bool WebsocketProtocol::SendAudio(std::unique_ptr<AudioStreamPacket> packet) {
 }
 
 bool WebsocketProtocol::SendText(const std::string& text) {
+    std::lock_guard<std::mutex> lock(send_mutex_);
     if (websocket_ == nullptr || !websocket_->IsConnected()) {
         return false;
     }
@@ -71,27 +127,175 @@ bool WebsocketProtocol::SendText(const std::string& text) {
     return true;
 }
 
+bool WebsocketProtocol::SendTextStream(const TextProducer& producer) {
+    std::lock_guard<std::mutex> lock(send_mutex_);
+    if (websocket_ == nullptr || !websocket_->IsConnected()) {
+        return false;
+    }
+
+    // Pieces are coalesced into fragments; the last fragment is held back so it can carry FIN
+    std::string fragment;
+    fragment.reserve(WEBSOCKET_TEXT_FRAGMENT_SIZE);
+    size_t total_size = 0;
+    bool ok = producer([this, &fragment, &total_size](const char* data, size_t len) {
+        while (len > 0) {
+            if (fragment.size() == WEBSOCKET_TEXT_FRAGMENT_SIZE) {
+                if (!websocket_->Send(fragment.data(), fragment.size(), false, false)) {
+                    return false;
+                }
+                total_size += fragment.size();
+                fragment.clear();
+            }
+            size_t n = std::min(len, WEBSOCKET_TEXT_FRAGMENT_SIZE - fragment.size());
+            fragment.append(data, n);
+            data += n;
+            len -= n;
+        }
+        return true;
+    });
+    if (ok) {
+        ok = websocket_->Send(fragment.data(), fragment.size(), false, true);
+        total_size += fragment.size();
+    }
+
+    if (!ok) {
+        // The message can not be completed, so the connection is no longer usable
+        ESP_LOGE(TAG, "Failed to send streamed text after %u bytes", total_size);
+        SetError(Lang::Strings::SERVER_ERROR);
+        return false;
+    }
+    ESP_LOGI(TAG, "Sent streamed text: %u bytes", total_size);
+    return true;
+}
+
 bool WebsocketProtocol::IsAudioChannelOpened() const {
+    return audio_channel_opened_ && IsConnectionWarm();
+}
+
+bool WebsocketProtocol::IsConnectionWarm() const {
     return websocket_ != nullptr && websocket_->IsConnected() && !error_occurred_ && !IsTimeout();
 }
 
+void WebsocketProtocol::StartKeepWarmTimer() {
+    esp_timer_stop(keep_warm_timer_);
+    esp_timer_start_once(keep_warm_timer_, keep_warm_seconds_ * 1000000ULL);
+}
+
 void WebsocketProtocol::CloseAudioChannel() {
-    websocket_.reset();
+    std::lock_guard<std::mutex> lock(connect_mutex_);
+    if (keep_warm_seconds_ > 0 && audio_channel_opened_ && IsConnectionWarm()) {
+        // End the session but keep the connection for the next conversation
+        std::string message = "{\"session_id\":\"" + session_id_ + "\",\"type\":\"goodbye\"}";
+        SendText(message);
+        session_ready_ = false;
+        audio_channel_opened_ = false;
+        StartKeepWarmTimer();
+        if (on_audio_channel_closed_ != nullptr) {
+            on_audio_channel_closed_();
+        }
+        return;
+    }
+
+    ResetWebSocket();
+    audio_channel_opened_ = false;
+    session_ready_ = false;
+}
+
+void WebsocketProtocol::ResetWebSocket() {
+    // Must be called with connect_mutex_ held. Audio is sent from the audio send task under
+    // send_mutex_ only, so the socket is taken out under that lock and destroyed after it
+    std::unique_ptr<WebSocket> websocket;
+    {
+        std::lock_guard<std::mutex> lock(send_mutex_);
+        websocket = std::move(websocket_);
+    }
+}
+
+void WebsocketProtocol::PreConnect() {
+    if (keep_warm_seconds_ <= 0) {
+        return;
+    }
+
+    std::unique_lock<std::mutex> lock(connect_mutex_, std::try_to_lock);
+    if (!lock.owns_lock() || pre_connecting_ || IsConnectionWarm()) {
+        return;
+    }
+    // The previous pre-connect has cleared pre_connecting_ and released the lock, it is only exiting
+    if (pre_connect_thread_.joinable()) {
+        pre_connect_thread_.join();
+    }
+    pre_connecting_ = true;
+    lock.unlock();
+
+    auto cfg = esp_pthread_get_default_config();
+    cfg.thread_name = "ws_preconnect";
+    // TLS handshake depth, same as the MCP tool workers
+    cfg.stack_size = 4096 * 2;
+    cfg.prio = 2;
+    esp_pthread_set_cfg(&cfg);
+    pre_connect_thread_ = std::thread([this]() {
+        std::lock_guard<std::mutex> lock(connect_mutex_);
+        if (*alive_ && !IsConnectionWarm()) {
+            // Only the transport is warmed up, the hello is sent once the wake word is confirmed
+            auto start_time = esp_timer_get_time();
+            if (Connect(false)) {
+                ESP_LOGI(TAG, "Pre-connected in %d ms", int((esp_timer_get_time() - start_time) / 1000));
+                auto unused = uxTaskGetStackHighWaterMark(NULL);
+                if (unused < PRE_CONNECT_STACK_WARNING) {
+                    ESP_LOGW(TAG, "ws_preconnect left only %u bytes of stack unused", (unsigned)unused);
+                }
+                StartKeepWarmTimer();
+            }
+        }
+        pre_connecting_ = false;
+    });
+    // Leave later threads of the calling task on the default configuration
+    cfg = esp_pthread_get_default_config();
+    esp_pthread_set_cfg(&cfg);
 }
 
 bool WebsocketProtocol::OpenAudioChannel() {
+    TRACE_SCOPE("ws.open_channel");
+    std::lock_guard<std::mutex> lock(connect_mutex_);
+    esp_timer_stop(keep_warm_timer_);
+
+    auto start_time = esp_timer_get_time();
+    if (IsConnectionWarm()) {
+        ESP_LOGI(TAG, "Reusing warm websocket connection");
+    } else if (!Connect(true)) {
+        return false;
+    }
+
+    if (!session_ready_ && !SendHelloAndWait()) {
+        return false;
+    }
+    ESP_LOGI(TAG, "Audio channel opened in %d ms", int((esp_timer_get_time() - start_time) / 1000));
+
+    audio_channel_opened_ = true;
+    if (on_audio_channel_opened_ != nullptr) {
+        on_audio_channel_opened_();
+    }
+    return true;
+}
+
+bool WebsocketProtocol::Connect(bool report_error) {
     Settings settings("websocket", false);
     std::string url = settings.GetString("url");
     std::string token = settings.GetString("token");
     int version = settings.GetInt("version");
-    if (version != 0) {
-        version_ = version;
-    }
 
     error_occurred_ = false;
+    session_ready_ = false;
 
+    ResetWebSocket();
     auto network = Board::GetInstance().GetNetwork();
-    websocket_ = network->CreateWebSocket(1);
+    {
+        std::lock_guard<std::mutex> lock(send_mutex_);
+        if (version != 0) {
+            version_ = version;
+        }
+        websocket_ = network->CreateWebSocket(1);
+    }
     if (websocket_ == nullptr) {
         ESP_LOGE(TAG, "Failed to create websocket");
         return false;
@@ -110,6 +314,11 @@ bool WebsocketProtocol::OpenAudioChannel() {
 
     websocket_->OnData([this](const char* data, size_t len, bool binary) {
         if (binary) {
+            TRACE_INSTANT("ws.recv_audio", len);
+            // Drop the audio of a session which is already closed while the connection is kept warm
+            if (!session_ready_) {
+                return;
+            }
             if (on_incoming_audio_ != nullptr) {
                 if (version_ == 2) {
                     BinaryProtocol2* bp2 = (BinaryProtocol2*)data;
@@ -146,12 +355,14 @@ bool WebsocketProtocol::OpenAudioChannel() {
             }
         } else {
             // Parse JSON data
+            TRACE_SCOPE("ws.recv_json");
+            HeapTagScope heap_tag(kHeapTagJson);
             auto root = cJSON_Parse(data);
             auto type = cJSON_GetObjectItem(root, "type");
             if (cJSON_IsString(type)) {
                 if (strcmp(type->valuestring, "hello") == 0) {
                     ParseServerHello(root);
-                } else {
+                } else if (session_ready_) {
                     if (on_incoming_json_ != nullptr) {
                         on_incoming_json_(root);
                     }
@@ -166,7 +377,8 @@ bool WebsocketProtocol::OpenAudioChannel() {
 
     websocket_->OnDisconnected([this]() {
         ESP_LOGI(TAG, "Websocket disconnected");
-        if (on_audio_channel_closed_ != nullptr) {
+        // A warm idle connection has no audio channel to close
+        if (audio_channel_opened_ && on_audio_channel_closed_ != nullptr) {
             on_audio_channel_closed_();
         }
     });
@@ -174,13 +386,24 @@ bool WebsocketProtocol::OpenAudioChannel() {
     ESP_LOGI(TAG, "Connecting to websocket server: %s with version: %d", url.c_str(), version_);
     if (!websocket_->Connect(url.c_str())) {
         ESP_LOGE(TAG, "Failed to connect to websocket server, code=%d", websocket_->GetLastError());
-        SetError(Lang::Strings::SERVER_NOT_CONNECTED);
+        if (report_error) {
+            SetError(Lang::Strings::SERVER_NOT_CONNECTED);
+        } else {
+            ResetWebSocket();
+        }
         return false;
     }
+    return true;
+}
+
+bool WebsocketProtocol::SendHelloAndWait() {
+    xEventGroupClearBits(event_group_handle_, WEBSOCKET_PROTOCOL_SERVER_HELLO_EVENT);
 
     // Send hello message to describe the client
     auto message = GetHelloMessage();
-    if (!SendText(message)) {
+    if (!websocket_->Send(message)) {
+        ESP_LOGE(TAG, "Failed to send hello message");
+        SetError(Lang::Strings::SERVER_ERROR);
         return false;
     }
 
@@ -191,11 +414,6 @@ bool WebsocketProtocol::OpenAudioChannel() {
         SetError(Lang::Strings::SERVER_TIMEOUT);
         return false;
     }
-
-    if (on_audio_channel_opened_ != nullptr) {
-        on_audio_channel_opened_();
-    }
-
     return true;
 }
 
@@ -249,5 +467,6 @@ void WebsocketProtocol::ParseServerHello(const cJSON* root) {
         }
     }
 
+    session_ready_ = true;
     xEventGroupSetBits(event_group_handle_, WEBSOCKET_PROTOCOL_SERVER_HELLO_EVENT);
 }
@@ -7,8 +7,16 @@
 #include <web_socket.h>
 #include <freertos/FreeRTOS.h>
 #include <freertos/event_groups.h>
+#include <esp_timer.h>
+
+#include <mutex>
+#include <memory>
+#include <atomic>
+#include <thread>
 
 #define WEBSOCKET_PROTOCOL_SERVER_HELLO_EVENT (1 << 0)
+// Streamed text messages are sent as fragments of about this size
+#define WEBSOCKET_TEXT_FRAGMENT_SIZE 4096
 
 class WebsocketProtocol : public Protocol {
 public:
@@ -20,14 +28,38 @@ public:
     bool OpenAudioChannel() override;
     void CloseAudioChannel() override;
     bool IsAudioChannelOpened() const override;
+    void PreConnect() override;
 
 private:
+    // Alive flag for safe scheduled callbacks - set to false in destructor
+    std::shared_ptr<std::atomic<bool>> alive_ = std::make_shared<std::atomic<bool>>(true);
+
     EventGroupHandle_t event_group_handle_;
     std::unique_ptr<WebSocket> websocket_;
+    // Keeps audio frames from being interleaved with the fragments of a streamed text message.
+    // websocket_ is replaced or reset under both connect_mutex_ and this lock.
+    std::mutex send_mutex_;
     int version_ = 1;
 
+    // Keep-warm: the connection is kept idle for keep_warm_seconds_ after the channel is closed
+    std::mutex connect_mutex_;
+    esp_timer_handle_t keep_warm_timer_ = nullptr;
+    int keep_warm_seconds_ = 0;
+    // Read by the websocket task and the audio path without connect_mutex_
+    std::atomic<bool> audio_channel_opened_{false};
+    std::atomic<bool> session_ready_{false};
+    std::atomic<bool> pre_connecting_{false};
+    // Joined before the next pre-connect and in the destructor, so it never outlives this object
+    std::thread pre_connect_thread_;
+
+    bool Connect(bool report_error);
+    void ResetWebSocket();
+    bool SendHelloAndWait();
+    bool IsConnectionWarm() const;
+    void StartKeepWarmTimer();
     void ParseServerHello(const cJSON* root);
     bool SendText(const std::string& text) override;
+    bool SendTextStream(const TextProducer& producer) override;
     std::string GetHelloMessage();
 };
 
@@ -1,108 +1,317 @@
 #include "settings.h"
+#include "application.h"
 
 #include <esp_log.h>
+#include <esp_timer.h>
+#include <esp_system.h>
 #include <nvs_flash.h>
 
+#include <map>
+#include <memory>
+#include <mutex>
+
 #define TAG "Settings"
 
-Settings::Settings(const std::string& ns, bool read_write) : ns_(ns), read_write_(read_write) {
-    nvs_open(ns.c_str(), read_write_ ? NVS_READWRITE : NVS_READONLY, &nvs_handle_);
+// Writes within this time are committed together
+#define SETTINGS_COMMIT_DELAY_MS 1000
+
+struct SettingsValue {
+    nvs_type_t type = NVS_TYPE_ANY;   // NVS_TYPE_ANY marks an erased value
+    int32_t int_value = 0;
+    std::string string_value;
+    bool dirty = false;
+};
+
+struct SettingsNamespace {
+    std::string name;
+    std::map<std::string, SettingsValue, std::less<>> values;
+    bool erase_all = false;
+    bool dirty = false;
+};
+
+// Cache of all namespaces opened so far, values are only read from NVS once
+class SettingsStore {
+public:
+    static SettingsStore& GetInstance() {
+        static SettingsStore instance;
+        return instance;
+    }
+
+    SettingsNamespace* Open(const std::string& ns);
+    void ScheduleCommit();
+    void Commit();
+
+private:
+    friend class Settings;
+    std::mutex mutex_;
+    std::map<std::string, std::unique_ptr<SettingsNamespace>, std::less<>> namespaces_;
+    esp_timer_handle_t commit_timer_ = nullptr;
+
+    SettingsStore();
+    void Load(SettingsNamespace& ns);
+    void CommitNamespace(SettingsNamespace& ns);
+};
+
+SettingsStore::SettingsStore() {
+    esp_timer_create_args_t timer_args = {
+        .callback = [](void* arg) {
+            // Erasing and writing flash takes too long for the esp_timer task
+            auto store = static_cast<SettingsStore*>(arg);
+            Application::GetInstance().Schedule([store]() {
+                store->Commit();
+            }, kSchedulePriorityBackground);
+        },
+        .arg = this,
+        .dispatch_method = ESP_TIMER_TASK,
+        .name = "settings_commit",
+        .skip_unhandled_events = true,
+    };
+    ESP_ERROR_CHECK(esp_timer_create(&timer_args, &commit_timer_));
+    // Pending writes must reach flash before a restart
+    esp_register_shutdown_handler([]() {
+        SettingsStore::GetInstance().Commit();
+    });
+}
+
+SettingsNamespace* SettingsStore::Open(const std::string& ns) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    auto it = namespaces_.find(ns);
+    if (it != namespaces_.end()) {
+        return it->second.get();
+    }
+    auto entry = std::make_unique<SettingsNamespace>();
+    entry->name = ns;
+    Load(*entry);
+    return namespaces_.emplace(ns, std::move(entry)).first->second.get();
 }
 
-Settings::~Settings() {
-    if (nvs_handle_ != 0) {
-        if (read_write_ && dirty_) {
-            ESP_ERROR_CHECK(nvs_commit(nvs_handle_));
+void SettingsStore::Load(SettingsNamespace& ns) {
+    nvs_handle_t nvs_handle;
+    if (nvs_open(ns.name.c_str(), NVS_READONLY, &nvs_handle) != ESP_OK) {
+        // The namespace does not exist yet
+        return;
+    }
+
+    // Only the types accessible through Settings are cached
+    nvs_iterator_t it = nullptr;
+    esp_err_t ret = nvs_entry_find(NVS_DEFAULT_PART_NAME, ns.name.c_str(), NVS_TYPE_ANY, &it);
+    while (ret == ESP_OK) {
+        nvs_entry_info_t info;
+        nvs_entry_info(it, &info);
+        SettingsValue value;
+        value.type = info.type;
+        if (info.type == NVS_TYPE_I32) {
+            nvs_get_i32(nvs_handle, info.key, &value.int_value);
+            ns.values.emplace(info.key, std::move(value));
+        } else if (info.type == NVS_TYPE_U8) {
+            uint8_t u8 = 0;
+            nvs_get_u8(nvs_handle, info.key, &u8);
+            value.int_value = u8;
+            ns.values.emplace(info.key, std::move(value));
+        } else if (info.type == NVS_TYPE_STR) {
+            size_t length = 0;
+            if (nvs_get_str(nvs_handle, info.key, nullptr, &length) == ESP_OK && length > 0) {
+                value.string_value.resize(length);
+                nvs_get_str(nvs_handle, info.key, value.string_value.data(), &length);
+                value.string_value.resize(length - 1);
+                ns.values.emplace(info.key, std::move(value));
+            }
         }
-        nvs_close(nvs_handle_);
+        ret = nvs_entry_next(&it);
     }
+    nvs_release_iterator(it);
+    nvs_close(nvs_handle);
+    ESP_LOGD(TAG, "Loaded %u values of namespace %s", ns.values.size(), ns.name.c_str());
 }
 
-std::string Settings::GetString(const std::string& key, const std::string& default_value) {
-    if (nvs_handle_ == 0) {
-        return default_value;
+void SettingsStore::ScheduleCommit() {
+    // Restarted by every write, so a burst of writes is committed once
+    esp_timer_stop(commit_timer_);
+    esp_timer_start_once(commit_timer_, SETTINGS_COMMIT_DELAY_MS * 1000);
+}
+
+void SettingsStore::Commit() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    esp_timer_stop(commit_timer_);
+    for (auto& [name, ns] : namespaces_) {
+        if (ns->dirty) {
+            CommitNamespace(*ns);
+        }
     }
+}
 
-    size_t length = 0;
-    if (nvs_get_str(nvs_handle_, key.c_str(), nullptr, &length) != ESP_OK) {
-        return default_value;
+void SettingsStore::CommitNamespace(SettingsNamespace& ns) {
+    nvs_handle_t nvs_handle;
+    esp_err_t ret = nvs_open(ns.name.c_str(), NVS_READWRITE, &nvs_handle);
+    if (ret != ESP_OK) {
+        ESP_LOGE(TAG, "Failed to open namespace %s: %s", ns.name.c_str(), esp_err_to_name(ret));
+        return;
+    }
+
+    if (ns.erase_all) {
+        ret = nvs_erase_all(nvs_handle);
+        if (ret != ESP_OK) {
+            ESP_LOGE(TAG, "Failed to erase namespace %s: %s", ns.name.c_str(), esp_err_to_name(ret));
+        }
+        ns.erase_all = false;
+    }
+
+    for (auto it = ns.values.begin(); it != ns.values.end();) {
+        auto& [key, value] = *it;
+        if (!value.dirty) {
+            ++it;
+            continue;
+        }
+        value.dirty = false;
+        switch (value.type) {
+        case NVS_TYPE_I32:
+            ret = nvs_set_i32(nvs_handle, key.c_str(), value.int_value);
+            break;
+        case NVS_TYPE_U8:
+            ret = nvs_set_u8(nvs_handle, key.c_str(), value.int_value);
+            break;
+        case NVS_TYPE_STR:
+            ret = nvs_set_str(nvs_handle, key.c_str(), value.string_value.c_str());
+            break;
+        default:
+            ret = nvs_erase_key(nvs_handle, key.c_str());
+            if (ret == ESP_ERR_NVS_NOT_FOUND) {
+                ret = ESP_OK;
+            }
+            break;
+        }
+        if (ret != ESP_OK) {
+            ESP_LOGE(TAG, "Failed to write %s.%s: %s", ns.name.c_str(), key.c_str(), esp_err_to_name(ret));
+        }
+        it = value.type == NVS_TYPE_ANY ? ns.values.erase(it) : std::next(it);
     }
 
-    std::string value;
-    value.resize(length);
-    ESP_ERROR_CHECK(nvs_get_str(nvs_handle_, key.c_str(), value.data(), &length));
-    while (!value.empty() && value.back() == '\0') {
-        value.pop_back();
+    ret = nvs_commit(nvs_handle);
+    if (ret != ESP_OK) {
+        ESP_LOGE(TAG, "Failed to commit namespace %s: %s", ns.name.c_str(), esp_err_to_name(ret));
     }
-    return value;
+    nvs_close(nvs_handle);
+    ns.dirty = false;
 }
 
-void Settings::SetString(const std::string& key, const std::string& value) {
-    if (read_write_) {
-        ESP_ERROR_CHECK(nvs_set_str(nvs_handle_, key.c_str(), value.c_str()));
-        dirty_ = true;
-    } else {
-        ESP_LOGW(TAG, "Namespace %s is not open for writing", ns_.c_str());
+Settings::Settings(const std::string& ns, bool read_write) : read_write_(read_write) {
+    namespace_ = SettingsStore::GetInstance().Open(ns);
+}
+
+void Settings::Flush() {
+    SettingsStore::GetInstance().Commit();
+}
+
+bool Settings::CheckWritable() {
+    if (!read_write_) {
+        ESP_LOGW(TAG, "Namespace %s is not open for writing", namespace_->name.c_str());
     }
+    return read_write_;
 }
 
-int32_t Settings::GetInt(const std::string& key, int32_t default_value) {
-    if (nvs_handle_ == 0) {
+std::string Settings::GetString(const std::string& key, const std::string& default_value) {
+    auto& store = SettingsStore::GetInstance();
+    std::lock_guard<std::mutex> lock(store.mutex_);
+    auto it = namespace_->values.find(key);
+    if (it == namespace_->values.end() || it->second.type != NVS_TYPE_STR) {
         return default_value;
     }
+    return it->second.string_value;
+}
 
-    int32_t value;
-    if (nvs_get_i32(nvs_handle_, key.c_str(), &value) != ESP_OK) {
+void Settings::SetString(const std::string& key, const std::string& value) {
+    if (!CheckWritable()) {
+        return;
+    }
+    auto& store = SettingsStore::GetInstance();
+    std::lock_guard<std::mutex> lock(store.mutex_);
+    auto& entry = namespace_->values[key];
+    if (entry.type == NVS_TYPE_STR && entry.string_value == value) {
+        return;
+    }
+    entry.type = NVS_TYPE_STR;
+    entry.string_value = value;
+    entry.dirty = namespace_->dirty = true;
+    store.ScheduleCommit();
+}
+
+int32_t Settings::GetInt(const std::string& key, int32_t default_value) {
+    auto& store = SettingsStore::GetInstance();
+    std::lock_guard<std::mutex> lock(store.mutex_);
+    auto it = namespace_->values.find(key);
+    if (it == namespace_->values.end() || it->second.type != NVS_TYPE_I32) {
         return default_value;
     }
-    return value;
+    return it->second.int_value;
 }
 
 void Settings::SetInt(const std::string& key, int32_t value) {
-    if (read_write_) {
-        ESP_ERROR_CHECK(nvs_set_i32(nvs_handle_, key.c_str(), value));
-        dirty_ = true;
-    } else {
-        ESP_LOGW(TAG, "Namespace %s is not open for writing", ns_.c_str());
+    if (!CheckWritable()) {
+        return;
+    }
+    auto& store = SettingsStore::GetInstance();
+    std::lock_guard<std::mutex> lock(store.mutex_);
+    auto& entry = namespace_->values[key];
+    if (entry.type == NVS_TYPE_I32 && entry.int_value == value) {
+        return;
     }
+    entry.type = NVS_TYPE_I32;
+    entry.int_value = value;
+    entry.string_value.clear();
+    entry.dirty = namespace_->dirty = true;
+    store.ScheduleCommit();
 }
 
 bool Settings::GetBool(const std::string& key, bool default_value) {
-    if (nvs_handle_ == 0) {
+    auto& store = SettingsStore::GetInstance();
+    std::lock_guard<std::mutex> lock(store.mutex_);
+    auto it = namespace_->values.find(key);
+    if (it == namespace_->values.end() || it->second.type != NVS_TYPE_U8) {
         return default_value;
     }
-
-    uint8_t value;
-    if (nvs_get_u8(nvs_handle_, key.c_str(), &value) != ESP_OK) {
-        return default_value;
-    }
-    return value != 0;
+    return it->second.int_value != 0;
 }
 
 void Settings::SetBool(const std::string& key, bool value) {
-    if (read_write_) {
-        ESP_ERROR_CHECK(nvs_set_u8(nvs_handle_, key.c_str(), value ? 1 : 0));
-        dirty_ = true;
-    } else {
-        ESP_LOGW(TAG, "Namespace %s is not open for writing", ns_.c_str());
+    if (!CheckWritable()) {
+        return;
     }
+    auto& store = SettingsStore::GetInstance();
+    std::lock_guard<std::mutex> lock(store.mutex_);
+    auto& entry = namespace_->values[key];
+    if (entry.type == NVS_TYPE_U8 && entry.int_value == (value ? 1 : 0)) {
+        return;
+    }
+    entry.type = NVS_TYPE_U8;
+    entry.int_value = value ? 1 : 0;
+    entry.string_value.clear();
+    entry.dirty = namespace_->dirty = true;
+    store.ScheduleCommit();
 }
 
 void Settings::EraseKey(const std::string& key) {
-    if (read_write_) {
-        auto ret = nvs_erase_key(nvs_handle_, key.c_str());
-        if (ret != ESP_ERR_NVS_NOT_FOUND) {
-            ESP_ERROR_CHECK(ret);
-        }
-    } else {
-        ESP_LOGW(TAG, "Namespace %s is not open for writing", ns_.c_str());
+    if (!CheckWritable()) {
+        return;
+    }
+    auto& store = SettingsStore::GetInstance();
+    std::lock_guard<std::mutex> lock(store.mutex_);
+    auto it = namespace_->values.find(key);
+    if (it == namespace_->values.end() || it->second.type == NVS_TYPE_ANY) {
+        return;
     }
+    it->second.type = NVS_TYPE_ANY;
+    it->second.string_value.clear();
+    it->second.dirty = namespace_->dirty = true;
+    store.ScheduleCommit();
 }
 
 void Settings::EraseAll() {
-    if (read_write_) {
-        ESP_ERROR_CHECK(nvs_erase_all(nvs_handle_));
-    } else {
-        ESP_LOGW(TAG, "Namespace %s is not open for writing", ns_.c_str());
+    if (!CheckWritable()) {
+        return;
     }
+    auto& store = SettingsStore::GetInstance();
+    std::lock_guard<std::mutex> lock(store.mutex_);
+    namespace_->values.clear();
+    namespace_->erase_all = namespace_->dirty = true;
+    store.ScheduleCommit();
 }
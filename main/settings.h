@@ -4,10 +4,19 @@
 #include <string>
 #include <nvs_flash.h>
 
+struct SettingsNamespace;
+
+/**
+ * Settings - Access to one NVS namespace
+ *
+ * All instances share a process-wide cache: a namespace is read from NVS the
+ * first time it is opened and later reads never touch flash. Writes update
+ * the cache at once and are committed to NVS together after a short delay
+ * from the main task, or right away on restart, deep sleep or Flush().
+ */
 class Settings {
 public:
     Settings(const std::string& ns, bool read_write = false);
-    ~Settings();
 
     std::string GetString(const std::string& key, const std::string& default_value = "");
     void SetString(const std::string& key, const std::string& value);
@@ -18,11 +27,14 @@ public:
     void EraseKey(const std::string& key);
     void EraseAll();
 
+    // Commits pending writes of all namespaces now
+    static void Flush();
+
 private:
-    std::string ns_;
-    nvs_handle_t nvs_handle_ = 0;
+    SettingsNamespace* namespace_;
     bool read_write_ = false;
-    bool dirty_ = false;
+
+    bool CheckWritable();
 };
 
 #endif
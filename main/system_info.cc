@@ -1,4 +1,5 @@
 #include "system_info.h"
+#include "heap_accounting.h"
 
 #include <freertos/task.h>
 #include <esp_log.h>
@@ -139,13 +140,35 @@ exit:    //Common return path
 }
 
 void SystemInfo::PrintTaskList() {
-    char buffer[1000];
-    vTaskList(buffer);
-    ESP_LOGI(TAG, "Task list: \n%s", buffer);
+    // vTaskList writes about 40 characters per task, keep the buffer off the caller's stack
+    std::string buffer((uxTaskGetNumberOfTasks() + 4) * 48, '\0');
+    vTaskList(buffer.data());
+    ESP_LOGI(TAG, "Task list: \n%s", buffer.c_str());
+}
+
+int SystemInfo::GetFragmentation(const multi_heap_info_t& info) {
+    if (info.total_free_bytes == 0) {
+        return 0;
+    }
+    return 1000 - int(uint64_t(info.largest_free_block) * 1000 / info.total_free_bytes);
 }
 
 void SystemInfo::PrintHeapStats() {
-    int free_sram = heap_caps_get_free_size(MALLOC_CAP_INTERNAL);
-    int min_free_sram = heap_caps_get_minimum_free_size(MALLOC_CAP_INTERNAL);
-    ESP_LOGI(TAG, "free sram: %u minimal sram: %u", free_sram, min_free_sram);
+    multi_heap_info_t info;
+    heap_caps_get_info(&info, MALLOC_CAP_INTERNAL);
+    ESP_LOGI(TAG, "free sram: %u minimal sram: %u largest block: %u fragmentation: %d.%d%%",
+        info.total_free_bytes, info.minimum_free_bytes, info.largest_free_block,
+        GetFragmentation(info) / 10, GetFragmentation(info) % 10);
+
+    std::string usage;
+    for (int tag = kHeapTagNone + 1; tag < kHeapTagCount; tag++) {
+        auto tag_usage = HeapAccounting::GetUsage(static_cast<HeapTag>(tag));
+        if (tag_usage.blocks > 0) {
+            usage += " " + std::string(HeapAccounting::GetTagName(static_cast<HeapTag>(tag))) + ": " +
+                std::to_string(tag_usage.bytes) + "/" + std::to_string(tag_usage.blocks);
+        }
+    }
+    if (!usage.empty()) {
+        ESP_LOGI(TAG, "heap by tag (bytes/blocks):%s", usage.c_str());
+    }
 }
@@ -4,6 +4,7 @@
 #include <string>
 
 #include <esp_err.h>
+#include <esp_heap_caps.h>
 #include <freertos/FreeRTOS.h>
 
 class SystemInfo {
@@ -17,6 +18,8 @@ public:
     static esp_err_t PrintTaskCpuUsage(TickType_t xTicksToWait);
     static void PrintTaskList();
     static void PrintHeapStats();
+    // Share of the free memory outside the largest free block, in per mille
+    static int GetFragmentation(const multi_heap_info_t& info);
 };
 
 #endif // _SYSTEM_INFO_H_
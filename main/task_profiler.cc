@@ -0,0 +1,147 @@
+#include "task_profiler.h"
+
+#include <algorithm>
+#include <esp_log.h>
+
+#define TAG "TaskProfiler"
+
+// Tasks beyond this are not profiled, bounds the memory of short-lived task names
+#define TASK_PROFILER_MAX_TASKS 48
+
+void TaskProfiler::Start(int interval_ms) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (timer_ == nullptr) {
+        esp_timer_create_args_t timer_args = {
+            .callback = [](void* arg) {
+                static_cast<TaskProfiler*>(arg)->Sample();
+            },
+            .arg = this,
+            .dispatch_method = ESP_TIMER_TASK,
+            .name = "task_profiler",
+            .skip_unhandled_events = true,
+        };
+        ESP_ERROR_CHECK(esp_timer_create(&timer_args, &timer_));
+    }
+    esp_timer_stop(timer_);
+    ESP_ERROR_CHECK(esp_timer_start_periodic(timer_, interval_ms * 1000));
+    ESP_LOGI(TAG, "Sampling tasks every %d ms", interval_ms);
+}
+
+void TaskProfiler::Stop() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (timer_ != nullptr) {
+        esp_timer_stop(timer_);
+    }
+}
+
+TaskProfiler::TaskProfile* TaskProfiler::FindProfile(const TaskStatus_t& status) {
+    for (auto& profile : profiles_) {
+        if (profile.handle == status.xHandle) {
+            return &profile;
+        }
+    }
+
+    // A task recreated under the same name continues the profile of the old one
+    TaskProfile* profile = nullptr;
+    for (auto& candidate : profiles_) {
+        if (!candidate.alive && candidate.name == status.pcTaskName) {
+            profile = &candidate;
+            break;
+        }
+    }
+    if (profile == nullptr) {
+        if (profiles_.size() >= TASK_PROFILER_MAX_TASKS) {
+            return nullptr;
+        }
+        // Tasks alive under the same name at once must not share gauges
+        int same_name = std::count_if(profiles_.begin(), profiles_.end(), [&status](const TaskProfile& other) {
+            return other.name == status.pcTaskName;
+        });
+        profile = &profiles_.emplace_back();
+        profile->name = status.pcTaskName;
+        profile->label = same_name == 0 ? profile->name : profile->name + "#" + std::to_string(same_name + 1);
+        profile->cpu_metric = "task." + profile->label + ".cpu";
+        profile->stack_metric = "task." + profile->label + ".stack_free";
+        auto& metrics = Metrics::GetInstance();
+        profile->cpu_gauge = metrics.GetGauge(profile->cpu_metric.c_str());
+        profile->stack_gauge = metrics.GetGauge(profile->stack_metric.c_str());
+    }
+    profile->handle = status.xHandle;
+    profile->last_run_time = status.ulRunTimeCounter;
+    return profile;
+}
+
+uint32_t TaskProfiler::GetRollingCpu(const TaskProfile& profile) const {
+    if (history_size_ == 0) {
+        return 0;
+    }
+    uint32_t sum = 0;
+    for (size_t i = 0; i < history_size_; i++) {
+        sum += profile.cpu_history[i];
+    }
+    return sum / history_size_;
+}
+
+void TaskProfiler::Sample() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    UBaseType_t capacity = uxTaskGetNumberOfTasks() + 4;
+    if (status_.size() < capacity) {
+        status_.resize(capacity);
+    }
+    configRUN_TIME_COUNTER_TYPE total_run_time;
+    UBaseType_t count = uxTaskGetSystemState(status_.data(), status_.size(), &total_run_time);
+    if (count == 0) {
+        return;
+    }
+    // Run time counters advance on every core, the total only once
+    uint64_t elapsed = static_cast<uint64_t>(total_run_time - last_total_run_time_) * CONFIG_FREERTOS_NUMBER_OF_CORES;
+    bool first_sample = last_total_run_time_ == 0;
+    last_total_run_time_ = total_run_time;
+
+    for (auto& profile : profiles_) {
+        profile.alive = false;
+        profile.cpu_history[history_index_] = 0;
+    }
+    for (UBaseType_t i = 0; i < count; i++) {
+        auto& status = status_[i];
+        auto profile = FindProfile(status);
+        if (profile == nullptr) {
+            continue;
+        }
+        uint32_t delta = status.ulRunTimeCounter - profile->last_run_time;
+        profile->last_run_time = status.ulRunTimeCounter;
+        profile->alive = true;
+        profile->priority = status.uxCurrentPriority;
+        profile->min_free_stack = std::min<uint32_t>(profile->min_free_stack, status.usStackHighWaterMark);
+        if (!first_sample && elapsed > 0) {
+            profile->cpu_history[history_index_] = std::min<uint64_t>(delta * 1000ull / elapsed, 1000);
+        }
+    }
+
+    history_index_ = (history_index_ + 1) % TASK_PROFILER_HISTORY;
+    if (!first_sample) {
+        history_size_ = std::min<size_t>(history_size_ + 1, TASK_PROFILER_HISTORY);
+    }
+    for (auto& profile : profiles_) {
+        profile.cpu_gauge->Set(GetRollingCpu(profile));
+        profile.stack_gauge->Set(profile.min_free_stack);
+    }
+}
+
+void TaskProfiler::Print() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    std::vector<const TaskProfile*> sorted;
+    for (auto& profile : profiles_) {
+        if (profile.alive) {
+            sorted.push_back(&profile);
+        }
+    }
+    std::sort(sorted.begin(), sorted.end(), [this](const TaskProfile* a, const TaskProfile* b) {
+        return GetRollingCpu(*a) > GetRollingCpu(*b);
+    });
+    for (auto profile : sorted) {
+        uint32_t cpu = GetRollingCpu(*profile);
+        ESP_LOGI(TAG, "%-16s cpu %2lu.%lu%%  stack free %5lu  priority %u", profile->label.c_str(),
+            cpu / 10, cpu % 10, profile->min_free_stack, profile->priority);
+    }
+}
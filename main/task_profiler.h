@@ -0,0 +1,75 @@
+#ifndef TASK_PROFILER_H
+#define TASK_PROFILER_H
+
+#include <freertos/FreeRTOS.h>
+#include <freertos/task.h>
+#include <esp_timer.h>
+
+#include <deque>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include "metrics.h"
+
+// Samples kept per task, the rolling CPU usage is averaged over them
+#define TASK_PROFILER_HISTORY 10
+
+/**
+ * TaskProfiler - Background sampler of per-task CPU usage and stack headroom
+ *
+ * A periodic timer reads the FreeRTOS run-time counters and stack high-water
+ * marks of all tasks in one uxTaskGetSystemState() call. The CPU share of each
+ * interval goes into a small per-task ring buffer, and the rolling average and
+ * the minimum free stack are published as the gauges task.<name>.cpu (per mille
+ * of all cores) and task.<name>.stack_free (bytes). Tasks that share a name,
+ * such as the MCP workers, get their own gauges as <name>#2, <name>#3 and so on.
+ */
+class TaskProfiler {
+public:
+    static TaskProfiler& GetInstance() {
+        static TaskProfiler instance;
+        return instance;
+    }
+
+    void Start(int interval_ms);
+    void Stop();
+    // Logs the rolling CPU usage, free stack and priority of every task
+    void Print();
+
+private:
+    struct TaskProfile {
+        TaskHandle_t handle = nullptr;
+        std::string name;
+        // Unique among the profiles: the task name, with #2, #3... for further tasks of that name
+        std::string label;
+        std::string cpu_metric;
+        std::string stack_metric;
+        bool alive = false;
+        UBaseType_t priority = 0;
+        configRUN_TIME_COUNTER_TYPE last_run_time = 0;
+        uint16_t cpu_history[TASK_PROFILER_HISTORY] = {};
+        uint32_t min_free_stack = UINT32_MAX;
+        MetricGauge* cpu_gauge = nullptr;
+        MetricGauge* stack_gauge = nullptr;
+    };
+
+    TaskProfiler() = default;
+    TaskProfiler(const TaskProfiler&) = delete;
+    TaskProfiler& operator=(const TaskProfiler&) = delete;
+
+    void Sample();
+    TaskProfile* FindProfile(const TaskStatus_t& status);
+    uint32_t GetRollingCpu(const TaskProfile& profile) const;
+
+    std::mutex mutex_;
+    esp_timer_handle_t timer_ = nullptr;
+    std::vector<TaskStatus_t> status_;
+    // Profiles are never removed, their names back the metric names
+    std::deque<TaskProfile> profiles_;
+    configRUN_TIME_COUNTER_TYPE last_total_run_time_ = 0;
+    size_t history_index_ = 0;
+    size_t history_size_ = 0;
+};
+
+#endif // TASK_PROFILER_H
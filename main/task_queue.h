@@ -0,0 +1,280 @@
+#ifndef TASK_QUEUE_H
+#define TASK_QUEUE_H
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <mutex>
+#include <new>
+#include <type_traits>
+#include <utility>
+
+/**
+ * InlineTask - A move-only void() callable with small buffer storage
+ *
+ * Callables whose size fits in InlineSize bytes are stored in place, so
+ * wrapping a lambda does not touch the heap. Larger callables fall back to a
+ * heap allocation, which IsHeapAllocated() reports for accounting.
+ */
+template <size_t InlineSize>
+class InlineTask {
+public:
+    InlineTask() = default;
+
+    template <typename F, typename = std::enable_if_t<!std::is_same_v<std::decay_t<F>, InlineTask>>>
+    InlineTask(F&& f) {
+        using T = std::decay_t<F>;
+        if constexpr (sizeof(T) <= InlineSize && alignof(T) <= alignof(std::max_align_t)) {
+            new (storage_) T(std::forward<F>(f));
+            ops_ = &InlineOps<T>::kOps;
+        } else {
+            *reinterpret_cast<T**>(storage_) = new T(std::forward<F>(f));
+            ops_ = &HeapOps<T>::kOps;
+        }
+    }
+
+    InlineTask(InlineTask&& other) noexcept {
+        MoveFrom(other);
+    }
+
+    InlineTask& operator=(InlineTask&& other) noexcept {
+        if (this != &other) {
+            Reset();
+            MoveFrom(other);
+        }
+        return *this;
+    }
+
+    InlineTask(const InlineTask&) = delete;
+    InlineTask& operator=(const InlineTask&) = delete;
+
+    ~InlineTask() { Reset(); }
+
+    void operator()() { ops_->invoke(storage_); }
+    explicit operator bool() const { return ops_ != nullptr; }
+    bool IsHeapAllocated() const { return ops_ != nullptr && ops_->heap; }
+
+    // Compiler generated signature naming the wrapped callable type, for diagnostics
+    const char* Name() const { return ops_ != nullptr ? ops_->name() : ""; }
+
+    void Reset() {
+        if (ops_ != nullptr) {
+            ops_->destroy(storage_);
+            ops_ = nullptr;
+        }
+    }
+
+private:
+    struct Ops {
+        void (*invoke)(void* storage);
+        void (*move)(void* dst, void* src);  // Move-construct into dst and destroy src
+        void (*destroy)(void* storage);
+        const char* (*name)();
+        bool heap;
+    };
+
+    template <typename T>
+    struct InlineOps {
+        static void Invoke(void* s) { (*static_cast<T*>(s))(); }
+        static void Move(void* d, void* s) {
+            new (d) T(std::move(*static_cast<T*>(s)));
+            static_cast<T*>(s)->~T();
+        }
+        static void Destroy(void* s) { static_cast<T*>(s)->~T(); }
+        static const char* Name() { return __PRETTY_FUNCTION__; }
+        static constexpr Ops kOps = { Invoke, Move, Destroy, Name, false };
+    };
+
+    template <typename T>
+    struct HeapOps {
+        static void Invoke(void* s) { (**static_cast<T**>(s))(); }
+        static void Move(void* d, void* s) { *static_cast<T**>(d) = *static_cast<T**>(s); }
+        static void Destroy(void* s) { delete *static_cast<T**>(s); }
+        static const char* Name() { return __PRETTY_FUNCTION__; }
+        static constexpr Ops kOps = { Invoke, Move, Destroy, Name, true };
+    };
+
+    void MoveFrom(InlineTask& other) {
+        ops_ = other.ops_;
+        if (ops_ != nullptr) {
+            ops_->move(storage_, other.storage_);
+            other.ops_ = nullptr;
+        }
+    }
+
+    alignas(std::max_align_t) unsigned char storage_[InlineSize < sizeof(void*) ? sizeof(void*) : InlineSize];
+    const Ops* ops_ = nullptr;
+};
+
+/**
+ * TaskQueue - Fixed-capacity multi-producer single-consumer queue of InlineTask
+ *
+ * Producers claim slots with a CAS on the enqueue position and publish them
+ * through a per-slot sequence number (bounded queue after D. Vyukov), so
+ * Push() never takes a lock or allocates for small captures. A push that
+ * finds the ring full spills into a mutex protected overflow list instead of
+ * being dropped; other pushes keep using the ring. A spilled task is tagged
+ * with the ring position it found full, and Pop() returns it after every ring
+ * task before that position, so tasks from one producer stay in order. Each
+ * task carries a caller supplied timestamp, which the consumer gets back from
+ * Pop() to measure queueing latency.
+ */
+template <size_t Capacity, size_t InlineSize>
+class TaskQueue {
+    static_assert(Capacity >= 2 && (Capacity & (Capacity - 1)) == 0, "Capacity must be a power of two");
+
+public:
+    using Task = InlineTask<InlineSize>;
+
+    struct Statistics {
+        uint32_t pushed;
+        uint32_t heap_allocated;    // Callables larger than InlineSize
+        uint32_t overflowed;        // Pushes that did not fit in the ring
+        uint32_t high_watermark;    // Maximum ring occupancy seen by the consumer
+    };
+
+    TaskQueue() {
+        for (size_t i = 0; i < Capacity; i++) {
+            cells_[i].sequence.store(i, std::memory_order_relaxed);
+        }
+    }
+
+    TaskQueue(const TaskQueue&) = delete;
+    TaskQueue& operator=(const TaskQueue&) = delete;
+
+    template <typename F>
+    void Push(F&& f, int64_t timestamp = 0) {
+        Task task(std::forward<F>(f));
+        pushed_.fetch_add(1, std::memory_order_relaxed);
+        if (task.IsHeapAllocated()) {
+            heap_allocated_.fetch_add(1, std::memory_order_relaxed);
+        }
+        size_t position;
+        if (TryPush(task, timestamp, position)) {
+            return;
+        }
+        std::lock_guard<std::mutex> lock(overflow_mutex_);
+        // Keep the tags ascending, waiting for a later position never reorders a producer
+        if (position < last_overflow_position_) {
+            position = last_overflow_position_;
+        }
+        last_overflow_position_ = position;
+        overflow_.push_back({ std::move(task), timestamp, position });
+        overflow_pending_.store(true, std::memory_order_release);
+        overflowed_.fetch_add(1, std::memory_order_relaxed);
+    }
+
+    /**
+     * Take the oldest task, returns false when the queue is empty
+     * Must only be called from the consumer task.
+     */
+    bool Pop(Task& task, int64_t& timestamp) {
+        size_t pending = enqueue_pos_.load(std::memory_order_relaxed) - dequeue_pos_;
+        if (pending > high_watermark_) {
+            high_watermark_ = pending;
+        }
+        // Check the ring before the overflow list: a producer that spilled and then
+        // pushed to the ring published the spilled task first
+        bool ring_ready = RingReady();
+        if (overflow_pending_.load(std::memory_order_acquire)) {
+            std::lock_guard<std::mutex> lock(overflow_mutex_);
+            for (auto& spilled : overflow_) {
+                spilled_.push_back(std::move(spilled));
+            }
+            overflow_.clear();
+            overflow_pending_.store(false, std::memory_order_relaxed);
+        }
+        // A spilled task goes after the ring tasks before the position it found full,
+        // which are all claimed, so wait for them rather than overtake them
+        if (!spilled_.empty() && (intptr_t)(spilled_.front().position - dequeue_pos_) <= 0) {
+            task = std::move(spilled_.front().task);
+            timestamp = spilled_.front().timestamp;
+            spilled_.pop_front();
+            return true;
+        }
+        return ring_ready && TryPop(task, timestamp);
+    }
+
+    Statistics GetStatistics() const {
+        return {
+            pushed_.load(std::memory_order_relaxed),
+            heap_allocated_.load(std::memory_order_relaxed),
+            overflowed_.load(std::memory_order_relaxed),
+            static_cast<uint32_t>(high_watermark_),
+        };
+    }
+
+private:
+    struct Cell {
+        std::atomic<size_t> sequence;
+        int64_t timestamp;
+        Task task;
+    };
+
+    struct Spilled {
+        Task task;
+        int64_t timestamp;
+        size_t position;    // Ring position that was full when the task was pushed
+    };
+
+    // On failure position is where the ring was full
+    bool TryPush(Task& task, int64_t timestamp, size_t& position) {
+        size_t pos = enqueue_pos_.load(std::memory_order_relaxed);
+        Cell* cell;
+        while (true) {
+            cell = &cells_[pos & (Capacity - 1)];
+            size_t seq = cell->sequence.load(std::memory_order_acquire);
+            intptr_t diff = (intptr_t)seq - (intptr_t)pos;
+            if (diff == 0) {
+                if (enqueue_pos_.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) {
+                    break;
+                }
+            } else if (diff < 0) {
+                position = pos;
+                return false;  // Full
+            } else {
+                pos = enqueue_pos_.load(std::memory_order_relaxed);
+            }
+        }
+        cell->task = std::move(task);
+        cell->timestamp = timestamp;
+        cell->sequence.store(pos + 1, std::memory_order_release);
+        return true;
+    }
+
+    // Whether the task at the dequeue position is published
+    bool RingReady() const {
+        size_t seq = cells_[dequeue_pos_ & (Capacity - 1)].sequence.load(std::memory_order_acquire);
+        return (intptr_t)seq - (intptr_t)(dequeue_pos_ + 1) >= 0;
+    }
+
+    bool TryPop(Task& task, int64_t& timestamp) {
+        Cell* cell = &cells_[dequeue_pos_ & (Capacity - 1)];
+        if (!RingReady()) {
+            return false;  // Slot claimed but not yet published
+        }
+        task = std::move(cell->task);
+        timestamp = cell->timestamp;
+        cell->sequence.store(dequeue_pos_ + Capacity, std::memory_order_release);
+        dequeue_pos_++;
+        return true;
+    }
+
+    Cell cells_[Capacity];
+    std::atomic<size_t> enqueue_pos_{0};
+    size_t dequeue_pos_ = 0;
+    size_t high_watermark_ = 0;
+
+    std::atomic<bool> overflow_pending_{false};  // overflow_ is not empty
+    std::mutex overflow_mutex_;
+    std::deque<Spilled> overflow_;
+    size_t last_overflow_position_ = 0;
+    std::deque<Spilled> spilled_;  // Overflow tasks taken over by the consumer
+
+    std::atomic<uint32_t> pushed_{0};
+    std::atomic<uint32_t> heap_allocated_{0};
+    std::atomic<uint32_t> overflowed_{0};
+};
+
+#endif // TASK_QUEUE_H
@@ -0,0 +1,183 @@
+#include "trace_recorder.h"
+
+#include <esp_log.h>
+#include <esp_timer.h>
+#include <esp_cpu.h>
+#include <mbedtls/base64.h>
+
+#include <cstdio>
+#include <cstring>
+#include <unordered_map>
+#include <vector>
+
+#define TAG "TraceRecorder"
+
+#define TRACE_FORMAT_VERSION 1
+// Raw bytes per line printed to the serial console, encodes to 76 characters
+#define TRACE_SERIAL_LINE_BYTES 57
+
+bool TraceRecorder::Start() {
+#if CONFIG_TRACE_RECORDER
+    if (events_ == nullptr) {
+        size_t size = CONFIG_TRACE_RECORDER_EVENTS * sizeof(TraceEvent);
+        events_ = static_cast<TraceEvent*>(MemoryPolicy::Allocate(BufferClass::kTrace, size));
+        if (events_ == nullptr) {
+            ESP_LOGE(TAG, "Failed to allocate %u bytes for %d events", size, CONFIG_TRACE_RECORDER_EVENTS);
+            return false;
+        }
+        // Slots with a null name are skipped by Dump() until an event is recorded in them
+        memset(static_cast<void*>(events_), 0, size);
+        ESP_LOGI(TAG, "Recording up to %d events", CONFIG_TRACE_RECORDER_EVENTS);
+    }
+    recording_.store(true, std::memory_order_release);
+    return true;
+#else
+    return false;
+#endif
+}
+
+void TraceRecorder::Record(TracePhase phase, const char* name, int32_t arg) {
+#if CONFIG_TRACE_RECORDER
+    if (!recording_.load(std::memory_order_acquire)) {
+        return;
+    }
+    uint32_t index = next_index_.fetch_add(1, std::memory_order_relaxed);
+    auto& event = events_[index % CONFIG_TRACE_RECORDER_EVENTS];
+    event.name.store(nullptr, std::memory_order_relaxed);
+    event.timestamp = static_cast<uint32_t>(esp_timer_get_time());
+    event.arg = arg;
+    event.task = xTaskGetCurrentTaskHandle();
+    event.phase = phase;
+    event.core = esp_cpu_get_core_id();
+    event.name.store(name, std::memory_order_release);
+#endif
+}
+
+#if CONFIG_TRACE_RECORDER
+template <typename T>
+static void Append(TraceData& data, T value) {
+    data.append(reinterpret_cast<const char*>(&value), sizeof(value));
+}
+
+static void AppendString(TraceData& data, const char* str) {
+    if (str == nullptr) {
+        str = "";
+    }
+    size_t length = std::min<size_t>(strlen(str), UINT8_MAX);
+    Append<uint8_t>(data, length);
+    data.append(str, length);
+}
+#endif
+
+TraceData TraceRecorder::Dump() {
+    TraceData data;
+#if CONFIG_TRACE_RECORDER
+    if (events_ == nullptr) {
+        return data;
+    }
+
+    // Let the writers already past the recording check finish their event
+    bool was_recording = recording_.exchange(false, std::memory_order_acq_rel);
+    vTaskDelay(1);
+
+    uint32_t end = next_index_.load(std::memory_order_relaxed);
+    uint32_t begin = end - std::min<uint32_t>(end, CONFIG_TRACE_RECORDER_EVENTS);
+    int64_t now = esp_timer_get_time();
+
+    // Slots whose writer has not published the name yet are left out and counted as dropped
+    std::vector<uint32_t> slots;
+    std::vector<const char*> event_names;
+    slots.reserve(end - begin);
+    event_names.reserve(end - begin);
+    for (uint32_t i = begin; i != end; i++) {
+        uint32_t slot = i % CONFIG_TRACE_RECORDER_EVENTS;
+        const char* name = events_[slot].name.load(std::memory_order_acquire);
+        if (name != nullptr) {
+            slots.push_back(slot);
+            event_names.push_back(name);
+        }
+    }
+    uint32_t count = slots.size();
+
+    // Names of the tasks still alive, the others are named after their handle
+    std::unordered_map<TaskHandle_t, const char*> live_tasks;
+    std::vector<TaskStatus_t> status(uxTaskGetNumberOfTasks() + 4);
+    UBaseType_t task_count = uxTaskGetSystemState(status.data(), status.size(), nullptr);
+    for (UBaseType_t i = 0; i < task_count; i++) {
+        live_tasks[status[i].xHandle] = status[i].pcTaskName;
+    }
+
+    std::unordered_map<const char*, uint16_t> name_ids;
+    std::vector<const char*> names;
+    std::unordered_map<TaskHandle_t, uint16_t> task_ids;
+    std::vector<std::string> tasks;
+    std::vector<int64_t> times(count);
+    int64_t base = now;
+    for (uint32_t i = 0; i < count; i++) {
+        auto& event = events_[slots[i]];
+        // The ring covers much less than the 71 minutes the 32-bit timestamps wrap around in
+        times[i] = now - static_cast<uint32_t>(static_cast<uint32_t>(now) - event.timestamp);
+        base = std::min(base, times[i]);
+        if (name_ids.emplace(event_names[i], names.size()).second) {
+            names.push_back(event_names[i]);
+        }
+        if (task_ids.emplace(event.task, tasks.size()).second) {
+            auto it = live_tasks.find(event.task);
+            if (it != live_tasks.end()) {
+                tasks.push_back(it->second);
+            } else {
+                char name[24];
+                snprintf(name, sizeof(name), "task@%p", event.task);
+                tasks.push_back(name);
+            }
+        }
+    }
+
+    data.reserve(24 + count * 16 + names.size() * 24 + tasks.size() * 16);
+    data.append("XZTR", 4);
+    Append<uint16_t>(data, TRACE_FORMAT_VERSION);
+    Append<uint16_t>(data, 0);
+    Append<uint32_t>(data, count);
+    Append<uint32_t>(data, end - count);
+    Append<uint64_t>(data, base);
+    Append<uint16_t>(data, names.size());
+    for (auto name : names) {
+        AppendString(data, name);
+    }
+    Append<uint16_t>(data, tasks.size());
+    for (auto& task : tasks) {
+        AppendString(data, task.c_str());
+    }
+    for (uint32_t i = 0; i < count; i++) {
+        auto& event = events_[slots[i]];
+        Append<uint32_t>(data, times[i] - base);
+        Append<int32_t>(data, event.arg);
+        Append<uint16_t>(data, name_ids[event_names[i]]);
+        Append<uint16_t>(data, task_ids[event.task]);
+        Append<uint8_t>(data, event.phase);
+        Append<uint8_t>(data, event.core);
+        Append<uint16_t>(data, 0);
+    }
+
+    if (was_recording) {
+        recording_.store(true, std::memory_order_release);
+    }
+    ESP_LOGI(TAG, "Dumped %lu events, %lu dropped, %u bytes", count, end - count, data.size());
+#endif
+    return data;
+}
+
+void TraceRecorder::DumpToSerial() {
+    auto data = Dump();
+    printf("XZTRACE BEGIN %u\n", data.size());
+    char line[TRACE_SERIAL_LINE_BYTES / 3 * 4 + 1];
+    for (size_t offset = 0; offset < data.size(); offset += TRACE_SERIAL_LINE_BYTES) {
+        size_t len = std::min<size_t>(data.size() - offset, TRACE_SERIAL_LINE_BYTES);
+        size_t olen = 0;
+        mbedtls_base64_encode((unsigned char*)line, sizeof(line), &olen,
+            (const unsigned char*)data.data() + offset, len);
+        printf("%.*s\n", (int)olen, line);
+    }
+    printf("XZTRACE END\n");
+    fflush(stdout);
+}
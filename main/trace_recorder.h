@@ -0,0 +1,112 @@
+#ifndef TRACE_RECORDER_H
+#define TRACE_RECORDER_H
+
+#include <freertos/FreeRTOS.h>
+#include <freertos/task.h>
+
+#include <atomic>
+#include <cstdint>
+#include <string>
+
+#include "memory_policy.h"
+
+enum TracePhase : uint8_t {
+    kTracePhaseBegin = 'B',
+    kTracePhaseEnd = 'E',
+    kTracePhaseInstant = 'i',
+    kTracePhaseCounter = 'C',
+};
+
+// Serialized trace, placed by the memory policy
+using TraceData = BufferString<BufferClass::kTrace>;
+
+/**
+ * TraceRecorder - Cross-task timeline of begin/end, instant and counter events
+ *
+ * Events go into a fixed-size ring in PSRAM. Recording takes one atomic index
+ * increment and no lock, so it can be used from any task on the hot paths; the
+ * oldest events are overwritten when the ring is full. Event names are kept as
+ * pointers, so they must be string literals or otherwise live forever.
+ *
+ * Dump() serializes the ring in the format read by scripts/trace_to_chrome.py,
+ * which converts it into Chrome / Perfetto trace JSON:
+ *
+ *   header  "XZTR", u16 version, u16 reserved, u32 events, u32 dropped, u64 base_us
+ *   names   u16 count, then u8 length + bytes for each name
+ *   tasks   u16 count, then u8 length + bytes for each task name
+ *   events  u32 time_us (since base_us), i32 arg, u16 name, u16 task, u8 phase, u8 core, u16 reserved
+ *
+ * All fields are little-endian. The instrumentation below compiles to nothing
+ * unless CONFIG_TRACE_RECORDER is enabled.
+ */
+class TraceRecorder {
+public:
+    static TraceRecorder& GetInstance() {
+        static TraceRecorder instance;
+        return instance;
+    }
+
+    // Allocates the ring and starts recording
+    bool Start();
+    void Record(TracePhase phase, const char* name, int32_t arg = 0);
+
+    // Serializes the recorded events, oldest first, recording is paused meanwhile
+    TraceData Dump();
+    // Prints the dump base64 encoded between XZTRACE markers, for scripts/trace_to_chrome.py
+    void DumpToSerial();
+
+private:
+    struct TraceEvent {
+        uint32_t timestamp;     // Low 32 bits of esp_timer_get_time()
+        int32_t arg;
+        // Stored last with release, null while the slot was never written or is being rewritten
+        std::atomic<const char*> name;
+        TaskHandle_t task;
+        uint8_t phase;
+        uint8_t core;
+    };
+
+    TraceRecorder() = default;
+    TraceRecorder(const TraceRecorder&) = delete;
+    TraceRecorder& operator=(const TraceRecorder&) = delete;
+
+    TraceEvent* events_ = nullptr;
+    std::atomic<uint32_t> next_index_{0};
+    std::atomic<bool> recording_{false};
+};
+
+// Traces the enclosing scope as a begin/end pair, the name must be a string literal
+class TraceScope {
+public:
+    explicit TraceScope(const char* name, int32_t arg = 0) : name_(name) {
+        TraceRecorder::GetInstance().Record(kTracePhaseBegin, name_, arg);
+    }
+    ~TraceScope() {
+        TraceRecorder::GetInstance().Record(kTracePhaseEnd, name_);
+    }
+
+    TraceScope(const TraceScope&) = delete;
+    TraceScope& operator=(const TraceScope&) = delete;
+
+private:
+    const char* name_;
+};
+
+#define TRACE_CONCAT_(a, b) a##b
+#define TRACE_CONCAT(a, b) TRACE_CONCAT_(a, b)
+
+#if CONFIG_TRACE_RECORDER
+#define TRACE_BEGIN(name) TraceRecorder::GetInstance().Record(kTracePhaseBegin, name)
+#define TRACE_END(name) TraceRecorder::GetInstance().Record(kTracePhaseEnd, name)
+#define TRACE_INSTANT(name, arg) TraceRecorder::GetInstance().Record(kTracePhaseInstant, name, arg)
+#define TRACE_COUNTER(name, value) TraceRecorder::GetInstance().Record(kTracePhaseCounter, name, value)
+#define TRACE_SCOPE(name) TraceScope TRACE_CONCAT(trace_scope_, __LINE__)(name)
+#else
+#define TRACE_BEGIN(name) do {} while (0)
+#define TRACE_END(name) do {} while (0)
+#define TRACE_INSTANT(name, arg) do {} while (0)
+#define TRACE_COUNTER(name, value) do {} while (0)
+#define TRACE_SCOPE(name) do {} while (0)
+#endif
+
+#endif // TRACE_RECORDER_H
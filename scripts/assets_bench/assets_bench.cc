@@ -0,0 +1,210 @@
+/*
+ * Linux microbenchmark of the assets partition checks in main/assets_table.cc over a
+ * synthetic image.
+ *
+ *     g++ -std=c++17 -Os -I../../main assets_bench.cc ../../main/assets_table.cc -o assets_bench
+ *     ./assets_bench [image MB] [files]
+ *
+ * -Os is what the firmware builds with. At -O2 the host compiler vectorizes the byte
+ * loop with SSE, which the ESP32 targets have no equivalent for.
+ *
+ * checksum: CalculateAssetsChecksum() against the byte loop Assets used before, over
+ * random data the size of the partition. Both must agree for every start alignment
+ * and tail length, and on the whole image.
+ *
+ * lookup: a file table of the given size, sorted like the packers write it. Compares
+ * building the std::map<std::string, Asset> index Assets kept before (time and heap
+ * allocations) with nothing, and the cost of one lookup by std::string name through
+ * that map, FindAssetsTableEntry() on the sorted table, and the linear scan used for
+ * tables from older packers.
+ */
+
+#include "assets_table.h"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <map>
+#include <new>
+#include <random>
+#include <string>
+#include <vector>
+
+static std::atomic<uint64_t> g_allocations{0};
+
+void* operator new(size_t size) {
+    g_allocations.fetch_add(1, std::memory_order_relaxed);
+    if (void* p = std::malloc(size)) {
+        return p;
+    }
+    throw std::bad_alloc();
+}
+
+void operator delete(void* p) noexcept {
+    std::free(p);
+}
+
+void operator delete(void* p, size_t) noexcept {
+    std::free(p);
+}
+
+static int64_t NowNs() {
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+// Best of a few runs, the first one also faults the pages in
+template <typename F>
+static double BestMs(int runs, F&& f) {
+    int64_t best = INT64_MAX;
+    for (int i = 0; i < runs; i++) {
+        int64_t start = NowNs();
+        f();
+        best = std::min(best, NowNs() - start);
+    }
+    return best / 1e6;
+}
+
+// The byte loop Assets::CalculateChecksum used before, summing the bytes as unsigned like the packer
+static uint32_t ByteChecksum(const char* data, uint32_t length) {
+    auto bytes = reinterpret_cast<const uint8_t*>(data);
+    uint32_t checksum = 0;
+    for (uint32_t i = 0; i < length; i++) {
+        checksum += bytes[i];
+    }
+    return checksum & 0xFFFF;
+}
+
+static int BenchChecksum(size_t image_size) {
+    std::vector<char> image(image_size + 8);
+    std::mt19937 rng(1);
+    for (auto& c : image) {
+        c = static_cast<char>(rng());
+    }
+
+    int failures = 0;
+    for (uint32_t offset = 0; offset < 4; offset++) {
+        for (uint32_t length = 0; length < 1100; length++) {
+            if (CalculateAssetsChecksum(image.data() + offset, length) != ByteChecksum(image.data() + offset, length)) {
+                printf("FAIL checksum: offset %u, length %u\n", offset, length);
+                failures++;
+            }
+        }
+    }
+
+    volatile uint32_t sink = 0;
+    uint32_t expected = ByteChecksum(image.data(), image_size);
+    uint32_t actual = CalculateAssetsChecksum(image.data(), image_size);
+    if (actual != expected) {
+        printf("FAIL checksum: whole image 0x%04x, expected 0x%04x\n", actual, expected);
+        failures++;
+    }
+    double byte_ms = BestMs(5, [&]() { sink = sink + ByteChecksum(image.data(), image_size); });
+    double word_ms = BestMs(5, [&]() { sink = sink + CalculateAssetsChecksum(image.data(), image_size); });
+    printf("checksum, %zu MB image: byte loop %.1f ms, word lanes %.1f ms (%.1fx)\n",
+        image_size >> 20, byte_ms, word_ms, byte_ms / word_ms);
+    return failures;
+}
+
+// The index Assets built at boot before looking up in the mapped table
+struct Asset {
+    size_t size;
+    size_t offset;
+};
+
+static int BenchLookup(uint32_t count) {
+    // Names shaped like those of the default assets: a few prefixes and numbered files
+    static const char* const prefixes[] = { "emoji_", "font_", "srmodels/", "background_", "gif/anim_" };
+    static const char* const suffixes[] = { ".png", ".bin", ".gif", ".jpg", "" };
+    std::mt19937 rng(2);
+    std::vector<mmap_assets_table> table;
+    std::vector<std::string> names;
+    while (table.size() < count) {
+        char name[32];
+        snprintf(name, sizeof(name), "%s%u%s", prefixes[rng() % 5], unsigned(rng() % 100000), suffixes[rng() % 5]);
+        if (std::find(names.begin(), names.end(), name) != names.end()) {
+            continue;
+        }
+        mmap_assets_table record = {};
+        strncpy(record.asset_name, name, sizeof(record.asset_name));
+        record.asset_size = rng() % 65536;
+        record.asset_offset = table.size() * 4096;
+        table.push_back(record);
+        names.push_back(name);
+    }
+    std::sort(table.begin(), table.end(), [](const mmap_assets_table& a, const mmap_assets_table& b) {
+        return strncmp(a.asset_name, b.asset_name, sizeof(a.asset_name)) < 0;
+    });
+
+    int failures = 0;
+    if (!IsAssetsTableSorted(table.data(), count)) {
+        printf("FAIL lookup: the sorted table is not recognized as sorted\n");
+        failures++;
+    }
+    for (auto& name : names) {
+        auto entry = FindAssetsTableEntry(table.data(), count, true, name.c_str());
+        if (entry == nullptr || name != entry->asset_name ||
+                entry != FindAssetsTableEntry(table.data(), count, false, name.c_str())) {
+            printf("FAIL lookup: %s\n", name.c_str());
+            failures++;
+        }
+    }
+    if (FindAssetsTableEntry(table.data(), count, true, "missing.png") != nullptr) {
+        printf("FAIL lookup: found a missing name\n");
+        failures++;
+    }
+
+    std::map<std::string, Asset> assets;
+    uint64_t allocations = g_allocations.load();
+    double build_ms = BestMs(1, [&]() {
+        for (uint32_t i = 0; i < count; i++) {
+            auto item = &table[i];
+            Asset asset;
+            asset.size = item->asset_size;
+            asset.offset = item->asset_offset;
+            assets[item->asset_name] = asset;
+        }
+    });
+    allocations = g_allocations.load() - allocations;
+
+    // Every name many times in random order, looked up by std::string as GetAssetData() is called
+    std::vector<std::string> queries;
+    for (int i = 0; i < 200; i++) {
+        queries.insert(queries.end(), names.begin(), names.end());
+    }
+    std::shuffle(queries.begin(), queries.end(), rng);
+    volatile size_t sink = 0;
+    auto per_lookup_ns = [&](double ms) { return ms * 1e6 / queries.size(); };
+    double map_ns = per_lookup_ns(BestMs(3, [&]() {
+        for (auto& query : queries) {
+            sink = sink + assets.find(query)->second.offset;
+        }
+    }));
+    double sorted_ns = per_lookup_ns(BestMs(3, [&]() {
+        for (auto& query : queries) {
+            sink = sink + FindAssetsTableEntry(table.data(), count, true, query.c_str())->asset_offset;
+        }
+    }));
+    double linear_ns = per_lookup_ns(BestMs(1, [&]() {
+        for (auto& query : queries) {
+            sink = sink + FindAssetsTableEntry(table.data(), count, false, query.c_str())->asset_offset;
+        }
+    }));
+    printf("lookup, %u files: std::map index built in %.3f ms with %llu allocations, table in place 0 ms\n",
+        count, build_ms, (unsigned long long)allocations);
+    printf("    per lookup: std::map %.0f ns, sorted table %.0f ns, linear scan %.0f ns\n",
+        map_ns, sorted_ns, linear_ns);
+    return failures;
+}
+
+int main(int argc, char** argv) {
+    size_t image_mb = argc > 1 ? atoi(argv[1]) : 16;
+    uint32_t files = argc > 2 ? atoi(argv[2]) : 500;
+    int failures = BenchChecksum(image_mb << 20);
+    failures += BenchLookup(files);
+    printf("%s\n", failures == 0 ? "PASS" : "FAIL");
+    return failures == 0 ? 0 : 1;
+}
@@ -0,0 +1,319 @@
+// Host test of main/assets_delta.cc: the in-place sector order of a delta update, on image
+// pairs written by make_cases.py, with the Downloader fetching from a fake server. See README.md.
+
+#include "assets_delta.h"
+#include "assets_table.h"
+#include "board.h"
+#include "settings.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <map>
+#include <random>
+#include <set>
+#include <string>
+#include <vector>
+
+static int failures = 0;
+
+#define CHECK(condition) do { \
+        if (!(condition)) { \
+            printf("FAIL %s:%d: %s\n", __FILE__, __LINE__, #condition); \
+            failures++; \
+        } \
+    } while (0)
+
+#define TEST_URL "http://fake/assets.bin"
+#define PARTITION_SIZE (8 * 1024 * 1024)
+#define IMAGE_HEADER_SIZE 12
+
+static std::string ReadFile(const std::string& path) {
+    std::ifstream file(path, std::ios::binary);
+    return std::string(std::istreambuf_iterator<char>(file), std::istreambuf_iterator<char>());
+}
+
+// Serves the new image and its manifest, with Range requests
+struct FakeServer {
+    std::map<std::string, std::string> files;
+    // Image positions where a connection is closed, each one once
+    std::vector<size_t> drops;
+    size_t requests = 0;
+    size_t served = 0;
+    std::mt19937 rng { 1 };
+};
+
+static FakeServer server;
+
+class FakeHttp : public Http {
+public:
+    void SetHeader(const std::string& key, const std::string& value) override { headers_[key] = value; }
+
+    bool Open(const std::string& method, const std::string& url) override {
+        server.requests++;
+        auto file = server.files.find(url);
+        if (file == server.files.end()) {
+            status_ = 404;
+            return true;
+        }
+        content_ = &file->second;
+        status_ = 200;
+        position_ = 0;
+        end_ = content_->size();
+        auto range = headers_.find("Range");
+        if (range != headers_.end()) {
+            size_t begin = 0;
+            size_t last = SIZE_MAX;
+            sscanf(range->second.c_str(), "bytes=%zu-%zu", &begin, &last);
+            status_ = 206;
+            position_ = begin;
+            end_ = std::min(end_, last == SIZE_MAX ? end_ : last + 1);
+        }
+        return true;
+    }
+
+    void Close() override {}
+    int GetStatusCode() override { return status_; }
+    std::string GetResponseHeader(const std::string& key) const override { return key == "ETag" ? "\"1\"" : ""; }
+    size_t GetBodyLength() override { return status_ == 404 ? 0 : end_ - position_; }
+
+    int Read(char* buffer, size_t buffer_size) override {
+        if (content_ == nullptr || position_ == end_) {
+            return 0;
+        }
+        size_t size = std::min({ buffer_size, end_ - position_, size_t(1 + server.rng() % 4096) });
+        for (auto it = server.drops.begin(); it != server.drops.end(); ++it) {
+            if (*it == position_) {
+                server.drops.erase(it);
+                end_ = position_;
+                return 0;
+            }
+            if (*it > position_ && *it < position_ + size) {
+                size = *it - position_;
+            }
+        }
+        memcpy(buffer, content_->data() + position_, size);
+        position_ += size;
+        server.served += size;
+        return size;
+    }
+
+private:
+    std::map<std::string, std::string> headers_;
+    const std::string* content_ = nullptr;
+    int status_ = 0;
+    size_t position_ = 0;
+    size_t end_ = 0;
+};
+
+std::unique_ptr<Http> NetworkInterface::CreateHttp(int connect_id) {
+    return std::make_unique<FakeHttp>();
+}
+
+// Downloads without a resume key never open Settings, only the symbols are needed
+struct SettingsNamespace {
+};
+
+Settings::Settings(const std::string& ns, bool read_write) : namespace_(nullptr), read_write_(read_write) {
+    CHECK(false);
+}
+
+std::string Settings::GetString(const std::string& key, const std::string& default_value) { return default_value; }
+void Settings::SetString(const std::string& key, const std::string& value) {}
+int32_t Settings::GetInt(const std::string& key, int32_t default_value) { return default_value; }
+void Settings::SetInt(const std::string& key, int32_t value) {}
+void Settings::EraseKey(const std::string& key) {}
+
+// A partition in memory with the rules of NOR flash: erases are whole sectors and a byte
+// is written once after an erase
+struct FakePartition {
+    esp_partition_t info;
+    std::vector<uint8_t> flash;
+    std::vector<bool> erased;
+    size_t erased_bytes = 0;
+    int violations = 0;
+
+    // The current image followed by what an earlier, larger image left behind
+    void Reset(const std::string& image) {
+        info = {};
+        info.size = PARTITION_SIZE;
+        strcpy(info.label, "assets");
+        std::mt19937 rng(image.size());
+        flash.resize(PARTITION_SIZE);
+        for (auto& byte : flash) {
+            byte = rng();
+        }
+        memcpy(flash.data(), image.data(), image.size());
+        erased.assign(PARTITION_SIZE, false);
+        erased_bytes = 0;
+        violations = 0;
+    }
+
+    bool Contains(const std::string& image) const {
+        return memcmp(flash.data(), image.data(), image.size()) == 0;
+    }
+};
+
+static FakePartition partition;
+
+esp_err_t esp_partition_read(const esp_partition_t* p, size_t offset, void* dst, size_t size) {
+    if (p != &partition.info || offset + size > p->size) {
+        partition.violations++;
+        return ESP_ERR_INVALID_ARG;
+    }
+    memcpy(dst, partition.flash.data() + offset, size);
+    return ESP_OK;
+}
+
+esp_err_t esp_partition_erase_range(const esp_partition_t* p, size_t offset, size_t size) {
+    if (p != &partition.info || offset % ASSETS_DELTA_BLOCK_SIZE != 0 || size % ASSETS_DELTA_BLOCK_SIZE != 0 ||
+        offset + size > p->size) {
+        printf("bad erase at %zu size %zu\n", offset, size);
+        partition.violations++;
+        return ESP_ERR_INVALID_ARG;
+    }
+    memset(partition.flash.data() + offset, 0xFF, size);
+    std::fill(partition.erased.begin() + offset, partition.erased.begin() + offset + size, true);
+    partition.erased_bytes += size;
+    return ESP_OK;
+}
+
+esp_err_t esp_partition_write(const esp_partition_t* p, size_t offset, const void* src, size_t size) {
+    if (p != &partition.info || offset + size > p->size) {
+        partition.violations++;
+        return ESP_ERR_INVALID_ARG;
+    }
+    for (size_t i = offset; i < offset + size; i++) {
+        if (!partition.erased[i]) {
+            printf("write at %zu size %zu hits a byte that is not erased: %zu\n", offset, size, i);
+            partition.violations++;
+            return ESP_FAIL;
+        }
+    }
+    memcpy(partition.flash.data() + offset, src, size);
+    std::fill(partition.erased.begin() + offset, partition.erased.begin() + offset + size, false);
+    return ESP_OK;
+}
+
+// The packed files of an image including their 0x5A5A prefix, as Assets::Download lists them
+static std::vector<AssetsDelta::OldFile> ListFiles(const std::string& image) {
+    uint32_t count, data_size;
+    memcpy(&count, image.data(), 4);
+    memcpy(&data_size, image.data() + 8, 4);
+    uint32_t data_offset = IMAGE_HEADER_SIZE + count * sizeof(mmap_assets_table);
+    data_size -= count * sizeof(mmap_assets_table);
+    std::vector<AssetsDelta::OldFile> files;
+    for (uint32_t i = 0; i < count; i++) {
+        mmap_assets_table entry;
+        memcpy(&entry, image.data() + IMAGE_HEADER_SIZE + i * sizeof(entry), sizeof(entry));
+        if (entry.asset_offset < data_size && entry.asset_size + 2ull <= data_size - entry.asset_offset) {
+            files.push_back({data_offset + entry.asset_offset, entry.asset_size + 2});
+        }
+    }
+    return files;
+}
+
+static bool SharesFiles(const std::string& old_image, const std::string& new_image) {
+    std::set<std::string> old_contents;
+    for (auto& file : ListFiles(old_image)) {
+        old_contents.insert(old_image.substr(file.offset, file.size));
+    }
+    for (auto& file : ListFiles(new_image)) {
+        if (old_contents.count(new_image.substr(file.offset, file.size)) > 0) {
+            return true;
+        }
+    }
+    return false;
+}
+
+struct Totals {
+    int cases = 0;
+    int nothing_reused = 0;
+    size_t image_bytes = 0;
+    size_t downloaded_bytes = 0;
+    size_t erased_bytes = 0;
+};
+
+static void RunCase(const std::string& old_image, const std::string& new_image, const std::string& manifest,
+                    Totals& totals) {
+    partition.Reset(old_image);
+    server.files = { { TEST_URL, new_image }, { TEST_URL ASSETS_DELTA_SUFFIX, manifest } };
+    // A connection closed somewhere in the image, it matters when that part is fetched
+    server.drops = { server.rng() % new_image.size() };
+    server.served = 0;
+    totals.cases++;
+
+    AssetsDelta delta(&partition.info, TEST_URL);
+    // Prepare() reads the mapped partition, Apply() runs after it is unmapped
+    std::string mapped(reinterpret_cast<const char*>(partition.flash.data()), old_image.size());
+    if (!delta.Prepare(mapped.data(), ListFiles(old_image))) {
+        CHECK(!SharesFiles(old_image, new_image));
+        totals.nothing_reused++;
+        return;
+    }
+    bool ok = delta.Apply(nullptr);
+    CHECK(ok);
+    CHECK(partition.Contains(new_image));
+    CHECK(partition.violations == 0);
+    totals.image_bytes += new_image.size();
+    totals.downloaded_bytes += server.served;
+    totals.erased_bytes += partition.erased_bytes;
+}
+
+// Without a manifest there is no delta, and a manifest that does not describe the image
+// served is caught by the final hash
+static void TestBadManifest(const std::string& old_image, const std::string& new_image, std::string manifest) {
+    partition.Reset(old_image);
+    server.files = { { TEST_URL, new_image } };
+    server.drops.clear();
+    {
+        AssetsDelta delta(&partition.info, TEST_URL);
+        CHECK(!delta.Prepare(old_image.data(), ListFiles(old_image)));
+    }
+
+    manifest[16] ^= 1;
+    server.files = { { TEST_URL, new_image }, { TEST_URL ASSETS_DELTA_SUFFIX, manifest } };
+    AssetsDelta delta(&partition.info, TEST_URL);
+    if (delta.Prepare(old_image.data(), ListFiles(old_image))) {
+        CHECK(!delta.Apply(nullptr));
+    }
+}
+
+int main(int argc, char** argv) {
+    if (argc < 2) {
+        printf("Usage: %s <cases directory>\n", argv[0]);
+        return 1;
+    }
+    std::string directory = argv[1];
+    Totals totals;
+    for (int i = 0; ; i++) {
+        std::string prefix = directory + "/" + std::to_string(i);
+        auto old_image = ReadFile(prefix + ".old.bin");
+        auto new_image = ReadFile(prefix + ".new.bin");
+        auto manifest = ReadFile(prefix + ".new.bin.delta");
+        if (old_image.empty() || new_image.empty() || manifest.empty()) {
+            break;
+        }
+        if (old_image.size() > PARTITION_SIZE || new_image.size() > PARTITION_SIZE) {
+            printf("case %d: image larger than the partition, skipped\n", i);
+            continue;
+        }
+        RunCase(old_image, new_image, manifest, totals);
+        if (i == 0) {
+            TestBadManifest(old_image, new_image, manifest);
+        }
+    }
+
+    if (totals.cases == 0) {
+        printf("No cases in %s\n", directory.c_str());
+        return 1;
+    }
+    printf("cases:      %d, %d with nothing to reuse\n", totals.cases, totals.nothing_reused);
+    printf("images:     %zu bytes in the delta updates\n", totals.image_bytes);
+    printf("downloaded: %zu bytes (%.1f%%)\n", totals.downloaded_bytes,
+           totals.downloaded_bytes * 100.0 / totals.image_bytes);
+    printf("erased:     %zu bytes (%.1f%%)\n", totals.erased_bytes, totals.erased_bytes * 100.0 / totals.image_bytes);
+    printf("%s\n", failures == 0 ? "PASS" : "FAIL");
+    return failures == 0 ? 0 : 1;
+}
@@ -0,0 +1,114 @@
+#!/usr/bin/env python3
+"""
+Write pairs of synthetic assets images with their delta manifests for assets_delta_test
+
+    python make_cases.py cases [--count 200] [--seed 1]
+
+Each case is <n>.old.bin, <n>.new.bin and <n>.new.bin.delta. The images have
+the layout pack_assets() in spiffs_assets_gen.py writes: the header, the file
+table sorted by name, and the files in (extension, name) order each behind a
+0x5A5A prefix. The delta manifest comes from asset_delta.py itself. new.bin is
+old.bin after a few random edits of the kind a new bundle brings: changed,
+resized, added, removed and renamed files, and files with the same content
+as another one.
+"""
+
+import argparse
+import os
+import random
+import sys
+
+sys.path.insert(0, os.path.join(os.path.dirname(os.path.abspath(__file__)), '..', 'spiffs_assets'))
+from asset_delta import write_delta_manifest  # noqa: E402
+
+NAME_LENGTH = 32
+EXTENSIONS = ['.bin', '.png', '.gif', '.json', '.ogg']
+
+
+def sort_key(filename):
+    basename, extension = os.path.splitext(filename)
+    return extension, basename
+
+
+def pack(files):
+    """Pack {name: content} the way pack_assets() does, without compression"""
+    merged_data = bytearray()
+    file_info_list = []
+    for name in sorted(files, key=sort_key):
+        file_info_list.append((name, len(merged_data), len(files[name])))
+        merged_data.extend(b'\x5A\x5A')
+        merged_data.extend(files[name])
+
+    file_info_list.sort(key=lambda info: info[0].encode('utf-8').ljust(NAME_LENGTH, b'\0'))
+    mmap_table = bytearray()
+    for name, offset, size in file_info_list:
+        mmap_table.extend(name.encode('utf-8').ljust(NAME_LENGTH, b'\0'))
+        mmap_table.extend(size.to_bytes(4, byteorder='little'))
+        mmap_table.extend(offset.to_bytes(4, byteorder='little'))
+        mmap_table.extend(bytes(4))
+
+    combined_data = mmap_table + merged_data
+    checksum = sum(combined_data) & 0xFFFF
+    header = (len(files).to_bytes(4, byteorder='little') + checksum.to_bytes(4, byteorder='little') +
+              len(combined_data).to_bytes(4, byteorder='little'))
+    return bytes(header + combined_data)
+
+
+def random_name(rng):
+    return f'{rng.choice("abcdefghijklmnopqrstuvwxyz")}{rng.randrange(100000)}{rng.choice(EXTENSIONS)}'
+
+
+def random_content(rng):
+    # Mostly small files, some large ones such as fonts and models
+    if rng.random() < 0.2:
+        return rng.randbytes(rng.randint(20000, 300000))
+    return rng.randbytes(rng.randint(1, 8000))
+
+
+def edit(rng, files, count):
+    files = dict(files)
+    for _ in range(count):
+        name = rng.choice(sorted(files))
+        kind = rng.random()
+        if kind < 0.25:
+            # Same size, new content
+            files[name] = rng.randbytes(len(files[name]))
+        elif kind < 0.4:
+            files[name] = random_content(rng)
+        elif kind < 0.6:
+            files[random_name(rng)] = random_content(rng)
+        elif kind < 0.75 and len(files) > 1:
+            del files[name]
+        elif kind < 0.9:
+            # Renamed, the data moves to another place in the order
+            files[random_name(rng)] = files.pop(name)
+        else:
+            # Same content as an existing file
+            files[random_name(rng)] = files[name]
+    return files
+
+
+def main():
+    parser = argparse.ArgumentParser()
+    parser.add_argument('directory')
+    parser.add_argument('--count', type=int, default=200)
+    parser.add_argument('--seed', type=int, default=1)
+    args = parser.parse_args()
+
+    rng = random.Random(args.seed)
+    os.makedirs(args.directory, exist_ok=True)
+    for case in range(args.count):
+        files = {random_name(rng): random_content(rng) for _ in range(rng.randint(5, 60))}
+        new_files = edit(rng, files, rng.randint(1, 10))
+        old_path = os.path.join(args.directory, f'{case}.old.bin')
+        new_path = os.path.join(args.directory, f'{case}.new.bin')
+        with open(old_path, 'wb') as f:
+            f.write(pack(files))
+        with open(new_path, 'wb') as f:
+            f.write(pack(new_files))
+        write_delta_manifest(new_path)
+    print(f'{args.count} cases in {args.directory}')
+
+
+if __name__ == '__main__':
+    main()
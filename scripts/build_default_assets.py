@@ -19,6 +19,11 @@ import json
 import struct
 from datetime import datetime
 
+sys.path.insert(0, os.path.join(os.path.dirname(os.path.abspath(__file__)), 'spiffs_assets'))
+from asset_manifest import MANIFEST_FILE, append_manifest
+from asset_delta import DELTA_SUFFIX, write_delta_manifest
+from asset_compress import encode_file, get_raw_files
+
 
 # =============================================================================
 # Pack model functions (from pack_model.py)
@@ -301,7 +306,7 @@ def generate_index_json(assets_dir, srmodels, text_font, emoji_collection, extra
     print(f"Generated: {index_path}")
 
 
-def generate_config_json(build_dir, assets_dir):
+def generate_config_json(build_dir, assets_dir, compress=False):
     """Generate config.json file"""
     config_data = {
         "include_path": os.path.join(build_dir, "include"),
@@ -318,7 +323,8 @@ def generate_config_json(build_dir, assets_dir):
         "support_sqoi": False,
         "support_raw": False,
         "support_raw_dither": False,
-        "support_raw_bgr": False
+        "support_raw_bgr": False,
+        "compress_assets": compress
     }
     
     # Write config.json
@@ -344,13 +350,14 @@ def sort_key(filename):
     return extension, basename
 
 
-def pack_assets_simple(target_path, include_path, out_file, assets_path, max_name_len=32):
+def pack_assets_simple(target_path, include_path, out_file, assets_path, max_name_len=32, compress=False):
     """
     Simplified version of pack_assets that handles basic file packing
     """
     merged_data = bytearray()
     file_info_list = []
-    skip_files = ['config.json']
+    skip_files = ['config.json', MANIFEST_FILE]
+    raw_files = get_raw_files(target_path)
 
     # Ensure output directory exists
     os.makedirs(os.path.dirname(out_file), exist_ok=True)
@@ -366,19 +373,23 @@ def pack_assets_simple(target_path, include_path, out_file, assets_path, max_nam
             continue
             
         file_name = os.path.basename(file_path)
-        file_size = os.path.getsize(file_path)
-
-        file_info_list.append((file_name, len(merged_data), file_size, 0, 0))
-        # Add 0x5A5A prefix to merged_data
-        merged_data.extend(b'\x5A' * 2)
 
         with open(file_path, 'rb') as bin_file:
             bin_data = bin_file.read()
 
-        merged_data.extend(bin_data)
+        # 0x5A5A prefix for files used in place, "ZL" for compressed ones
+        prefix, stored_data = encode_file(bin_data, compress and file_name not in raw_files)
+        file_info_list.append((file_name, len(merged_data), len(stored_data), 0, 0))
+        merged_data.extend(prefix)
+        merged_data.extend(stored_data)
 
+    append_manifest(target_path, file_info_list, merged_data)
     total_files = len(file_info_list)
 
+    # Sort the file table by its stored name bytes so the firmware can binary search it in place;
+    # the file data keeps its order, entries point to it by offset
+    file_info_list.sort(key=lambda info: info[0].encode('utf-8').ljust(max_name_len, b'\0')[:max_name_len])
+
     mmap_table = bytearray()
     for file_name, offset, file_size, width, height in file_info_list:
         if len(file_name) > max_name_len:
@@ -398,6 +409,7 @@ def pack_assets_simple(target_path, include_path, out_file, assets_path, max_nam
 
     with open(out_file, 'wb') as output_bin:
         output_bin.write(final_data)
+    write_delta_manifest(out_file)
 
     # Generate header file
     current_year = datetime.now().year
@@ -698,7 +710,7 @@ def get_emoji_collection_path(default_emoji_collection, xiaozhi_fonts_path):
         return None
 
 
-def build_assets_integrated(wakenet_model_paths, multinet_model_paths, text_font_path, emoji_collection_path, extra_files_path, output_path, multinet_model_info=None):
+def build_assets_integrated(wakenet_model_paths, multinet_model_paths, text_font_path, emoji_collection_path, extra_files_path, output_path, multinet_model_info=None, compress=False):
     """
     Build assets using integrated functions (no external dependencies)
     """
@@ -725,7 +737,7 @@ def build_assets_integrated(wakenet_model_paths, multinet_model_paths, text_font
         generate_index_json(assets_dir, srmodels, text_font, emoji_collection, extra_files, multinet_model_info)
         
         # Generate config.json for packing
-        config_path = generate_config_json(temp_build_dir, assets_dir)
+        config_path = generate_config_json(temp_build_dir, assets_dir, compress)
         
         # Load config and pack assets
         with open(config_path, 'r') as f:
@@ -734,11 +746,13 @@ def build_assets_integrated(wakenet_model_paths, multinet_model_paths, text_font
         # Use simplified packing function
         include_path = config_data['include_path']
         image_file = config_data['image_file']
-        pack_assets_simple(assets_dir, include_path, image_file, "assets", int(config_data['name_length']))
+        pack_assets_simple(assets_dir, include_path, image_file, "assets", int(config_data['name_length']),
+                           config_data.get('compress_assets', False))
         
         # Copy final assets.bin to output location
         if os.path.exists(image_file):
             shutil.copy2(image_file, output_path)
+            shutil.copy2(image_file + DELTA_SUFFIX, output_path + DELTA_SUFFIX)
             print(f"Successfully generated assets.bin: {output_path}")
             
             # Show size information
@@ -768,6 +782,7 @@ def main():
     parser.add_argument('--esp_sr_model_path', help='Path to ESP-SR model directory')
     parser.add_argument('--xiaozhi_fonts_path', help='Path to xiaozhi-fonts component directory')
     parser.add_argument('--extra_files', help='Path to extra files directory to be included in assets')
+    parser.add_argument('--compress', action='store_true', help='LZ4 compress files that shrink, except the srmodels and the text font')
     
     args = parser.parse_args()
     
@@ -870,7 +885,7 @@ def main():
     
     # Build the assets
     success = build_assets_integrated(wakenet_model_paths, multinet_model_paths, text_font_path, emoji_collection_path, 
-                                     extra_files_path, args.output, multinet_model_info)
+                                     extra_files_path, args.output, multinet_model_info, args.compress)
     
     if not success:
         sys.exit(1)
@@ -0,0 +1,241 @@
+// Host test of main/device_state_timing.cc, driven through DeviceStateMachine with a virtual
+// clock, read back through Metrics::ToJson(). See README.md.
+
+#include "device_state_machine.h"
+#include "metrics.h"
+
+#include <esp_timer.h>
+
+#include <atomic>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <thread>
+
+static int failures = 0;
+
+#define CHECK(condition) do { \
+        if (!(condition)) { \
+            printf("FAIL %s:%d: %s\n", __FILE__, __LINE__, #condition); \
+            failures++; \
+        } \
+    } while (0)
+
+static void AdvanceMs(int64_t ms) {
+    HostVirtualTimeUs() += ms * 1000;
+}
+
+// A number that follows "key": in the JSON object of the metric name, -1 when missing
+static int64_t ReadNumber(const std::string& json, const std::string& name, const char* key = nullptr) {
+    size_t position = json.find("\"" + name + "\":");
+    if (position == std::string::npos) {
+        return -1;
+    }
+    position += name.size() + 3;
+    if (key != nullptr) {
+        position = json.find(std::string("\"") + key + "\":", position);
+        if (position == std::string::npos) {
+            return -1;
+        }
+        position += strlen(key) + 3;
+    }
+    return strtoll(json.c_str() + position, nullptr, 10);
+}
+
+// The metrics live for the whole process, so each check looks at what changed since the last snapshot
+class Snapshot {
+public:
+    Snapshot() : json_(Metrics::GetInstance().ToJson()) {}
+
+    int64_t Counter(const std::string& name) const {
+        return ReadNumber(Metrics::GetInstance().ToJson(), name) - ReadNumber(json_, name);
+    }
+    int64_t Count(const std::string& name) const {
+        return ReadNumber(Metrics::GetInstance().ToJson(), name, "count") - ReadNumber(json_, name, "count");
+    }
+    int64_t Sum(const std::string& name) const {
+        return ReadNumber(Metrics::GetInstance().ToJson(), name, "sum") - ReadNumber(json_, name, "sum");
+    }
+    static int64_t Max(const std::string& name) {
+        return ReadNumber(Metrics::GetInstance().ToJson(), name, "max");
+    }
+
+private:
+    std::string json_;
+};
+
+// Boot to idle, every state entered is counted and its dwell time recorded when it is left
+static void TestDwell(DeviceStateMachine& machine) {
+    Snapshot snapshot;
+    AdvanceMs(50);
+    CHECK(machine.TransitionTo(kDeviceStateStarting));
+    AdvanceMs(1200);
+    CHECK(machine.TransitionTo(kDeviceStateActivating));
+    AdvanceMs(800);
+    CHECK(machine.TransitionTo(kDeviceStateIdle));
+    CHECK(snapshot.Counter("state.transitions") == 3);
+    CHECK(snapshot.Counter("state.starting.entered") == 1);
+    CHECK(snapshot.Counter("state.idle.entered") == 1);
+    CHECK(snapshot.Count("state.unknown.dwell_ms") == 1 && snapshot.Sum("state.unknown.dwell_ms") == 50);
+    CHECK(snapshot.Count("state.starting.dwell_ms") == 1 && snapshot.Sum("state.starting.dwell_ms") == 1200);
+    CHECK(snapshot.Count("state.activating.dwell_ms") == 1 && snapshot.Sum("state.activating.dwell_ms") == 800);
+    CHECK(snapshot.Count("state.idle.dwell_ms") == 0);
+
+    // Staying in the same state is not a transition
+    CHECK(machine.TransitionTo(kDeviceStateIdle));
+    CHECK(snapshot.Counter("state.transitions") == 3);
+}
+
+// idle -> connecting -> listening is measured until listening is settled, not until it is entered
+static void TestIdleToListening(DeviceStateMachine& machine) {
+    Snapshot snapshot;
+    AdvanceMs(5000);
+    CHECK(machine.TransitionTo(kDeviceStateConnecting));
+    AdvanceMs(400);
+    CHECK(machine.TransitionTo(kDeviceStateListening));
+    CHECK(snapshot.Count("state.idle_to_listening_ms") == 0);
+    AdvanceMs(150);
+    machine.timing().OnStateSettled();
+    CHECK(snapshot.Count("state.idle_to_listening_ms") == 1);
+    CHECK(snapshot.Sum("state.idle_to_listening_ms") == 550);
+    CHECK(snapshot.Sum("state.idle.dwell_ms") == 5000);
+
+    // Settling again records nothing more
+    AdvanceMs(100);
+    machine.timing().OnStateSettled();
+    CHECK(snapshot.Count("state.idle_to_listening_ms") == 1);
+}
+
+// speaking -> listening is measured from the transition until listening is settled
+static void TestSpeakingToListening(DeviceStateMachine& machine) {
+    Snapshot snapshot;
+    AdvanceMs(3000);
+    CHECK(machine.TransitionTo(kDeviceStateSpeaking));
+    machine.timing().OnStateSettled();
+    AdvanceMs(2000);
+    CHECK(machine.TransitionTo(kDeviceStateListening));
+    AdvanceMs(80);
+    machine.timing().OnStateSettled();
+    CHECK(snapshot.Count("state.speaking_to_listening_ms") == 1);
+    CHECK(snapshot.Sum("state.speaking_to_listening_ms") == 80);
+    CHECK(snapshot.Count("state.idle_to_listening_ms") == 0);
+    CHECK(snapshot.Sum("state.speaking.dwell_ms") == 2000);
+
+    // Leaving listening before it settled drops the measurement
+    CHECK(machine.TransitionTo(kDeviceStateSpeaking));
+    AdvanceMs(500);
+    CHECK(machine.TransitionTo(kDeviceStateListening));
+    AdvanceMs(30);
+    CHECK(machine.TransitionTo(kDeviceStateIdle));
+    machine.timing().OnStateSettled();
+    CHECK(snapshot.Count("state.speaking_to_listening_ms") == 1);
+}
+
+// A failed connection does not count, nor does listening entered from idle in manual mode
+static void TestFailedConnect(DeviceStateMachine& machine) {
+    Snapshot snapshot;
+    AdvanceMs(1000);
+    CHECK(machine.TransitionTo(kDeviceStateConnecting));
+    AdvanceMs(3000);
+    CHECK(machine.TransitionTo(kDeviceStateIdle));
+    machine.timing().OnStateSettled();
+    AdvanceMs(1000);
+    CHECK(machine.TransitionTo(kDeviceStateListening));
+    machine.timing().OnStateSettled();
+    CHECK(snapshot.Count("state.idle_to_listening_ms") == 0);
+    CHECK(snapshot.Count("state.connecting.dwell_ms") == 1 && snapshot.Sum("state.connecting.dwell_ms") == 3000);
+    CHECK(machine.TransitionTo(kDeviceStateIdle));
+}
+
+static void TestInvalidTransition(DeviceStateMachine& machine) {
+    Snapshot snapshot;
+    CHECK(machine.TransitionTo(kDeviceStateConnecting));
+    CHECK(!machine.TransitionTo(kDeviceStateSpeaking));
+    CHECK(machine.GetState() == kDeviceStateConnecting);
+    CHECK(snapshot.Counter("state.invalid_transitions") == 1);
+    CHECK(snapshot.Counter("state.transitions") == 1);
+    CHECK(snapshot.Counter("state.speaking.entered") == 0);
+    CHECK(machine.TransitionTo(kDeviceStateIdle));
+}
+
+// The first uplink packet after the wake word measures it once, going back to idle or
+// cancelling the wake word forgets it
+static void TestWakeToUplink(DeviceStateMachine& machine) {
+    auto& timing = machine.timing();
+    Snapshot snapshot;
+    CHECK(timing.OnUplinkAudioSent() == -1);
+    timing.OnWakeWordDetected();
+    AdvanceMs(700);
+    CHECK(timing.OnUplinkAudioSent() == 700);
+    CHECK(timing.OnUplinkAudioSent() == -1);
+    CHECK(snapshot.Count("app.wake_to_uplink_ms") == 1 && snapshot.Sum("app.wake_to_uplink_ms") == 700);
+
+    timing.OnWakeWordDetected();
+    timing.OnWakeWordCancelled();
+    AdvanceMs(100);
+    CHECK(timing.OnUplinkAudioSent() == -1);
+
+    timing.OnWakeWordDetected();
+    CHECK(machine.TransitionTo(kDeviceStateConnecting));
+    CHECK(machine.TransitionTo(kDeviceStateIdle));
+    CHECK(timing.OnUplinkAudioSent() == -1);
+    CHECK(snapshot.Count("app.wake_to_uplink_ms") == 1);
+}
+
+// Uplink packets are sent while the main task handles the wake word, each wake word is
+// still measured exactly once
+static void TestWakeToUplinkRace(DeviceStateMachine& machine, int rounds) {
+    auto& timing = machine.timing();
+    Snapshot snapshot;
+    std::atomic<int> measured { 0 };
+    for (int round = 0; round < rounds; round++) {
+        timing.OnWakeWordDetected();
+        std::thread senders[2];
+        for (auto& sender : senders) {
+            sender = std::thread([&timing, &measured]() {
+                for (int i = 0; i < 10; i++) {
+                    if (timing.OnUplinkAudioSent() >= 0) {
+                        measured++;
+                    }
+                }
+            });
+        }
+        for (auto& sender : senders) {
+            sender.join();
+        }
+    }
+    CHECK(measured == rounds);
+    CHECK(snapshot.Count("app.wake_to_uplink_ms") == rounds);
+}
+
+// Dwell times longer than INT32_MAX ms are clamped rather than wrapped
+static void TestLongDwell(DeviceStateMachine& machine) {
+    AdvanceMs(int64_t(30) * 24 * 3600 * 1000);
+    CHECK(machine.TransitionTo(kDeviceStateConnecting));
+    CHECK(Snapshot::Max("state.idle.dwell_ms") == INT32_MAX);
+    CHECK(machine.TransitionTo(kDeviceStateIdle));
+}
+
+int main(int argc, char** argv) {
+    int rounds = argc > 1 ? atoi(argv[1]) : 10000;
+    DeviceStateMachine machine;
+    TestDwell(machine);
+    printf("dwell:               done\n");
+    TestIdleToListening(machine);
+    printf("idle to listening:   done\n");
+    TestSpeakingToListening(machine);
+    printf("speaking to listen:  done\n");
+    TestFailedConnect(machine);
+    printf("failed connect:      done\n");
+    TestInvalidTransition(machine);
+    printf("invalid transition:  done\n");
+    TestWakeToUplink(machine);
+    printf("wake to uplink:      done\n");
+    TestWakeToUplinkRace(machine, rounds);
+    printf("wake to uplink race: %d rounds\n", rounds);
+    TestLongDwell(machine);
+    printf("long dwell:          done\n");
+    printf("%s\n", failures == 0 ? "PASS" : "FAIL");
+    return failures == 0 ? 0 : 1;
+}
@@ -0,0 +1,15 @@
+// Host stand-in for esp_timer.h, a virtual clock the test moves forward
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+
+// Starts at 1 s, DeviceStateTiming takes a time of 0 as not set
+inline std::atomic<int64_t>& HostVirtualTimeUs() {
+    static std::atomic<int64_t> time_us { 1000000 };
+    return time_us;
+}
+
+inline int64_t esp_timer_get_time() {
+    return HostVirtualTimeUs().load();
+}
@@ -0,0 +1,8 @@
+// Host stand-in for FreeRTOS.h, trace_recorder.h only needs the types
+#pragma once
+
+#include <cstdint>
+
+typedef uint32_t TickType_t;
+typedef int BaseType_t;
+typedef unsigned int UBaseType_t;
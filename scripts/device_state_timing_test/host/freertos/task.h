@@ -0,0 +1,6 @@
+// Host stand-in for task.h, trace_recorder.h only needs the handle type
+#pragma once
+
+#include "freertos/FreeRTOS.h"
+
+typedef void* TaskHandle_t;
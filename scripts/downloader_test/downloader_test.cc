@@ -0,0 +1,557 @@
+// Host test of main/downloader.cc: resuming with Range and If-Range, reconnecting, and the
+// erase-ahead of PartitionWriter, against a fake HTTP server in memory. See README.md.
+
+#include "downloader.h"
+#include "board.h"
+#include "settings.h"
+
+#include <freertos/task.h>
+
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <map>
+#include <random>
+#include <string>
+#include <vector>
+
+static int failures = 0;
+
+#define CHECK(condition) do { \
+        if (!(condition)) { \
+            printf("FAIL %s:%d: %s\n", __FILE__, __LINE__, #condition); \
+            failures++; \
+        } \
+    } while (0)
+
+#define TEST_URL "http://fake/xiaozhi.bin"
+
+static std::string MakeContent(size_t size, uint32_t seed) {
+    std::mt19937 rng(seed);
+    std::string content(size, '\0');
+    for (auto& c : content) {
+        c = char(rng());
+    }
+    return content;
+}
+
+// The file served at TEST_URL, and what goes wrong while serving it
+struct FakeServer {
+    std::string content;
+    std::string etag;
+    std::string last_modified;
+    bool ranges = true;
+    // File positions where a connection is closed, each one once
+    std::vector<size_t> drops;
+    // Return an error instead of a clean close at the drops
+    bool drop_with_error = false;
+    // Connections that may still be opened, -1 for no limit
+    int open_budget = -1;
+    // Request headers of every Open(), also the refused ones
+    std::vector<std::map<std::string, std::string>> requests;
+    std::mt19937 rng { 1 };
+
+    void Reset(size_t size, uint32_t seed) {
+        auto read_sizes = rng;
+        *this = FakeServer();
+        rng = read_sizes;
+        content = MakeContent(size, seed);
+        etag = "\"" + std::to_string(seed) + "\"";
+        last_modified = "Mon, 19 Oct 2026 08:00:00 GMT";
+    }
+
+    bool Validates(const std::string& if_range) const {
+        if (!etag.empty() && etag.compare(0, 2, "W/") != 0 && if_range == etag) {
+            return true;
+        }
+        return !last_modified.empty() && if_range == last_modified;
+    }
+};
+
+static FakeServer server;
+
+class FakeHttp : public Http {
+public:
+    void SetHeader(const std::string& key, const std::string& value) override { headers_[key] = value; }
+
+    bool Open(const std::string& method, const std::string& url) override {
+        server.requests.push_back(headers_);
+        if (method != "GET" || url != TEST_URL || server.open_budget == 0) {
+            return false;
+        }
+        if (server.open_budget > 0) {
+            server.open_budget--;
+        }
+
+        status_ = 200;
+        position_ = 0;
+        end_ = server.content.size();
+        auto range = headers_.find("Range");
+        auto if_range = headers_.find("If-Range");
+        if (server.ranges && range != headers_.end() &&
+            (if_range == headers_.end() || server.Validates(if_range->second))) {
+            size_t begin = 0;
+            size_t last = SIZE_MAX;
+            if (sscanf(range->second.c_str(), "bytes=%zu-%zu", &begin, &last) < 1 || begin >= end_) {
+                status_ = 416;
+                end_ = 0;
+                return true;
+            }
+            status_ = 206;
+            position_ = begin;
+            end_ = std::min(end_, last == SIZE_MAX ? end_ : last + 1);
+        }
+        return true;
+    }
+
+    void Close() override {}
+    int GetStatusCode() override { return status_; }
+
+    std::string GetResponseHeader(const std::string& key) const override {
+        if (key == "ETag") {
+            return server.etag;
+        }
+        if (key == "Last-Modified") {
+            return server.last_modified;
+        }
+        return "";
+    }
+
+    size_t GetBodyLength() override { return end_ - position_; }
+
+    int Read(char* buffer, size_t buffer_size) override {
+        if (position_ == end_) {
+            return 0;
+        }
+        // Reads return what one TCP segment or a few of them would
+        size_t size = std::min({ buffer_size, end_ - position_, size_t(1 + server.rng() % 4096) });
+        for (auto it = server.drops.begin(); it != server.drops.end(); ++it) {
+            if (*it == position_) {
+                server.drops.erase(it);
+                end_ = position_;
+                return server.drop_with_error ? ESP_FAIL : 0;
+            }
+            if (*it > position_ && *it < position_ + size) {
+                size = *it - position_;
+            }
+        }
+        memcpy(buffer, server.content.data() + position_, size);
+        position_ += size;
+        return size;
+    }
+
+private:
+    std::map<std::string, std::string> headers_;
+    int status_ = 0;
+    size_t position_ = 0;
+    size_t end_ = 0;
+};
+
+// Settings of main/settings.h in memory for the whole process, so that a second Downloader
+// sees what the first one persisted, as after a reboot
+struct SettingsNamespace {
+    std::map<std::string, std::string> values;
+};
+
+Settings::Settings(const std::string& ns, bool read_write) : read_write_(read_write) {
+    static std::map<std::string, SettingsNamespace> namespaces;
+    namespace_ = &namespaces[ns];
+}
+
+std::string Settings::GetString(const std::string& key, const std::string& default_value) {
+    auto it = namespace_->values.find(key);
+    return it != namespace_->values.end() ? it->second : default_value;
+}
+
+void Settings::SetString(const std::string& key, const std::string& value) {
+    CHECK(read_write_);
+    namespace_->values[key] = value;
+}
+
+int32_t Settings::GetInt(const std::string& key, int32_t default_value) {
+    auto it = namespace_->values.find(key);
+    return it != namespace_->values.end() ? std::stoi(it->second) : default_value;
+}
+
+void Settings::SetInt(const std::string& key, int32_t value) {
+    SetString(key, std::to_string(value));
+}
+
+void Settings::EraseKey(const std::string& key) {
+    CHECK(read_write_);
+    namespace_->values.erase(key);
+}
+
+std::unique_ptr<Http> NetworkInterface::CreateHttp(int connect_id) {
+    return std::make_unique<FakeHttp>();
+}
+
+// A partition in memory with the rules of NOR flash: erases are whole sectors, a byte
+// is written once after an erase, and encrypted writes are 16-byte aligned
+struct FakePartition {
+    esp_partition_t info;
+    std::vector<uint8_t> flash;
+    std::vector<bool> erased;
+    size_t erased_bytes = 0;
+    int violations = 0;
+
+    void Reset(size_t size, bool encrypted) {
+        info = {};
+        info.size = size;
+        strcpy(info.label, "ota_1");
+        info.encrypted = encrypted;
+        // Left over from an earlier image, nothing is erased
+        std::mt19937 rng(size);
+        flash.resize(size);
+        for (auto& byte : flash) {
+            byte = rng();
+        }
+        erased.assign(size, false);
+        erased_bytes = 0;
+        violations = 0;
+    }
+
+    bool Contains(const std::string& content) const {
+        return flash.size() >= content.size() && memcmp(flash.data(), content.data(), content.size()) == 0;
+    }
+};
+
+static FakePartition partition;
+
+esp_err_t esp_partition_erase_range(const esp_partition_t* p, size_t offset, size_t size) {
+    if (p != &partition.info || offset % DOWNLOAD_SECTOR_SIZE != 0 || size % DOWNLOAD_SECTOR_SIZE != 0 ||
+        offset + size > p->size) {
+        printf("bad erase at %zu size %zu\n", offset, size);
+        partition.violations++;
+        return ESP_ERR_INVALID_ARG;
+    }
+    memset(partition.flash.data() + offset, 0xFF, size);
+    std::fill(partition.erased.begin() + offset, partition.erased.begin() + offset + size, true);
+    partition.erased_bytes += size;
+    return ESP_OK;
+}
+
+esp_err_t esp_partition_write(const esp_partition_t* p, size_t offset, const void* src, size_t size) {
+    if (p != &partition.info || offset + size > p->size ||
+        (p->encrypted && (offset % 16 != 0 || size % 16 != 0))) {
+        printf("bad write at %zu size %zu\n", offset, size);
+        partition.violations++;
+        return ESP_ERR_INVALID_ARG;
+    }
+    for (size_t i = offset; i < offset + size; i++) {
+        if (!partition.erased[i]) {
+            printf("write at %zu size %zu hits a byte that is not erased: %zu\n", offset, size, i);
+            partition.violations++;
+            return ESP_FAIL;
+        }
+    }
+    memcpy(partition.flash.data() + offset, src, size);
+    std::fill(partition.erased.begin() + offset, partition.erased.begin() + offset + size, false);
+    return ESP_OK;
+}
+
+// Runs a download into the partition, as Ota::Upgrade does, and checks the writes are consecutive
+struct DownloadResult {
+    bool ok = false;
+    size_t first_offset = SIZE_MAX;
+    size_t end_offset = 0;
+    size_t writes = 0;
+    int last_progress = -1;
+};
+
+static DownloadResult Download(Downloader& downloader) {
+    DownloadResult result;
+    PartitionWriter writer(&partition.info);
+    result.ok = downloader.Run([&](size_t offset, const uint8_t* data, size_t size) {
+        if (result.writes > 0 && offset != result.end_offset) {
+            printf("write at %zu does not follow %zu\n", offset, result.end_offset);
+            failures++;
+        }
+        if (result.writes == 0) {
+            result.first_offset = offset;
+        }
+        result.writes++;
+        result.end_offset = offset + size;
+        return writer.Write(offset, data, size);
+    }, [&](int progress, size_t speed) {
+        result.last_progress = progress;
+    });
+    return result;
+}
+
+static size_t SectorsOf(size_t size) {
+    return (size + DOWNLOAD_SECTOR_SIZE - 1) / DOWNLOAD_SECTOR_SIZE * DOWNLOAD_SECTOR_SIZE;
+}
+
+static bool HasResume(const std::string& key) {
+    return !Settings("download").GetString(key + "_url").empty();
+}
+
+static std::string Header(size_t request, const char* name) {
+    if (request >= server.requests.size()) {
+        return "<none>";
+    }
+    auto it = server.requests[request].find(name);
+    return it != server.requests[request].end() ? it->second : "";
+}
+
+// One connection without any trouble
+static void TestFull() {
+    server.Reset(1000003, 1);
+    partition.Reset(2 * 1024 * 1024, false);
+    Downloader downloader(TEST_URL);
+    auto result = Download(downloader);
+    CHECK(result.ok);
+    CHECK(downloader.total_size() == server.content.size());
+    CHECK(result.first_offset == 0 && result.end_offset == server.content.size());
+    CHECK(result.last_progress == 100);
+    CHECK(partition.Contains(server.content));
+    CHECK(partition.erased_bytes == SectorsOf(server.content.size()));
+    CHECK(partition.violations == 0);
+    CHECK(server.requests.size() == 1 && Header(0, "Range").empty());
+}
+
+// Closed connections within one Run() reconnect with a Range request at a 16-byte boundary
+static void TestReconnect(bool with_error) {
+    server.Reset(1048581, 2);
+    server.drops = { 300001, 600003 };
+    server.drop_with_error = with_error;
+    partition.Reset(2 * 1024 * 1024, false);
+    auto delayed = HostDelayedTicks().load();
+    Downloader downloader(TEST_URL, "ota");
+    auto result = Download(downloader);
+    CHECK(result.ok);
+    CHECK(partition.Contains(server.content));
+    CHECK(partition.erased_bytes == SectorsOf(server.content.size()));
+    CHECK(partition.violations == 0);
+    CHECK(server.requests.size() == 3);
+    CHECK(Header(1, "Range") == "bytes=" + std::to_string(300001 & ~15) + "-");
+    CHECK(Header(1, "If-Range") == server.etag);
+    CHECK(Header(2, "Range") == "bytes=" + std::to_string(600003 & ~15) + "-");
+    // Back-off of the first and the second retry
+    CHECK(HostDelayedTicks() - delayed == pdMS_TO_TICKS(1000 + 2000));
+    CHECK(!HasResume("ota"));
+}
+
+// A Run() that gives up leaves a checkpoint on a sector boundary, and the next Run(), as after
+// a reboot, erases and downloads from there only
+static void TestResumeAfterReboot() {
+    server.Reset(1048576 + 1000, 3);
+    server.drops = { 700000 };
+    server.open_budget = 1;
+    partition.Reset(2 * 1024 * 1024, false);
+    auto delayed = HostDelayedTicks().load();
+    {
+        Downloader downloader(TEST_URL, "ota");
+        CHECK(!Download(downloader).ok);
+    }
+    CHECK(server.requests.size() == 1 + DOWNLOAD_MAX_RETRIES);
+    CHECK(HostDelayedTicks() - delayed == pdMS_TO_TICKS(1000 + 2000 + 3000));
+    size_t checkpoint = Settings("download").GetInt("ota_off");
+    CHECK(checkpoint % DOWNLOAD_SECTOR_SIZE == 0);
+    CHECK(checkpoint <= 700000 && checkpoint + DOWNLOAD_CHECKPOINT_SIZE + DOWNLOAD_BUFFER_SIZE > 700000);
+    CHECK(Settings("download").GetString("ota_tag") == server.etag);
+
+    server.open_budget = -1;
+    server.requests.clear();
+    partition.erased_bytes = 0;
+    Downloader downloader(TEST_URL, "ota");
+    auto result = Download(downloader);
+    CHECK(result.ok);
+    CHECK(result.first_offset == checkpoint);
+    CHECK(Header(0, "Range") == "bytes=" + std::to_string(checkpoint) + "-");
+    CHECK(Header(0, "If-Range") == server.etag);
+    CHECK(partition.Contains(server.content));
+    CHECK(partition.erased_bytes == SectorsOf(server.content.size()) - checkpoint);
+    CHECK(partition.violations == 0);
+    CHECK(!HasResume("ota"));
+}
+
+// A file that changed since the checkpoint fails If-Range, the server sends all of it
+// and the download starts over instead of splicing two files
+static void TestChangedFile() {
+    server.Reset(600000, 4);
+    server.drops = { 400000 };
+    server.open_budget = 1;
+    partition.Reset(2 * 1024 * 1024, false);
+    {
+        Downloader downloader(TEST_URL, "ota");
+        CHECK(!Download(downloader).ok);
+    }
+    CHECK(Settings("download").GetInt("ota_off") > 0);
+    std::string old_etag = server.etag;
+
+    server.Reset(650000, 5);
+    Downloader downloader(TEST_URL, "ota");
+    auto result = Download(downloader);
+    CHECK(result.ok);
+    CHECK(Header(0, "If-Range") == old_etag);
+    CHECK(result.first_offset == 0);
+    CHECK(downloader.total_size() == server.content.size());
+    CHECK(partition.Contains(server.content));
+    CHECK(partition.violations == 0);
+    CHECK(!HasResume("ota"));
+}
+
+// If-Range takes a strong ETag only, a weak one falls back to Last-Modified, and a file
+// with neither is not resumed at all
+static void TestValidators() {
+    server.Reset(400000, 6);
+    server.etag = "W/\"6\"";
+    server.drops = { 300000 };
+    server.open_budget = 1;
+    partition.Reset(2 * 1024 * 1024, false);
+    {
+        Downloader downloader(TEST_URL, "ota");
+        CHECK(!Download(downloader).ok);
+    }
+    server.open_budget = -1;
+    server.requests.clear();
+    {
+        Downloader downloader(TEST_URL, "ota");
+        auto result = Download(downloader);
+        CHECK(result.ok && result.first_offset > 0);
+        CHECK(Header(0, "If-Range") == server.last_modified);
+        CHECK(partition.Contains(server.content));
+    }
+
+    server.Reset(400000, 7);
+    server.etag.clear();
+    server.last_modified.clear();
+    server.drops = { 300000 };
+    server.open_budget = 1;
+    partition.Reset(2 * 1024 * 1024, false);
+    {
+        Downloader downloader(TEST_URL, "ota");
+        CHECK(!Download(downloader).ok);
+        // Retries within the Run() do not need a validator, the total size guards them
+        CHECK(Header(1, "Range") == "bytes=" + std::to_string(300000 & ~15) + "-");
+        CHECK(Header(1, "If-Range").empty());
+    }
+    server.open_budget = -1;
+    server.requests.clear();
+    Downloader downloader(TEST_URL, "ota");
+    auto result = Download(downloader);
+    CHECK(result.ok && result.first_offset == 0);
+    CHECK(Header(0, "Range").empty());
+    CHECK(partition.Contains(server.content));
+    CHECK(partition.violations == 0);
+}
+
+// A server that ignores Range answers 200: reconnects within the Run() fail, and the next
+// Run() starts over
+static void TestNoRanges() {
+    server.Reset(500000, 8);
+    server.ranges = false;
+    server.drops = { 250000 };
+    partition.Reset(2 * 1024 * 1024, false);
+    {
+        Downloader downloader(TEST_URL, "ota");
+        CHECK(!Download(downloader).ok);
+    }
+    CHECK(server.requests.size() == 1 + DOWNLOAD_MAX_RETRIES);
+    server.requests.clear();
+    Downloader downloader(TEST_URL, "ota");
+    auto result = Download(downloader);
+    CHECK(result.ok && result.first_offset == 0);
+    CHECK(!Header(0, "Range").empty());
+    CHECK(partition.Contains(server.content));
+    CHECK(partition.violations == 0);
+}
+
+// set_range() downloads bytes [begin, end) only, also across a reconnect
+static void TestRange() {
+    server.Reset(100000, 9);
+    server.drops = { 30001 };
+    std::string received;
+    size_t first_offset = SIZE_MAX;
+    Downloader downloader(TEST_URL);
+    downloader.set_range(5000, 70000);
+    bool ok = downloader.Run([&](size_t offset, const uint8_t* data, size_t size) {
+        if (first_offset == SIZE_MAX) {
+            first_offset = offset;
+        }
+        CHECK(offset == first_offset + received.size());
+        received.append(reinterpret_cast<const char*>(data), size);
+        return true;
+    }, nullptr);
+    CHECK(ok);
+    CHECK(first_offset == 5000);
+    CHECK(received == server.content.substr(5000, 65000));
+    CHECK(server.requests.size() == 2);
+    CHECK(Header(0, "Range") == "bytes=5000-69999");
+    CHECK(Header(0, "If-Range").empty());
+    CHECK(Header(1, "Range") == "bytes=" + std::to_string(5000 + ((30001 - 5000) & ~15)) + "-69999");
+}
+
+static void TestMaxSize() {
+    server.Reset(5000, 10);
+    int writes = 0;
+    Downloader downloader(TEST_URL, "ota");
+    downloader.set_max_size(4999);
+    bool ok = downloader.Run([&](size_t, const uint8_t*, size_t) {
+        writes++;
+        return true;
+    }, nullptr);
+    CHECK(!ok);
+    CHECK(writes == 0);
+    CHECK(!HasResume("ota"));
+}
+
+// An encrypted partition takes 16-byte aligned writes only: reconnects keep block offsets
+// aligned and the tail of the file is padded with erased bytes
+static void TestEncrypted() {
+    server.Reset(300007, 11);
+    server.drops = { 100003, 200011 };
+    partition.Reset(1024 * 1024, true);
+    Downloader downloader(TEST_URL, "ota");
+    auto result = Download(downloader);
+    CHECK(result.ok);
+    CHECK(partition.violations == 0);
+    CHECK(partition.Contains(server.content));
+    for (size_t i = server.content.size(); i < (server.content.size() + 15) / 16 * 16; i++) {
+        CHECK(partition.flash[i] == 0xFF);
+    }
+}
+
+// A failing sink ends the Run() without waiting for the rest of the file
+static void TestWriteFailure() {
+    server.Reset(1000000, 12);
+    size_t writes_after_failure = 0;
+    bool failed = false;
+    Downloader downloader(TEST_URL, "ota");
+    bool ok = downloader.Run([&](size_t offset, const uint8_t*, size_t size) {
+        if (failed) {
+            writes_after_failure++;
+        }
+        failed = failed || offset + size > 200000;
+        return !failed;
+    }, nullptr);
+    CHECK(!ok);
+    CHECK(writes_after_failure == 0);
+    // The checkpoint before the failure is kept for the next attempt
+    CHECK(HasResume("ota"));
+    Downloader::ClearResume("ota");
+    CHECK(!HasResume("ota"));
+}
+
+int main(int argc, char** argv) {
+    int rounds = argc > 1 ? atoi(argv[1]) : 20;
+    // The read sizes of the fake server are random, so every round cuts the blocks differently
+    for (int round = 0; round < rounds; round++) {
+        TestFull();
+        TestReconnect(round % 2 == 1);
+        TestResumeAfterReboot();
+        TestChangedFile();
+        TestValidators();
+        TestNoRanges();
+        TestRange();
+        TestMaxSize();
+        TestEncrypted();
+        TestWriteFailure();
+    }
+    printf("%d rounds of full, reconnect, reboot, changed, validators, no-ranges, range, max-size, encrypted, write-failure\n",
+           rounds);
+    printf("%s\n", failures == 0 ? "PASS" : "FAIL");
+    return failures == 0 ? 0 : 1;
+}
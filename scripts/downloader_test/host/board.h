@@ -0,0 +1,25 @@
+// Host stand-in for Board, only the network that creates the Http of the fake server
+#pragma once
+
+#include <memory>
+
+#include "http.h"
+
+class NetworkInterface {
+public:
+    // Defined by the test
+    std::unique_ptr<Http> CreateHttp(int connect_id);
+};
+
+class Board {
+public:
+    static Board& GetInstance() {
+        static Board instance;
+        return instance;
+    }
+
+    NetworkInterface* GetNetwork() { return &network_; }
+
+private:
+    NetworkInterface network_;
+};
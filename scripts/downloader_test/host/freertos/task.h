@@ -0,0 +1,39 @@
+// Host stand-in for FreeRTOS tasks, a task is a detached thread
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <thread>
+
+#include "freertos/FreeRTOS.h"
+
+typedef void* TaskHandle_t;
+typedef void (*TaskFunction_t)(void*);
+
+inline BaseType_t xTaskCreate(TaskFunction_t function, const char*, uint32_t, void* arg,
+                              UBaseType_t, TaskHandle_t* handle) {
+    std::thread(function, arg).detach();
+    if (handle != nullptr) {
+        *handle = nullptr;
+    }
+    return pdPASS;
+}
+
+// Only deleting the calling task is supported, the thread ends when the task function returns
+inline void vTaskDelete(TaskHandle_t) {
+}
+
+inline UBaseType_t uxTaskPriorityGet(TaskHandle_t) {
+    return 1;
+}
+
+// The retry back-off is added up here instead of being waited for, so the tests run fast
+inline std::atomic<TickType_t>& HostDelayedTicks() {
+    static std::atomic<TickType_t> ticks { 0 };
+    return ticks;
+}
+
+inline void vTaskDelay(TickType_t ticks) {
+    HostDelayedTicks() += ticks;
+    std::this_thread::sleep_for(std::chrono::milliseconds(1));
+}
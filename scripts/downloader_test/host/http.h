@@ -0,0 +1,19 @@
+// Host stand-in for the esp-ml307 Http interface, implemented by the fake server of the test
+#pragma once
+
+#include <cstddef>
+#include <string>
+
+class Http {
+public:
+    virtual ~Http() = default;
+
+    virtual void SetHeader(const std::string& key, const std::string& value) = 0;
+    virtual bool Open(const std::string& method, const std::string& url) = 0;
+    virtual void Close() = 0;
+    virtual int GetStatusCode() = 0;
+    virtual std::string GetResponseHeader(const std::string& key) const = 0;
+    virtual size_t GetBodyLength() = 0;
+    // Bytes read, 0 when the connection was closed and negative on errors
+    virtual int Read(char* buffer, size_t buffer_size) = 0;
+};
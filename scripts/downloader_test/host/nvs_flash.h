@@ -0,0 +1,2 @@
+// Host stand-in for nvs_flash.h, the test keeps the Settings namespaces in memory
+#pragma once
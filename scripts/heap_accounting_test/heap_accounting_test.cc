@@ -0,0 +1,210 @@
+// Host test of main/heap_accounting.cc: the accounted allocator LVGL uses through
+// lvgl_mem.cc, and the address table of the cJSON hooks. See README.md.
+
+#include "heap_accounting.h"
+#include "metrics.h"
+
+#include <cJSON.h>
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <random>
+#include <string>
+#include <thread>
+#include <vector>
+
+static int failures = 0;
+
+#define CHECK(condition) do { \
+        if (!(condition)) { \
+            printf("FAIL %s:%d: %s\n", __FILE__, __LINE__, #condition); \
+            failures++; \
+        } \
+    } while (0)
+
+static void CheckUsage(HeapTag tag, size_t bytes, size_t blocks, int line) {
+    auto usage = HeapAccounting::GetUsage(tag);
+    if (usage.bytes != bytes || usage.blocks != blocks) {
+        printf("FAIL line %d: %s has %zu bytes in %zu blocks, expected %zu in %zu\n", line,
+            HeapAccounting::GetTagName(tag), usage.bytes, usage.blocks, bytes, blocks);
+        failures++;
+    }
+}
+
+#define CHECK_USAGE(tag, bytes, blocks) CheckUsage(tag, bytes, blocks, __LINE__)
+
+// Allocate / Reallocate / Free, as lv_malloc_core / lv_realloc_core / lv_free_core call them
+static void TestAllocator() {
+    void* a = HeapAccounting::Allocate(100, kHeapTagDisplay);
+    void* b = HeapAccounting::Allocate(28, kHeapTagDisplay);
+    CHECK(a != nullptr && b != nullptr);
+    CHECK(reinterpret_cast<uintptr_t>(a) % 8 == 0 && reinterpret_cast<uintptr_t>(b) % 8 == 0);
+    memset(a, 0xAA, 100);
+    memset(b, 0xBB, 28);
+    CHECK_USAGE(kHeapTagDisplay, 128, 2);
+    CHECK(HeapAccounting::GetUsage(kHeapTagDisplay).peak_bytes == 128);
+
+    // Growing keeps the contents and the tag, even inside a scope of another tag
+    {
+        HeapTagScope scope(kHeapTagMcp);
+        a = HeapAccounting::Reallocate(a, 4000, kHeapTagDisplay);
+    }
+    CHECK(a != nullptr && static_cast<uint8_t*>(a)[99] == 0xAA);
+    CHECK_USAGE(kHeapTagDisplay, 4028, 2);
+    CHECK_USAGE(kHeapTagMcp, 0, 0);
+    a = HeapAccounting::Reallocate(a, 10, kHeapTagDisplay);
+    CHECK(a != nullptr && static_cast<uint8_t*>(a)[9] == 0xAA);
+    CHECK_USAGE(kHeapTagDisplay, 38, 2);
+    CHECK(HeapAccounting::GetUsage(kHeapTagDisplay).peak_bytes == 4028);
+
+    // realloc() semantics for a null pointer and a zero size
+    void* c = HeapAccounting::Reallocate(nullptr, 50, kHeapTagDisplay);
+    CHECK_USAGE(kHeapTagDisplay, 88, 3);
+    CHECK(HeapAccounting::Reallocate(c, 0, kHeapTagDisplay) == nullptr);
+    CHECK_USAGE(kHeapTagDisplay, 38, 2);
+
+    HeapAccounting::Free(nullptr);
+    HeapAccounting::Free(a);
+    HeapAccounting::Free(b);
+    CHECK_USAGE(kHeapTagDisplay, 0, 0);
+    CHECK(HeapAccounting::GetUsage(kHeapTagDisplay).peak_bytes == 4028);
+}
+
+// A scope moves the allocations of its own thread only, and nests
+static void TestScopes() {
+    void* outer;
+    void* inner;
+    void* other = nullptr;
+    {
+        HeapTagScope scope(kHeapTagMcp);
+        outer = HeapAccounting::Allocate(10, kHeapTagDisplay);
+        {
+            HeapTagScope nested(kHeapTagJson);
+            inner = HeapAccounting::Allocate(20, kHeapTagDisplay);
+        }
+        std::thread([&other]() { other = HeapAccounting::Allocate(30, kHeapTagDisplay); }).join();
+    }
+    void* after = HeapAccounting::Allocate(40, kHeapTagDisplay);
+    CHECK_USAGE(kHeapTagMcp, 10, 1);
+    CHECK_USAGE(kHeapTagJson, 20, 1);
+    CHECK_USAGE(kHeapTagDisplay, 70, 2);
+    for (void* p : { outer, inner, other, after }) {
+        HeapAccounting::Free(p);
+    }
+    CHECK_USAGE(kHeapTagMcp, 0, 0);
+    CHECK_USAGE(kHeapTagJson, 0, 0);
+    CHECK_USAGE(kHeapTagDisplay, 0, 0);
+}
+
+// Counters stay exact with many tasks allocating, resizing and freeing at once
+static void TestThreads(int iterations) {
+    std::vector<std::thread> threads;
+    for (int t = 0; t < 4; t++) {
+        threads.emplace_back([t, iterations]() {
+            std::mt19937 rng(t);
+            std::vector<void*> blocks;
+            HeapTagScope scope(t % 2 == 0 ? kHeapTagNone : kHeapTagMcp);
+            for (int i = 0; i < iterations; i++) {
+                size_t size = 1 + rng() % 2000;
+                int action = rng() % 3;
+                if (action == 0 || blocks.empty()) {
+                    blocks.push_back(HeapAccounting::Allocate(size, kHeapTagDisplay));
+                } else {
+                    size_t index = rng() % blocks.size();
+                    if (action == 1) {
+                        blocks[index] = HeapAccounting::Reallocate(blocks[index], size, kHeapTagDisplay);
+                    } else {
+                        HeapAccounting::Free(blocks[index]);
+                        blocks[index] = blocks.back();
+                        blocks.pop_back();
+                    }
+                }
+            }
+            for (void* p : blocks) {
+                HeapAccounting::Free(p);
+            }
+        });
+    }
+    for (auto& thread : threads) {
+        thread.join();
+    }
+    CHECK_USAGE(kHeapTagDisplay, 0, 0);
+    CHECK_USAGE(kHeapTagMcp, 0, 0);
+}
+
+// cJSON blocks stay plain malloc() blocks and are only recorded inside a scope
+static void TestJson() {
+    HeapAccounting::InstallJsonHooks();
+    const char* text = "{\"type\":\"mcp\",\"payload\":{\"method\":\"tools/list\",\"params\":{\"cursor\":\"x\"},\"id\":1}}";
+
+    // Outside a scope nothing is recorded, and the output can be released with free()
+    cJSON* root = cJSON_Parse(text);
+    char* printed = cJSON_PrintUnformatted(root);
+    CHECK_USAGE(kHeapTagJson, 0, 0);
+    CHECK_USAGE(kHeapTagMcp, 0, 0);
+    free(printed);
+    cJSON_Delete(root);
+
+    // Everything parsed and printed inside the scope is accounted until deleted, also
+    // when it is deleted outside the scope or on another thread
+    {
+        HeapTagScope scope(kHeapTagMcp);
+        root = cJSON_Parse(text);
+        printed = cJSON_PrintUnformatted(root);
+    }
+    auto usage = HeapAccounting::GetUsage(kHeapTagMcp);
+    CHECK(usage.blocks > 1 && usage.bytes > strlen(text));
+    cJSON_free(printed);
+    std::thread([root]() { cJSON_Delete(root); }).join();
+    CHECK_USAGE(kHeapTagMcp, 0, 0);
+
+    // A recorded block released with plain free(), as managed components may do, is corrected
+    // when its address comes back from malloc()
+    void* first;
+    void* second;
+    {
+        HeapTagScope scope(kHeapTagJson);
+        first = cJSON_malloc(64);
+        free(first);
+        second = cJSON_malloc(64);
+    }
+    if (second == first) {
+        CHECK_USAGE(kHeapTagJson, 64, 1);
+    } else {
+        printf("note: malloc() did not reuse the address, skipped the free() case\n");
+    }
+    cJSON_free(second);
+    if (second == first) {
+        CHECK_USAGE(kHeapTagJson, 0, 0);
+    }
+
+    cJSON_InitHooks(nullptr);
+}
+
+static void TestMetrics() {
+    HeapAccounting::RegisterMetrics();
+    void* p = HeapAccounting::Allocate(1234, kHeapTagDisplay);
+    auto json = Metrics::GetInstance().ToJson();
+    CHECK(json.find("\"heap.display.bytes\":1234") != std::string::npos);
+    CHECK(json.find("\"heap.display.blocks\":1") != std::string::npos);
+    CHECK(json.find("\"heap.mcp.bytes\":0") != std::string::npos);
+    CHECK(json.find("heap.none.") == std::string::npos);
+    HeapAccounting::Free(p);
+}
+
+int main(int argc, char** argv) {
+    int iterations = argc > 1 ? atoi(argv[1]) : 100000;
+    TestAllocator();
+    printf("allocator: done\n");
+    TestScopes();
+    printf("scopes:    done\n");
+    TestThreads(iterations);
+    printf("threads:   4 x %d operations\n", iterations);
+    TestJson();
+    printf("json:      done\n");
+    TestMetrics();
+    printf("metrics:   done\n");
+    printf("%s\n", failures == 0 ? "PASS" : "FAIL");
+    return failures == 0 ? 0 : 1;
+}
@@ -0,0 +1,151 @@
+#!/usr/bin/env python3
+"""
+Build a firmware patch for Ota::UpgradeWithPatch
+
+    python scripts/ota_patch.py old.bin new.bin patch.bin
+
+old.bin is the application image the devices are running. The devices report
+its elf_sha256 when checking for updates, and the server answers with the
+patch in "firmware.patch_url" next to the full image in "firmware.url". The
+device rebuilds new.bin by reading its running partition while the patch
+streams in, and falls back to the full image when anything does not match.
+
+Layout (little endian, must match main/ota_patch.cc):
+
+    header      magic "XZOP", format version, reserved,
+                elf_sha256 of old.bin, size of new.bin, SHA-256 of new.bin  (76 bytes)
+    operations  length, source offset                                        (8 bytes each)
+                with bit 31 of the length set the length bytes follow as they are,
+                otherwise they are copied from old.bin at the source offset
+"""
+
+import argparse
+import hashlib
+import struct
+
+PATCH_MAGIC = b'XZOP'
+PATCH_FORMAT_VERSION = 1
+INSERT_FLAG = 0x80000000
+
+HEADER_FORMAT = '<4sHH32sI32s'
+OPERATION_FORMAT = '<II'
+
+# esp_image_header_t + esp_image_segment_header_t, then esp_app_desc_t
+APP_DESC_OFFSET = 0x20
+APP_DESC_MAGIC = 0xABCD5432
+ELF_SHA256_OFFSET = APP_DESC_OFFSET + 0x90
+
+# Old content is indexed by the KEY_SIZE bytes at every INDEX_STEP-th offset
+KEY_SIZE = 16
+INDEX_STEP = 4
+# Shorter matches cost more as an operation than as literal bytes
+MIN_MATCH = 24
+
+
+def get_elf_sha256(image):
+    if image[0] != 0xE9 or struct.unpack_from('<I', image, APP_DESC_OFFSET)[0] != APP_DESC_MAGIC:
+        raise ValueError('not an application image')
+    return image[ELF_SHA256_OFFSET:ELF_SHA256_OFFSET + 32]
+
+
+def match_length(old, old_offset, new, new_offset):
+    """Number of equal bytes from the two offsets on"""
+    length = 0
+    while True:
+        size = min(4096, len(old) - old_offset - length, len(new) - new_offset - length)
+        if size <= 0:
+            return length
+        a = old[old_offset + length:old_offset + length + size]
+        b = new[new_offset + length:new_offset + length + size]
+        if a == b:
+            length += size
+            continue
+        for i in range(size):
+            if a[i] != b[i]:
+                return length + i
+
+
+def diff(old, new):
+    """Yield (source offset, length) for copies and (None, bytes) for literal runs"""
+    old = memoryview(old)
+    new = memoryview(new)
+    index = {}
+    for offset in range(0, len(old) - KEY_SIZE + 1, INDEX_STEP):
+        index.setdefault(bytes(old[offset:offset + KEY_SIZE]), offset)
+
+    literal = bytearray()
+    position = 0
+    # After a small edit the old content usually continues at the same distance
+    shift = 0
+    while position < len(new):
+        key = bytes(new[position:position + KEY_SIZE])
+        candidates = [position + shift]
+        if key in index:
+            candidates.append(index[key])
+
+        best_source, best_length, best_back = 0, 0, 0
+        for source in candidates:
+            if source < 0 or source + KEY_SIZE > len(old) or bytes(old[source:source + KEY_SIZE]) != key:
+                continue
+            length = match_length(old, source, new, position)
+            back = 0
+            while back < len(literal) and source - back > 0 and old[source - back - 1] == new[position - back - 1]:
+                back += 1
+            if length + back > best_length + best_back:
+                best_source, best_length, best_back = source, length, back
+
+        if best_length + best_back < MIN_MATCH:
+            literal.append(new[position])
+            position += 1
+            continue
+
+        if best_back:
+            del literal[-best_back:]
+        if literal:
+            yield None, bytes(literal)
+            literal.clear()
+        yield best_source - best_back, best_length + best_back
+        shift = best_source - position
+        position += best_length
+
+    if literal:
+        yield None, bytes(literal)
+
+
+def make_patch(old, new):
+    operations = bytearray()
+    copied = 0
+    for source, data in diff(old, new):
+        if source is None:
+            operations.extend(struct.pack(OPERATION_FORMAT, len(data) | INSERT_FLAG, 0))
+            operations.extend(data)
+        else:
+            operations.extend(struct.pack(OPERATION_FORMAT, data, source))
+            copied += data
+    header = struct.pack(HEADER_FORMAT, PATCH_MAGIC, PATCH_FORMAT_VERSION, 0, get_elf_sha256(old),
+                         len(new), hashlib.sha256(new).digest())
+    return header + bytes(operations), copied
+
+
+def main():
+    parser = argparse.ArgumentParser(description='Build a firmware patch against a running image')
+    parser.add_argument('old', help='Application image running on the devices')
+    parser.add_argument('new', help='New application image')
+    parser.add_argument('patch', help='Output patch file')
+    args = parser.parse_args()
+
+    with open(args.old, 'rb') as f:
+        old = f.read()
+    with open(args.new, 'rb') as f:
+        new = f.read()
+    get_elf_sha256(new)
+
+    patch, copied = make_patch(old, new)
+    with open(args.patch, 'wb') as f:
+        f.write(patch)
+    print(f'Patch: {len(patch)} bytes for a {len(new)} byte image ({len(patch) * 100 // len(new)}%), '
+          f'{copied} bytes copied from {get_elf_sha256(old).hex()}')
+
+
+if __name__ == '__main__':
+    main()
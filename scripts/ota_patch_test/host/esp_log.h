@@ -0,0 +1,14 @@
+// Host stand-in for esp_log.h, OtaPatch errors are expected by most test cases and stay quiet
+#pragma once
+
+#include <cstdio>
+
+#ifdef OTA_PATCH_TEST_VERBOSE
+#define ESP_LOGI(tag, format, ...) printf("I %s: " format "\n", tag, ##__VA_ARGS__)
+#define ESP_LOGW(tag, format, ...) printf("W %s: " format "\n", tag, ##__VA_ARGS__)
+#define ESP_LOGE(tag, format, ...) printf("E %s: " format "\n", tag, ##__VA_ARGS__)
+#else
+#define ESP_LOGI(tag, format, ...) do {} while (0)
+#define ESP_LOGW(tag, format, ...) do {} while (0)
+#define ESP_LOGE(tag, format, ...) do {} while (0)
+#endif
@@ -0,0 +1,68 @@
+#!/usr/bin/env python3
+"""
+Write a pair of synthetic application images for ota_patch_test
+
+    python make_images.py old.bin new.bin [--size 1500000] [--seed 1]
+
+Both images carry the esp_image_header_t magic and an esp_app_desc_t with a
+random elf_sha256, which is all scripts/ota_patch.py looks at. new.bin is
+old.bin with the kind of edits a rebuild makes: code shifted by inserted
+bytes, changed strings and constants, and rewritten tables.
+"""
+
+import argparse
+import random
+import struct
+
+APP_DESC_OFFSET = 0x20
+APP_DESC_MAGIC = 0xABCD5432
+ELF_SHA256_OFFSET = APP_DESC_OFFSET + 0x90
+APP_DESC_SIZE = 256
+
+
+def make_image(rng, body):
+    header = bytearray(APP_DESC_OFFSET)
+    header[0] = 0xE9
+    desc = bytearray(APP_DESC_SIZE)
+    struct.pack_into('<I', desc, 0, APP_DESC_MAGIC)
+    desc[ELF_SHA256_OFFSET - APP_DESC_OFFSET:ELF_SHA256_OFFSET - APP_DESC_OFFSET + 32] = rng.randbytes(32)
+    return bytes(header + desc + body)
+
+
+def edit(rng, body, count):
+    body = bytearray(body)
+    for _ in range(count):
+        position = rng.randrange(len(body))
+        kind = rng.random()
+        if kind < 0.3:
+            # Changed string or constant
+            body[position:position + rng.randint(1, 50)] = rng.randbytes(rng.randint(0, 80))
+        elif kind < 0.6:
+            # Relocated code: a table of addresses all shifted by the same amount
+            for offset in range(position, min(position + 5000, len(body)), 37):
+                body[offset] ^= 0x5A
+        else:
+            # New code shifts everything after it
+            body[position:position] = rng.randbytes(rng.randint(1, 3000))
+    return bytes(body)
+
+
+def main():
+    parser = argparse.ArgumentParser(description='Write synthetic old and new application images')
+    parser.add_argument('old', help='Output image the devices are running')
+    parser.add_argument('new', help='Output image to upgrade to')
+    parser.add_argument('--size', type=int, default=1500000, help='Size of the old image body')
+    parser.add_argument('--edits', type=int, default=20, help='Number of edits in the new image')
+    parser.add_argument('--seed', type=int, default=1)
+    args = parser.parse_args()
+
+    rng = random.Random(args.seed)
+    body = rng.randbytes(args.size)
+    with open(args.old, 'wb') as f:
+        f.write(make_image(rng, body))
+    with open(args.new, 'wb') as f:
+        f.write(make_image(rng, edit(rng, body, args.edits)))
+
+
+if __name__ == '__main__':
+    main()
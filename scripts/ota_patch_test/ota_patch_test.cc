@@ -0,0 +1,185 @@
+// Host test of main/ota_patch.cc against patches written by scripts/ota_patch.py
+//
+// The running and the update partitions are files, read and written through the same
+// callbacks Ota::UpgradeWithPatch() passes to OtaPatch. See README.md.
+
+#include "ota_patch.h"
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <random>
+#include <string>
+#include <vector>
+
+// Offset of esp_app_desc_t::app_elf_sha256 in an application image
+static constexpr size_t kElfSha256Offset = 0x20 + 0x90;
+// Writes past this fail like they would past the end of an ota_x partition
+static constexpr size_t kPartitionSize = 4 * 1024 * 1024;
+
+static std::vector<uint8_t> LoadFile(const char* path) {
+    std::vector<uint8_t> data;
+    FILE* file = fopen(path, "rb");
+    if (file == nullptr) {
+        fprintf(stderr, "Cannot open %s\n", path);
+        exit(2);
+    }
+    uint8_t buffer[65536];
+    size_t n;
+    while ((n = fread(buffer, 1, sizeof(buffer), file)) > 0) {
+        data.insert(data.end(), buffer, buffer + n);
+    }
+    fclose(file);
+    return data;
+}
+
+struct Result {
+    bool ok;                // Feed() and Finish() both succeeded
+    bool sequential;        // Every write continued where the previous one ended
+    std::vector<uint8_t> output;
+};
+
+// Feeds the patch in pieces of 1 to max_piece bytes, as the downloader would hand them over
+static Result Apply(const char* source_path, const std::vector<uint8_t>& patch_data, size_t max_piece,
+        std::mt19937& rng, const char* output_path) {
+    FILE* source = fopen(source_path, "rb");
+    FILE* output = fopen(output_path, "w+b");
+    if (source == nullptr || output == nullptr) {
+        fprintf(stderr, "Cannot open the partition files\n");
+        exit(2);
+    }
+    fseek(source, 0, SEEK_END);
+    size_t source_size = ftell(source);
+    uint8_t elf_sha256[32];
+    fseek(source, kElfSha256Offset, SEEK_SET);
+    if (fread(elf_sha256, 1, sizeof(elf_sha256), source) != sizeof(elf_sha256)) {
+        fprintf(stderr, "%s is too short for an application image\n", source_path);
+        exit(2);
+    }
+
+    Result result = { false, true, {} };
+    size_t written = 0;
+    OtaPatch patch(elf_sha256, source_size,
+        [source](size_t offset, uint8_t* data, size_t size) {
+            return fseek(source, offset, SEEK_SET) == 0 && fread(data, 1, size, source) == size;
+        },
+        [output, &written, &result](size_t offset, const uint8_t* data, size_t size) {
+            if (offset != written) {
+                result.sequential = false;
+            }
+            if (offset + size > kPartitionSize) {
+                return false;
+            }
+            written = offset + size;
+            return fseek(output, offset, SEEK_SET) == 0 && fwrite(data, 1, size, output) == size;
+        });
+
+    std::uniform_int_distribution<size_t> piece(1, max_piece);
+    bool ok = true;
+    for (size_t offset = 0; ok && offset < patch_data.size();) {
+        size_t size = std::min(piece(rng), patch_data.size() - offset);
+        ok = patch.Feed(patch_data.data() + offset, size);
+        offset += size;
+    }
+    result.ok = ok && patch.Finish();
+
+    fflush(output);
+    fseek(output, 0, SEEK_SET);
+    result.output.resize(written);
+    if (fread(result.output.data(), 1, written, output) != written) {
+        result.ok = false;
+    }
+    fclose(source);
+    fclose(output);
+    return result;
+}
+
+int main(int argc, char** argv) {
+    if (argc < 4) {
+        fprintf(stderr, "Usage: %s old.bin new.bin patch.bin [iterations] [seed]\n", argv[0]);
+        return 2;
+    }
+    const char* old_path = argv[1];
+    auto new_image = LoadFile(argv[2]);
+    auto patch_data = LoadFile(argv[3]);
+    int iterations = argc > 4 ? atoi(argv[4]) : 100;
+    std::mt19937 rng(argc > 5 ? atoi(argv[5]) : 1);
+    std::string output_path = std::string(argv[3]) + ".out";
+    const size_t piece_sizes[] = { 1, 7, 76, 1460, 4096, 20000, patch_data.size() };
+    int failures = 0;
+
+    // Any split of the stream rebuilds new.bin exactly
+    for (int i = 0; i < iterations; i++) {
+        size_t max_piece = piece_sizes[i % (sizeof(piece_sizes) / sizeof(piece_sizes[0]))];
+        auto result = Apply(old_path, patch_data, max_piece, rng, output_path.c_str());
+        if (!result.ok || !result.sequential || result.output != new_image) {
+            printf("FAIL split: pieces up to %zu bytes, ok=%d sequential=%d output %zu bytes\n",
+                max_piece, result.ok, result.sequential, result.output.size());
+            failures++;
+        }
+    }
+    printf("split:    %d runs\n", iterations);
+
+    // A cut-off patch is never accepted
+    std::uniform_int_distribution<size_t> cut(0, patch_data.size() - 1);
+    for (int i = 0; i < iterations; i++) {
+        size_t size = i == 0 ? patch_data.size() - 1 : cut(rng);
+        std::vector<uint8_t> truncated(patch_data.begin(), patch_data.begin() + size);
+        auto result = Apply(old_path, truncated, 20000, rng, output_path.c_str());
+        if (result.ok || !result.sequential || result.output.size() > new_image.size()) {
+            printf("FAIL truncate: %zu of %zu bytes, ok=%d sequential=%d\n", size, patch_data.size(),
+                result.ok, result.sequential);
+            failures++;
+        }
+    }
+    printf("truncate: %d runs\n", iterations);
+
+    // A damaged patch is rejected, or still produces exactly new.bin when the damage is in
+    // a field that does not matter, like the reserved header bytes
+    std::uniform_int_distribution<size_t> position(0, patch_data.size() - 1);
+    int harmless = 0;
+    for (int i = 0; i < iterations; i++) {
+        auto corrupted = patch_data;
+        int flips = 1 + i % 3;
+        for (int j = 0; j < flips; j++) {
+            corrupted[position(rng)] ^= 1 << (rng() % 8);
+        }
+        auto result = Apply(old_path, corrupted, 20000, rng, output_path.c_str());
+        if (result.ok && result.output == new_image) {
+            harmless++;
+        } else if (result.ok || !result.sequential) {
+            printf("FAIL corrupt: accepted a wrong image of %zu bytes, sequential=%d\n",
+                result.output.size(), result.sequential);
+            failures++;
+        }
+    }
+    printf("corrupt:  %d runs, %d with harmless damage\n", iterations, harmless);
+
+    // A running image that differs from old.bin behind the header is caught by the final hash
+    auto source = LoadFile(old_path);
+    std::string source_path = output_path + ".src";
+    std::uniform_int_distribution<size_t> source_position(kElfSha256Offset + 32, source.size() - 1);
+    int unused = 0;
+    for (int i = 0; i < iterations; i++) {
+        auto damaged = source;
+        size_t offset = source_position(rng);
+        damaged[offset] ^= 0xFF;
+        FILE* file = fopen(source_path.c_str(), "wb");
+        fwrite(damaged.data(), 1, damaged.size(), file);
+        fclose(file);
+        auto result = Apply(source_path.c_str(), patch_data, 20000, rng, output_path.c_str());
+        if (result.ok && result.output == new_image) {
+            // The damaged byte is not copied into the new image
+            unused++;
+        } else if (result.ok) {
+            printf("FAIL source: accepted a wrong image with the running image changed at 0x%zx\n", offset);
+            failures++;
+        }
+    }
+    printf("source:   %d runs, %d with the change outside copied ranges\n", iterations, unused);
+
+    remove(source_path.c_str());
+    remove(output_path.c_str());
+    printf("%s\n", failures == 0 ? "PASS" : "FAIL");
+    return failures == 0 ? 0 : 1;
+}
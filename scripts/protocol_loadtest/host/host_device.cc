@@ -0,0 +1,137 @@
+#include "host_device.h"
+#include "board.h"
+#include "settings.h"
+#include "system_info.h"
+
+#include <cstdio>
+#include <cstdlib>
+#include <ctime>
+
+bool host_log_verbose = false;
+
+static thread_local HostDevice* current_device = nullptr;
+
+HostDevice::HostDevice(int index) : index_(index), application_(this) {
+    char mac[18];
+    snprintf(mac, sizeof(mac), "02:00:00:%02x:%02x:%02x", (index >> 16) & 0xFF, (index >> 8) & 0xFF, index & 0xFF);
+    mac_address_ = mac;
+    char uuid[37];
+    snprintf(uuid, sizeof(uuid), "00000000-0000-4000-8000-%012x", index);
+    uuid_ = uuid;
+}
+
+HostDevice* HostDevice::Current() {
+    if (current_device == nullptr) {
+        fprintf(stderr, "Firmware code called on a thread without a simulated device\n");
+        abort();
+    }
+    return current_device;
+}
+
+void HostDevice::Bind(HostDevice* device) {
+    current_device = device;
+}
+
+std::string HostDevice::GetSetting(const std::string& key, const std::string& default_value) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    auto it = settings_.find(key);
+    return it == settings_.end() ? default_value : it->second;
+}
+
+void HostDevice::SetSetting(const std::string& key, const std::string& value) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    settings_[key] = value;
+}
+
+void HostDevice::Post(std::function<void()> callback) {
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        tasks_.push_back(std::move(callback));
+    }
+    cv_.notify_all();
+}
+
+void HostDevice::Notify() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    cv_.notify_all();
+}
+
+bool HostDevice::RunUntil(std::chrono::steady_clock::time_point deadline, const std::function<bool()>& done) {
+    std::unique_lock<std::mutex> lock(mutex_);
+    while (true) {
+        while (!tasks_.empty()) {
+            auto task = std::move(tasks_.front());
+            tasks_.pop_front();
+            lock.unlock();
+            task();
+            lock.lock();
+        }
+        if (done && done()) {
+            return true;
+        }
+        if (cv_.wait_until(lock, deadline) == std::cv_status::timeout && tasks_.empty()) {
+            return done && done();
+        }
+    }
+}
+
+std::thread HostDevice::StartThread(std::function<void()> body) {
+    return std::thread([this, body = std::move(body)]() {
+        Bind(this);
+        body();
+        AddThreadCpuTime();
+    });
+}
+
+void HostDevice::AddThreadCpuTime() {
+    timespec ts;
+    clock_gettime(CLOCK_THREAD_CPUTIME_ID, &ts);
+    cpu_ns_ += int64_t(ts.tv_sec) * 1000000000 + ts.tv_nsec;
+}
+
+// Singletons of the firmware, resolved per device
+
+Application& Application::GetInstance() {
+    return HostDevice::Current()->application();
+}
+
+void Application::Schedule(std::function<void()> callback, SchedulePriority) {
+    device_->Post(std::move(callback));
+}
+
+Board& Board::GetInstance() {
+    static Board board;
+    return board;
+}
+
+std::string Board::GetUuid() {
+    return HostDevice::Current()->uuid();
+}
+
+NetworkInterface* Board::GetNetwork() {
+    return &network_;
+}
+
+std::string SystemInfo::GetMacAddress() {
+    return HostDevice::Current()->mac_address();
+}
+
+Settings::Settings(const std::string& ns, bool) : device_(HostDevice::Current()), ns_(ns) {
+}
+
+std::string Settings::GetString(const std::string& key, const std::string& default_value) {
+    return device_->GetSetting(ns_ + "." + key, default_value);
+}
+
+void Settings::SetString(const std::string& key, const std::string& value) {
+    device_->SetSetting(ns_ + "." + key, value);
+}
+
+int32_t Settings::GetInt(const std::string& key, int32_t default_value) {
+    auto value = device_->GetSetting(ns_ + "." + key, "");
+    return value.empty() ? default_value : atoi(value.c_str());
+}
+
+void Settings::SetInt(const std::string& key, int32_t value) {
+    device_->SetSetting(ns_ + "." + key, std::to_string(value));
+}
@@ -0,0 +1,66 @@
+#ifndef HOST_DEVICE_H
+#define HOST_DEVICE_H
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <map>
+#include <mutex>
+#include <string>
+#include <thread>
+
+#include "application.h"
+
+/**
+ * HostDevice - One simulated device of the host build
+ *
+ * The firmware sources reach their device through singletons (Board, Application,
+ * Settings, SystemInfo). On the host those resolve to the HostDevice bound to the
+ * calling thread, so many devices can share one process. Threads started through
+ * StartThread() and timers created on a bound thread stay bound to the same device,
+ * and the CPU time of those threads is added up per device.
+ */
+class HostDevice {
+public:
+    explicit HostDevice(int index);
+
+    static HostDevice* Current();
+    static void Bind(HostDevice* device);
+
+    int index() const { return index_; }
+    const std::string& mac_address() const { return mac_address_; }
+    const std::string& uuid() const { return uuid_; }
+    Application& application() { return application_; }
+
+    std::string GetSetting(const std::string& key, const std::string& default_value);
+    void SetSetting(const std::string& key, const std::string& value);
+
+    // Main task of the device: callbacks scheduled from any thread run in RunUntil()
+    void Post(std::function<void()> callback);
+    // Runs scheduled callbacks until done() returns true or the deadline passes, returns done()
+    bool RunUntil(std::chrono::steady_clock::time_point deadline, const std::function<bool()>& done);
+    // Wakes RunUntil() to check done() again
+    void Notify();
+
+    std::thread StartThread(std::function<void()> body);
+    // Adds the CPU time of the calling thread, called once when a bound thread ends
+    void AddThreadCpuTime();
+    double cpu_ms() const { return cpu_ns_ / 1e6; }
+
+private:
+    int index_;
+    std::string mac_address_;
+    std::string uuid_;
+    Application application_;
+
+    std::mutex mutex_;
+    std::condition_variable cv_;
+    std::deque<std::function<void()>> tasks_;
+    std::map<std::string, std::string> settings_;
+    std::atomic<int64_t> cpu_ns_{0};
+};
+
+#endif // HOST_DEVICE_H
@@ -0,0 +1,230 @@
+// FreeRTOS event groups, esp_timer and the mbedtls AES calls used by the protocol sources
+#include "host_device.h"
+
+#include <esp_timer.h>
+#include <freertos/event_groups.h>
+#include <freertos/task.h>
+#include <mbedtls/aes.h>
+#include <openssl/evp.h>
+
+#include <chrono>
+#include <condition_variable>
+#include <cstring>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <thread>
+
+struct EventGroup {
+    std::mutex mutex;
+    std::condition_variable cv;
+    EventBits_t bits = 0;
+};
+
+EventGroupHandle_t xEventGroupCreate() {
+    return new EventGroup();
+}
+
+void vEventGroupDelete(EventGroupHandle_t group) {
+    delete group;
+}
+
+EventBits_t xEventGroupSetBits(EventGroupHandle_t group, EventBits_t bits) {
+    std::lock_guard<std::mutex> lock(group->mutex);
+    group->bits |= bits;
+    group->cv.notify_all();
+    return group->bits;
+}
+
+EventBits_t xEventGroupClearBits(EventGroupHandle_t group, EventBits_t bits) {
+    std::lock_guard<std::mutex> lock(group->mutex);
+    EventBits_t previous = group->bits;
+    group->bits &= ~bits;
+    return previous;
+}
+
+EventBits_t xEventGroupWaitBits(EventGroupHandle_t group, EventBits_t bits, BaseType_t clear_on_exit,
+        BaseType_t wait_for_all, TickType_t ticks_to_wait) {
+    std::unique_lock<std::mutex> lock(group->mutex);
+    auto satisfied = [&]() {
+        return wait_for_all ? (group->bits & bits) == bits : (group->bits & bits) != 0;
+    };
+    if (ticks_to_wait == portMAX_DELAY) {
+        group->cv.wait(lock, satisfied);
+    } else {
+        group->cv.wait_for(lock, std::chrono::milliseconds(ticks_to_wait), satisfied);
+    }
+    EventBits_t result = group->bits;
+    if (satisfied() && clear_on_exit) {
+        group->bits &= ~bits;
+    }
+    return result;
+}
+
+void vTaskDelay(TickType_t ticks) {
+    std::this_thread::sleep_for(std::chrono::milliseconds(ticks));
+}
+
+// All timers share one thread, like the esp_timer task. Callbacks run bound to the device
+// that created the timer.
+struct esp_timer {
+    esp_timer_cb_t callback;
+    void* arg;
+    HostDevice* device;
+    uint64_t period_us = 0;
+    int64_t due_us = -1;
+};
+
+class TimerService {
+public:
+    static TimerService& GetInstance() {
+        // Never destroyed, the timer thread still waits on cv when the process exits
+        static TimerService* instance = new TimerService();
+        return *instance;
+    }
+
+    std::recursive_mutex mutex;
+    std::condition_variable_any cv;
+    std::multimap<int64_t, esp_timer*> queue;
+
+    void Arm(esp_timer* timer, int64_t due_us) {
+        Disarm(timer);
+        timer->due_us = due_us;
+        queue.emplace(due_us, timer);
+        cv.notify_all();
+    }
+
+    void Disarm(esp_timer* timer) {
+        if (timer->due_us < 0) {
+            return;
+        }
+        auto range = queue.equal_range(timer->due_us);
+        for (auto it = range.first; it != range.second; ++it) {
+            if (it->second == timer) {
+                queue.erase(it);
+                break;
+            }
+        }
+        timer->due_us = -1;
+    }
+
+private:
+    TimerService() {
+        std::thread([this]() { Run(); }).detach();
+    }
+
+    void Run() {
+        std::unique_lock<std::recursive_mutex> lock(mutex);
+        while (true) {
+            if (queue.empty()) {
+                cv.wait(lock);
+                continue;
+            }
+            auto it = queue.begin();
+            int64_t now = esp_timer_get_time();
+            if (it->first > now) {
+                cv.wait_for(lock, std::chrono::microseconds(it->first - now));
+                continue;
+            }
+            esp_timer* timer = it->second;
+            queue.erase(it);
+            timer->due_us = -1;
+            if (timer->period_us > 0) {
+                Arm(timer, now + timer->period_us);
+            }
+            auto callback = timer->callback;
+            auto arg = timer->arg;
+            HostDevice::Bind(timer->device);
+            // Held while the callback runs, so esp_timer_delete() never races with it. It is
+            // recursive because callbacks may start or stop timers themselves
+            callback(arg);
+        }
+    }
+};
+
+esp_err_t esp_timer_create(const esp_timer_create_args_t* create_args, esp_timer_handle_t* out_handle) {
+    *out_handle = new esp_timer{ create_args->callback, create_args->arg, HostDevice::Current() };
+    return ESP_OK;
+}
+
+esp_err_t esp_timer_start_once(esp_timer_handle_t timer, uint64_t timeout_us) {
+    auto& service = TimerService::GetInstance();
+    std::lock_guard<std::recursive_mutex> lock(service.mutex);
+    timer->period_us = 0;
+    service.Arm(timer, esp_timer_get_time() + timeout_us);
+    return ESP_OK;
+}
+
+esp_err_t esp_timer_start_periodic(esp_timer_handle_t timer, uint64_t period) {
+    auto& service = TimerService::GetInstance();
+    std::lock_guard<std::recursive_mutex> lock(service.mutex);
+    timer->period_us = period;
+    service.Arm(timer, esp_timer_get_time() + period);
+    return ESP_OK;
+}
+
+esp_err_t esp_timer_stop(esp_timer_handle_t timer) {
+    auto& service = TimerService::GetInstance();
+    std::lock_guard<std::recursive_mutex> lock(service.mutex);
+    timer->period_us = 0;
+    service.Disarm(timer);
+    return ESP_OK;
+}
+
+esp_err_t esp_timer_delete(esp_timer_handle_t timer) {
+    auto& service = TimerService::GetInstance();
+    std::lock_guard<std::recursive_mutex> lock(service.mutex);
+    service.Disarm(timer);
+    delete timer;
+    return ESP_OK;
+}
+
+int64_t esp_timer_get_time() {
+    return std::chrono::duration_cast<std::chrono::microseconds>(
+        std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+// AES-CTR as mbedtls implements it, so the nonce counter and stream block behave the same
+
+void mbedtls_aes_init(mbedtls_aes_context* ctx) {
+    memset(ctx, 0, sizeof(*ctx));
+}
+
+void mbedtls_aes_free(mbedtls_aes_context* ctx) {
+    memset(ctx, 0, sizeof(*ctx));
+}
+
+int mbedtls_aes_setkey_enc(mbedtls_aes_context* ctx, const unsigned char* key, unsigned int keybits) {
+    if (keybits != 128) {
+        return -1;
+    }
+    memcpy(ctx->key, key, sizeof(ctx->key));
+    return 0;
+}
+
+int mbedtls_aes_crypt_ctr(mbedtls_aes_context* ctx, size_t length, size_t* nc_off, unsigned char nonce_counter[16],
+        unsigned char stream_block[16], const unsigned char* input, unsigned char* output) {
+    // One AES-ECB cipher per thread, keyed for each call
+    static thread_local std::unique_ptr<EVP_CIPHER_CTX, decltype(&EVP_CIPHER_CTX_free)> cipher(
+        EVP_CIPHER_CTX_new(), EVP_CIPHER_CTX_free);
+    if (length > 0) {
+        EVP_EncryptInit_ex(cipher.get(), EVP_aes_128_ecb(), nullptr, ctx->key, nullptr);
+        EVP_CIPHER_CTX_set_padding(cipher.get(), 0);
+    }
+    size_t n = *nc_off;
+    for (size_t i = 0; i < length; i++) {
+        if (n == 0) {
+            int out_size = 0;
+            EVP_EncryptUpdate(cipher.get(), stream_block, &out_size, nonce_counter, 16);
+            for (int j = 15; j >= 0; j--) {
+                if (++nonce_counter[j] != 0) {
+                    break;
+                }
+            }
+        }
+        output[i] = input[i] ^ stream_block[n];
+        n = (n + 1) & 0x0F;
+    }
+    *nc_off = n;
+    return 0;
+}
@@ -0,0 +1,497 @@
+// WebSocket, MQTT and UDP clients on POSIX sockets, behind the esp-ml307 interfaces
+#include "host_device.h"
+
+#include <network_interface.h>
+#include <esp_log.h>
+
+#include <arpa/inet.h>
+#include <netdb.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include <cstring>
+#include <random>
+#include <vector>
+
+#define TAG "HostNet"
+
+static int OpenSocket(const std::string& host, int port, int type) {
+    addrinfo hints = {};
+    hints.ai_family = AF_INET;
+    hints.ai_socktype = type;
+    addrinfo* result = nullptr;
+    if (getaddrinfo(host.c_str(), std::to_string(port).c_str(), &hints, &result) != 0 || result == nullptr) {
+        ESP_LOGE(TAG, "Failed to resolve %s", host.c_str());
+        return -1;
+    }
+    int fd = socket(result->ai_family, result->ai_socktype, result->ai_protocol);
+    if (fd >= 0 && connect(fd, result->ai_addr, result->ai_addrlen) != 0) {
+        close(fd);
+        fd = -1;
+    }
+    freeaddrinfo(result);
+    if (fd >= 0 && type == SOCK_STREAM) {
+        int one = 1;
+        setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+    }
+    return fd;
+}
+
+static bool SendAll(int fd, const void* data, size_t size) {
+    auto p = static_cast<const uint8_t*>(data);
+    while (size > 0) {
+        ssize_t n = send(fd, p, size, MSG_NOSIGNAL);
+        if (n <= 0) {
+            return false;
+        }
+        p += n;
+        size -= n;
+    }
+    return true;
+}
+
+static bool ReceiveAll(int fd, void* data, size_t size) {
+    auto p = static_cast<uint8_t*>(data);
+    while (size > 0) {
+        ssize_t n = recv(fd, p, size, 0);
+        if (n <= 0) {
+            return false;
+        }
+        p += n;
+        size -= n;
+    }
+    return true;
+}
+
+// Stops the receive thread of a client, which may be the calling thread itself
+static void StopThread(int fd, std::thread& thread) {
+    if (fd >= 0) {
+        shutdown(fd, SHUT_RDWR);
+    }
+    if (thread.joinable()) {
+        if (thread.get_id() == std::this_thread::get_id()) {
+            thread.detach();
+        } else {
+            thread.join();
+        }
+    }
+}
+
+std::unique_ptr<WebSocket> NetworkInterface::CreateWebSocket(int) {
+    return std::make_unique<WebSocket>();
+}
+
+std::unique_ptr<Mqtt> NetworkInterface::CreateMqtt(int) {
+    return std::make_unique<Mqtt>();
+}
+
+std::unique_ptr<Udp> NetworkInterface::CreateUdp(int) {
+    return std::make_unique<Udp>();
+}
+
+// WebSocket (RFC 6455 client, no extensions)
+
+WebSocket::WebSocket() : device_(HostDevice::Current()) {
+}
+
+WebSocket::~WebSocket() {
+    Close();
+}
+
+void WebSocket::SetHeader(const char* key, const char* value) {
+    headers_[key] = value;
+}
+
+bool WebSocket::Connect(const char* uri) {
+    std::string url = uri;
+    if (url.rfind("ws://", 0) != 0) {
+        ESP_LOGE(TAG, "Only ws:// URLs are supported on the host: %s", uri);
+        last_error_ = -1;
+        return false;
+    }
+    std::string rest = url.substr(5);
+    std::string path = "/";
+    size_t slash = rest.find('/');
+    if (slash != std::string::npos) {
+        path = rest.substr(slash);
+        rest = rest.substr(0, slash);
+    }
+    std::string host = rest;
+    int port = 80;
+    size_t colon = rest.find(':');
+    if (colon != std::string::npos) {
+        host = rest.substr(0, colon);
+        port = atoi(rest.c_str() + colon + 1);
+    }
+
+    fd_ = OpenSocket(host, port, SOCK_STREAM);
+    if (fd_ < 0) {
+        last_error_ = errno;
+        return false;
+    }
+
+    std::string request = "GET " + path + " HTTP/1.1\r\nHost: " + rest + "\r\n"
+        "Upgrade: websocket\r\nConnection: Upgrade\r\n"
+        "Sec-WebSocket-Key: dGhlIHNhbXBsZSBub25jZQ==\r\nSec-WebSocket-Version: 13\r\n";
+    for (auto& [key, value] : headers_) {
+        request += key + ": " + value + "\r\n";
+    }
+    request += "\r\n";
+    if (!SendAll(fd_, request.data(), request.size())) {
+        last_error_ = errno;
+        return false;
+    }
+
+    // The server sends nothing after its response until the client has spoken, so reading
+    // byte by byte up to the blank line never consumes a frame
+    std::string response;
+    char c;
+    while (response.size() < 4096 && (response.size() < 4 || response.compare(response.size() - 4, 4, "\r\n\r\n") != 0)) {
+        if (recv(fd_, &c, 1, 0) != 1) {
+            last_error_ = errno;
+            return false;
+        }
+        response += c;
+    }
+    if (response.compare(0, 12, "HTTP/1.1 101") != 0) {
+        ESP_LOGE(TAG, "Websocket upgrade refused: %s", response.substr(0, response.find('\r')).c_str());
+        last_error_ = atoi(response.c_str() + 9);
+        return false;
+    }
+
+    connected_ = true;
+    receive_thread_ = device_->StartThread([this]() { ReceiveLoop(); });
+    if (on_connected_) {
+        on_connected_();
+    }
+    return true;
+}
+
+bool WebSocket::Send(const std::string& data) {
+    return Send(data.data(), data.size(), false, true);
+}
+
+bool WebSocket::Send(const void* data, size_t len, bool binary, bool fin) {
+    std::lock_guard<std::mutex> lock(send_mutex_);
+    if (!connected_) {
+        return false;
+    }
+    int opcode = continuation_ ? 0x0 : (binary ? 0x2 : 0x1);
+    continuation_ = !fin;
+    return SendFrame(opcode, data, len, fin);
+}
+
+bool WebSocket::SendFrame(int opcode, const void* data, size_t len, bool fin) {
+    static thread_local std::mt19937 rng(std::random_device{}());
+    std::vector<uint8_t> frame;
+    frame.reserve(len + 14);
+    frame.push_back((fin ? 0x80 : 0x00) | opcode);
+    if (len < 126) {
+        frame.push_back(0x80 | len);
+    } else if (len < 65536) {
+        frame.push_back(0x80 | 126);
+        frame.push_back(len >> 8);
+        frame.push_back(len & 0xFF);
+    } else {
+        frame.push_back(0x80 | 127);
+        for (int i = 7; i >= 0; i--) {
+            frame.push_back((uint64_t)len >> (i * 8));
+        }
+    }
+    uint32_t mask = rng();
+    uint8_t mask_bytes[4];
+    memcpy(mask_bytes, &mask, 4);
+    frame.insert(frame.end(), mask_bytes, mask_bytes + 4);
+    auto payload = static_cast<const uint8_t*>(data);
+    for (size_t i = 0; i < len; i++) {
+        frame.push_back(payload[i] ^ mask_bytes[i & 3]);
+    }
+    return SendAll(fd_, frame.data(), frame.size());
+}
+
+void WebSocket::ReceiveLoop() {
+    std::vector<char> message;
+    bool message_binary = false;
+    while (true) {
+        uint8_t header[2];
+        if (!ReceiveAll(fd_, header, 2)) {
+            break;
+        }
+        bool fin = header[0] & 0x80;
+        int opcode = header[0] & 0x0F;
+        uint64_t len = header[1] & 0x7F;
+        if (len == 126) {
+            uint8_t ext[2];
+            if (!ReceiveAll(fd_, ext, 2)) {
+                break;
+            }
+            len = (ext[0] << 8) | ext[1];
+        } else if (len == 127) {
+            uint8_t ext[8];
+            if (!ReceiveAll(fd_, ext, 8)) {
+                break;
+            }
+            len = 0;
+            for (int i = 0; i < 8; i++) {
+                len = (len << 8) | ext[i];
+            }
+        }
+        uint8_t mask[4] = {};
+        bool masked = header[1] & 0x80;
+        if (masked && !ReceiveAll(fd_, mask, 4)) {
+            break;
+        }
+        std::vector<char> payload(len);
+        if (len > 0 && !ReceiveAll(fd_, payload.data(), len)) {
+            break;
+        }
+        if (masked) {
+            for (size_t i = 0; i < len; i++) {
+                payload[i] ^= mask[i & 3];
+            }
+        }
+
+        if (opcode == 0x8) {
+            std::lock_guard<std::mutex> lock(send_mutex_);
+            SendFrame(0x8, payload.data(), std::min<size_t>(len, 2), true);
+            break;
+        } else if (opcode == 0x9) {
+            std::lock_guard<std::mutex> lock(send_mutex_);
+            SendFrame(0xA, payload.data(), len, true);
+            continue;
+        } else if (opcode == 0xA) {
+            continue;
+        }
+
+        if (opcode != 0x0) {
+            message.clear();
+            message_binary = opcode == 0x2;
+        }
+        message.insert(message.end(), payload.begin(), payload.end());
+        if (fin && on_data_) {
+            // Text handlers parse the data as a C string
+            size_t size = message.size();
+            message.push_back('\0');
+            on_data_(message.data(), size, message_binary);
+        }
+    }
+    connected_ = false;
+    if (!closing_ && on_disconnected_) {
+        on_disconnected_();
+    }
+}
+
+void WebSocket::Close() {
+    closing_ = true;
+    if (connected_) {
+        std::lock_guard<std::mutex> lock(send_mutex_);
+        uint8_t code[2] = { 0x03, 0xE8 };
+        SendFrame(0x8, code, sizeof(code), true);
+    }
+    StopThread(fd_, receive_thread_);
+    connected_ = false;
+    if (fd_ >= 0) {
+        close(fd_);
+        fd_ = -1;
+    }
+}
+
+// MQTT 3.1.1, QoS 0
+
+static void AppendString(std::string& body, const std::string& value) {
+    body.push_back(value.size() >> 8);
+    body.push_back(value.size() & 0xFF);
+    body += value;
+}
+
+Mqtt::Mqtt() : device_(HostDevice::Current()) {
+}
+
+Mqtt::~Mqtt() {
+    Disconnect();
+}
+
+bool Mqtt::SendPacket(uint8_t header, const std::string& body) {
+    std::string packet(1, header);
+    size_t length = body.size();
+    do {
+        uint8_t byte = length % 128;
+        length /= 128;
+        packet.push_back(length > 0 ? byte | 0x80 : byte);
+    } while (length > 0);
+    packet += body;
+    std::lock_guard<std::mutex> lock(send_mutex_);
+    return fd_ >= 0 && SendAll(fd_, packet.data(), packet.size());
+}
+
+bool Mqtt::Connect(const std::string broker_address, int broker_port, const std::string client_id,
+        const std::string username, const std::string password) {
+    fd_ = OpenSocket(broker_address, broker_port, SOCK_STREAM);
+    if (fd_ < 0) {
+        last_error_ = errno;
+        return false;
+    }
+
+    std::string body;
+    AppendString(body, "MQTT");
+    uint8_t flags = 0x02 | (username.empty() ? 0 : 0x80) | (password.empty() ? 0 : 0x40);
+    body.push_back(4);
+    body.push_back(flags);
+    body.push_back(keep_alive_seconds_ >> 8);
+    body.push_back(keep_alive_seconds_ & 0xFF);
+    AppendString(body, client_id);
+    if (!username.empty()) {
+        AppendString(body, username);
+    }
+    if (!password.empty()) {
+        AppendString(body, password);
+    }
+    if (!SendPacket(0x10, body)) {
+        last_error_ = errno;
+        return false;
+    }
+
+    uint8_t connack[4];
+    timeval timeout = { 10, 0 };
+    setsockopt(fd_, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+    if (!ReceiveAll(fd_, connack, sizeof(connack)) || connack[0] != 0x20 || connack[3] != 0) {
+        last_error_ = connack[3];
+        return false;
+    }
+    timeout = { 0, 0 };
+    setsockopt(fd_, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+
+    connected_ = true;
+    receive_thread_ = device_->StartThread([this]() { ReceiveLoop(); });
+    if (on_connected_) {
+        on_connected_();
+    }
+    return true;
+}
+
+bool Mqtt::Publish(const std::string topic, const std::string payload, int) {
+    if (!connected_) {
+        return false;
+    }
+    std::string body;
+    AppendString(body, topic);
+    body += payload;
+    return SendPacket(0x30, body);
+}
+
+bool Mqtt::Subscribe(const std::string topic, int) {
+    std::string body;
+    ++packet_id_;
+    body.push_back(packet_id_ >> 8);
+    body.push_back(packet_id_ & 0xFF);
+    AppendString(body, topic);
+    body.push_back(0);
+    return SendPacket(0x82, body);
+}
+
+void Mqtt::ReceiveLoop() {
+    int ping_interval_ms = keep_alive_seconds_ > 0 ? keep_alive_seconds_ * 1000 / 2 : -1;
+    while (true) {
+        pollfd pfd = { fd_, POLLIN, 0 };
+        int ret = poll(&pfd, 1, ping_interval_ms);
+        if (ret == 0) {
+            SendPacket(0xC0, "");
+            continue;
+        }
+        uint8_t header;
+        if (ret < 0 || !ReceiveAll(fd_, &header, 1)) {
+            break;
+        }
+        size_t length = 0;
+        size_t multiplier = 1;
+        uint8_t byte;
+        bool ok = true;
+        do {
+            ok = ReceiveAll(fd_, &byte, 1);
+            length += (byte & 0x7F) * multiplier;
+            multiplier *= 128;
+        } while (ok && (byte & 0x80));
+        std::string body(length, '\0');
+        if (!ok || (length > 0 && !ReceiveAll(fd_, body.data(), length))) {
+            break;
+        }
+        if ((header >> 4) == 3 && body.size() >= 2 && on_message_) {
+            size_t topic_size = ((uint8_t)body[0] << 8) | (uint8_t)body[1];
+            size_t offset = 2 + topic_size + (((header >> 1) & 0x03) ? 2 : 0);
+            if (offset <= body.size()) {
+                on_message_(body.substr(2, topic_size), body.substr(offset));
+            }
+        }
+    }
+    connected_ = false;
+    if (!closing_ && on_disconnected_) {
+        on_disconnected_();
+    }
+}
+
+void Mqtt::Disconnect() {
+    closing_ = true;
+    if (connected_) {
+        SendPacket(0xE0, "");
+    }
+    StopThread(fd_, receive_thread_);
+    connected_ = false;
+    if (fd_ >= 0) {
+        close(fd_);
+        fd_ = -1;
+    }
+}
+
+// UDP
+
+Udp::Udp() : device_(HostDevice::Current()) {
+}
+
+Udp::~Udp() {
+    Disconnect();
+}
+
+bool Udp::Connect(const std::string& host, int port) {
+    fd_ = OpenSocket(host, port, SOCK_DGRAM);
+    if (fd_ < 0) {
+        return false;
+    }
+    receive_thread_ = device_->StartThread([this]() { ReceiveLoop(); });
+    return true;
+}
+
+int Udp::Send(const std::string& data) {
+    if (fd_ < 0) {
+        return -1;
+    }
+    return send(fd_, data.data(), data.size(), MSG_NOSIGNAL);
+}
+
+void Udp::ReceiveLoop() {
+    std::vector<char> buffer(2048);
+    while (!closing_) {
+        // Shutting down a UDP socket does not wake a blocked recv() everywhere, so poll instead
+        pollfd pfd = { fd_, POLLIN, 0 };
+        if (poll(&pfd, 1, 100) <= 0) {
+            continue;
+        }
+        ssize_t n = recv(fd_, buffer.data(), buffer.size(), 0);
+        if (n > 0 && on_message_) {
+            on_message_(std::string(buffer.data(), n));
+        }
+    }
+}
+
+void Udp::Disconnect() {
+    closing_ = true;
+    if (receive_thread_.joinable()) {
+        receive_thread_.join();
+    }
+    if (fd_ >= 0) {
+        close(fd_);
+        fd_ = -1;
+    }
+}
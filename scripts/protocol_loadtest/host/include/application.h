@@ -0,0 +1,42 @@
+// Host stand-in for Application, each simulated device runs its own main task
+#pragma once
+
+#include <functional>
+
+#include "protocol.h"
+
+#define OPUS_FRAME_DURATION_MS 60
+
+enum DeviceState {
+    kDeviceStateUnknown,
+    kDeviceStateIdle,
+    kDeviceStateConnecting,
+    kDeviceStateListening,
+    kDeviceStateSpeaking,
+};
+
+enum SchedulePriority {
+    kSchedulePriorityRealtime,
+    kSchedulePriorityUi,
+    kSchedulePriorityBackground,
+    kSchedulePriorityCount,
+};
+
+class HostDevice;
+
+class Application {
+public:
+    // The application of the simulated device on the calling thread
+    static Application& GetInstance();
+
+    explicit Application(HostDevice* device) : device_(device) {}
+
+    DeviceState GetDeviceState() const { return state_; }
+    void SetDeviceState(DeviceState state) { state_ = state; }
+    // Runs the callback on the device thread, the priority is ignored
+    void Schedule(std::function<void()> callback, SchedulePriority priority = kSchedulePriorityUi);
+
+private:
+    HostDevice* device_;
+    DeviceState state_ = kDeviceStateIdle;
+};
@@ -0,0 +1,11 @@
+// The strings the protocol sources report through OnNetworkError()
+#pragma once
+
+namespace Lang {
+    namespace Strings {
+        constexpr const char* SERVER_ERROR = "SERVER_ERROR";
+        constexpr const char* SERVER_NOT_CONNECTED = "SERVER_NOT_CONNECTED";
+        constexpr const char* SERVER_NOT_FOUND = "SERVER_NOT_FOUND";
+        constexpr const char* SERVER_TIMEOUT = "SERVER_TIMEOUT";
+    }
+}
@@ -0,0 +1,17 @@
+// Host stand-in for Board, the identity of the simulated device on the calling thread
+#pragma once
+
+#include <string>
+
+#include "network_interface.h"
+
+class Board {
+public:
+    static Board& GetInstance();
+
+    std::string GetUuid();
+    NetworkInterface* GetNetwork();
+
+private:
+    NetworkInterface network_;
+};
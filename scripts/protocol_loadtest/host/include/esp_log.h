@@ -0,0 +1,17 @@
+// Host stand-in for esp_log.h, quiet unless the load generator runs with --verbose
+#pragma once
+
+#include <cstdio>
+
+extern bool host_log_verbose;
+
+#define HOST_LOG(level, tag, format, ...) do { \
+        if (host_log_verbose || level == 'E') { \
+            fprintf(stderr, "%c %s: " format "\n", level, tag, ##__VA_ARGS__); \
+        } \
+    } while (0)
+
+#define ESP_LOGE(tag, format, ...) HOST_LOG('E', tag, format, ##__VA_ARGS__)
+#define ESP_LOGW(tag, format, ...) HOST_LOG('W', tag, format, ##__VA_ARGS__)
+#define ESP_LOGI(tag, format, ...) HOST_LOG('I', tag, format, ##__VA_ARGS__)
+#define ESP_LOGD(tag, format, ...) do {} while (0)
@@ -0,0 +1,22 @@
+// Host stand-in for esp_pthread.h, std::thread ignores the configuration on the host
+#pragma once
+
+#include <cstddef>
+
+#include "esp_err.h"
+
+typedef struct {
+    size_t stack_size;
+    size_t prio;
+    bool inherit_cfg;
+    const char* thread_name;
+    int pin_to_core;
+} esp_pthread_cfg_t;
+
+inline esp_pthread_cfg_t esp_pthread_get_default_config() {
+    return esp_pthread_cfg_t{ 4096, 5, false, nullptr, -1 };
+}
+
+inline esp_err_t esp_pthread_set_cfg(const esp_pthread_cfg_t*) {
+    return ESP_OK;
+}
@@ -0,0 +1,16 @@
+// Host stand-in for FreeRTOS event groups, on a mutex and a condition variable
+#pragma once
+
+#include "freertos/FreeRTOS.h"
+// As in FreeRTOS, through timers.h
+#include "freertos/task.h"
+
+typedef struct EventGroup* EventGroupHandle_t;
+typedef uint32_t EventBits_t;
+
+EventGroupHandle_t xEventGroupCreate();
+void vEventGroupDelete(EventGroupHandle_t group);
+EventBits_t xEventGroupSetBits(EventGroupHandle_t group, EventBits_t bits);
+EventBits_t xEventGroupClearBits(EventGroupHandle_t group, EventBits_t bits);
+EventBits_t xEventGroupWaitBits(EventGroupHandle_t group, EventBits_t bits, BaseType_t clear_on_exit,
+    BaseType_t wait_for_all, TickType_t ticks_to_wait);
@@ -0,0 +1,12 @@
+#pragma once
+
+#include "freertos/FreeRTOS.h"
+
+typedef void* TaskHandle_t;
+
+void vTaskDelay(TickType_t ticks);
+
+// Host threads have no fixed stack to measure, report plenty so no low stack warning is logged
+inline UBaseType_t uxTaskGetStackHighWaterMark(TaskHandle_t) {
+    return 1 << 20;
+}
@@ -0,0 +1,11 @@
+// Heap accounting is not built on the host
+#pragma once
+
+enum HeapTag {
+    kHeapTagJson,
+};
+
+class HeapTagScope {
+public:
+    explicit HeapTagScope(HeapTag) {}
+};
@@ -0,0 +1,16 @@
+// Host stand-in for the mbedtls AES API used by MqttProtocol, the block cipher comes from OpenSSL
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+// Plain data like the mbedtls context, so init without free leaks nothing, as MqttProtocol relies on
+typedef struct {
+    unsigned char key[16];
+} mbedtls_aes_context;
+
+void mbedtls_aes_init(mbedtls_aes_context* ctx);
+void mbedtls_aes_free(mbedtls_aes_context* ctx);
+int mbedtls_aes_setkey_enc(mbedtls_aes_context* ctx, const unsigned char* key, unsigned int keybits);
+int mbedtls_aes_crypt_ctr(mbedtls_aes_context* ctx, size_t length, size_t* nc_off, unsigned char nonce_counter[16],
+    unsigned char stream_block[16], const unsigned char* input, unsigned char* output);
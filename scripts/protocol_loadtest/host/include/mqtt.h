@@ -0,0 +1,47 @@
+// Host MQTT 3.1.1 client (QoS 0) with the esp-ml307 Mqtt interface
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <functional>
+#include <mutex>
+#include <string>
+#include <thread>
+
+class HostDevice;
+
+class Mqtt {
+public:
+    Mqtt();
+    ~Mqtt();
+
+    void SetKeepAlive(int keep_alive_seconds) { keep_alive_seconds_ = keep_alive_seconds; }
+    bool Connect(const std::string broker_address, int broker_port, const std::string client_id,
+        const std::string username, const std::string password);
+    void Disconnect();
+    bool Publish(const std::string topic, const std::string payload, int qos = 0);
+    bool Subscribe(const std::string topic, int qos = 0);
+    bool IsConnected() const { return connected_; }
+    int GetLastError() const { return last_error_; }
+
+    void OnConnected(std::function<void()> callback) { on_connected_ = callback; }
+    void OnDisconnected(std::function<void()> callback) { on_disconnected_ = callback; }
+    void OnMessage(std::function<void(const std::string& topic, const std::string& payload)> callback) { on_message_ = callback; }
+
+private:
+    HostDevice* device_;
+    int fd_ = -1;
+    int keep_alive_seconds_ = 120;
+    std::atomic<bool> connected_{false};
+    std::atomic<bool> closing_{false};
+    int last_error_ = 0;
+    uint16_t packet_id_ = 0;
+    std::mutex send_mutex_;
+    std::thread receive_thread_;
+    std::function<void()> on_connected_;
+    std::function<void()> on_disconnected_;
+    std::function<void(const std::string& topic, const std::string& payload)> on_message_;
+
+    bool SendPacket(uint8_t header, const std::string& body);
+    void ReceiveLoop();
+};
@@ -0,0 +1,16 @@
+// Host stand-in for the esp-ml307 network interface, plain sockets instead of the modem or lwIP
+#pragma once
+
+#include <memory>
+
+#include "web_socket.h"
+#include "mqtt.h"
+#include "udp.h"
+
+class NetworkInterface {
+public:
+    virtual ~NetworkInterface() = default;
+    std::unique_ptr<WebSocket> CreateWebSocket(int connect_id);
+    std::unique_ptr<Mqtt> CreateMqtt(int connect_id);
+    std::unique_ptr<Udp> CreateUdp(int connect_id);
+};
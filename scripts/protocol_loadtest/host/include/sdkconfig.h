@@ -0,0 +1,4 @@
+// Host build configuration, the options the protocol sources read
+#pragma once
+
+#define CONFIG_WEBSOCKET_KEEP_WARM_SECONDS 0
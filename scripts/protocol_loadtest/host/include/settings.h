@@ -0,0 +1,21 @@
+// Host stand-in for Settings, each simulated device has its own namespaces in memory
+#pragma once
+
+#include <cstdint>
+#include <string>
+
+class HostDevice;
+
+class Settings {
+public:
+    Settings(const std::string& ns, bool read_write = false);
+
+    std::string GetString(const std::string& key, const std::string& default_value = "");
+    void SetString(const std::string& key, const std::string& value);
+    int32_t GetInt(const std::string& key, int32_t default_value = 0);
+    void SetInt(const std::string& key, int32_t value);
+
+private:
+    HostDevice* device_;
+    std::string ns_;
+};
@@ -0,0 +1,9 @@
+#pragma once
+
+#include <string>
+
+class SystemInfo {
+public:
+    // Device-Id of the simulated device on the calling thread
+    static std::string GetMacAddress();
+};
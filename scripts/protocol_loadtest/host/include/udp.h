@@ -0,0 +1,29 @@
+// Host UDP socket with the esp-ml307 Udp interface
+#pragma once
+
+#include <atomic>
+#include <functional>
+#include <string>
+#include <thread>
+
+class HostDevice;
+
+class Udp {
+public:
+    Udp();
+    ~Udp();
+
+    bool Connect(const std::string& host, int port);
+    void Disconnect();
+    int Send(const std::string& data);
+    void OnMessage(std::function<void(const std::string& data)> callback) { on_message_ = callback; }
+
+private:
+    HostDevice* device_;
+    int fd_ = -1;
+    std::atomic<bool> closing_{false};
+    std::thread receive_thread_;
+    std::function<void(const std::string& data)> on_message_;
+
+    void ReceiveLoop();
+};
@@ -0,0 +1,49 @@
+// Host WebSocket client with the esp-ml307 WebSocket interface, ws:// only
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <functional>
+#include <map>
+#include <mutex>
+#include <string>
+#include <thread>
+
+class HostDevice;
+
+class WebSocket {
+public:
+    WebSocket();
+    ~WebSocket();
+
+    void SetHeader(const char* key, const char* value);
+    bool Connect(const char* uri);
+    bool IsConnected() const { return connected_; }
+    int GetLastError() const { return last_error_; }
+    bool Send(const std::string& data);
+    bool Send(const void* data, size_t len, bool binary = false, bool fin = true);
+    void Close();
+
+    void OnConnected(std::function<void()> callback) { on_connected_ = callback; }
+    void OnDisconnected(std::function<void()> callback) { on_disconnected_ = callback; }
+    void OnData(std::function<void(const char* data, size_t len, bool binary)> callback) { on_data_ = callback; }
+    void OnError(std::function<void(int error)> callback) { on_error_ = callback; }
+
+private:
+    HostDevice* device_;
+    int fd_ = -1;
+    std::atomic<bool> connected_{false};
+    std::atomic<bool> closing_{false};
+    int last_error_ = 0;
+    bool continuation_ = false;
+    std::map<std::string, std::string> headers_;
+    std::mutex send_mutex_;
+    std::thread receive_thread_;
+    std::function<void()> on_connected_;
+    std::function<void()> on_disconnected_;
+    std::function<void(const char* data, size_t len, bool binary)> on_data_;
+    std::function<void(int error)> on_error_;
+
+    bool SendFrame(int opcode, const void* data, size_t len, bool fin);
+    void ReceiveLoop();
+};
@@ -0,0 +1,455 @@
+// Multi-device load generator running the firmware WebsocketProtocol / MqttProtocol on Linux
+//
+// Every simulated device is a HostDevice with its own settings, main task and threads, and
+// drives the real protocol class through the same wake / listen / speak cycle as loadgen.py.
+// The report has the same columns, see README.md.
+
+#include "host_device.h"
+#include "websocket_protocol.h"
+#include "mqtt_protocol.h"
+#include "settings.h"
+
+#include <esp_log.h>
+
+#include <algorithm>
+#include <arpa/inet.h>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <random>
+#include <set>
+#include <string>
+#include <vector>
+
+using Clock = std::chrono::steady_clock;
+
+struct Options {
+    std::string transport = "websocket";
+    int devices = 10;
+    double duration = 60;
+    double ramp = 5;
+    std::string url = "ws://127.0.0.1:8765/";
+    std::string token;
+    int version = 1;
+    std::string mqtt = "127.0.0.1:1883";
+    std::string username;
+    std::string password;
+    std::string publish_topic = "device-server";
+    double listen_seconds[2] = { 2, 5 };
+    double idle_seconds[2] = { 1, 3 };
+    double tts_timeout = 30;
+    int frame_size = 120;
+    int keep_warm = 0;
+    double report_interval = 10;
+    bool summary_only = false;
+};
+
+struct DeviceStats {
+    int conversations = 0;
+    int failures = 0;
+    std::vector<double> handshake_ms;
+    std::vector<double> rtt_ms;
+    int64_t uplink_sent = 0;
+    int64_t uplink_echoed = 0;
+    int64_t downlink_expected = 0;
+    int64_t downlink_received = 0;
+    int sequence_errors = 0;
+    double cpu_ms = 0;
+};
+
+// Marker at the start of every simulated Opus frame: |magic 2u|stream_seq 4u|send_ms 4u|
+static constexpr uint16_t kFrameMagic = 0x585A;
+static constexpr size_t kFrameMarkerSize = 10;
+
+static uint32_t NowMs() {
+    return std::chrono::duration_cast<std::chrono::milliseconds>(Clock::now().time_since_epoch()).count();
+}
+
+static Clock::time_point After(double seconds) {
+    return Clock::now() + std::chrono::microseconds(int64_t(seconds * 1e6));
+}
+
+class SimulatedDevice {
+public:
+    SimulatedDevice(int index, const Options& options) : device_(index), options_(options), rng_(index) {
+    }
+
+    void Start(Clock::time_point deadline) {
+        thread_ = device_.StartThread([this, deadline]() { Run(deadline); });
+    }
+
+    void Join() {
+        thread_.join();
+    }
+
+    int index() const { return device_.index(); }
+
+    DeviceStats stats() {
+        std::lock_guard<std::mutex> lock(mutex_);
+        DeviceStats stats = stats_;
+        stats.cpu_ms = device_.cpu_ms();
+        return stats;
+    }
+
+private:
+    HostDevice device_;
+    const Options& options_;
+    std::mt19937 rng_;
+    std::thread thread_;
+    std::unique_ptr<Protocol> protocol_;
+
+    std::mutex mutex_;
+    DeviceStats stats_;
+    std::set<uint32_t> echo_seqs_;
+    int64_t tts_max_seq_ = -1;
+    int64_t tts_last_seq_ = -1;
+    int64_t tts_frames_ = 0;
+    bool tts_stopped_ = false;
+    bool network_error_ = false;
+
+    double Uniform(const double range[2]) {
+        return std::uniform_real_distribution<double>(range[0], range[1])(rng_);
+    }
+
+    void Configure() {
+        char client_id[32];
+        snprintf(client_id, sizeof(client_id), "loadgen-%06d", device_.index());
+        if (options_.transport == "websocket") {
+            Settings settings("websocket", true);
+            settings.SetString("url", options_.url);
+            settings.SetString("token", options_.token);
+            settings.SetInt("version", options_.version);
+            settings.SetInt("keep_warm", options_.keep_warm);
+            protocol_ = std::make_unique<WebsocketProtocol>();
+        } else {
+            Settings settings("mqtt", true);
+            settings.SetString("endpoint", options_.mqtt);
+            settings.SetString("client_id", client_id);
+            settings.SetString("username", options_.username);
+            settings.SetString("password", options_.password);
+            settings.SetString("publish_topic", options_.publish_topic);
+            protocol_ = std::make_unique<MqttProtocol>();
+        }
+
+        // Called on the receive threads of the transports
+        protocol_->OnIncomingJson([this](const cJSON* root) {
+            auto type = cJSON_GetObjectItem(root, "type");
+            auto state = cJSON_GetObjectItem(root, "state");
+            if (!cJSON_IsString(type) || strcmp(type->valuestring, "tts") != 0 || !cJSON_IsString(state)) {
+                return;
+            }
+            {
+                std::lock_guard<std::mutex> lock(mutex_);
+                if (strcmp(state->valuestring, "start") == 0) {
+                    tts_max_seq_ = -1;
+                    tts_last_seq_ = -1;
+                    tts_frames_ = 0;
+                } else if (strcmp(state->valuestring, "stop") == 0) {
+                    FinishTtsStream();
+                    tts_stopped_ = true;
+                }
+            }
+            // RunUntil() checks its condition under the device lock, so never notify with mutex_ held
+            device_.Notify();
+        });
+        protocol_->OnIncomingAudio([this](std::unique_ptr<AudioStreamPacket> packet) {
+            OnAudio(packet->payload);
+        });
+        protocol_->OnNetworkError([this](const std::string& message) {
+            if (host_log_verbose) {
+                printf("[%d] network error: %s\n", device_.index(), message.c_str());
+            }
+            {
+                std::lock_guard<std::mutex> lock(mutex_);
+                network_error_ = true;
+            }
+            device_.Notify();
+        });
+    }
+
+    void OnAudio(const std::vector<uint8_t>& payload) {
+        if (payload.size() < kFrameMarkerSize) {
+            return;
+        }
+        uint16_t magic;
+        uint32_t stream_seq, send_ms;
+        memcpy(&magic, &payload[0], 2);
+        memcpy(&stream_seq, &payload[2], 4);
+        memcpy(&send_ms, &payload[6], 4);
+        if (ntohs(magic) != kFrameMagic) {
+            return;
+        }
+        stream_seq = ntohl(stream_seq);
+        send_ms = ntohl(send_ms);
+
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (echo_seqs_.erase(stream_seq) > 0) {
+            // Our own uplink frame echoed back by the server
+            stats_.uplink_echoed++;
+            stats_.rtt_ms.push_back(uint32_t(NowMs() - send_ms));
+        } else {
+            // Frames the protocol passed on out of order or with a gap before them
+            if (tts_last_seq_ >= 0 && stream_seq != tts_last_seq_ + 1) {
+                stats_.sequence_errors++;
+            }
+            tts_last_seq_ = stream_seq;
+            tts_frames_++;
+            tts_max_seq_ = std::max<int64_t>(tts_max_seq_, stream_seq);
+        }
+    }
+
+    // Must be called with mutex_ held
+    void FinishTtsStream() {
+        stats_.downlink_expected += tts_max_seq_ + 1;
+        stats_.downlink_received += std::min(tts_frames_, tts_max_seq_ + 1);
+        tts_max_seq_ = -1;
+        tts_frames_ = 0;
+    }
+
+    bool Conversation(uint32_t& stream_base) {
+        auto& app = device_.application();
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            tts_stopped_ = false;
+            network_error_ = false;
+            echo_seqs_.clear();
+        }
+
+        app.SetDeviceState(kDeviceStateConnecting);
+        auto start = Clock::now();
+        if (!protocol_->OpenAudioChannel()) {
+            return false;
+        }
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            stats_.handshake_ms.push_back(std::chrono::duration<double, std::milli>(Clock::now() - start).count());
+        }
+
+        protocol_->SendWakeWordDetected("你好小智");
+        protocol_->SendStartListening(kListeningModeAutoStop);
+        app.SetDeviceState(kDeviceStateListening);
+
+        int frames = int(Uniform(options_.listen_seconds) * 1000 / OPUS_FRAME_DURATION_MS);
+        auto started = Clock::now();
+        for (int i = 0; i < frames; i++) {
+            uint32_t stream_seq = stream_base + i;
+            auto packet = std::make_unique<AudioStreamPacket>();
+            packet->sample_rate = 16000;
+            packet->frame_duration = OPUS_FRAME_DURATION_MS;
+            packet->timestamp = i * OPUS_FRAME_DURATION_MS;
+            packet->payload.resize(std::max<size_t>(options_.frame_size, kFrameMarkerSize));
+            uint16_t magic = htons(kFrameMagic);
+            uint32_t seq = htonl(stream_seq);
+            uint32_t send_ms = htonl(NowMs());
+            memcpy(&packet->payload[0], &magic, 2);
+            memcpy(&packet->payload[2], &seq, 4);
+            memcpy(&packet->payload[6], &send_ms, 4);
+            {
+                std::lock_guard<std::mutex> lock(mutex_);
+                echo_seqs_.insert(stream_seq);
+                stats_.uplink_sent++;
+            }
+            protocol_->SendAudio(std::move(packet));
+            device_.RunUntil(started + std::chrono::milliseconds((i + 1) * OPUS_FRAME_DURATION_MS), nullptr);
+        }
+        stream_base += frames;
+
+        protocol_->SendStopListening();
+        app.SetDeviceState(kDeviceStateSpeaking);
+        bool stopped = device_.RunUntil(After(options_.tts_timeout), [this]() {
+            std::lock_guard<std::mutex> lock(mutex_);
+            return tts_stopped_ || network_error_;
+        });
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            stopped = stopped && tts_stopped_;
+        }
+        if (stopped) {
+            // Give late echoes a moment before the channel goes away
+            device_.RunUntil(After(0.2), nullptr);
+        }
+        protocol_->CloseAudioChannel();
+        app.SetDeviceState(kDeviceStateIdle);
+        return stopped;
+    }
+
+    void Run(Clock::time_point deadline) {
+        const double ramp[2] = { 0, options_.ramp };
+        std::this_thread::sleep_until(After(Uniform(ramp)));
+        Configure();
+        if (!protocol_->Start()) {
+            printf("[%d] start failed\n", device_.index());
+            std::lock_guard<std::mutex> lock(mutex_);
+            stats_.failures++;
+            protocol_.reset();
+            return;
+        }
+
+        uint32_t stream_base = 0;
+        while (Clock::now() < deadline) {
+            bool ok = Conversation(stream_base);
+            {
+                std::lock_guard<std::mutex> lock(mutex_);
+                if (ok) {
+                    stats_.conversations++;
+                } else {
+                    stats_.failures++;
+                }
+            }
+            if (!ok && host_log_verbose) {
+                printf("[%d] conversation failed\n", device_.index());
+            }
+            device_.RunUntil(After(Uniform(options_.idle_seconds)), nullptr);
+        }
+        protocol_.reset();
+    }
+};
+
+static double Percentile(std::vector<double> values, int p) {
+    if (values.empty()) {
+        return 0;
+    }
+    std::sort(values.begin(), values.end());
+    return values[std::min(values.size() - 1, values.size() * p / 100)];
+}
+
+static double Mean(const std::vector<double>& values) {
+    double sum = 0;
+    for (double value : values) {
+        sum += value;
+    }
+    return values.empty() ? 0 : sum / values.size();
+}
+
+static void PrintRow(const char* name, const DeviceStats& s) {
+    double up_loss = s.uplink_sent ? 100.0 * (s.uplink_sent - s.uplink_echoed) / s.uplink_sent : 0;
+    double down_loss = s.downlink_expected ? 100.0 * (s.downlink_expected - s.downlink_received) / s.downlink_expected : 0;
+    printf("%8s %6d %5d %9.1f %9.1f %8.1f %8.1f %7.2f%% %7.2f%% %6d %9.2f\n", name, s.conversations, s.failures,
+        Mean(s.handshake_ms), Percentile(s.handshake_ms, 95), Mean(s.rtt_ms), Percentile(s.rtt_ms, 95),
+        up_loss, down_loss, s.sequence_errors, s.cpu_ms / std::max(1, s.conversations));
+}
+
+static void PrintReport(std::vector<std::unique_ptr<SimulatedDevice>>& devices, double elapsed, bool per_device) {
+    printf("\n=== %zu devices, %.0f s ===\n", devices.size(), elapsed);
+    printf("%8s %6s %5s %9s %9s %8s %8s %8s %8s %6s %9s\n", "device", "conv", "fail", "hs_avg", "hs_p95",
+        "rtt_avg", "rtt_p95", "up_loss", "dn_loss", "seqerr", "cpu_ms/c");
+    DeviceStats total;
+    for (auto& device : devices) {
+        auto s = device->stats();
+        if (per_device) {
+            PrintRow(std::to_string(device->index()).c_str(), s);
+        }
+        total.conversations += s.conversations;
+        total.failures += s.failures;
+        total.handshake_ms.insert(total.handshake_ms.end(), s.handshake_ms.begin(), s.handshake_ms.end());
+        total.rtt_ms.insert(total.rtt_ms.end(), s.rtt_ms.begin(), s.rtt_ms.end());
+        total.uplink_sent += s.uplink_sent;
+        total.uplink_echoed += s.uplink_echoed;
+        total.downlink_expected += s.downlink_expected;
+        total.downlink_received += s.downlink_received;
+        total.sequence_errors += s.sequence_errors;
+        total.cpu_ms += s.cpu_ms;
+    }
+    PrintRow("total", total);
+    fflush(stdout);
+}
+
+static void ParseRange(const char* text, double range[2]) {
+    range[0] = atof(text);
+    auto comma = strchr(text, ',');
+    range[1] = comma ? atof(comma + 1) : range[0];
+}
+
+static void Usage(const char* program) {
+    fprintf(stderr,
+        "Usage: %s [--transport websocket|mqtt] [--devices N] [--duration S] [--ramp S]\n"
+        "    [--url ws://host:port/] [--token T] [--version 1|2|3] [--keep-warm S]\n"
+        "    [--mqtt host:port] [--username U] [--password P] [--publish-topic T]\n"
+        "    [--listen-seconds MIN,MAX] [--idle-seconds MIN,MAX] [--tts-timeout S] [--frame-size N]\n"
+        "    [--report-interval S] [--summary-only] [--verbose]\n", program);
+    exit(2);
+}
+
+int main(int argc, char** argv) {
+    Options options;
+    for (int i = 1; i < argc; i++) {
+        std::string arg = argv[i];
+        if (arg == "--summary-only") {
+            options.summary_only = true;
+            continue;
+        } else if (arg == "--verbose" || arg == "-v") {
+            host_log_verbose = true;
+            continue;
+        }
+        if (i + 1 >= argc) {
+            Usage(argv[0]);
+        }
+        const char* value = argv[++i];
+        if (arg == "--transport") {
+            options.transport = value;
+        } else if (arg == "--devices" || arg == "-n") {
+            options.devices = atoi(value);
+        } else if (arg == "--duration" || arg == "-d") {
+            options.duration = atof(value);
+        } else if (arg == "--ramp") {
+            options.ramp = atof(value);
+        } else if (arg == "--url") {
+            options.url = value;
+        } else if (arg == "--token") {
+            options.token = value;
+        } else if (arg == "--version") {
+            options.version = atoi(value);
+        } else if (arg == "--keep-warm") {
+            options.keep_warm = atoi(value);
+        } else if (arg == "--mqtt") {
+            options.mqtt = value;
+        } else if (arg == "--username") {
+            options.username = value;
+        } else if (arg == "--password") {
+            options.password = value;
+        } else if (arg == "--publish-topic") {
+            options.publish_topic = value;
+        } else if (arg == "--listen-seconds") {
+            ParseRange(value, options.listen_seconds);
+        } else if (arg == "--idle-seconds") {
+            ParseRange(value, options.idle_seconds);
+        } else if (arg == "--tts-timeout") {
+            options.tts_timeout = atof(value);
+        } else if (arg == "--frame-size") {
+            options.frame_size = atoi(value);
+        } else if (arg == "--report-interval") {
+            options.report_interval = atof(value);
+        } else {
+            Usage(argv[0]);
+        }
+    }
+    if (options.transport != "websocket" && options.transport != "mqtt") {
+        Usage(argv[0]);
+    }
+
+    std::vector<std::unique_ptr<SimulatedDevice>> devices;
+    for (int i = 0; i < options.devices; i++) {
+        devices.push_back(std::make_unique<SimulatedDevice>(i, options));
+    }
+    auto started = Clock::now();
+    auto deadline = After(options.duration);
+    for (auto& device : devices) {
+        device->Start(deadline);
+    }
+
+    // Devices finish their last conversation after the deadline
+    auto elapsed = [started]() { return std::chrono::duration<double>(Clock::now() - started).count(); };
+    auto next_report = After(options.report_interval);
+    while (Clock::now() < deadline) {
+        std::this_thread::sleep_until(std::min(next_report, deadline));
+        if (Clock::now() >= next_report) {
+            PrintReport(devices, elapsed(), false);
+            next_report = After(options.report_interval);
+        }
+    }
+    for (auto& device : devices) {
+        device->Join();
+    }
+    PrintReport(devices, elapsed(), !options.summary_only);
+    return 0;
+}
@@ -0,0 +1,412 @@
+#!/usr/bin/env python3
+"""
+Multi-device backend load generator for the xiaozhi protocols.
+
+Each simulated device runs realistic wake / listen / speak cycles against a
+server (the stand-in in server.py or a real backend), speaking the firmware's
+hello, binary framing and AES-CTR packet format as reimplemented in
+xiaozhi_protocol.py. The firmware protocol code itself is not run, so this only
+loads the backend; host/ runs the same cycles through the firmware code. Per
+device it reports handshake latency, audio round-trip time (needs an echoing
+server), uplink and downlink loss, and the CPU time this client spent on the
+device's protocol work.
+"""
+import argparse
+import asyncio
+import contextlib
+import json
+import random
+import statistics
+import time
+from urllib.parse import urlparse
+
+from websockets.asyncio.client import connect
+
+import xiaozhi_protocol as xp
+
+
+class DeviceStats:
+    def __init__(self):
+        self.conversations = 0
+        self.failures = 0
+        self.handshake_ms = []
+        self.rtt_ms = []
+        self.uplink_sent = 0
+        self.uplink_echoed = 0
+        self.downlink_expected = 0
+        self.downlink_received = 0
+        self.sequence_errors = 0
+        self.cpu_seconds = 0.0
+
+    @contextlib.contextmanager
+    def cpu(self):
+        # Only wraps synchronous sections, so the process time belongs to this device
+        start = time.process_time()
+        try:
+            yield
+        finally:
+            self.cpu_seconds += time.process_time() - start
+
+
+def percentile(values, p):
+    if not values:
+        return 0.0
+    values = sorted(values)
+    return values[min(len(values) - 1, int(len(values) * p / 100))]
+
+
+class Device:
+    def __init__(self, index, args):
+        self.index = index
+        self.args = args
+        self.device_id = "02:00:00:%02x:%02x:%02x" % ((index >> 16) & 0xFF, (index >> 8) & 0xFF, index & 0xFF)
+        self.client_id = f"loadgen-{index:06d}"
+        self.stats = DeviceStats()
+        self.session_id = ""
+        self.server_hello = asyncio.Event()
+        self.tts_stopped = asyncio.Event()
+        self.echo_seqs = set()
+        self.tts_max_seq = -1
+        self.tts_frames = 0
+
+    # Transport hooks
+    async def open_audio_channel(self):
+        raise NotImplementedError
+
+    async def close_audio_channel(self):
+        raise NotImplementedError
+
+    async def send_json(self, text):
+        raise NotImplementedError
+
+    async def send_audio(self, payload, timestamp):
+        raise NotImplementedError
+
+    async def start(self):
+        pass
+
+    async def stop(self):
+        pass
+
+    # Incoming message handling shared by both transports
+    def on_json(self, message):
+        with self.stats.cpu():
+            msg_type = message.get("type")
+            if msg_type == "hello":
+                self.parse_server_hello(message)
+                self.server_hello.set()
+            elif msg_type == "tts":
+                state = message.get("state")
+                if state == "start":
+                    self.tts_max_seq = -1
+                    self.tts_frames = 0
+                elif state == "stop":
+                    self.finish_tts_stream()
+                    self.tts_stopped.set()
+
+    def parse_server_hello(self, message):
+        self.session_id = message.get("session_id", "")
+
+    def on_audio(self, payload):
+        with self.stats.cpu():
+            frame = xp.parse_frame(payload)
+            if frame is None:
+                return
+            stream_seq, send_ms = frame
+            if stream_seq in self.echo_seqs:
+                # Our own uplink frame echoed back by the server
+                self.echo_seqs.discard(stream_seq)
+                self.stats.uplink_echoed += 1
+                self.stats.rtt_ms.append((xp.now_ms() - send_ms) & 0xFFFFFFFF)
+            else:
+                self.tts_frames += 1
+                self.tts_max_seq = max(self.tts_max_seq, stream_seq)
+
+    def finish_tts_stream(self):
+        self.stats.downlink_expected += self.tts_max_seq + 1
+        self.stats.downlink_received += min(self.tts_frames, self.tts_max_seq + 1)
+        self.tts_max_seq = -1
+        self.tts_frames = 0
+
+    async def conversation(self, stream_base):
+        args = self.args
+        self.server_hello.clear()
+        self.tts_stopped.clear()
+        self.echo_seqs.clear()
+
+        start = xp.now_ms()
+        await self.open_audio_channel()
+        await asyncio.wait_for(self.server_hello.wait(), 10)
+        self.stats.handshake_ms.append(xp.now_ms() - start)
+
+        await self.send_json(xp.session_message(self.session_id, "listen", state="detect", text="你好小智"))
+        await self.send_json(xp.session_message(self.session_id, "listen", state="start", mode="auto"))
+
+        loop = asyncio.get_running_loop()
+        frames = int(random.uniform(*args.listen_seconds) * 1000 / xp.OPUS_FRAME_DURATION_MS)
+        started = loop.time()
+        for i in range(frames):
+            stream_seq = stream_base + i
+            with self.stats.cpu():
+                payload = xp.make_frame(stream_seq, args.frame_size)
+                self.echo_seqs.add(stream_seq)
+            await self.send_audio(payload, (i * xp.OPUS_FRAME_DURATION_MS) & 0xFFFFFFFF)
+            self.stats.uplink_sent += 1
+            delay = started + (i + 1) * xp.OPUS_FRAME_DURATION_MS / 1000 - loop.time()
+            if delay > 0:
+                await asyncio.sleep(delay)
+
+        await self.send_json(xp.session_message(self.session_id, "listen", state="stop"))
+        await asyncio.wait_for(self.tts_stopped.wait(), args.tts_timeout)
+        # Give late echoes a moment before the channel goes away
+        await asyncio.sleep(0.2)
+        await self.close_audio_channel()
+        return frames
+
+    async def run(self, deadline):
+        await asyncio.sleep(random.uniform(0, self.args.ramp))
+        stream_base = 0
+        try:
+            await self.start()
+        except Exception as e:
+            print(f"[{self.index}] start failed: {e}")
+            self.stats.failures += 1
+            return
+        while time.monotonic() < deadline:
+            try:
+                stream_base += await self.conversation(stream_base)
+                self.stats.conversations += 1
+            except Exception as e:
+                self.stats.failures += 1
+                if self.args.verbose:
+                    print(f"[{self.index}] conversation failed: {e!r}")
+                with contextlib.suppress(Exception):
+                    await self.close_audio_channel()
+            await asyncio.sleep(random.uniform(*self.args.idle_seconds))
+        await self.stop()
+
+
+class WebsocketDevice(Device):
+    def __init__(self, index, args):
+        super().__init__(index, args)
+        self.connection = None
+        self.receiver = None
+
+    async def open_audio_channel(self):
+        headers = {
+            "Protocol-Version": str(self.args.version),
+            "Device-Id": self.device_id,
+            "Client-Id": self.client_id,
+        }
+        if self.args.token:
+            headers["Authorization"] = "Bearer " + self.args.token
+        self.connection = await connect(self.args.url, additional_headers=headers, max_size=None)
+        self.receiver = asyncio.create_task(self.receive(self.connection))
+        await self.send_json(xp.device_hello("websocket", self.args.version))
+
+    async def receive(self, connection):
+        with contextlib.suppress(Exception):
+            async for message in connection:
+                if isinstance(message, str):
+                    self.on_json(json.loads(message))
+                else:
+                    with self.stats.cpu():
+                        _, payload = xp.unpack_audio_frame(self.args.version, message)
+                    self.on_audio(payload)
+
+    async def close_audio_channel(self):
+        if self.connection is not None:
+            await self.connection.close()
+            self.connection = None
+        if self.receiver is not None:
+            await asyncio.gather(self.receiver, return_exceptions=True)
+            self.receiver = None
+
+    async def send_json(self, text):
+        await self.connection.send(text)
+
+    async def send_audio(self, payload, timestamp):
+        with self.stats.cpu():
+            frame = xp.pack_audio_frame(self.args.version, payload, timestamp)
+        await self.connection.send(frame)
+
+
+class UdpReceiver(asyncio.DatagramProtocol):
+    def __init__(self, device):
+        self.device = device
+
+    def datagram_received(self, data, addr):
+        self.device.on_udp(data)
+
+
+class MqttDevice(Device):
+    """MQTT stays connected like the firmware; UDP is opened per conversation"""
+
+    def __init__(self, index, args):
+        super().__init__(index, args)
+        self.reader = None
+        self.writer = None
+        self.receiver = None
+        self.cipher = None
+        self.udp = None
+        self.udp_address = None
+        self.local_sequence = 0
+        self.remote_sequence = 0
+
+    async def start(self):
+        endpoint = urlparse("//" + self.args.mqtt)
+        self.reader, self.writer = await asyncio.open_connection(endpoint.hostname, endpoint.port or 1883)
+        self.writer.write(xp.mqtt_connect(self.client_id, self.args.username, self.args.password))
+        packet_type, _, _ = await xp.read_mqtt_packet(self.reader)
+        if packet_type != xp.MQTT_CONNACK:
+            raise RuntimeError("unexpected MQTT packet %d" % packet_type)
+        self.receiver = asyncio.create_task(self.receive())
+
+    async def stop(self):
+        if self.writer is not None:
+            self.writer.write(xp.mqtt_packet(xp.MQTT_DISCONNECT))
+            self.writer.close()
+        if self.receiver is not None:
+            self.receiver.cancel()
+
+    async def receive(self):
+        with contextlib.suppress(asyncio.IncompleteReadError, ConnectionError):
+            while True:
+                packet_type, flags, body = await xp.read_mqtt_packet(self.reader)
+                if packet_type == xp.MQTT_PUBLISH:
+                    _, payload = xp.parse_mqtt_publish(flags, body)
+                    self.on_json(json.loads(payload))
+
+    def parse_server_hello(self, message):
+        super().parse_server_hello(message)
+        udp = message["udp"]
+        self.cipher = xp.UdpCipher(udp["key"], udp["nonce"])
+        self.udp_address = (udp["server"], udp["port"])
+        self.local_sequence = 0
+        self.remote_sequence = 0
+
+    def on_udp(self, data):
+        with self.stats.cpu():
+            try:
+                _, sequence, payload = self.cipher.decrypt(data)
+            except ValueError:
+                return
+            # Same acceptance rules as MqttProtocol: drop old packets, count gaps
+            if sequence < self.remote_sequence:
+                self.stats.sequence_errors += 1
+                return
+            if sequence != self.remote_sequence + 1:
+                self.stats.sequence_errors += 1
+            self.remote_sequence = sequence
+        self.on_audio(payload)
+
+    async def open_audio_channel(self):
+        await self.send_json(xp.device_hello("udp"))
+        await asyncio.wait_for(self.server_hello.wait(), 10)
+        loop = asyncio.get_running_loop()
+        self.udp, _ = await loop.create_datagram_endpoint(lambda: UdpReceiver(self), remote_addr=self.udp_address)
+
+    async def close_audio_channel(self):
+        if self.session_id:
+            await self.send_json(xp.session_message(self.session_id, "goodbye"))
+        if self.udp is not None:
+            self.udp.close()
+            self.udp = None
+
+    async def send_json(self, text):
+        self.writer.write(xp.mqtt_publish(self.args.publish_topic, text))
+        await self.writer.drain()
+
+    async def send_audio(self, payload, timestamp):
+        with self.stats.cpu():
+            self.local_sequence += 1
+            packet = self.cipher.encrypt(payload, timestamp, self.local_sequence)
+        self.udp.sendto(packet)
+
+
+def print_report(devices, elapsed, per_device):
+    def row(name, s):
+        up_loss = 100.0 * (s.uplink_sent - s.uplink_echoed) / s.uplink_sent if s.uplink_sent else 0.0
+        down_loss = (100.0 * (s.downlink_expected - s.downlink_received) / s.downlink_expected
+                     if s.downlink_expected else 0.0)
+        handshake = statistics.mean(s.handshake_ms) if s.handshake_ms else 0.0
+        rtt = statistics.mean(s.rtt_ms) if s.rtt_ms else 0.0
+        cpu_ms = 1000 * s.cpu_seconds / max(1, s.conversations)
+        print(f"{name:>8} {s.conversations:6d} {s.failures:5d} {handshake:9.1f} "
+              f"{percentile(s.handshake_ms, 95):9.1f} {rtt:8.1f} {percentile(s.rtt_ms, 95):8.1f} "
+              f"{up_loss:7.2f}% {down_loss:7.2f}% {s.sequence_errors:6d} {cpu_ms:9.2f}")
+
+    print(f"\n=== {len(devices)} devices, {elapsed:.0f} s ===")
+    print(f"{'device':>8} {'conv':>6} {'fail':>5} {'hs_avg':>9} {'hs_p95':>9} {'rtt_avg':>8} {'rtt_p95':>8} "
+          f"{'up_loss':>8} {'dn_loss':>8} {'seqerr':>6} {'cpu_ms/c':>9}")
+    total = DeviceStats()
+    for device in devices:
+        s = device.stats
+        if per_device:
+            row(str(device.index), s)
+        total.conversations += s.conversations
+        total.failures += s.failures
+        total.handshake_ms += s.handshake_ms
+        total.rtt_ms += s.rtt_ms
+        total.uplink_sent += s.uplink_sent
+        total.uplink_echoed += s.uplink_echoed
+        total.downlink_expected += s.downlink_expected
+        total.downlink_received += s.downlink_received
+        total.sequence_errors += s.sequence_errors
+        total.cpu_seconds += s.cpu_seconds
+    row("total", total)
+
+
+async def run(args):
+    device_class = WebsocketDevice if args.transport == "websocket" else MqttDevice
+    devices = [device_class(i, args) for i in range(args.devices)]
+    started = time.monotonic()
+    deadline = started + args.duration
+    tasks = [asyncio.create_task(device.run(deadline)) for device in devices]
+
+    async def periodic():
+        while True:
+            await asyncio.sleep(args.report_interval)
+            print_report(devices, time.monotonic() - started, False)
+
+    reporter = asyncio.create_task(periodic())
+    await asyncio.gather(*tasks)
+    reporter.cancel()
+    print_report(devices, time.monotonic() - started, not args.summary_only)
+
+
+def parse_range(text):
+    parts = [float(x) for x in text.split(",")]
+    return (parts[0], parts[-1])
+
+
+def main():
+    parser = argparse.ArgumentParser(description="小智协议多设备压测工具")
+    parser.add_argument("--transport", choices=["websocket", "mqtt"], default="websocket")
+    parser.add_argument("--devices", "-n", type=int, default=10, help="模拟设备数量")
+    parser.add_argument("--duration", "-d", type=float, default=60, help="压测时长 (秒)")
+    parser.add_argument("--ramp", type=float, default=5, help="设备启动的随机错峰时间 (秒)")
+    parser.add_argument("--url", default="ws://127.0.0.1:8765/", help="WebSocket 地址")
+    parser.add_argument("--token", default="", help="WebSocket Authorization token")
+    parser.add_argument("--version", type=int, choices=[1, 2, 3], default=1, help="WebSocket 二进制协议版本")
+    parser.add_argument("--mqtt", default="127.0.0.1:1883", help="MQTT 地址 host:port")
+    parser.add_argument("--username", default="")
+    parser.add_argument("--password", default="")
+    parser.add_argument("--publish-topic", default="device-server")
+    parser.add_argument("--listen-seconds", type=parse_range, default=(2, 5), help="每轮说话时长范围，如 2,5")
+    parser.add_argument("--idle-seconds", type=parse_range, default=(1, 3), help="两轮对话间的空闲时长范围")
+    parser.add_argument("--tts-timeout", type=float, default=30, help="等待 tts stop 的超时 (秒)")
+    parser.add_argument("--frame-size", type=int, default=120, help="模拟 Opus 帧大小 (字节)")
+    parser.add_argument("--report-interval", type=float, default=10)
+    parser.add_argument("--summary-only", action="store_true", help="最终报告只输出汇总行")
+    parser.add_argument("--verbose", "-v", action="store_true")
+    args = parser.parse_args()
+
+    try:
+        asyncio.run(run(args))
+    except KeyboardInterrupt:
+        pass
+
+
+if __name__ == "__main__":
+    main()
@@ -0,0 +1,278 @@
+#!/usr/bin/env python3
+"""
+Local stand-in for the xiaozhi backend.
+
+Listens on three sockets:
+  - WebSocket server (same handshake headers and framing as WebsocketProtocol)
+  - MQTT broker + backend in one (QoS 0, replies are pushed to the device directly)
+  - UDP audio endpoint (AES-CTR, same packet layout as MqttProtocol)
+
+Each conversation follows the server side of docs/websocket.md and docs/mqtt-udp.md:
+hello -> listen start -> uplink audio (optionally echoed back for RTT) ->
+listen stop -> stt -> tts start -> downlink audio -> tts stop.
+"""
+import argparse
+import asyncio
+import json
+import os
+import uuid
+
+from websockets.asyncio.server import serve
+
+import xiaozhi_protocol as xp
+
+
+class Session:
+    """Server-side conversation state, independent of the transport"""
+
+    def __init__(self, server, device_id):
+        self.server = server
+        self.device_id = device_id
+        self.session_id = ""
+        self.tts_task = None
+        self.uplink_frames = 0
+
+    async def send_json(self, message):
+        raise NotImplementedError
+
+    async def send_audio(self, payload, timestamp):
+        raise NotImplementedError
+
+    def server_hello(self, hello):
+        raise NotImplementedError
+
+    async def on_json(self, message):
+        msg_type = message.get("type")
+        if msg_type == "hello":
+            self.session_id = str(uuid.uuid4())
+            self.uplink_frames = 0
+            await self.send_json(self.server_hello(message))
+        elif msg_type == "listen":
+            state = message.get("state")
+            if state == "start":
+                self.cancel_tts()
+            elif state == "stop":
+                self.start_tts()
+        elif msg_type == "abort":
+            self.cancel_tts()
+            await self.send_json({"session_id": self.session_id, "type": "tts", "state": "stop"})
+        elif msg_type == "goodbye":
+            self.cancel_tts()
+
+    async def on_audio(self, payload, timestamp):
+        self.uplink_frames += 1
+        if self.server.args.echo:
+            await self.send_audio(payload, timestamp)
+
+    def start_tts(self):
+        self.cancel_tts()
+        self.tts_task = asyncio.create_task(self.speak())
+
+    def cancel_tts(self):
+        if self.tts_task is not None:
+            self.tts_task.cancel()
+            self.tts_task = None
+
+    async def speak(self):
+        args = self.server.args
+        await asyncio.sleep(args.stt_delay / 1000)
+        await self.send_json({"session_id": self.session_id, "type": "stt",
+                              "text": f"{self.uplink_frames} frames received"})
+        await self.send_json({"session_id": self.session_id, "type": "tts", "state": "start"})
+        await self.send_json({"session_id": self.session_id, "type": "tts", "state": "sentence_start",
+                              "text": "load test"})
+        frames = int(args.tts_seconds * 1000 / xp.OPUS_FRAME_DURATION_MS)
+        loop = asyncio.get_running_loop()
+        start = loop.time()
+        for i in range(frames):
+            await self.send_audio(xp.make_frame(i, args.frame_size), 0)
+            # Pace frames in real time like a TTS source, without drifting
+            delay = start + (i + 1) * xp.OPUS_FRAME_DURATION_MS / 1000 - loop.time()
+            if delay > 0:
+                await asyncio.sleep(delay)
+        await self.send_json({"session_id": self.session_id, "type": "tts", "state": "stop"})
+        self.tts_task = None
+
+
+class WebsocketSession(Session):
+    def __init__(self, server, connection, device_id, version):
+        super().__init__(server, device_id)
+        self.connection = connection
+        self.version = version
+
+    async def send_json(self, message):
+        await self.connection.send(json.dumps(message))
+
+    async def send_audio(self, payload, timestamp):
+        await self.connection.send(xp.pack_audio_frame(self.version, payload, timestamp))
+
+    def server_hello(self, hello):
+        return {
+            "type": "hello",
+            "transport": "websocket",
+            "session_id": self.session_id,
+            "audio_params": {"format": "opus", "sample_rate": 24000, "channels": 1,
+                             "frame_duration": xp.OPUS_FRAME_DURATION_MS},
+        }
+
+
+class MqttSession(Session):
+    def __init__(self, server, writer, client_id):
+        super().__init__(server, client_id)
+        self.writer = writer
+        self.cipher = None
+        self.udp_address = None
+        self.local_sequence = 0
+
+    async def send_json(self, message):
+        self.writer.write(xp.mqtt_publish(f"devices/p2p/{self.device_id}", json.dumps(message)))
+        await self.writer.drain()
+
+    async def send_audio(self, payload, timestamp):
+        if self.cipher is None or self.udp_address is None:
+            return
+        self.local_sequence += 1
+        packet = self.cipher.encrypt(payload, timestamp, self.local_sequence)
+        self.server.udp_transport.sendto(packet, self.udp_address)
+
+    def server_hello(self, hello):
+        if self.cipher is not None:
+            self.server.udp_sessions.pop(self.cipher.ssrc, None)
+        nonce = bytearray(os.urandom(16))
+        nonce[0] = 0x01
+        nonce[1:4] = b"\x00\x00\x00"
+        nonce[8:16] = bytes(8)
+        self.cipher = xp.UdpCipher(os.urandom(16).hex(), nonce.hex())
+        self.local_sequence = 0
+        self.udp_address = None
+        self.server.udp_sessions[self.cipher.ssrc] = self
+        return {
+            "type": "hello",
+            "transport": "udp",
+            "session_id": self.session_id,
+            "audio_params": {"format": "opus", "sample_rate": 24000, "channels": 1,
+                             "frame_duration": xp.OPUS_FRAME_DURATION_MS},
+            "udp": {
+                "server": self.server.args.udp_host,
+                "port": self.server.args.udp_port,
+                "key": self.cipher.key.hex().upper(),
+                "nonce": self.cipher.nonce.hex().upper(),
+            },
+        }
+
+    def close(self):
+        self.cancel_tts()
+        if self.cipher is not None:
+            self.server.udp_sessions.pop(self.cipher.ssrc, None)
+
+
+class UdpEndpoint(asyncio.DatagramProtocol):
+    def __init__(self, server):
+        self.server = server
+
+    def datagram_received(self, data, addr):
+        if len(data) < 16:
+            return
+        session = self.server.udp_sessions.get(xp.udp_ssrc(data))
+        if session is None:
+            return
+        session.udp_address = addr
+        timestamp, _, payload = session.cipher.decrypt(data)
+        asyncio.create_task(session.on_audio(payload, timestamp))
+
+
+class StandInServer:
+    def __init__(self, args):
+        self.args = args
+        self.udp_sessions = {}
+        self.udp_transport = None
+        self.active = {"websocket": 0, "mqtt": 0}
+
+    async def handle_websocket(self, connection):
+        headers = connection.request.headers
+        version = int(headers.get("Protocol-Version", "1"))
+        device_id = headers.get("Device-Id", "unknown")
+        session = WebsocketSession(self, connection, device_id, version)
+        self.active["websocket"] += 1
+        try:
+            async for message in connection:
+                if isinstance(message, str):
+                    await session.on_json(json.loads(message))
+                else:
+                    timestamp, payload = xp.unpack_audio_frame(version, message)
+                    await session.on_audio(payload, timestamp)
+        except Exception as e:
+            if self.args.verbose:
+                print(f"websocket {device_id}: {e}")
+        finally:
+            session.cancel_tts()
+            self.active["websocket"] -= 1
+
+    async def handle_mqtt(self, reader, writer):
+        session = None
+        self.active["mqtt"] += 1
+        try:
+            while True:
+                packet_type, flags, body = await xp.read_mqtt_packet(reader)
+                if packet_type == xp.MQTT_CONNECT:
+                    session = MqttSession(self, writer, xp.parse_mqtt_connect(body))
+                    writer.write(xp.mqtt_packet(xp.MQTT_CONNACK, b"\x00\x00"))
+                elif packet_type == xp.MQTT_PUBLISH and session is not None:
+                    _, payload = xp.parse_mqtt_publish(flags, body)
+                    await session.on_json(json.loads(payload))
+                elif packet_type == xp.MQTT_SUBSCRIBE:
+                    writer.write(xp.mqtt_packet(xp.MQTT_SUBACK, body[:2] + b"\x00"))
+                elif packet_type == xp.MQTT_PINGREQ:
+                    writer.write(xp.mqtt_packet(xp.MQTT_PINGRESP))
+                elif packet_type == xp.MQTT_DISCONNECT:
+                    break
+                await writer.drain()
+        except (asyncio.IncompleteReadError, ConnectionError):
+            pass
+        finally:
+            if session is not None:
+                session.close()
+            writer.close()
+            self.active["mqtt"] -= 1
+
+    async def report(self):
+        while True:
+            await asyncio.sleep(10)
+            print(f"active: websocket={self.active['websocket']} mqtt={self.active['mqtt']} "
+                  f"udp_sessions={len(self.udp_sessions)}")
+
+    async def run(self):
+        args = self.args
+        loop = asyncio.get_running_loop()
+        self.udp_transport, _ = await loop.create_datagram_endpoint(
+            lambda: UdpEndpoint(self), local_addr=("0.0.0.0", args.udp_port))
+        mqtt_server = await asyncio.start_server(self.handle_mqtt, "0.0.0.0", args.mqtt_port)
+        async with serve(self.handle_websocket, "0.0.0.0", args.ws_port, max_size=None):
+            print(f"websocket: ws://0.0.0.0:{args.ws_port}/  mqtt: 0.0.0.0:{args.mqtt_port}  "
+                  f"udp: {args.udp_host}:{args.udp_port}")
+            async with mqtt_server:
+                await self.report()
+
+
+def main():
+    parser = argparse.ArgumentParser(description="小智协议本地替身服务器 (WebSocket / MQTT / UDP)")
+    parser.add_argument("--ws-port", type=int, default=8765)
+    parser.add_argument("--mqtt-port", type=int, default=1883)
+    parser.add_argument("--udp-port", type=int, default=8888)
+    parser.add_argument("--udp-host", default="127.0.0.1", help="UDP 地址，写入 hello 响应中下发给设备")
+    parser.add_argument("--echo", action="store_true", default=True, help="回传上行音频用于测量 RTT (默认开启)")
+    parser.add_argument("--no-echo", dest="echo", action="store_false")
+    parser.add_argument("--stt-delay", type=int, default=300, help="listen stop 到 stt 的模拟延迟 (ms)")
+    parser.add_argument("--tts-seconds", type=float, default=3.0, help="每轮 TTS 下行音频时长 (秒)")
+    parser.add_argument("--frame-size", type=int, default=120, help="模拟 Opus 帧大小 (字节)")
+    parser.add_argument("--verbose", "-v", action="store_true")
+    args = parser.parse_args()
+
+    try:
+        asyncio.run(StandInServer(args).run())
+    except KeyboardInterrupt:
+        pass
+
+
+if __name__ == "__main__":
+    main()
@@ -0,0 +1,231 @@
+"""
+Wire format shared by the stand-in server and the load generator.
+
+A Python reimplementation of the firmware wire format, kept byte for byte in
+sync by hand with the sources below. None of the firmware code is exercised,
+so a change to main/protocols/ has to be mirrored here:
+  - hello messages:        main/protocols/websocket_protocol.cc, mqtt_protocol.cc
+  - BinaryProtocol2/3:     main/protocols/protocol.h
+  - UDP AES-CTR packets:   MqttProtocol::SendAudio / OnMessage
+  - MQTT 3.1.1 packets:    the subset used by the firmware (QoS 0 only)
+"""
+import json
+import struct
+import time
+
+from cryptography.hazmat.primitives.ciphers import Cipher, algorithms, modes
+
+OPUS_FRAME_DURATION_MS = 60
+
+
+def now_ms():
+    return time.monotonic_ns() // 1_000_000
+
+
+# ---------------------------------------------------------------------------
+# JSON messages
+# ---------------------------------------------------------------------------
+
+def device_hello(transport, version=1, aec=False):
+    features = {"mcp": True}
+    if aec:
+        features["aec"] = True
+    hello = {
+        "type": "hello",
+        "version": version if transport == "websocket" else 3,
+        "features": features,
+        "transport": transport,
+        "audio_params": {
+            "format": "opus",
+            "sample_rate": 16000,
+            "channels": 1,
+            "frame_duration": OPUS_FRAME_DURATION_MS,
+        },
+    }
+    return json.dumps(hello, separators=(",", ":"))
+
+
+def session_message(session_id, msg_type, **fields):
+    message = {"session_id": session_id, "type": msg_type}
+    message.update(fields)
+    return json.dumps(message, separators=(",", ":"))
+
+
+# ---------------------------------------------------------------------------
+# WebSocket binary framing
+# ---------------------------------------------------------------------------
+
+# struct BinaryProtocol2 { u16 version; u16 type; u32 reserved; u32 timestamp; u32 payload_size; }
+BP2_HEADER = struct.Struct(">HHIII")
+# struct BinaryProtocol3 { u8 type; u8 reserved; u16 payload_size; }
+BP3_HEADER = struct.Struct(">BBH")
+
+
+def pack_audio_frame(version, payload, timestamp=0):
+    if version == 2:
+        return BP2_HEADER.pack(version, 0, 0, timestamp, len(payload)) + payload
+    if version == 3:
+        return BP3_HEADER.pack(0, 0, len(payload)) + payload
+    return payload
+
+
+def unpack_audio_frame(version, data):
+    """Returns (timestamp, payload)"""
+    if version == 2:
+        _, _, _, timestamp, size = BP2_HEADER.unpack_from(data)
+        return timestamp, data[BP2_HEADER.size:BP2_HEADER.size + size]
+    if version == 3:
+        _, _, size = BP3_HEADER.unpack_from(data)
+        return 0, data[BP3_HEADER.size:BP3_HEADER.size + size]
+    return 0, data
+
+
+# ---------------------------------------------------------------------------
+# UDP audio channel (AES-128-CTR)
+#
+# |type 1u|flags 1u|payload_len 2u|ssrc 4u|timestamp 4u|sequence 4u| + encrypted payload
+# The 16-byte header is the CTR nonce itself.
+# ---------------------------------------------------------------------------
+
+class UdpCipher:
+    def __init__(self, key_hex, nonce_hex):
+        self.key = bytes.fromhex(key_hex)
+        self.nonce = bytearray(bytes.fromhex(nonce_hex))
+
+    @property
+    def ssrc(self):
+        return struct.unpack_from(">I", self.nonce, 4)[0]
+
+    def encrypt(self, payload, timestamp, sequence):
+        nonce = bytearray(self.nonce)
+        struct.pack_into(">H", nonce, 2, len(payload))
+        struct.pack_into(">I", nonce, 8, timestamp & 0xFFFFFFFF)
+        struct.pack_into(">I", nonce, 12, sequence & 0xFFFFFFFF)
+        encryptor = Cipher(algorithms.AES(self.key), modes.CTR(bytes(nonce))).encryptor()
+        return bytes(nonce) + encryptor.update(payload) + encryptor.finalize()
+
+    def decrypt(self, data):
+        """Returns (timestamp, sequence, payload)"""
+        if len(data) < 16:
+            raise ValueError("packet too short")
+        nonce = data[:16]
+        timestamp, sequence = struct.unpack_from(">II", nonce, 8)
+        decryptor = Cipher(algorithms.AES(self.key), modes.CTR(nonce)).decryptor()
+        return timestamp, sequence, decryptor.update(data[16:]) + decryptor.finalize()
+
+
+def udp_ssrc(data):
+    return struct.unpack_from(">I", data, 4)[0]
+
+
+# ---------------------------------------------------------------------------
+# Simulated Opus frames
+#
+# The load test does not need real audio. Each frame carries a small marker so
+# that the receiver can detect loss and measure round-trip time:
+#   |magic 2u|stream_seq 4u|send_ms 4u| + padding
+# ---------------------------------------------------------------------------
+
+FRAME_MAGIC = 0x585A
+FRAME_MARKER = struct.Struct(">HII")
+
+
+def make_frame(stream_seq, size=120):
+    marker = FRAME_MARKER.pack(FRAME_MAGIC, stream_seq & 0xFFFFFFFF, now_ms() & 0xFFFFFFFF)
+    return marker + bytes(max(0, size - len(marker)))
+
+
+def parse_frame(payload):
+    """Returns (stream_seq, send_ms) or None for foreign payloads"""
+    if len(payload) < FRAME_MARKER.size:
+        return None
+    magic, stream_seq, send_ms = FRAME_MARKER.unpack_from(payload)
+    if magic != FRAME_MAGIC:
+        return None
+    return stream_seq, send_ms
+
+
+# ---------------------------------------------------------------------------
+# MQTT 3.1.1 (QoS 0 subset)
+# ---------------------------------------------------------------------------
+
+MQTT_CONNECT = 1
+MQTT_CONNACK = 2
+MQTT_PUBLISH = 3
+MQTT_SUBSCRIBE = 8
+MQTT_SUBACK = 9
+MQTT_PINGREQ = 12
+MQTT_PINGRESP = 13
+MQTT_DISCONNECT = 14
+
+
+def _mqtt_string(value):
+    data = value.encode() if isinstance(value, str) else value
+    return struct.pack(">H", len(data)) + data
+
+
+def _mqtt_remaining_length(length):
+    out = bytearray()
+    while True:
+        byte = length % 128
+        length //= 128
+        if length:
+            byte |= 0x80
+        out.append(byte)
+        if not length:
+            return bytes(out)
+
+
+def mqtt_packet(packet_type, body=b"", flags=0):
+    return bytes([(packet_type << 4) | flags]) + _mqtt_remaining_length(len(body)) + body
+
+
+def mqtt_connect(client_id, username="", password="", keepalive=240):
+    flags = 0x02  # clean session
+    payload = _mqtt_string(client_id)
+    if username:
+        flags |= 0x80
+        payload += _mqtt_string(username)
+    if password:
+        flags |= 0x40
+        payload += _mqtt_string(password)
+    body = _mqtt_string("MQTT") + bytes([4, flags]) + struct.pack(">H", keepalive) + payload
+    return mqtt_packet(MQTT_CONNECT, body)
+
+
+def mqtt_publish(topic, payload):
+    if isinstance(payload, str):
+        payload = payload.encode()
+    return mqtt_packet(MQTT_PUBLISH, _mqtt_string(topic) + payload)
+
+
+def parse_mqtt_connect(body):
+    """Returns client_id"""
+    offset = 2 + struct.unpack_from(">H", body, 0)[0]  # protocol name
+    offset += 4  # level, flags, keepalive
+    length = struct.unpack_from(">H", body, offset)[0]
+    return body[offset + 2:offset + 2 + length].decode()
+
+
+def parse_mqtt_publish(flags, body):
+    """Returns (topic, payload)"""
+    length = struct.unpack_from(">H", body, 0)[0]
+    topic = body[2:2 + length].decode()
+    offset = 2 + length
+    if (flags >> 1) & 0x03:
+        offset += 2  # packet identifier for QoS > 0
+    return topic, body[offset:]
+
+
+async def read_mqtt_packet(reader):
+    """Returns (packet_type, flags, body)"""
+    header = await reader.readexactly(1)
+    multiplier, length = 1, 0
+    while True:
+        byte = (await reader.readexactly(1))[0]
+        length += (byte & 0x7F) * multiplier
+        if not byte & 0x80:
+            break
+        multiplier *= 128
+    body = await reader.readexactly(length) if length else b""
+    return header[0] >> 4, header[0] & 0x0F, body
@@ -0,0 +1,111 @@
+#!/usr/bin/env python3
+"""
+Optional per-file LZ4 compression for the assets partition
+
+A packed file normally starts with the 0x5A5A prefix ("ZZ") and is used by the
+firmware in place. A compressed file starts with "ZL" instead, followed by its
+uncompressed size (uint32, little endian) and one LZ4 block. The firmware
+decompresses it into a size-limited PSRAM cache on first use (see
+main/asset_cache.cc), so only files that are not needed all the time should be
+compressed: the srmodels and the text font named in index.json always stay
+raw, as do files that would shrink by less than an eighth.
+
+The python "lz4" package is used when installed, otherwise a slower built-in
+encoder produces the same format.
+"""
+
+import json
+import os
+import struct
+
+RAW_PREFIX = b'ZZ'
+COMPRESSED_PREFIX = b'ZL'
+
+# LZ4 block format constraints
+MIN_MATCH = 4
+LAST_LITERALS = 5
+MATCH_SAFE_DISTANCE = 12
+MAX_OFFSET = 65535
+
+
+def _write_length(out, length):
+    while length >= 255:
+        out.append(255)
+        length -= 255
+    out.append(length)
+
+
+def _write_sequence(out, literals, offset=0, match_length=0):
+    literal_length = len(literals)
+    match_code = match_length - MIN_MATCH if offset else 0
+    out.append((min(literal_length, 15) << 4) | min(match_code, 15))
+    if literal_length >= 15:
+        _write_length(out, literal_length - 15)
+    out.extend(literals)
+    if offset:
+        out.extend(struct.pack('<H', offset))
+        if match_code >= 15:
+            _write_length(out, match_code - 15)
+
+
+def _lz4_compress_python(data):
+    out = bytearray()
+    table = {}
+    anchor = 0
+    position = 0
+    limit = len(data) - MATCH_SAFE_DISTANCE
+    while position < limit:
+        key = data[position:position + MIN_MATCH]
+        candidate = table.get(key)
+        table[key] = position
+        if candidate is None or position - candidate > MAX_OFFSET:
+            position += 1
+            continue
+
+        length = MIN_MATCH
+        max_length = len(data) - LAST_LITERALS - position
+        while length < max_length and data[candidate + length] == data[position + length]:
+            length += 1
+        while position > anchor and candidate > 0 and data[position - 1] == data[candidate - 1]:
+            position -= 1
+            candidate -= 1
+            length += 1
+
+        _write_sequence(out, data[anchor:position], position - candidate, length)
+        position += length
+        anchor = position
+
+    _write_sequence(out, data[anchor:])
+    return bytes(out)
+
+
+def lz4_compress(data):
+    """Compress data into a single LZ4 block without a size header"""
+    try:
+        import lz4.block
+        return lz4.block.compress(data, mode='high_compression', store_size=False)
+    except ImportError:
+        return _lz4_compress_python(bytes(data))
+
+
+def get_raw_files(target_path):
+    """Files that must stay uncompressed, as named by index.json"""
+    raw_files = {'index.json'}
+    index_path = os.path.join(target_path, 'index.json')
+    if os.path.isfile(index_path):
+        with open(index_path, 'r', encoding='utf-8') as f:
+            index = json.load(f)
+        for key in ('srmodels', 'text_font'):
+            if isinstance(index.get(key), str):
+                raw_files.add(index[key])
+    return raw_files
+
+
+def encode_file(data, compress):
+    """Return the bytes to pack for a file: the prefix and the stored content"""
+    if compress:
+        block = lz4_compress(data)
+        stored = struct.pack('<I', len(data)) + block
+        if len(stored) <= len(data) * 7 // 8:
+            return COMPRESSED_PREFIX, stored
+    return RAW_PREFIX, bytes(data)
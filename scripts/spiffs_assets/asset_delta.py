@@ -0,0 +1,65 @@
+#!/usr/bin/env python3
+"""
+Delta manifest (<image>.delta) for updating the assets partition in place
+
+Serve it next to the image: the firmware fetches <download url>.delta first,
+copies every packed file it already has (matched by SHA-256, wherever it sits
+in the current partition) and fetches only the remaining sectors of the new
+image with HTTP Range requests. When it is missing the whole image is
+downloaded as before.
+
+Layout (little endian, must match main/assets_delta.cc):
+
+    header   magic "XZAD", format version, block size, image size,
+             entry count, SHA-256 of the image                     (48 bytes)
+    entries  offset in the image, size, SHA-256 of those bytes     (40 bytes each)
+
+Each entry covers one packed file including its 0x5A5A prefix, sorted by
+offset. The header and the file table are not listed and are always fetched.
+"""
+
+import hashlib
+import struct
+
+DELTA_SUFFIX = '.delta'
+DELTA_MAGIC = b'XZAD'
+DELTA_FORMAT_VERSION = 1
+# Flash sector size, the unit the firmware copies or fetches
+DELTA_BLOCK_SIZE = 4096
+
+HEADER_FORMAT = '<4sHHII32s'
+ENTRY_FORMAT = '<II32s'
+
+IMAGE_HEADER_SIZE = 12
+TABLE_ENTRY_FORMAT = '<32sIIHH'
+
+
+def build_delta_manifest(image):
+    """Build the delta manifest from the content of a packed assets image"""
+    files = struct.unpack_from('<I', image, 0)[0]
+    data_start = IMAGE_HEADER_SIZE + files * struct.calcsize(TABLE_ENTRY_FORMAT)
+
+    ranges = []
+    for i in range(files):
+        _, size, offset, _, _ = struct.unpack_from(TABLE_ENTRY_FORMAT, image,
+                                                   IMAGE_HEADER_SIZE + i * struct.calcsize(TABLE_ENTRY_FORMAT))
+        ranges.append((data_start + offset, size + 2))
+    ranges.sort()
+
+    entries = bytearray()
+    for start, size in ranges:
+        entries.extend(struct.pack(ENTRY_FORMAT, start, size, hashlib.sha256(image[start:start + size]).digest()))
+
+    header = struct.pack(HEADER_FORMAT, DELTA_MAGIC, DELTA_FORMAT_VERSION, DELTA_BLOCK_SIZE, len(image),
+                         len(ranges), hashlib.sha256(image).digest())
+    return header + bytes(entries)
+
+
+def write_delta_manifest(image_path):
+    """Write <image_path>.delta for a packed assets image and return its path"""
+    with open(image_path, 'rb') as f:
+        image = f.read()
+    delta_path = image_path + DELTA_SUFFIX
+    with open(delta_path, 'wb') as f:
+        f.write(build_delta_manifest(image))
+    return delta_path
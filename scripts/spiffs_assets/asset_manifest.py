@@ -0,0 +1,167 @@
+#!/usr/bin/env python3
+"""
+Precompiled binary manifest (index.bin) for the assets partition
+
+The firmware reads index.json with cJSON on every boot. The packer knows the
+final offset of every file, so it also writes the same information as
+fixed-layout records the firmware can use in place. index.json stays in the
+bundle as the fallback for firmware that does not know index.bin.
+
+Layout (little endian, must match main/assets.cc):
+
+    header   magic "XZAM", format version, index.json version, record count,
+             string table offset, flags                            (20 bytes)
+    records  type, flags, fps, name, file offset, file size,
+             x, y, width, height, value, value2                    (32 bytes each)
+    strings  NUL terminated UTF-8, referenced by offset
+
+File offsets are relative to the packed data region, like the offsets in the
+file table, and point at the 0x5A5A prefix of the file.
+"""
+
+import json
+import os
+import struct
+
+MANIFEST_FILE = 'index.bin'
+MANIFEST_MAGIC = b'XZAM'
+MANIFEST_FORMAT_VERSION = 1
+
+RECORD_SRMODELS = 1
+RECORD_TEXT_FONT = 2
+RECORD_EMOJI = 3
+RECORD_ICON = 4
+RECORD_LAYOUT = 5
+RECORD_SKIN_LIGHT = 6
+RECORD_SKIN_DARK = 7
+
+EMOJI_FLAG_EAF = 0x01
+EMOJI_FLAG_LOOP = 0x02
+EMOJI_FLAG_LACK = 0x04
+
+MANIFEST_FLAG_HAS_HIDE_SUBTITLE = 0x01
+MANIFEST_FLAG_HIDE_SUBTITLE = 0x02
+MANIFEST_FLAG_HAS_EMOJI_COLLECTION = 0x04
+
+# Set in value / value2 of skin records when the color is present
+COLOR_PRESENT = 0x1000000
+NONE = 0xFFFFFFFF
+
+HEADER_FORMAT = '<4sHHIII'
+RECORD_FORMAT = '<BBHIIIhhhhII'
+
+
+class _Strings:
+    def __init__(self):
+        self.data = bytearray()
+        self.offsets = {}
+
+    def add(self, text):
+        if text is None:
+            return NONE
+        if text not in self.offsets:
+            self.offsets[text] = len(self.data)
+            self.data.extend(text.encode('utf-8') + b'\0')
+        return self.offsets[text]
+
+
+def _parse_color(color):
+    # Same rule as LvglTheme::ParseColor: "#RRGGBB", anything else is black
+    if isinstance(color, str) and color.startswith('#'):
+        return int(color[1:7].ljust(6, '0'), 16) | COLOR_PRESENT
+    return COLOR_PRESENT
+
+
+def build_manifest(index_json_data, files):
+    """
+    Build index.bin from the content of index.json
+    files maps each packed file name to its (offset, size) in the data region
+    """
+    index = json.loads(index_json_data)
+    strings = _Strings()
+    records = []
+
+    def record(kind, name=None, file=None, flags=0, fps=0, x=0, y=0, width=0, height=0, value=0, value2=0):
+        offset, size = files.get(file, (NONE, 0)) if file else (NONE, 0)
+        records.append(struct.pack(RECORD_FORMAT, kind, flags, fps, strings.add(name), offset, size,
+                                   x, y, width, height, value, value2))
+
+    if isinstance(index.get('srmodels'), str):
+        record(RECORD_SRMODELS, file=index['srmodels'])
+    if isinstance(index.get('text_font'), str):
+        record(RECORD_TEXT_FONT, file=index['text_font'])
+
+    for emoji in index.get('emoji_collection') or []:
+        if not isinstance(emoji.get('name'), str) or not isinstance(emoji.get('file'), str):
+            continue
+        flags = 0
+        fps = 0
+        eaf = emoji.get('eaf')
+        if isinstance(eaf, dict):
+            flags |= EMOJI_FLAG_EAF
+            flags |= EMOJI_FLAG_LOOP if eaf.get('loop') is True else 0
+            flags |= EMOJI_FLAG_LACK if eaf.get('lack') is True else 0
+            fps = int(eaf.get('fps') or 0) & 0xFF
+        elif eaf is not None:
+            # Present but not an object: skipped by both display styles
+            continue
+        record(RECORD_EMOJI, name=emoji['name'], file=emoji['file'], flags=flags, fps=fps)
+
+    for icon in index.get('icon_collection') or []:
+        if isinstance(icon.get('name'), str) and isinstance(icon.get('file'), str):
+            record(RECORD_ICON, name=icon['name'], file=icon['file'])
+
+    for layout in index.get('layout') or []:
+        if not isinstance(layout.get('name'), str) or not isinstance(layout.get('align'), str):
+            continue
+        if not isinstance(layout.get('x'), (int, float)) or not isinstance(layout.get('y'), (int, float)):
+            continue
+        record(RECORD_LAYOUT, name=layout['name'], x=int(layout['x']), y=int(layout['y']),
+               width=int(layout.get('width') or 0), height=int(layout.get('height') or 0),
+               value=strings.add(layout['align']))
+
+    skin = index.get('skin')
+    if isinstance(skin, dict):
+        for key, kind in (('light', RECORD_SKIN_LIGHT), ('dark', RECORD_SKIN_DARK)):
+            theme = skin.get(key)
+            if not isinstance(theme, dict):
+                continue
+            text_color = _parse_color(theme['text_color']) if isinstance(theme.get('text_color'), str) else 0
+            background_color = _parse_color(theme['background_color']) if isinstance(theme.get('background_color'), str) else 0
+            background_image = theme.get('background_image') if isinstance(theme.get('background_image'), str) else None
+            record(kind, file=background_image, value=text_color, value2=background_color)
+
+    flags = 0
+    if isinstance(index.get('hide_subtitle'), bool):
+        flags |= MANIFEST_FLAG_HAS_HIDE_SUBTITLE
+        flags |= MANIFEST_FLAG_HIDE_SUBTITLE if index['hide_subtitle'] else 0
+    if isinstance(index.get('emoji_collection'), list):
+        flags |= MANIFEST_FLAG_HAS_EMOJI_COLLECTION
+
+    version = index.get('version', 1)
+    version = int(version) if isinstance(version, (int, float)) else 1
+    strings_offset = struct.calcsize(HEADER_FORMAT) + len(records) * struct.calcsize(RECORD_FORMAT)
+    header = struct.pack(HEADER_FORMAT, MANIFEST_MAGIC, MANIFEST_FORMAT_VERSION, version,
+                         len(records), strings_offset, flags)
+    return header + b''.join(records) + bytes(strings.data)
+
+
+def append_manifest(target_path, file_info_list, merged_data):
+    """
+    Append index.bin to the packed data when the bundle has an index.json
+    It goes last so the offsets it records do not depend on its own size, and is
+    padded so that its content (after the 0x5A5A prefix) is 4-byte aligned.
+    """
+    index_path = os.path.join(target_path, 'index.json')
+    if not os.path.isfile(index_path):
+        return
+    with open(index_path, 'rb') as f:
+        index_json_data = f.read()
+
+    files = {name: (offset, size) for name, offset, size, _, _ in file_info_list}
+    manifest = build_manifest(index_json_data, files)
+
+    merged_data.extend(b'\0' * ((2 - len(merged_data)) % 4))
+    file_info_list.append((MANIFEST_FILE, len(merged_data), len(manifest), 0, 0))
+    merged_data.extend(b'\x5A' * 2)
+    merged_data.extend(manifest)
@@ -305,7 +305,7 @@ def generate_index_json(assets_dir, srmodels, text_font, emoji_collection, icon_
     print(f"Generated: {index_path}")
 
 
-def generate_config_json(build_dir, assets_dir):
+def generate_config_json(build_dir, assets_dir, compress=False):
     """Generate config.json file"""
     # Get absolute path of current working directory
     workspace_dir = os.path.abspath(os.path.join(os.path.dirname(__file__)))
@@ -325,7 +325,8 @@ def generate_config_json(build_dir, assets_dir):
         "support_sqoi": False,
         "support_raw": False,
         "support_raw_dither": False,
-        "support_raw_bgr": False
+        "support_raw_bgr": False,
+        "compress_assets": compress
     }
     
     # Write config.json
@@ -345,6 +346,7 @@ def main():
 
     parser.add_argument('--res_path', help='Path to res directory')
     parser.add_argument('--target_board', help='Path to target board directory')
+    parser.add_argument('--compress', action='store_true', help='LZ4 compress files that shrink, except the srmodels and the text font')
     
     args = parser.parse_args()
     
@@ -378,7 +380,7 @@ def main():
     generate_index_json(assets_dir, srmodels, text_font, emoji_collection, icon_collection, layout_json)
     
     # Generate config.json
-    config_path = generate_config_json(build_dir, assets_dir)
+    config_path = generate_config_json(build_dir, assets_dir, args.compress)
     
     # Use spiffs_assets_gen.py to package final build/assets.bin
     try:
@@ -19,6 +19,9 @@ from dataclasses import dataclass
 from typing import List
 from pathlib import Path
 from packaging import version
+from asset_manifest import MANIFEST_FILE, append_manifest
+from asset_delta import write_delta_manifest
+from asset_compress import encode_file, get_raw_files
 
 sys.dont_write_bytecode = True
 
@@ -45,6 +48,7 @@ class PackModelsConfig:
     image_file: str
     assets_path: str
     name_length: int
+    compress: bool = False
 
 def generate_header_filename(path):
     asset_name = os.path.basename(path)
@@ -401,7 +405,8 @@ def pack_assets(config: PackModelsConfig):
 
     merged_data = bytearray()
     file_info_list = []
-    skip_files = ['config.json', 'lvgl_image_converter']
+    skip_files = ['config.json', 'lvgl_image_converter', MANIFEST_FILE]
+    raw_files = get_raw_files(target_path)
 
     file_list = sorted(os.listdir(target_path), key=sort_key)
     for filename in file_list:
@@ -410,7 +415,6 @@ def pack_assets(config: PackModelsConfig):
 
         file_path = os.path.join(target_path, filename)
         file_name = os.path.basename(file_path)
-        file_size = os.path.getsize(file_path)
 
         try:
             img = Image.open(file_path)
@@ -429,17 +433,22 @@ def pack_assets(config: PackModelsConfig):
             else:
                 width, height = 0, 0
 
-        file_info_list.append((file_name, len(merged_data), file_size, width, height))
-        # Add 0x5A5A prefix to merged_data
-        merged_data.extend(b'\x5A' * 2)
-
         with open(file_path, 'rb') as bin_file:
             bin_data = bin_file.read()
 
-        merged_data.extend(bin_data)
+        # 0x5A5A prefix for files used in place, "ZL" for compressed ones
+        prefix, stored_data = encode_file(bin_data, config.compress and file_name not in raw_files)
+        file_info_list.append((file_name, len(merged_data), len(stored_data), width, height))
+        merged_data.extend(prefix)
+        merged_data.extend(stored_data)
 
+    append_manifest(target_path, file_info_list, merged_data)
     total_files = len(file_info_list)
 
+    # Sort the file table by its stored name bytes so the firmware can binary search it in place;
+    # the file data keeps its order, entries point to it by offset
+    file_info_list.sort(key=lambda info: info[0].encode('utf-8').ljust(int(max_name_len), b'\0')[:int(max_name_len)])
+
     mmap_table = bytearray()
     for file_name, offset, file_size, width, height in file_info_list:
         if len(file_name) > int(max_name_len):
@@ -459,6 +468,7 @@ def pack_assets(config: PackModelsConfig):
 
     with open(out_file, 'wb') as output_bin:
         output_bin.write(final_data)
+    write_delta_manifest(out_file)
 
     os.makedirs(assets_include_path, exist_ok=True)
     current_year = datetime.now().year
@@ -557,7 +567,8 @@ def process_assets_build(config_data):
         include_path=include_path,
         image_file=image_file,
         assets_path=assets_path,
-        name_length=name_length
+        name_length=name_length,
+        compress=config_data.get('compress_assets', False)
     )
 
     print('--support_format:', support_format)
@@ -0,0 +1,249 @@
+/*
+ * Linux microbenchmark of main/task_queue.h against the std::deque<std::function>
+ * under a mutex that Application::Schedule used before.
+ *
+ *     g++ -std=c++17 -O2 -pthread -I../../main task_queue_bench.cc -o task_queue_bench
+ *     ./task_queue_bench [producers] [tasks per producer]
+ *
+ * Every producer pushes a lambda capturing the same [this, pointer, std::string]
+ * shape as the typical display update. A single consumer drains the queue like
+ * the main loop does. Two loads are measured: paced, where producers keep the
+ * backlog below half the ring as on the device, and flood, where they push as
+ * fast as they can and TaskQueue spills into its overflow list. Reported per
+ * queue: throughput, push latency percentiles and heap allocations per task.
+ * A last single-threaded refill run checks that after the ring was full once,
+ * pushes go back to the ring as soon as it has room and the order is kept.
+ */
+
+#include "task_queue.h"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <new>
+#include <string>
+#include <thread>
+#include <vector>
+
+// MAIN_TASK_QUEUE_SIZE and MAIN_TASK_INLINE_SIZE, the inline storage scaled to the
+// host pointer size so the same captures stay inline as on the 32-bit targets
+#define BENCH_QUEUE_SIZE    32
+#define BENCH_INLINE_SIZE   (40 * sizeof(void*) / 4)
+
+static std::atomic<uint64_t> g_allocations{0};
+
+void* operator new(size_t size) {
+    g_allocations.fetch_add(1, std::memory_order_relaxed);
+    if (void* p = std::malloc(size)) {
+        return p;
+    }
+    throw std::bad_alloc();
+}
+
+void operator delete(void* p) noexcept {
+    std::free(p);
+}
+
+void operator delete(void* p, size_t) noexcept {
+    std::free(p);
+}
+
+static int64_t NowNs() {
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+// The queue Application::Schedule used before TaskQueue
+class MutexQueue {
+public:
+    template <typename F>
+    void Push(F&& f) {
+        std::lock_guard<std::mutex> lock(mutex_);
+        tasks_.emplace_back(std::forward<F>(f));
+    }
+
+    bool Pop(std::function<void()>& task) {
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (tasks_.empty()) {
+            return false;
+        }
+        task = std::move(tasks_.front());
+        tasks_.pop_front();
+        return true;
+    }
+
+private:
+    std::mutex mutex_;
+    std::deque<std::function<void()>> tasks_;
+};
+
+class LockFreeQueue {
+public:
+    template <typename F>
+    void Push(F&& f) {
+        queue_.Push(std::forward<F>(f));
+    }
+
+    bool Pop(TaskQueue<BENCH_QUEUE_SIZE, BENCH_INLINE_SIZE>::Task& task) {
+        int64_t timestamp;
+        return queue_.Pop(task, timestamp);
+    }
+
+    TaskQueue<BENCH_QUEUE_SIZE, BENCH_INLINE_SIZE>& queue() { return queue_; }
+
+private:
+    TaskQueue<BENCH_QUEUE_SIZE, BENCH_INLINE_SIZE> queue_;
+};
+
+struct Result {
+    double seconds;
+    uint64_t allocations;
+    std::vector<int64_t> push_ns;
+};
+
+template <typename Queue, typename Task>
+static Result Run(Queue& queue, int producers, int tasks_per_producer, bool paced) {
+    std::atomic<int> ready{0};
+    std::atomic<bool> start{false};
+    std::atomic<uint64_t> executed{0};
+    std::atomic<uint64_t> pushed{0};
+    std::vector<std::vector<int64_t>> latencies(producers);
+    // Short strings stay in the std::string buffer, like most scheduled messages
+    const std::string message = "listening";
+    int dummy = 0;
+
+    std::vector<std::thread> threads;
+    for (int p = 0; p < producers; p++) {
+        threads.emplace_back([&, p]() {
+            auto& samples = latencies[p];
+            samples.reserve(tasks_per_producer);
+            ready.fetch_add(1);
+            while (!start.load(std::memory_order_acquire)) {
+            }
+            for (int i = 0; i < tasks_per_producer; i++) {
+                if (paced) {
+                    while (pushed.load(std::memory_order_relaxed) - executed.load(std::memory_order_relaxed)
+                            >= BENCH_QUEUE_SIZE / 2) {
+                        std::this_thread::yield();
+                    }
+                    pushed.fetch_add(1, std::memory_order_relaxed);
+                }
+                int64_t begin = NowNs();
+                queue.Push([&executed, display = &dummy, message]() {
+                    *display += message.size();
+                    executed.fetch_add(1, std::memory_order_relaxed);
+                });
+                samples.push_back(NowNs() - begin);
+            }
+        });
+    }
+    while (ready.load() != producers) {
+    }
+
+    uint64_t total = uint64_t(producers) * tasks_per_producer;
+    uint64_t allocations_before = g_allocations.load();
+    int64_t begin = NowNs();
+    start.store(true, std::memory_order_release);
+    Task task;
+    while (executed.load(std::memory_order_relaxed) < total) {
+        if (queue.Pop(task)) {
+            task();
+        }
+    }
+    int64_t elapsed = NowNs() - begin;
+    uint64_t allocations = g_allocations.load() - allocations_before;
+    for (auto& thread : threads) {
+        thread.join();
+    }
+
+    Result result{ elapsed / 1e9, allocations, {} };
+    for (auto& samples : latencies) {
+        result.push_ns.insert(result.push_ns.end(), samples.begin(), samples.end());
+    }
+    return result;
+}
+
+// Overfill the ring by a quarter, drain half of it, then pop one and push one with
+// the backlog steady below the ring size: only the first quarter may overflow,
+// and the tasks still come out in push order
+static void Refill(int rounds) {
+    TaskQueue<BENCH_QUEUE_SIZE, BENCH_INLINE_SIZE> queue;
+    int pushed = 0;
+    int next = 0;
+    int out_of_order = 0;
+    auto push = [&]() {
+        queue.Push([&next, &out_of_order, i = pushed]() {
+            if (i != next) {
+                out_of_order++;
+            }
+            next = i + 1;
+        });
+        pushed++;
+    };
+    while (pushed < BENCH_QUEUE_SIZE + BENCH_QUEUE_SIZE / 4) {
+        push();
+    }
+    TaskQueue<BENCH_QUEUE_SIZE, BENCH_INLINE_SIZE>::Task task;
+    int64_t timestamp;
+    for (int i = 0; i < BENCH_QUEUE_SIZE / 2; i++) {
+        if (queue.Pop(task, timestamp)) {
+            task();
+        }
+    }
+    for (int i = 0; i < rounds; i++) {
+        if (queue.Pop(task, timestamp)) {
+            task();
+        }
+        push();
+    }
+    while (queue.Pop(task, timestamp)) {
+        task();
+    }
+    auto stats = queue.GetStatistics();
+    printf("refill: pushed %u, overflowed %u, out of order %d, %s\n", stats.pushed, stats.overflowed, out_of_order,
+        next == pushed ? "all run" : "tasks lost");
+}
+
+static void Print(const char* name, Result& result, uint64_t total) {
+    auto& push_ns = result.push_ns;
+    std::sort(push_ns.begin(), push_ns.end());
+    auto percentile = [&](double p) { return push_ns[std::min(push_ns.size() - 1, size_t(push_ns.size() * p))]; };
+    // Latency sample vectors were reserved up front, so the counted allocations are the queue's
+    printf("%-18s %8.0f Ktasks/s  push p50 %5lld ns  p99 %6lld ns  max %8lld ns  allocations/task %.2f\n",
+        name, total / result.seconds / 1e3,
+        (long long)percentile(0.5), (long long)percentile(0.99), (long long)push_ns.back(),
+        double(result.allocations) / total);
+}
+
+int main(int argc, char* argv[]) {
+    int producers = argc > 1 ? atoi(argv[1]) : 4;
+    int tasks_per_producer = argc > 2 ? atoi(argv[2]) : 200000;
+    uint64_t total = uint64_t(producers) * tasks_per_producer;
+    printf("%d producers x %d tasks, ring of %d, %zu byte inline storage\n",
+        producers, tasks_per_producer, BENCH_QUEUE_SIZE, BENCH_INLINE_SIZE);
+
+    for (bool paced : { true, false }) {
+        printf("%s:\n", paced ? "paced" : "flood");
+        {
+            MutexQueue queue;
+            auto result = Run<MutexQueue, std::function<void()>>(queue, producers, tasks_per_producer, paced);
+            Print("  mutex + deque", result, total);
+        }
+        {
+            LockFreeQueue queue;
+            auto result = Run<LockFreeQueue, TaskQueue<BENCH_QUEUE_SIZE, BENCH_INLINE_SIZE>::Task>(
+                queue, producers, tasks_per_producer, paced);
+            Print("  TaskQueue", result, total);
+            auto stats = queue.queue().GetStatistics();
+            printf("%-18s pushed %u, heap allocated %u, overflowed %u, high watermark %u\n",
+                "", stats.pushed, stats.heap_allocated, stats.overflowed, stats.high_watermark);
+        }
+    }
+    Refill(tasks_per_producer);
+    return 0;
+}
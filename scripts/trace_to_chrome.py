@@ -0,0 +1,160 @@
+#!/usr/bin/env python3
+"""
+Convert a TraceRecorder dump into Chrome / Perfetto trace JSON
+
+    python scripts/trace_to_chrome.py dump trace.json
+
+The dump may be given as:
+
+    - the raw binary dump
+    - a serial console log containing "XZTRACE BEGIN" ... "XZTRACE END", as
+      printed by self.trace.dump with "serial": true (the last dump is used)
+    - the result of the self.trace.dump MCP tool, or the JSON in its text
+
+Open the output in https://ui.perfetto.dev or chrome://tracing. Every task is a
+thread, timestamps are microseconds since boot.
+
+Layout (little endian, must match main/trace_recorder.cc):
+
+    header  magic "XZTR", version, reserved, events, dropped, base_us  (24 bytes)
+    names   count, then length + bytes for each event name
+    tasks   count, then length + bytes for each task name
+    events  time_us since base_us, arg, name, task, phase, core, reserved  (16 bytes each)
+"""
+
+import argparse
+import base64
+import binascii
+import json
+import re
+import struct
+import sys
+
+TRACE_MAGIC = b'XZTR'
+TRACE_FORMAT_VERSION = 1
+
+HEADER_FORMAT = '<4sHHIIQ'
+EVENT_FORMAT = '<IiHHBBH'
+
+ANSI_ESCAPE = re.compile(r'\x1b\[[0-9;]*m')
+
+
+def find_trace_data(value):
+    """Finds the base64 data of an xztrace object anywhere in a JSON document"""
+    if isinstance(value, dict):
+        if value.get('format') == 'xztrace' and 'data' in value:
+            return value['data']
+        for item in value.values():
+            found = find_trace_data(item)
+            if found is not None:
+                return found
+    elif isinstance(value, list):
+        for item in value:
+            found = find_trace_data(item)
+            if found is not None:
+                return found
+    elif isinstance(value, str) and 'xztrace' in value:
+        try:
+            return find_trace_data(json.loads(value))
+        except ValueError:
+            pass
+    return None
+
+
+def load_dump(content):
+    # A serial log may start with the marker, which shares the prefix of the magic
+    if content.startswith(TRACE_MAGIC) and not content.startswith(b'XZTRACE'):
+        return content
+
+    text = ANSI_ESCAPE.sub('', content.decode('utf-8', errors='replace'))
+    if 'XZTRACE BEGIN' in text:
+        dump = text[text.rindex('XZTRACE BEGIN'):]
+        if 'XZTRACE END' not in dump:
+            raise ValueError('the serial dump is incomplete')
+        lines = dump[:dump.index('XZTRACE END')].splitlines()[1:]
+        return base64.b64decode(''.join(line.strip() for line in lines))
+
+    try:
+        data = find_trace_data(json.loads(text))
+    except ValueError:
+        data = None
+    if data is None:
+        try:
+            return base64.b64decode(text.strip(), validate=True)
+        except binascii.Error:
+            raise ValueError('no trace dump found') from None
+    return base64.b64decode(data)
+
+
+def read_strings(dump, offset):
+    count, = struct.unpack_from('<H', dump, offset)
+    offset += 2
+    strings = []
+    for _ in range(count):
+        length = dump[offset]
+        strings.append(dump[offset + 1:offset + 1 + length].decode('utf-8', errors='replace'))
+        offset += 1 + length
+    return strings, offset
+
+
+def parse_dump(dump):
+    magic, version, _, event_count, dropped, base_us = struct.unpack_from(HEADER_FORMAT, dump, 0)
+    if magic != TRACE_MAGIC:
+        raise ValueError('not a trace dump')
+    if version != TRACE_FORMAT_VERSION:
+        raise ValueError(f'unsupported trace format version {version}')
+
+    offset = struct.calcsize(HEADER_FORMAT)
+    names, offset = read_strings(dump, offset)
+    tasks, offset = read_strings(dump, offset)
+
+    events = []
+    for _ in range(event_count):
+        events.append(struct.unpack_from(EVENT_FORMAT, dump, offset))
+        offset += struct.calcsize(EVENT_FORMAT)
+    return names, tasks, events, dropped, base_us
+
+
+def to_chrome_trace(names, tasks, events, base_us):
+    trace_events = [{'ph': 'M', 'pid': 1, 'name': 'process_name', 'args': {'name': 'xiaozhi'}}]
+    for tid, task in enumerate(tasks, 1):
+        trace_events.append({'ph': 'M', 'pid': 1, 'tid': tid, 'name': 'thread_name', 'args': {'name': task}})
+
+    timeline = []
+    for time_us, arg, name_id, task_id, phase, core, _ in events:
+        name = names[name_id]
+        event = {'name': name, 'ph': chr(phase), 'ts': base_us + time_us, 'pid': 1, 'tid': task_id + 1}
+        if phase == ord('C'):
+            event['args'] = {name: arg}
+        elif phase == ord('i'):
+            event['s'] = 't'
+            event['args'] = {'arg': arg, 'core': core}
+        elif phase == ord('B'):
+            event['args'] = {'arg': arg, 'core': core}
+        timeline.append(event)
+    # Tasks on the two cores may take ring slots slightly out of time order
+    timeline.sort(key=lambda event: event['ts'])
+    return {'traceEvents': trace_events + timeline, 'displayTimeUnit': 'ms'}
+
+
+def main():
+    parser = argparse.ArgumentParser(description='Convert a TraceRecorder dump into Chrome trace JSON')
+    parser.add_argument('dump', help='Binary dump, serial log or self.trace.dump result, - for stdin')
+    parser.add_argument('output', help='Output trace JSON file')
+    args = parser.parse_args()
+
+    if args.dump == '-':
+        content = sys.stdin.buffer.read()
+    else:
+        with open(args.dump, 'rb') as f:
+            content = f.read()
+
+    names, tasks, events, dropped, base_us = parse_dump(load_dump(content))
+    with open(args.output, 'w') as f:
+        json.dump(to_chrome_trace(names, tasks, events, base_us), f)
+    duration_ms = (max(event[0] for event in events) - min(event[0] for event in events)) // 1000 if events else 0
+    print(f'{len(events)} events from {len(tasks)} tasks over {duration_ms} ms, {dropped} older events dropped')
+
+
+if __name__ == '__main__':
+    main()